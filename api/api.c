@@ -1068,6 +1068,8 @@ int __core_main(int argc, char *argv[])
     hmo.gossip_thread_stop = 1;
     if (hmo.conf.xnet_resend_to)
         g_xnet_conf.resend_timeout = hmo.conf.xnet_resend_to;
+    if (hmo.conf.xnet_pollin_nr)
+        g_xnet_conf.pollin_nr = hmo.conf.xnet_pollin_nr;
 
     /* setup the profiling file */
     memset(profiling_fname, 0, sizeof(profiling_fname));
@@ -4297,6 +4299,12 @@ resend:
         xnet_free_msg(msg->pair);
         msg->pair = NULL;
         goto resend;
+    } else if (msg->pair->tx.err == -ELOCKED) {
+        /* wait for the read leases of other clients */
+        xnet_free_msg(msg->pair);
+        msg->pair = NULL;
+        usleep(LEASE_WAIT_INTERVAL);
+        goto resend;
     } else if (msg->pair->tx.err) {
         hvfs_err(xnet, "UPDATE failed @ MDS site %lx w/ %d\n",
                  msg->pair->tx.ssite_id, msg->pair->tx.err);
@@ -4456,6 +4464,12 @@ resend:
         xnet_free_msg(msg->pair);
         msg->pair = NULL;
         goto resend;
+    } else if (msg->pair->tx.err == -ELOCKED) {
+        /* wait for the read leases of other clients */
+        xnet_free_msg(msg->pair);
+        msg->pair = NULL;
+        usleep(LEASE_WAIT_INTERVAL);
+        goto resend;
     } else if (msg->pair->tx.err) {
         hvfs_err(xnet, "UNLINK failed @ MDS site %lx w/ %d\n",
                  msg->pair->tx.ssite_id, msg->pair->tx.err);
@@ -4796,6 +4810,210 @@ int __hvfs_stat_ext(u64 puuid, u64 psalt, int column, u32 flag,
     return __hvfs_stat_v2(puuid, psalt, column, flag, hs);
 }
 
+/* __hvfs_lease_release()
+ *
+ * Release the read lease @lease on the ITE (@hs->uuid, @hs->hash) granted by
+ * a lookup w/ INDEX_LEASE, thus our own update need not wait for it. If the
+ * lease has been granted to others after us, the MDS keeps it.
+ */
+int __hvfs_lease_release(u64 puuid, u64 psalt, struct hstat *hs, u64 lease)
+{
+    struct xnet_msg *msg;
+    struct hvfs_index *hi;
+    u64 dsite;
+    u32 vid;
+    int err = 0;
+
+    hi = xzalloc(sizeof(*hi));
+    if (unlikely(!hi)) {
+        hvfs_err(xnet, "xzalloc() hvfs_index failed\n");
+        return -ENOMEM;
+    }
+    hi->flag = INDEX_BY_UUID;
+    hi->uuid = hs->uuid;
+    hi->hash = hs->hash;
+    hi->puuid = puuid;
+    hi->psalt = psalt;
+    err = SET_ITBID(hi);
+    if (unlikely(err))
+        goto out_free;
+    dsite = SELECT_SITE(hi->itbid, hi->psalt, CH_RING_MDS, &vid);
+
+    msg = xnet_alloc_msg(XNET_MSG_NORMAL);
+    if (unlikely(!msg)) {
+        hvfs_err(xnet, "xnet_alloc_msg() failed\n");
+        err = -ENOMEM;
+        goto out_free;
+    }
+    xnet_msg_fill_tx(msg, XNET_MSG_REQ, XNET_NEED_DATA_FREE |
+                     XNET_NEED_REPLY, hmo.xc->site_id, dsite);
+    xnet_msg_fill_cmd(msg, HVFS_CLT2MDS_RELEASE, 0, lease);
+#ifdef XNET_EAGER_WRITEV
+    xnet_msg_add_sdata(msg, &msg->tx, sizeof(msg->tx));
+#endif
+    xnet_msg_add_sdata(msg, hi, sizeof(*hi));
+
+resend:
+    err = xnet_send(hmo.xc, msg);
+    if (unlikely(err)) {
+        hvfs_err(xnet, "xnet_send() release to %lx failed w/ %d\n",
+                 msg->tx.dsite_id, err);
+        goto out;
+    }
+
+    ASSERT(msg->pair, xnet);
+    if (msg->pair->tx.err == -ESPLIT ||
+        msg->pair->tx.err == -ERESTART ||
+        msg->pair->tx.err == -EHWAIT) {
+        xnet_set_auto_free(msg->pair);
+        xnet_free_msg(msg->pair);
+        msg->pair = NULL;
+        sched_yield();
+        goto resend;
+    }
+    /* -EINVAL means the lease is not ours now, it is ok */
+    err = msg->pair->tx.err;
+
+out:
+    xnet_free_msg(msg);
+    return err;
+out_free:
+    xfree(hi);
+    return err;
+}
+
+/* __hvfs_resolve()
+ *
+ * Resolve the directory components of @path from (*puuid, *psalt) in one
+ * request. The MDS walks the components it owns and forwards the remaining
+ * ones to the next owner. Each resolved directory is passed to @cb w/ its
+ * parent uuid and name, thus the caller can cache the intermediate
+ * directories. If RESOLVE_KEEP_LAST is
+ * set in @flag, the last component is left to the caller.
+ *
+ * Return value: # of path bytes resolved, the caller should resolve the
+ * components after @path + ret by itself (e.g. links or errors).
+ */
+int __hvfs_resolve(char *path, u64 *puuid, u64 *psalt, u32 flag,
+                   resolve_cb_t cb)
+{
+    struct xnet_msg *msg;
+    struct resolve_req *rr, *rpy;
+    struct resolve_entry *re;
+    struct hvfs_index hi = {0,};
+    char *p, *q, *cname;
+    size_t plen, dpayload;
+    u64 dsite;
+    u32 vid;
+    int max = 0, off = 0, i, err = 0;
+
+    if (!path)
+        return 0;
+    plen = strlen(path);
+    if (plen > 0xffff)
+        return 0;
+    for (p = path; *p != '\0'; ) {
+        while (*p == '/')
+            p++;
+        if (*p == '\0')
+            break;
+        max++;
+        while (*p != '\0' && *p != '/')
+            p++;
+    }
+    if (flag & RESOLVE_KEEP_LAST)
+        max--;
+    if (max <= 0)
+        return 0;
+
+    dpayload = RESOLVE_SIZE(plen, max);
+    rr = xzalloc(dpayload);
+    if (unlikely(!rr)) {
+        hvfs_err(xnet, "xzalloc() resolve_req failed\n");
+        return 0;
+    }
+    rr->puuid = *puuid;
+    rr->psalt = *psalt;
+    rr->plen = plen;
+    rr->max = max;
+    memcpy(rr->path, path, plen);
+
+    /* send to the owner of the first component */
+    for (p = path; *p == '/'; p++) ;
+    for (q = p; *q != '\0' && *q != '/'; q++) ;
+    hi.puuid = *puuid;
+    hi.psalt = *psalt;
+    hi.hash = hvfs_hash(*puuid, (u64)p, q - p, HASH_SEL_EH);
+    err = SET_ITBID(&hi);
+    if (unlikely(err)) {
+        xfree(rr);
+        return 0;
+    }
+    dsite = SELECT_SITE(hi.itbid, hi.psalt, CH_RING_MDS, &vid);
+
+    msg = xnet_alloc_msg(XNET_MSG_NORMAL);
+    if (unlikely(!msg)) {
+        hvfs_err(xnet, "xnet_alloc_msg() failed\n");
+        xfree(rr);
+        return 0;
+    }
+    xnet_msg_fill_tx(msg, XNET_MSG_REQ, XNET_NEED_DATA_FREE |
+                     XNET_NEED_REPLY, hmo.xc->site_id, dsite);
+    xnet_msg_fill_cmd(msg, HVFS_CLT2MDS_RESOLVE, 0, 0);
+#ifdef XNET_EAGER_WRITEV
+    xnet_msg_add_sdata(msg, &msg->tx, sizeof(msg->tx));
+#endif
+    xnet_msg_add_sdata(msg, rr, dpayload);
+
+    err = xnet_send(hmo.xc, msg);
+    if (unlikely(err)) {
+        hvfs_err(xnet, "xnet_send() resolve to %lx failed w/ %d\n",
+                 msg->tx.dsite_id, err);
+        goto out;
+    }
+
+    ASSERT(msg->pair, xnet);
+    if (msg->pair->tx.err) {
+        /* the caller will resolve the whole path */
+        hvfs_debug(xnet, "RESOLVE failed @ MDS site %lx w/ %d\n",
+                   msg->pair->tx.ssite_id, msg->pair->tx.err);
+        goto out;
+    }
+    if (!msg->pair->xm_datacheck || msg->pair->tx.len < dpayload) {
+        hvfs_err(xnet, "Invalid RESOLVE reply from site %lx\n",
+                 msg->pair->tx.ssite_id);
+        goto out;
+    }
+    rpy = (struct resolve_req *)msg->pair->xm_data;
+    if (rpy->err) {
+        hvfs_debug(xnet, "RESOLVE '%s' stopped @ %d w/ %d\n",
+                   path, rpy->off, rpy->err);
+    }
+
+    cname = xmalloc(plen + 1);
+    re = RESOLVE_ENTRY(rpy);
+    for (i = 0; i < rpy->nr && i < max; i++) {
+        if (re[i].plen > plen || re[i].plen <= off)
+            break;
+        if (cb && cname) {
+            /* the component name ends at the prefix length */
+            q = path + re[i].plen;
+            for (p = q; p > path && *(p - 1) != '/'; p--) ;
+            memcpy(cname, p, q - p);
+            cname[q - p] = '\0';
+            cb(*puuid, cname, re[i].uuid, re[i].salt);
+        }
+        *puuid = re[i].uuid;
+        *psalt = re[i].salt;
+        off = re[i].plen;
+    }
+    xfree(cname);
+
+out:
+    xnet_free_msg(msg);
+    return off;
+}
+
 static inline
 int __hvfs_linkadd_v2(u64 puuid, u64 psalt, int nlink, u32 flag, 
                       struct hstat *hs)
@@ -4881,6 +5099,13 @@ resend:
         xnet_free_msg(msg->pair);
         msg->pair = NULL;
         goto resend;
+    } else if (msg->pair->tx.err == -ELOCKED) {
+        /* wait for the read leases of other clients */
+        xnet_set_auto_free(msg->pair);
+        xnet_free_msg(msg->pair);
+        msg->pair = NULL;
+        usleep(LEASE_WAIT_INTERVAL);
+        goto resend;
     } else if (msg->pair->tx.err) {
         hvfs_err(xnet, "LINKADD failed @ MDS site %lx w/ %d\n",
                  msg->pair->tx.ssite_id, msg->pair->tx.err);
@@ -5226,6 +5451,7 @@ int hvfs_stat(char *path, char *name, void **data)
     if (!path || !data)
         return -EINVAL;
 
+    n += __hvfs_resolve(n, &puuid, &psalt, RESOLVE_KEEP_LAST, NULL);
     /* parse the path and do __stat on each directory */
     do {
         p = strtok_r(n, "/", &s);
@@ -5319,6 +5545,7 @@ int hvfs_create(char *path, char *name, void **data, u32 is_dir)
     if (!path || !name || !data)
         return -EINVAL;
 
+    n += __hvfs_resolve(n, &puuid, &psalt, RESOLVE_KEEP_LAST, NULL);
     /* parse the path and do __stat on each directory */
     do {
         p = strtok_r(n, "/", &s);
@@ -5521,6 +5748,7 @@ int hvfs_fupdate(char *path, char *name, void **data)
     if (!path || !data)
         return -EINVAL;
 
+    n += __hvfs_resolve(n, &puuid, &psalt, RESOLVE_KEEP_LAST, NULL);
     /* parse the path and do __stat on each directory */
     do {
         p = strtok_r(n, "/", &s);
@@ -5657,6 +5885,7 @@ int hvfs_fdel(char *path, char *name, void **data, u32 is_dir)
         return -EINVAL;
     *data = NULL;
 
+    n += __hvfs_resolve(n, &puuid, &psalt, RESOLVE_KEEP_LAST, NULL);
     /* parse the path and do __stat on each directory */
     do {
         p = strtok_r(n, "/", &s);
@@ -5790,6 +6019,7 @@ int hvfs_readdir(char *path, char *name, void **data)
         return -EINVAL;
     *data = NULL;
 
+    n += __hvfs_resolve(n, &puuid, &psalt, RESOLVE_KEEP_LAST, NULL);
     /* parse the path and do __stat on each directory */
     do {
         p = strtok_r(n, "/", &s);
@@ -6494,6 +6724,7 @@ ssize_t hvfs_fread(char *path, char *name, int column, void **data, u64 *len)
         return -ENOSYS;
     }
 
+    n += __hvfs_resolve(n, &puuid, &psalt, RESOLVE_KEEP_LAST, NULL);
     /* parse the path and do __stat on each directory */
     do {
         p = strtok_r(n, "/", &s);
@@ -6585,6 +6816,7 @@ int hvfs_fwrite(char *path, char *name, int column, void *data,
         return -ENOSYS;
     }
 
+    n += __hvfs_resolve(n, &puuid, &psalt, RESOLVE_KEEP_LAST, NULL);
     /* parse the path and do __stat on each directory */
     do {
         p = strtok_r(n, "/", &s);
@@ -6930,6 +7162,7 @@ int hvfs_reg_dtrigger(char *path, char *name, u16 priority, u16 where,
     if (!path || !data)
         return -EINVAL;
 
+    n += __hvfs_resolve(n, &puuid, &psalt, RESOLVE_KEEP_LAST, NULL);
     /* parse the path and do __stat on each directory */
     do {
         p = strtok_r(n, "/", &s);
@@ -7155,6 +7388,7 @@ int hvfs_cat_dtrigger(char *path, char *name, void **data)
     if (!path || !data)
         return -EINVAL;
 
+    n += __hvfs_resolve(n, &puuid, &psalt, RESOLVE_KEEP_LAST, NULL);
     /* parse the path and do __stat on each directory */
     do {
         p = strtok_r(n, "/", &s);
@@ -739,9 +739,15 @@ reselect:
 }
 
 /* __branch_replicate() replicate one branch_line to dsite
+ *
+ * The msg is sent asynchronously in the wait group, thus we can replicate to
+ * all the sites in parallel. The caller should wait on the wait group and
+ * then free the returned msg.
  */
 int __branch_replicate(struct branch_entry *be,
-                       struct branch_line *bl, u64 dsite)
+                       struct branch_line *bl, u64 dsite,
+                       struct xnet_wait_group *wg,
+                       struct xnet_msg **omsg)
 {
     struct xnet_msg *msg;
     struct branch_line_disk bld = {
@@ -779,14 +785,19 @@ int __branch_replicate(struct branch_entry *be,
     if (bl->data_len)
         xnet_msg_add_sdata(msg, bl->data, bl->data_len);
 
-    err = xnet_send(hmo.xc, msg);
+    /* bld is on our stack, however it is safe to return after isend */
+    xnet_wait_group_add(wg, msg);
+    err = xnet_isend(hmo.xc, msg);
     if (err) {
-        hvfs_err(xnet, "xnet_send() REPLICA '%s' id:%ld to %lx "
+        hvfs_err(xnet, "xnet_isend() REPLICA '%s' id:%ld to %lx "
                  "failed w/ %d\n",
                  be->branch_name, bl->id, dsite, err);
+        xnet_wait_group_del(wg, msg);
         goto out_free;
     }
+    *omsg = msg;
 
+    return err;
 out_free:
     xnet_free_msg(msg);
     
@@ -2599,6 +2610,8 @@ int branch_publish(u64 puuid, u64 uuid, char *branch_name,
         /* it is ok to continue */
         ;
     } else {
+        struct xnet_msg *msgs[BRANCH_NR_MASK + 1] = {NULL,};
+        struct xnet_wait_group *wg;
         u64 dsite;
         int i, nr = 0;
         
@@ -2609,6 +2622,13 @@ int branch_publish(u64 puuid, u64 uuid, char *branch_name,
             bl->replica_nr = 1;
         }
         BL_SELF_SITE(bl) = hmo.site_id;
+
+        wg = xnet_wait_group_create();
+        if (!wg) {
+            xfree(bl);
+            err = -ENOMEM;
+            goto out_put;
+        }
         
         for (i = 1; i < bl->replica_nr; i++) {
             /* find a target site to replicate */
@@ -2618,7 +2638,7 @@ int branch_publish(u64 puuid, u64 uuid, char *branch_name,
                 continue;
             }
             /* send the branch_line to replicas */
-            err = __branch_replicate(be, bl, dsite);
+            err = __branch_replicate(be, bl, dsite, wg, &msgs[i]);
             if (err) {
                 hvfs_err(xnet, "Replicate BL %ld to site %lx "
                          "failed w/ %d\n", bl->id, dsite, err);
@@ -2626,6 +2646,27 @@ int branch_publish(u64 puuid, u64 uuid, char *branch_name,
             } else
                 bl->sites[i] = dsite;
         }
+        /* wait for all the replicas' replies */
+        err = xnet_wait_group_wait(wg);
+        for (i = 1; i < bl->replica_nr; i++) {
+            int replied;
+
+            if (!msgs[i])
+                continue;
+            replied = (msgs[i]->pair != NULL);
+            if (!xnet_wait_group_abandon(wg, msgs[i])) {
+                /* still in flight, it is freed on the late reply */
+                if (!replied) {
+                    hvfs_err(xnet, "Replicate BL %ld to site %lx "
+                             "w/o reply\n", bl->id, bl->sites[i]);
+                    bl->sites[i] = -1UL;
+                }
+                continue;
+            }
+            xnet_free_msg(msgs[i]);
+        }
+        xnet_wait_group_destroy(wg);
+        err = 0;
         /* recalculate how many sites we have sent */
         for (i = 0; i < bl->replica_nr; i++) {
             if (bl->sites[i] != -1UL)
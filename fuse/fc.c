@@ -174,8 +174,10 @@ struct soc_entry *__soc_lookup(const char *key)
 }
 
 /* We construct a write buffer cache to absorb user's write requests and flush
- * them as a whole to disk when the file are closed. Thus, we have
- * close-to-open consistency.
+ * them as a whole to disk. The flusher threads sync the file soon after it is
+ * closed (write-behind), and fsync() waits for it. If write-behind is
+ * disabled, the file is synced on close, thus we have close-to-open
+ * consistency.
  */
 size_t g_pagesize = 0;
 static void *zero_page = NULL;
@@ -183,38 +185,127 @@ struct __pfs_fuse_mgr pfs_fuse_mgr = {.inited = 0,};
 
 #define PFS_FUSE_CONFIG_UUID            0xffff000000000000
 
-/* We are sure that there is no page hole! */
+/* The pages of an opened file are indexed by the page number. Clean pages
+ * can be evicted, thus there may be page holes in the index.
+ */
 struct __pfs_odc_mgr
 {
 #define PFS_ODC_HSIZE_DEFAULT   (8191)
     struct regular_hash *ht;
     u32 hsize;
+    /* the files opened for write are also indexed by (puuid, name hash), then
+     * getattr() can skip the lease w/o knowing the uuid */
+#define PFS_ODC_WSIZE           (1021)
+    struct regular_hash wt[PFS_ODC_WSIZE];
 } pfs_odc_mgr;
 
 struct bhhead
 {
     struct hlist_node hlist;
-    struct list_head bh;
-    size_t size;                /* total buffer size */
+    struct bh **bhv;            /* page index, NULL means not cached */
+    size_t bhv_nr;              /* # of slots in the page index */
     size_t asize;               /* actually size for release use */
     struct hstat hs;
     xrwlock_t clock;
     u64 uuid;                   /* who am i? */
 #define BH_CLEAN        0x00
 #define BH_DIRTY        0x01
+#define BH_UPDATE       0x02    /* opened for write, we would update it */
+#define BH_SYNC         0x04    /* syncing, the pages are pinned */
 #define BH_CONFIG       0x80
     u32 flag;
     atomic_t ref;
     void *ptr;                  /* private pointer */
+    /* sequential read detection, they are just hints and updated w/o lock */
+    off_t ra_next;              /* expected offset of the next seq read */
+    off_t ra_end;               /* end of the issued read-ahead window */
+    size_t ra_win;              /* current read-ahead window */
+    /* write-behind */
+    struct list_head dlist;     /* linked on the dirty list */
+    time_t dtime;               /* when we are linked on the dirty list */
+    xlock_t slock;              /* serialize the syncs */
+    int err;                    /* write back error, reported by fsync() */
+    struct hlist_node whlist;   /* linked on the ODC write index */
 };
 
 struct bh
 {
-    struct list_head list;
+    struct list_head list;      /* linked on the global LRU list */
+    struct bhhead *bhh;         /* who owns me */
     off_t offset;               /* buffer offset */
     void *data;                 /* this is always a page */
+#define BHP_DIRTY       0x01
+#define BHP_SYNC        0x02    /* cleaned by the running sync */
+    u32 flag;
+};
+
+/* Buffer Cache Manager: all the cached pages are linked on one LRU list. The
+ * clean pages are evicted from the tail if we exceed the memory bound, the
+ * dirty pages are pinned until they are synced. Lock order is bhh->clock ->
+ * lock, thus the evictor only try-locks the clock.
+ *
+ * Sequential readers are served by the read-ahead threads, which read in the
+ * next window from MDSL in one request.
+ */
+struct bh_ra
+{
+    struct list_head list;
+    struct bhhead *bhh;         /* w/ a reference */
+    off_t offset;
+    size_t size;
 };
 
+struct __pfs_bhc_mgr
+{
+#define PFS_BHC_MAX_DEFAULT     (256)   /* MB */
+#define PFS_BHC_RA_MAX_DEFAULT  (4096)  /* KB */
+#define PFS_BHC_RA_MIN          (128 * 1024)
+#define PFS_BHC_RA_THREADS      (2)
+#define PFS_BHC_RA_QMAX         (64)
+#define PFS_BHC_EVICT_SCAN      (1024)
+    struct list_head lru;       /* head is the hottest page */
+    xlock_t lock;
+    u64 max;                    /* max # of cached pages */
+    size_t ra_max;              /* max read-ahead window, 0 to disable */
+    atomic64_t nr;              /* # of cached pages */
+
+    /* read-ahead queue */
+    struct list_head raq;
+    xlock_t ralock;
+    sem_t rasem;
+    pthread_t *rat;
+    int rat_nr;
+    int ra_stop;
+    atomic_t ra_pending;
+
+    atomic64_t hit, miss, evict, ra, ra_drop;
+} pfs_bhc_mgr;
+
+/* Write-behind: a dirty file is linked on the dirty list w/ a reference, thus
+ * release() returns w/o waiting and the file stays in ODC until the flusher
+ * threads sync it out. As __bh_sync() rewrites the whole file, only the
+ * released files are flushed, the open ones are synced by fsync() or on the
+ * last release. A failed flush re-dirties the pages and is retried after
+ * expire seconds. The writers are throttled at the hard threshold while
+ * there are released files to flush.
+ */
+struct __pfs_wb_mgr
+{
+#define PFS_WB_EXPIRE_DEFAULT   (5)     /* seconds */
+#define PFS_WB_THREADS          (2)
+#define PFS_WB_THROTTLE_WAIT    (10000) /* us */
+    struct list_head dlist;     /* dirty files, the oldest first */
+    xlock_t lock;
+    sem_t sem;
+    pthread_t *t;
+    int t_nr;
+    int stop;
+    int expire;                 /* retry a failed flush in seconds */
+    u64 bg, hard;               /* dirty page thresholds */
+    atomic64_t dirty;           /* # of dirty pages */
+    atomic64_t flush, throttle;
+} pfs_wb_mgr;
+
 static int __odc_init(int hsize)
 {
     int i;
@@ -235,6 +326,10 @@ static int __odc_init(int hsize)
         INIT_HLIST_HEAD(&pfs_odc_mgr.ht[i].h);
         xlock_init(&pfs_odc_mgr.ht[i].lock);
     }
+    for (i = 0; i < PFS_ODC_WSIZE; i++) {
+        INIT_HLIST_HEAD(&pfs_odc_mgr.wt[i].h);
+        xlock_init(&pfs_odc_mgr.wt[i].lock);
+    }
 
     return 0;
 }
@@ -251,6 +346,28 @@ int __odc_hash(u64 uuid)
         pfs_odc_mgr.hsize;
 }
 
+/* __odc_writing() checks if the file (puuid, name hash) is opened for write
+ * by anyone in ODC.
+ */
+static int __odc_writing(u64 puuid, u64 hash)
+{
+    struct regular_hash *rh = pfs_odc_mgr.wt + hash % PFS_ODC_WSIZE;
+    struct bhhead *bhh;
+    struct hlist_node *n;
+    int found = 0;
+
+    xlock_lock(&rh->lock);
+    hlist_for_each_entry(bhh, n, &rh->h, whlist) {
+        if (bhh->hs.puuid == puuid && bhh->hs.hash == hash) {
+            found = 1;
+            break;
+        }
+    }
+    xlock_unlock(&rh->lock);
+
+    return found;
+}
+
 /* Return value: 0: not really removed; 1: truely removed
  */
 static inline
@@ -349,8 +466,10 @@ struct bhhead* __get_bhhead(struct hstat *hs)
         if (unlikely(!bhh)) {
             return NULL;
         }
-        INIT_LIST_HEAD(&bhh->bh);
         xrwlock_init(&bhh->clock);
+        xlock_init(&bhh->slock);
+        INIT_LIST_HEAD(&bhh->dlist);
+        INIT_HLIST_NODE(&bhh->whlist);
         bhh->hs = *hs;
         bhh->uuid = hs->uuid;
         bhh->asize = hs->mc.c.len;
@@ -370,12 +489,27 @@ struct bhhead* __get_bhhead(struct hstat *hs)
 
 static inline void __set_bhh_dirty(struct bhhead *bhh)
 {
-    bhh->flag = BH_DIRTY;
+    bhh->flag |= BH_DIRTY;
 }
 static inline void __clr_bhh_dirty(struct bhhead *bhh)
 {
     bhh->flag &= ~BH_DIRTY;
 }
+/* the flag is shared w/ the writers and the flushers, take the clock */
+static inline void __set_bhh_update(struct bhhead *bhh)
+{
+    struct regular_hash *rh;
+
+    xrwlock_wlock(&bhh->clock);
+    if (!(bhh->flag & BH_UPDATE)) {
+        bhh->flag |= BH_UPDATE;
+        rh = pfs_odc_mgr.wt + bhh->hs.hash % PFS_ODC_WSIZE;
+        xlock_lock(&rh->lock);
+        hlist_add_head(&bhh->whlist, &rh->h);
+        xlock_unlock(&rh->lock);
+    }
+    xrwlock_wunlock(&bhh->clock);
+}
 
 static inline void __set_bhh_config(struct bhhead *bhh)
 {
@@ -423,185 +557,331 @@ static void __put_bh(struct bh *bh)
     xfree(bh);
 }
 
-static void __put_bhhead(struct bhhead *bhh)
+/* __bhv_grow() grows the page index to cover the range [0, end). The caller
+ * should hold the clock wlock.
+ */
+static int __bhv_grow(struct bhhead *bhh, off_t end)
+{
+    struct bh **bhv;
+    size_t nr = PAGE_ROUNDUP(end, g_pagesize) / g_pagesize;
+    size_t new_nr = bhh->bhv_nr ? bhh->bhv_nr : 16;
+
+    if (nr <= bhh->bhv_nr)
+        return 0;
+
+    while (new_nr < nr)
+        new_nr <<= 1;
+    bhv = xrealloc(bhh->bhv, new_nr * sizeof(*bhv));
+    if (!bhv) {
+        hvfs_err(xnet, "xrealloc() page index w/ %ld slots failed\n",
+                 new_nr);
+        return -ENOMEM;
+    }
+    memset(bhv + bhh->bhv_nr, 0, (new_nr - bhh->bhv_nr) * sizeof(*bhv));
+    bhh->bhv = bhv;
+    bhh->bhv_nr = new_nr;
+
+    return 0;
+}
+
+static inline
+struct bh *__bhv_lookup(struct bhhead *bhh, off_t offset)
+{
+    size_t i = offset / g_pagesize;
+
+    if (i >= bhh->bhv_nr)
+        return NULL;
+    return bhh->bhv[i];
+}
+
+/* __bhc_insert() adds a new page to the page index and the LRU list. The
+ * caller should hold the clock wlock and have grown the index.
+ */
+static inline
+void __bhc_insert(struct bhhead *bhh, struct bh *bh)
+{
+    bh->bhh = bhh;
+    bhh->bhv[bh->offset / g_pagesize] = bh;
+    xlock_lock(&pfs_bhc_mgr.lock);
+    list_add(&bh->list, &pfs_bhc_mgr.lru);
+    xlock_unlock(&pfs_bhc_mgr.lock);
+    atomic64_inc(&pfs_bhc_mgr.nr);
+}
+
+/* __bhc_evict() drops the clean pages from the LRU tail until we are under
+ * the memory bound. Do NOT call it w/ any clock held.
+ */
+static void __bhc_evict(void)
 {
     struct bh *bh, *n;
+    struct bhhead *bhh;
+    int scan = 0;
 
-    if (__odc_remove(bhh)) {
-        list_for_each_entry_safe(bh, n, &bhh->bh, list) {
+    if (atomic64_read(&pfs_bhc_mgr.nr) <= pfs_bhc_mgr.max)
+        return;
+
+    xlock_lock(&pfs_bhc_mgr.lock);
+    list_for_each_entry_safe_reverse(bh, n, &pfs_bhc_mgr.lru, list) {
+        if (atomic64_read(&pfs_bhc_mgr.nr) <= pfs_bhc_mgr.max ||
+            ++scan > PFS_BHC_EVICT_SCAN)
+            break;
+        bhh = bh->bhh;
+        if (xrwlock_trywlock(&bhh->clock))
+            continue;
+        /* dirty pages are pinned until the sync */
+        if (!(bh->flag & BHP_DIRTY) && !(bhh->flag & BH_SYNC)) {
+            bhh->bhv[bh->offset / g_pagesize] = NULL;
             list_del(&bh->list);
             __put_bh(bh);
+            atomic64_dec(&pfs_bhc_mgr.nr);
+            atomic64_inc(&pfs_bhc_mgr.evict);
+        }
+        xrwlock_wunlock(&bhh->clock);
+    }
+    xlock_unlock(&pfs_bhc_mgr.lock);
+}
+
+static void __put_bhhead(struct bhhead *bhh)
+{
+    struct bh *bh;
+    size_t i;
+
+    if (__odc_remove(bhh)) {
+        if (!hlist_unhashed(&bhh->whlist)) {
+            struct regular_hash *rh = pfs_odc_mgr.wt +
+                bhh->hs.hash % PFS_ODC_WSIZE;
+
+            xlock_lock(&rh->lock);
+            hlist_del_init(&bhh->whlist);
+            xlock_unlock(&rh->lock);
+        }
+        /* unlink the pages first, then the evictor can not find us */
+        xlock_lock(&pfs_bhc_mgr.lock);
+        for (i = 0; i < bhh->bhv_nr; i++) {
+            if (bhh->bhv[i])
+                list_del(&bhh->bhv[i]->list);
+        }
+        xlock_unlock(&pfs_bhc_mgr.lock);
+
+        for (i = 0; i < bhh->bhv_nr; i++) {
+            bh = bhh->bhv[i];
+            if (bh) {
+                if (bh->flag & BHP_DIRTY)
+                    atomic64_dec(&pfs_wb_mgr.dirty);
+                __put_bh(bh);
+                atomic64_dec(&pfs_bhc_mgr.nr);
+            }
         }
 
+        xfree(bhh->bhv);
         xfree(bhh);
     }
 }
 
-/* __bh_fill() will fill the buffer cache w/ buf. if there are holes, it will
- * fill them automatically.
+/* __bh_load() reads in one page, the range beyond the column is zero.
+ */
+static int __bh_load(struct hstat *hs, int column, struct column *c,
+                     struct bh *bh)
+{
+    ssize_t rlen;
+    int err = 0;
+
+    if (bh->offset < c->len || hs->mdu.flags & HVFS_MDU_IF_LZO) {
+        err = __prepare_bh(bh, 1);
+        if (err)
+            return err;
+    }
+    rlen = __hvfs_fread(hs, column, &bh->data, c, bh->offset, g_pagesize);
+    if (rlen == -EFBIG) {
+        /* it is ok, we just zero the page */
+    } else if (rlen < 0) {
+        hvfs_err(xnet, "bh_load() read the file range [%ld, %ld] "
+                 "failed w/ %ld\n",
+                 bh->offset, bh->offset + g_pagesize, rlen);
+        err = rlen;
+    }
+
+    return err;
+}
+
+/* __bh_fill() will fill the buffer cache w/ buf and mark the pages dirty. if
+ * there are holes, it will load them automatically.
  */
 static int __bh_fill(struct hstat *hs, int column, struct column *c,
                      struct bhhead *bhh, void *buf, off_t offset,
                      size_t size)
 {
-    /* round down the offset */
     struct bh *bh;
     off_t off_end = PAGE_ROUNDUP((offset + size), g_pagesize);
-    off_t loff = 0;
-    ssize_t rlen;
-    size_t _size = 0;
+    off_t poff, loff = 0;
+    size_t _size;
     int err = 0;
 
     xrwlock_wlock(&bhh->clock);
-    /* should we loadin the middle holes */
-    if (offset >= bhh->size) {
-        while (bhh->size < off_end) {
-            bh = __get_bh(bhh->size, 0);
+    err = __bhv_grow(bhh, off_end);
+    if (err)
+        goto out;
+
+    for (poff = offset - offset % g_pagesize; poff < off_end;
+         poff += g_pagesize) {
+        _size = min(size, poff + g_pagesize - offset);
+        bh = bhh->bhv[poff / g_pagesize];
+        if (!bh) {
+            bh = __get_bh(poff, 0);
             if (!bh) {
                 err = -ENOMEM;
                 goto out;
             }
-            if (offset == bhh->size && size >= g_pagesize) {
-                /* just copy the buffer, prepare true page */
-                __prepare_bh(bh, 1);
-                _size = min(size, bh->offset + g_pagesize - offset);
-                if (buf)
-                    memcpy(bh->data + offset - bh->offset,
-                           buf + loff, _size);
-                size -= _size;
-                loff += _size;
-                offset = bh->offset + g_pagesize;
+            if (buf && _size == g_pagesize) {
+                /* the whole page is overwritten, do not read it in */
+                err = __prepare_bh(bh, 1);
             } else {
-                /* read in the page now */
-                if (bhh->size <= hs->mc.c.len || 
-                    hs->mdu.flags & HVFS_MDU_IF_LZO) {
-                    __prepare_bh(bh, 1);
-                }
-                rlen = __hvfs_fread(hs, 0, &bh->data, &hs->mc.c,
-                                    bhh->size, g_pagesize);
-                if (rlen == -EFBIG) {
-                    /* it is ok, we just zero the page */
-                    err = 0;
-                } else if (rlen < 0) {
-                    hvfs_err(xnet, "bh_fill() read the file range [%ld, %ld] "
-                             "failed w/ %ld\n",
-                             bhh->size, bhh->size + g_pagesize, rlen);
-                    err = rlen;
-                    goto out;
-                }
-                /* should we fill with buf? */
-                if (size && offset < bh->offset + g_pagesize) {
-                    __prepare_bh(bh, 1);
-                    _size = min(size, bh->offset + g_pagesize - offset);
-                    if (buf)
-                        memcpy(bh->data + offset - bh->offset,
-                               buf + loff, _size);
-                    size -= _size;
-                    loff += _size;
-                    offset = bh->offset + g_pagesize;
-                }
+                err = __bh_load(hs, column, c, bh);
             }
-            list_add_tail(&bh->list, &bhh->bh);
-            bhh->size += g_pagesize;
-        }
-    } else {
-        /* update the cached content */
-        list_for_each_entry(bh, &bhh->bh, list) {
-            if (offset >= bh->offset && offset < bh->offset + g_pagesize) {
-                __prepare_bh(bh, 1);
-                _size = min(size, bh->offset + g_pagesize - offset);
-                if (buf)
-                    memcpy(bh->data + offset - bh->offset,
-                           buf + loff, _size);
-                size -= _size;
-                loff += _size;
-                offset = bh->offset + g_pagesize;
-                if (size <= 0)
-                    break;
+            if (err) {
+                __put_bh(bh);
+                goto out;
             }
+            __bhc_insert(bhh, bh);
         }
-        if (size) {
-            /* fill the last holes */
-            while (bhh->size < off_end) {
-                bh = __get_bh(bhh->size, 1);
-                if (!bh) {
-                    err = -ENOMEM;
-                    goto out;
-                }
-                if (offset == bhh->size && size >= g_pagesize) {
-                    /* just copy the buffer */
-                    _size = min(size, bh->offset + g_pagesize - offset);
-                    if (buf)
-                        memcpy(bh->data + offset - bh->offset,
-                               buf + loff, _size);
-                    size -= _size;
-                    loff += _size;
-                    offset = bh->offset + g_pagesize;
-                } else {
-                    /* read in the page now */
-                    rlen = __hvfs_fread(hs, 0, &bh->data, &hs->mc.c,
-                                       bhh->size, g_pagesize);
-                    if (rlen == -EFBIG) {
-                        /* it is ok, we just zero the page */
-                        err = 0;
-                    } else if (rlen < 0) {
-                        hvfs_err(xnet, "bh_fill() read the file range [%ld, %ld] "
-                                 "failed w/ %ld",
-                                 bhh->size, bhh->size + g_pagesize, rlen);
-                        err = rlen;
-                        goto out;
-                    }
-                    /* should we fill with buf? */
-                    if (size && offset < bh->offset + g_pagesize) {
-                        _size = min(size, bh->offset + g_pagesize - offset);
-                        if (buf)
-                            memcpy(bh->data + offset - bh->offset,
-                                   buf + loff, _size);
-                        size -= _size;
-                        loff += _size;
-                        offset = bh->offset + g_pagesize;
-                    }
-                    list_add_tail(&bh->list, &bhh->bh);
-                    bhh->size += g_pagesize;
-                }
+        if (buf && _size) {
+            err = __prepare_bh(bh, 1);
+            if (err)
+                goto out;
+            memcpy(bh->data + offset - poff, buf + loff, _size);
+            if (!(bh->flag & BHP_DIRTY)) {
+                bh->flag |= BHP_DIRTY;
+                atomic64_inc(&pfs_wb_mgr.dirty);
             }
+            __set_bhh_dirty(bhh);
         }
+        size -= _size;
+        loff += _size;
+        offset = poff + g_pagesize;
     }
 
 out:
     xrwlock_wunlock(&bhh->clock);
+    __bhc_evict();
     
     return err;
 }
 
-/* Return the cached bytes we can read or minus errno
+/* __bh_readin() reads in the holes of range [offset, offset + size) in one
+ * MDSL request. The cached pages are never overwritten as they may be dirty.
+ *
+ * Return value: # of pages read in or minus errno
+ */
+static int __bh_readin(struct bhhead *bhh, struct hstat *hs, off_t offset,
+                       size_t size)
+{
+    struct bh *bh;
+    void *data = NULL;
+    off_t start, end, poff;
+    ssize_t rlen;
+    int err = 0, nr = 0;
+
+    start = offset - offset % g_pagesize;
+    end = PAGE_ROUNDUP((offset + size), g_pagesize);
+
+    /* shrink the range to the holes */
+    xrwlock_rlock(&bhh->clock);
+    while (start < end && __bhv_lookup(bhh, start))
+        start += g_pagesize;
+    while (end > start && __bhv_lookup(bhh, end - g_pagesize))
+        end -= g_pagesize;
+    xrwlock_runlock(&bhh->clock);
+    if (start >= end)
+        return 0;
+
+    rlen = __hvfs_fread(hs, 0 /* column is ZERO */, &data, &hs->mc.c,
+                        start, end - start);
+    if (rlen == -EFBIG) {
+        /* it is ok, we just zero the pages */
+        rlen = 0;
+    } else if (rlen < 0) {
+        hvfs_err(xnet, "bh_readin() read the file range [%ld, %ld] "
+                 "failed w/ %ld\n", start, end, rlen);
+        return rlen;
+    }
+
+    xrwlock_wlock(&bhh->clock);
+    /* the file has been synced by someone, the data is stale */
+    if (memcmp(&bhh->hs.mc.c, &hs->mc.c, sizeof(struct column)))
+        goto out_unlock;
+    err = __bhv_grow(bhh, end);
+    if (err)
+        goto out_unlock;
+
+    for (poff = start; poff < end; poff += g_pagesize) {
+        if (bhh->bhv[poff / g_pagesize])
+            continue;
+        bh = __get_bh(poff, 0);
+        if (!bh) {
+            err = -ENOMEM;
+            break;
+        }
+        if (poff - start < rlen) {
+            err = __prepare_bh(bh, 1);
+            if (err) {
+                __put_bh(bh);
+                break;
+            }
+            memcpy(bh->data, data + poff - start,
+                   min((size_t)(rlen - (poff - start)), g_pagesize));
+        }
+        __bhc_insert(bhh, bh);
+        nr++;
+    }
+
+out_unlock:
+    xrwlock_wunlock(&bhh->clock);
+    xfree(data);
+    __bhc_evict();
+
+    return err ? err : nr;
+}
+
+/* Return the cached bytes we can read or minus errno, -EFBIG means there are
+ * holes in the range.
  */
 static int __bh_read(struct bhhead *bhh, void *buf, off_t offset, 
                      size_t size)
 {
     struct bh *bh;
-    off_t loff = 0, saved_offset = offset;
+    off_t off_end = PAGE_ROUNDUP((offset + size), g_pagesize);
+    off_t loff = 0, saved_offset = offset, poff;
     size_t _size, saved_size = size;
-    
-    if (offset + size > bhh->size || list_empty(&bhh->bh)) {
-        return -EFBIG;
-    }
-    
+
     xrwlock_rlock(&bhh->clock);
-    list_for_each_entry(bh, &bhh->bh, list) {
-        if (offset >= bh->offset && offset < bh->offset + g_pagesize) {
-            _size = min(size, bh->offset + g_pagesize - offset);
-            memcpy(buf + loff, bh->data + offset - bh->offset,
-                   _size);
-            /* adjust the offset and size */
-            size -= _size;
-            loff += _size;
-            offset = bh->offset + g_pagesize;
-            if (size <= 0)
-                break;
-        }
+    for (poff = offset - offset % g_pagesize; poff < off_end;
+         poff += g_pagesize) {
+        if (!__bhv_lookup(bhh, poff)) {
+            xrwlock_runlock(&bhh->clock);
+            atomic64_inc(&pfs_bhc_mgr.miss);
+            return -EFBIG;
+        }
+    }
+    for (poff = offset - offset % g_pagesize; poff < off_end;
+         poff += g_pagesize) {
+        bh = bhh->bhv[poff / g_pagesize];
+        _size = min(size, poff + g_pagesize - offset);
+        memcpy(buf + loff, bh->data + offset - poff, _size);
+        /* adjust the offset and size */
+        size -= _size;
+        loff += _size;
+        offset = poff + g_pagesize;
+    }
+    /* refresh the pages in LRU list */
+    xlock_lock(&pfs_bhc_mgr.lock);
+    for (poff = saved_offset - saved_offset % g_pagesize; poff < off_end;
+         poff += g_pagesize) {
+        bh = bhh->bhv[poff / g_pagesize];
+        list_move(&bh->list, &pfs_bhc_mgr.lru);
     }
+    xlock_unlock(&pfs_bhc_mgr.lock);
     xrwlock_runlock(&bhh->clock);
+    atomic64_inc(&pfs_bhc_mgr.hit);
 
     size = saved_size - size;
     /* adjust the return size to valid file range */
@@ -614,79 +894,287 @@ static int __bh_read(struct bhhead *bhh, void *buf, off_t offset,
     return size;
 }
 
+static void __bh_ra_submit(struct bhhead *bhh, off_t offset, size_t size)
+{
+    struct bh_ra *ra;
+
+    if (!pfs_bhc_mgr.rat_nr)
+        return;
+    if (atomic_inc_return(&pfs_bhc_mgr.ra_pending) > PFS_BHC_RA_QMAX) {
+        atomic_dec(&pfs_bhc_mgr.ra_pending);
+        atomic64_inc(&pfs_bhc_mgr.ra_drop);
+        return;
+    }
+
+    ra = xzalloc(sizeof(*ra));
+    if (!ra) {
+        atomic_dec(&pfs_bhc_mgr.ra_pending);
+        return;
+    }
+    INIT_LIST_HEAD(&ra->list);
+    /* the caller holds a reference, it is safe to get another one */
+    atomic_inc(&bhh->ref);
+    ra->bhh = bhh;
+    ra->offset = offset;
+    ra->size = size;
+
+    xlock_lock(&pfs_bhc_mgr.ralock);
+    list_add_tail(&ra->list, &pfs_bhc_mgr.raq);
+    xlock_unlock(&pfs_bhc_mgr.ralock);
+    sem_post(&pfs_bhc_mgr.rasem);
+}
+
+/* __bh_readahead() detects the sequential reads. The window starts from
+ * PFS_BHC_RA_MIN and doubles up to ra_max, the next window is issued when
+ * the reader has consumed half of the current window.
+ */
+static void __bh_readahead(struct bhhead *bhh, off_t offset, size_t size)
+{
+    off_t start, end, fend;
+
+    if (!pfs_bhc_mgr.ra_max)
+        return;
+
+    if (offset != bhh->ra_next) {
+        /* random access, reset the window */
+        bhh->ra_next = offset + size;
+        bhh->ra_end = 0;
+        bhh->ra_win = 0;
+        return;
+    }
+    bhh->ra_next = offset + size;
+    if (bhh->ra_end - bhh->ra_next > (off_t)(bhh->ra_win >> 1))
+        return;
+
+    if (!bhh->ra_win)
+        bhh->ra_win = max(PAGE_ROUNDUP(size << 1, g_pagesize),
+                          (size_t)PFS_BHC_RA_MIN);
+    else
+        bhh->ra_win = bhh->ra_win << 1;
+    bhh->ra_win = min(bhh->ra_win, pfs_bhc_mgr.ra_max);
+
+    start = max(bhh->ra_end, (off_t)PAGE_ROUNDUP(bhh->ra_next, g_pagesize));
+    end = start + bhh->ra_win;
+    fend = PAGE_ROUNDUP(max((u64)bhh->asize, bhh->hs.mdu.size), g_pagesize);
+    if (end > fend)
+        end = fend;
+    if (start >= end)
+        return;
+    bhh->ra_end = end;
+
+    __bh_ra_submit(bhh, start, end - start);
+}
+
+static void *__bhc_ra_main(void *arg)
+{
+    struct bh_ra *ra;
+    struct hstat hs;
+    sigset_t set;
+    int err;
+
+    /* first, let us block the SIGALRM */
+    sigemptyset(&set);
+    sigaddset(&set, SIGALRM);
+    sigaddset(&set, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &set, NULL); /* oh, we do not care about the
+                                             * errs */
+
+    while (!pfs_bhc_mgr.ra_stop) {
+        err = sem_wait(&pfs_bhc_mgr.rasem);
+        if (err < 0 && errno == EINTR)
+            continue;
+
+        ra = NULL;
+        xlock_lock(&pfs_bhc_mgr.ralock);
+        if (!list_empty(&pfs_bhc_mgr.raq)) {
+            ra = list_first_entry(&pfs_bhc_mgr.raq, struct bh_ra, list);
+            list_del(&ra->list);
+        }
+        xlock_unlock(&pfs_bhc_mgr.ralock);
+        if (!ra)
+            continue;
+        atomic_dec(&pfs_bhc_mgr.ra_pending);
+
+        hs = ra->bhh->hs;
+        err = __bh_readin(ra->bhh, &hs, ra->offset, ra->size);
+        if (err < 0) {
+            hvfs_warning(xnet, "read-ahead [%ld, %ld] of ino'%lx' failed "
+                         "w/ %d\n", ra->offset, ra->offset + ra->size,
+                         hs.uuid, err);
+        } else
+            atomic64_add(err, &pfs_bhc_mgr.ra);
+        __put_bhhead(ra->bhh);
+        xfree(ra);
+    }
+    pthread_exit(0);
+}
+
+/* __bhc_init() setups the buffer cache. bc_max is the memory bound in MB,
+ * ra_max is the max read-ahead window in KB. Zero means the default value,
+ * negative value means unlimited memory or read-ahead disabled.
+ */
+static int __bhc_init(int bc_max, int ra_max)
+{
+    int i, err = 0;
+
+    INIT_LIST_HEAD(&pfs_bhc_mgr.lru);
+    xlock_init(&pfs_bhc_mgr.lock);
+    INIT_LIST_HEAD(&pfs_bhc_mgr.raq);
+    xlock_init(&pfs_bhc_mgr.ralock);
+    sem_init(&pfs_bhc_mgr.rasem, 0, 0);
+    atomic64_set(&pfs_bhc_mgr.nr, 0);
+    atomic_set(&pfs_bhc_mgr.ra_pending, 0);
+    atomic64_set(&pfs_bhc_mgr.hit, 0);
+    atomic64_set(&pfs_bhc_mgr.miss, 0);
+    atomic64_set(&pfs_bhc_mgr.evict, 0);
+    atomic64_set(&pfs_bhc_mgr.ra, 0);
+    atomic64_set(&pfs_bhc_mgr.ra_drop, 0);
+
+    if (!bc_max)
+        bc_max = PFS_BHC_MAX_DEFAULT;
+    if (bc_max < 0)
+        pfs_bhc_mgr.max = -1UL;
+    else
+        pfs_bhc_mgr.max = ((u64)bc_max << 20) / g_pagesize;
+
+    if (!ra_max)
+        ra_max = PFS_BHC_RA_MAX_DEFAULT;
+    if (ra_max < 0) {
+        pfs_bhc_mgr.ra_max = 0;
+        return 0;
+    }
+    pfs_bhc_mgr.ra_max = PAGE_ROUNDUP(((size_t)ra_max << 10), g_pagesize);
+
+    pfs_bhc_mgr.rat = xzalloc(PFS_BHC_RA_THREADS * sizeof(pthread_t));
+    if (!pfs_bhc_mgr.rat) {
+        hvfs_err(xnet, "xzalloc() read-ahead threads failed\n");
+        err = -ENOMEM;
+        goto out_disable;
+    }
+    for (i = 0; i < PFS_BHC_RA_THREADS; i++) {
+        err = pthread_create(pfs_bhc_mgr.rat + i, NULL, &__bhc_ra_main,
+                             NULL);
+        if (err) {
+            hvfs_err(xnet, "create read-ahead thread %d failed w/ %s\n",
+                     i, strerror(err));
+            err = -err;
+            break;
+        }
+        pfs_bhc_mgr.rat_nr++;
+    }
+    if (!pfs_bhc_mgr.rat_nr)
+        goto out_disable;
+
+    return 0;
+out_disable:
+    pfs_bhc_mgr.ra_max = 0;
+    return err;
+}
+
+static void __bhc_destroy(void)
+{
+    struct bh_ra *ra, *n;
+    int i;
+
+    pfs_bhc_mgr.ra_stop = 1;
+    for (i = 0; i < pfs_bhc_mgr.rat_nr; i++) {
+        sem_post(&pfs_bhc_mgr.rasem);
+    }
+    for (i = 0; i < pfs_bhc_mgr.rat_nr; i++) {
+        pthread_join(pfs_bhc_mgr.rat[i], NULL);
+    }
+    /* drop the read-ahead requests not handled yet */
+    xlock_lock(&pfs_bhc_mgr.ralock);
+    list_for_each_entry_safe(ra, n, &pfs_bhc_mgr.raq, list) {
+        list_del(&ra->list);
+        atomic_dec(&pfs_bhc_mgr.ra_pending);
+        __put_bhhead(ra->bhh);
+        xfree(ra);
+    }
+    xlock_unlock(&pfs_bhc_mgr.ralock);
+    xfree(pfs_bhc_mgr.rat);
+    sem_destroy(&pfs_bhc_mgr.rasem);
+}
+
 static int __bh_sync(struct bhhead *bhh)
 {
     struct hstat hs;
-    struct bh *bh;
     struct iovec *iov = NULL;
     off_t offset = 0;
     void *data = NULL;
-    size_t size, _size;
+    size_t size, _size, nr;
     u64 hash;
     int err = 0, i;
 
-    if (bhh->asize > bhh->size) {
-        /* oh, we have to fill the remain pages */
-        err = __bh_fill(&bhh->hs, 0, &bhh->hs.mc.c, bhh, NULL, 
-                        bhh->asize, 0);
-        if (err < 0) {
-            hvfs_err(xnet, "fill the buffer cache failed w/ %d\n",
-                     err);
-            goto out;
-        }
+    /* pin the pages first, otherwise __bhc_evict() may drop the clean pages
+     * we read in below and we would reload forever */
+    xrwlock_wlock(&bhh->clock);
+    bhh->flag |= BH_SYNC;
+    xrwlock_wunlock(&bhh->clock);
+
+reload:
+    /* oh, we have to read in the holes (evicted clean pages) */
+    hs = bhh->hs;
+    err = __bh_readin(bhh, &hs, 0, bhh->asize);
+    if (err < 0) {
+        hvfs_err(xnet, "read in the buffer cache failed w/ %d\n",
+                 err);
+        goto out_free;
     }
 
     hs = bhh->hs;
 
     xrwlock_wlock(&bhh->clock);
     size = bhh->asize;
-    i = 0;
-    list_for_each_entry(bh, &bhh->bh, list) {
-        _size = min(size, g_pagesize);
-        i++;
-        size -= _size;
-        if (size <= 0)
-            break;
+    nr = PAGE_ROUNDUP(size, g_pagesize) / g_pagesize;
+    for (i = 0; i < nr; i++) {
+        if (!bhh->bhv || i >= bhh->bhv_nr || !bhh->bhv[i]) {
+            /* somebody synced and the pages were evicted, retry */
+            xrwlock_wunlock(&bhh->clock);
+            goto reload;
+        }
     }
 
-    if (i > IOV_MAX - 5) {
+    if (nr > IOV_MAX - 5) {
         /* sadly fallback to memcpy approach */
         data = xmalloc(bhh->asize);
         if (!data) {
             hvfs_err(xnet, "xmalloc(%ld) data buffer failed\n", 
                      bhh->asize);
             xrwlock_wunlock(&bhh->clock);
-            return -ENOMEM;
+            err = -ENOMEM;
+            goto out_free;
         }
 
-        size = bhh->asize;
-        list_for_each_entry(bh, &bhh->bh, list) {
+        for (i = 0; i < nr; i++) {
             _size = min(size, g_pagesize);
-            memcpy(data + offset, bh->data, _size);
+            memcpy(data + offset, bhh->bhv[i]->data, _size);
             offset += _size;
             size -= _size;
-            if (size <= 0)
-                break;
         }
     } else {
-        iov = xmalloc(sizeof(*iov) * i);
+        iov = xmalloc(sizeof(*iov) * nr);
         if (!iov) {
             hvfs_err(xnet, "xmalloc() iov buffer failed\n");
             xrwlock_wunlock(&bhh->clock);
-            return -ENOMEM;
+            err = -ENOMEM;
+            goto out_free;
         }
         
-        size = bhh->asize;
-        i = 0;
-        list_for_each_entry(bh, &bhh->bh, list) {
+        for (i = 0; i < nr; i++) {
             _size = min(size, g_pagesize);
             
-            (iov + i)->iov_base = bh->data;
+            (iov + i)->iov_base = bhh->bhv[i]->data;
             (iov + i)->iov_len = _size;
-            i++;
             size -= _size;
-            if (size <= 0)
-                break;
+        }
+    }
+    /* the pages are pinned until the iov has been written out */
+    for (i = 0; i < nr; i++) {
+        if (bhh->bhv[i]->flag & BHP_DIRTY) {
+            bhh->bhv[i]->flag &= ~BHP_DIRTY;
+            bhh->bhv[i]->flag |= BHP_SYNC;
+            atomic64_dec(&pfs_wb_mgr.dirty);
         }
     }
     __clr_bhh_dirty(bhh);
@@ -765,61 +1253,325 @@ static int __bh_sync(struct bhhead *bhh)
     err = size;
 
 out_free:
+    xrwlock_wlock(&bhh->clock);
+    for (i = 0; i < bhh->bhv_nr; i++) {
+        struct bh *bh = bhh->bhv[i];
+
+        if (!bh || !(bh->flag & BHP_SYNC))
+            continue;
+        bh->flag &= ~BHP_SYNC;
+        /* the write failed, re-dirty the pages we cleaned */
+        if (err < 0 && !(bh->flag & BHP_DIRTY)) {
+            bh->flag |= BHP_DIRTY;
+            atomic64_inc(&pfs_wb_mgr.dirty);
+        }
+    }
+    if (err < 0)
+        __set_bhh_dirty(bhh);
+    bhh->flag &= ~BH_SYNC;
+    xrwlock_wunlock(&bhh->clock);
     xfree(iov);
     xfree(data);
 
-out:
     return err;
 }
 
-/* We have a LRU translate cache to resolve file system pathname(only
- * directory) to uuid and salt pair.
+/* __bh_flush() syncs the file if it is dirty. If the file is being flushed by
+ * the flusher, we wait for it. The error is kept in bhh->err until
+ * __bh_report() consumes it.
+ */
+static int __bh_flush(struct bhhead *bhh)
+{
+    int err = 0;
+
+    xlock_lock(&bhh->slock);
+    if (bhh->flag & BH_DIRTY) {
+        err = __bh_sync(bhh);
+        if (err >= 0)
+            atomic64_inc(&pfs_wb_mgr.flush);
+        else
+            bhh->err = err;
+    }
+    xlock_unlock(&bhh->slock);
+
+    return err;
+}
+
+/* __bh_report() waits for the outstanding flush and returns the pending write
+ * back error once.
+ */
+static int __bh_report(struct bhhead *bhh)
+{
+    int err;
+
+    xlock_lock(&bhh->slock);
+    err = bhh->err;
+    bhh->err = 0;
+    xlock_unlock(&bhh->slock);
+
+    return err;
+}
+
+/* __wb_can_flush() checks if the file can be flushed now: it has been released
+ * (only the dirty list holds it), and its last flush did not fail within the
+ * expire seconds. Hold the wb lock.
+ */
+static inline int __wb_can_flush(struct bhhead *bhh, time_t now)
+{
+    return atomic_read(&bhh->ref) == 1 &&
+        (!bhh->err || now - bhh->dtime >= pfs_wb_mgr.expire);
+}
+
+/* __wb_ready() checks if there is any file the flushers can work on
+ */
+static int __wb_ready(void)
+{
+    struct bhhead *bhh;
+    time_t now = time(NULL);
+    int ready = 0;
+
+    xlock_lock(&pfs_wb_mgr.lock);
+    list_for_each_entry(bhh, &pfs_wb_mgr.dlist, dlist) {
+        if (__wb_can_flush(bhh, now)) {
+            ready = 1;
+            break;
+        }
+    }
+    xlock_unlock(&pfs_wb_mgr.lock);
+
+    return ready;
+}
+
+/* __wb_dirty() links the dirtied file on the dirty list and throttles the
+ * writer if there are too many dirty pages.
+ */
+static void __wb_dirty(struct bhhead *bhh)
+{
+    if (!pfs_wb_mgr.t_nr)
+        return;
+
+    xlock_lock(&pfs_wb_mgr.lock);
+    if (list_empty(&bhh->dlist)) {
+        /* the dirty list holds a reference */
+        atomic_inc(&bhh->ref);
+        bhh->dtime = time(NULL);
+        list_add_tail(&bhh->dlist, &pfs_wb_mgr.dlist);
+    }
+    xlock_unlock(&pfs_wb_mgr.lock);
+
+    if (atomic64_read(&pfs_wb_mgr.dirty) > pfs_wb_mgr.bg)
+        sem_post(&pfs_wb_mgr.sem);
+    if (atomic64_read(&pfs_wb_mgr.dirty) > pfs_wb_mgr.hard) {
+        atomic64_inc(&pfs_wb_mgr.throttle);
+        do {
+            sem_post(&pfs_wb_mgr.sem);
+            usleep(PFS_WB_THROTTLE_WAIT);
+        } while (atomic64_read(&pfs_wb_mgr.dirty) > pfs_wb_mgr.hard &&
+                 !pfs_wb_mgr.stop && __wb_ready());
+    }
+}
+
+/* __wb_pick() unlinks a file to flush from the dirty list, the reference is
+ * passed to the caller.
+ */
+static struct bhhead *__wb_pick(int force)
+{
+    struct bhhead *bhh, *n;
+    time_t now = time(NULL);
+
+    xlock_lock(&pfs_wb_mgr.lock);
+    list_for_each_entry_safe(bhh, n, &pfs_wb_mgr.dlist, dlist) {
+        if (force || __wb_can_flush(bhh, now)) {
+            list_del_init(&bhh->dlist);
+            xlock_unlock(&pfs_wb_mgr.lock);
+            return bhh;
+        }
+    }
+    xlock_unlock(&pfs_wb_mgr.lock);
+
+    return NULL;
+}
+
+/* __wb_requeue() links the file back on the dirty list after a failed flush,
+ * the reference is passed in.
+ */
+static void __wb_requeue(struct bhhead *bhh)
+{
+    int linked = 0;
+
+    xlock_lock(&pfs_wb_mgr.lock);
+    if (list_empty(&bhh->dlist)) {
+        bhh->dtime = time(NULL);
+        list_add_tail(&bhh->dlist, &pfs_wb_mgr.dlist);
+        linked = 1;
+    }
+    xlock_unlock(&pfs_wb_mgr.lock);
+
+    if (!linked)
+        __put_bhhead(bhh);
+}
+
+static void *__wb_main(void *arg)
+{
+    struct bhhead *bhh;
+    struct timespec ts;
+    sigset_t set;
+    int err;
+
+    /* first, let us block the SIGALRM */
+    sigemptyset(&set);
+    sigaddset(&set, SIGALRM);
+    sigaddset(&set, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &set, NULL); /* oh, we do not care about the
+                                             * errs */
+
+    while (!pfs_wb_mgr.stop) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec++;
+        err = sem_timedwait(&pfs_wb_mgr.sem, &ts);
+        if (err < 0 && errno == EINTR)
+            continue;
+
+        while ((bhh = __wb_pick(0)) != NULL) {
+            err = __bh_flush(bhh);
+            if (err < 0) {
+                hvfs_err(xnet, "write-behind flush on ino'%lx' failed "
+                         "w/ %d, retry later\n", bhh->uuid, err);
+                __wb_requeue(bhh);
+                continue;
+            }
+            __put_bhhead(bhh);
+        }
+    }
+    pthread_exit(0);
+}
+
+/* __wb_init() starts the flusher threads. expire is the dirty expire in
+ * seconds, zero means the default value, negative value means write-behind
+ * disabled (release() syncs the file itself).
+ */
+static int __wb_init(int expire)
+{
+    int i, err = 0;
+
+    INIT_LIST_HEAD(&pfs_wb_mgr.dlist);
+    xlock_init(&pfs_wb_mgr.lock);
+    sem_init(&pfs_wb_mgr.sem, 0, 0);
+    atomic64_set(&pfs_wb_mgr.dirty, 0);
+    atomic64_set(&pfs_wb_mgr.flush, 0);
+    atomic64_set(&pfs_wb_mgr.throttle, 0);
+
+    if (!expire)
+        expire = PFS_WB_EXPIRE_DEFAULT;
+    if (expire < 0)
+        return 0;
+    pfs_wb_mgr.expire = expire;
+    /* the dirty pages are pinned, keep them under the cache bound */
+    pfs_wb_mgr.bg = pfs_bhc_mgr.max >> 2;
+    pfs_wb_mgr.hard = pfs_bhc_mgr.max >> 1;
+
+    pfs_wb_mgr.t = xzalloc(PFS_WB_THREADS * sizeof(pthread_t));
+    if (!pfs_wb_mgr.t) {
+        hvfs_err(xnet, "xzalloc() flusher threads failed\n");
+        return -ENOMEM;
+    }
+    for (i = 0; i < PFS_WB_THREADS; i++) {
+        err = pthread_create(pfs_wb_mgr.t + i, NULL, &__wb_main, NULL);
+        if (err) {
+            hvfs_err(xnet, "create flusher thread %d failed w/ %s\n",
+                     i, strerror(err));
+            err = -err;
+            break;
+        }
+        pfs_wb_mgr.t_nr++;
+    }
+
+    return pfs_wb_mgr.t_nr ? 0 : err;
+}
+
+/* __wb_destroy() stops the flushers and syncs all the dirty files
+ */
+static void __wb_destroy(void)
+{
+    struct bhhead *bhh;
+    int i;
+
+    pfs_wb_mgr.stop = 1;
+    for (i = 0; i < pfs_wb_mgr.t_nr; i++) {
+        sem_post(&pfs_wb_mgr.sem);
+    }
+    for (i = 0; i < pfs_wb_mgr.t_nr; i++) {
+        pthread_join(pfs_wb_mgr.t[i], NULL);
+    }
+
+    while ((bhh = __wb_pick(1)) != NULL) {
+        if (__bh_flush(bhh) < 0) {
+            hvfs_err(xnet, "write-behind flush on ino'%lx' failed, "
+                     "drop the dirty pages\n", bhh->uuid);
+        }
+        __put_bhhead(bhh);
+    }
+    pfs_wb_mgr.t_nr = 0;
+    xfree(pfs_wb_mgr.t);
+    sem_destroy(&pfs_wb_mgr.sem);
+}
+
+/* We have a Dentry Translate Cache (DTC) to resolve file system pathname to
+ * uuid and salt pair component by component. The entries are keyed by
+ * (parent uuid, name), thus a miss on /a/b/c/d reuses the cached /a/b/c, and
+ * a rename only drops the dentries it touches. A zero uuid entry is a
+ * negative entry, the name does not exist.
  */
 static time_t *g_pfs_tick = NULL; /* file system tick */
-struct __pfs_ltc_mgr
+struct __pfs_dtc_mgr
 {
     struct regular_hash *ht;
-    struct list_head lru;
-    xlock_t lru_lock;
-#define PFS_LTC_HSIZE_DEFAULT   (8191)
-    u32 hsize:16;               /* hash table size */
-    u32 ttl:8;                  /* valid ttl. 0 means do not believe the
+#define PFS_DTC_HSIZE_DEFAULT   (8191)
+#define PFS_DTC_BUCKET_MAX      (8) /* LRU entries in each bucket */
+    u32 hsize;                  /* hash table size */
+    u32 ttl;                    /* valid ttl. 0 means do not believe the
                                  * cached value (cache disabled) */
-} pfs_ltc_mgr;
+    atomic64_t hit, nhit, miss; /* nhit is the negative hit */
+    atomic64_t evict, invalid;
+} pfs_dtc_mgr;
 
-struct ltc_entry
+struct dtc_entry
 {
     struct hlist_node hlist;
-    struct list_head list;
-    char *fullname;             /* full pathname */
-    u64 uuid, salt;
-    u64 born;
+    u64 puuid;                  /* parent uuid */
+    u64 uuid, salt;             /* zero uuid means negative entry */
+    time_t born;
+    int namelen;
+    char name[0];
 };
 
-static int __ltc_init(int ttl, int hsize)
+static int __dtc_init(int ttl, int hsize)
 {
     int i;
     
     if (hsize)
-        pfs_ltc_mgr.hsize = hsize;
+        pfs_dtc_mgr.hsize = hsize;
     else
-        pfs_ltc_mgr.hsize = PFS_LTC_HSIZE_DEFAULT;
+        pfs_dtc_mgr.hsize = PFS_DTC_HSIZE_DEFAULT;
 
-    pfs_ltc_mgr.ttl = ttl;
+    pfs_dtc_mgr.ttl = ttl;
 
-    pfs_ltc_mgr.ht = xmalloc(pfs_ltc_mgr.hsize * sizeof(struct regular_hash));
-    if (!pfs_ltc_mgr.ht) {
-        hvfs_err(xnet, "LRU Translate Cache hash table init failed\n");
+    pfs_dtc_mgr.ht = xmalloc(pfs_dtc_mgr.hsize * sizeof(struct regular_hash));
+    if (!pfs_dtc_mgr.ht) {
+        hvfs_err(xnet, "Dentry Translate Cache hash table init failed\n");
         return -ENOMEM;
     }
 
     /* init the hash table */
-    for (i = 0; i < pfs_ltc_mgr.hsize; i++) {
-        INIT_HLIST_HEAD(&pfs_ltc_mgr.ht[i].h);
-        xlock_init(&pfs_ltc_mgr.ht[i].lock);
+    for (i = 0; i < pfs_dtc_mgr.hsize; i++) {
+        INIT_HLIST_HEAD(&pfs_dtc_mgr.ht[i].h);
+        xlock_init(&pfs_dtc_mgr.ht[i].lock);
     }
-    INIT_LIST_HEAD(&pfs_ltc_mgr.lru);
-    xlock_init(&pfs_ltc_mgr.lru_lock);
+    atomic64_set(&pfs_dtc_mgr.hit, 0);
+    atomic64_set(&pfs_dtc_mgr.nhit, 0);
+    atomic64_set(&pfs_dtc_mgr.miss, 0);
+    atomic64_set(&pfs_dtc_mgr.evict, 0);
+    atomic64_set(&pfs_dtc_mgr.invalid, 0);
 
     /* init file system tick */
     g_pfs_tick = &hmo.tick;
@@ -827,195 +1579,458 @@ static int __ltc_init(int ttl, int hsize)
     return 0;
 }
 
-static void __ltc_destroy(void)
+static void __dtc_destroy(void)
 {
-    xfree(pfs_ltc_mgr.ht);
+    struct dtc_entry *de;
+    struct hlist_node *pos, *n;
+    int i;
+
+    if (!pfs_dtc_mgr.ht)
+        return;
+    for (i = 0; i < pfs_dtc_mgr.hsize; i++) {
+        hlist_for_each_entry_safe(de, pos, n, &pfs_dtc_mgr.ht[i].h, hlist) {
+            hlist_del(&de->hlist);
+            xfree(de);
+        }
+    }
+    xfree(pfs_dtc_mgr.ht);
 }
 
-#define LE_LIFE_FACTOR          (4)
-#define LE_IS_OLD(le) (                                                 \
-        ((*g_pfs_tick - (le)->born) >                                   \
-         LE_LIFE_FACTOR * pfs_ltc_mgr.ttl)                              \
-        )
-#define LE_IS_VALID(le) (*g_pfs_tick - (le)->born <= pfs_ltc_mgr.ttl)
+#define DE_IS_VALID(de) (*g_pfs_tick - (de)->born <= pfs_dtc_mgr.ttl)
+#define DE_MATCH(de, pu, n, nl) ((de)->puuid == (pu) &&                 \
+                                 (de)->namelen == (nl) &&               \
+                                 memcmp((de)->name, n, nl) == 0)
 
 static inline
-int __ltc_hash(const char *key)
+int __dtc_hash(u64 puuid, const char *name, int namelen)
 {
-    return __murmurhash64a(key, strlen(key), 0xfead31435df3) % 
-        pfs_ltc_mgr.hsize;
+    return __murmurhash64a(name, namelen, puuid) % pfs_dtc_mgr.hsize;
 }
 
-static void __ltc_remove(struct ltc_entry *del)
+/* Return value: 0: miss; 1: hit; -ENOENT: negative hit
+ */
+static int __dtc_lookup(u64 puuid, const char *name, u64 *uuid, u64 *salt)
 {
     struct regular_hash *rh;
-    struct ltc_entry *le;
+    struct dtc_entry *de;
     struct hlist_node *pos, *n;
-    int idx;
+    int namelen, found = 0;
+
+    if (unlikely(!pfs_dtc_mgr.ttl || !pfs_dtc_mgr.ht))
+        return 0;
 
-    idx = __ltc_hash(del->fullname);
-    rh = pfs_ltc_mgr.ht + idx;
+    namelen = strlen(name);
+    rh = pfs_dtc_mgr.ht + __dtc_hash(puuid, name, namelen);
 
     xlock_lock(&rh->lock);
-    hlist_for_each_entry_safe(le, pos, n, &rh->h, hlist) {
-        if (del == le && strcmp(del->fullname, le->fullname) == 0) {
-            hlist_del(&le->hlist);
+    hlist_for_each_entry_safe(de, pos, n, &rh->h, hlist) {
+        if (DE_MATCH(de, puuid, name, namelen)) {
+            hlist_del(&de->hlist);
+            if (!DE_IS_VALID(de)) {
+                xfree(de);
+                break;
+            }
+            if (de->uuid) {
+                *uuid = de->uuid;
+                *salt = de->salt;
+                found = 1;
+            } else
+                found = -ENOENT;
+            /* move to the bucket head, the tail is the LRU one */
+            hlist_add_head(&de->hlist, &rh->h);
+            break;
+        }
+    }
+    xlock_unlock(&rh->lock);
+
+    if (found > 0)
+        atomic64_inc(&pfs_dtc_mgr.hit);
+    else if (found < 0)
+        atomic64_inc(&pfs_dtc_mgr.nhit);
+    else
+        atomic64_inc(&pfs_dtc_mgr.miss);
+
+    return found;
+}
+
+/* zero uuid inserts a negative entry
+ */
+static void __dtc_update(u64 puuid, const char *name, u64 uuid, u64 salt)
+{
+    struct regular_hash *rh;
+    struct dtc_entry *de, *nde;
+    struct hlist_node *pos, *n;
+    int namelen, nr = 0;
+
+    if (unlikely(!pfs_dtc_mgr.ttl || !pfs_dtc_mgr.ht))
+        return;
+
+    namelen = strlen(name);
+    nde = xmalloc(sizeof(*nde) + namelen);
+    if (!nde)
+        return;
+    nde->puuid = puuid;
+    nde->uuid = uuid;
+    nde->salt = salt;
+    nde->born = *g_pfs_tick;
+    nde->namelen = namelen;
+    memcpy(nde->name, name, namelen);
+
+    rh = pfs_dtc_mgr.ht + __dtc_hash(puuid, name, namelen);
+
+    xlock_lock(&rh->lock);
+    hlist_for_each_entry_safe(de, pos, n, &rh->h, hlist) {
+        if (DE_MATCH(de, puuid, name, namelen) || !DE_IS_VALID(de)) {
+            hlist_del(&de->hlist);
+            xfree(de);
+        } else if (++nr >= PFS_DTC_BUCKET_MAX) {
+            /* evict the LRU entries in this bucket */
+            hlist_del(&de->hlist);
+            xfree(de);
+            atomic64_inc(&pfs_dtc_mgr.evict);
+        }
+    }
+    hlist_add_head(&nde->hlist, &rh->h);
+    xlock_unlock(&rh->lock);
+}
+
+static void __dtc_resolve_cb(u64 puuid, char *name, u64 uuid, u64 salt)
+{
+    __dtc_update(puuid, name, uuid, salt);
+}
+
+static inline
+void __dtc_invalid(u64 puuid, const char *name)
+{
+    struct regular_hash *rh;
+    struct dtc_entry *de;
+    struct hlist_node *pos, *n;
+    int namelen;
+
+    if (unlikely(!pfs_dtc_mgr.ht))
+        return;
+
+    namelen = strlen(name);
+    rh = pfs_dtc_mgr.ht + __dtc_hash(puuid, name, namelen);
+
+    xlock_lock(&rh->lock);
+    hlist_for_each_entry_safe(de, pos, n, &rh->h, hlist) {
+        if (DE_MATCH(de, puuid, name, namelen)) {
+            hlist_del(&de->hlist);
+            xfree(de);
+            atomic64_inc(&pfs_dtc_mgr.invalid);
+            break;
+        }
+    }
+    xlock_unlock(&rh->lock);
+}
+
+/* __dtc_invalid_uuid() drops the dentry of directory uuid and the dentries
+ * in it. It scans the whole table, use it for the rare removals.
+ */
+static void __dtc_invalid_uuid(u64 uuid)
+{
+    struct regular_hash *rh;
+    struct dtc_entry *de;
+    struct hlist_node *pos, *n;
+    int i;
+
+    if (unlikely(!pfs_dtc_mgr.ht))
+        return;
+
+    for (i = 0; i < pfs_dtc_mgr.hsize; i++) {
+        rh = pfs_dtc_mgr.ht + i;
+        if (hlist_empty(&rh->h))
+            continue;
+        xlock_lock(&rh->lock);
+        hlist_for_each_entry_safe(de, pos, n, &rh->h, hlist) {
+            if (de->uuid == uuid || de->puuid == uuid) {
+                hlist_del(&de->hlist);
+                xfree(de);
+                atomic64_inc(&pfs_dtc_mgr.invalid);
+            }
+        }
+        xlock_unlock(&rh->lock);
+    }
+}
+
+/* __dtc_walk() resolves the directory path to (puuid, psalt)
+ *
+ * Each component is looked up in the DTC firstly. On the first miss, we
+ * resolve the remaining components w/ the MDSs (which fills the DTC), and
+ * stat the left ones one by one. The path buffer is not changed.
+ */
+static int __dtc_walk(char *path, u64 *puuid, u64 *psalt)
+{
+    struct hstat hs;
+    char *p = path, *e, c;
+    u64 uuid, salt;
+    int err = 0, resolved = 0;
+
+    while (1) {
+        while (*p == '/')
+            p++;
+        if (*p == '\0')
+            break;
+        for (e = p; *e != '\0' && *e != '/'; e++) ;
+        c = *e;
+        *e = '\0';
+        hvfs_debug(xnet, "token: %s\n", p);
+
+        err = __dtc_lookup(*puuid, p, &uuid, &salt);
+        if (err > 0) {
+            *puuid = uuid;
+            *psalt = salt;
+            err = 0;
+            goto next;
+        } else if (err < 0) {
+            *e = c;
             break;
         }
+        if (!resolved) {
+            int off;
+
+            /* resolve the remaining components in one request */
+            *e = c;
+            resolved = 1;
+            off = __hvfs_resolve(p, puuid, psalt, 0, __dtc_resolve_cb);
+            if (off > 0) {
+                p += off;
+                continue;
+            }
+            *e = '\0';
+        }
+        /* Step 1: find in the SDT, zero uuid means using name to lookup */
+        hs.name = p;
+        hs.uuid = 0;
+        err = __hvfs_stat(*puuid, *psalt, -1, &hs);
+        if (err) {
+            hvfs_err(xnet, "do internal dir stat (SDT) on '%s' failed w/ %d\n",
+                     p, err);
+            if (err == -ENOENT)
+                __dtc_update(*puuid, p, 0, 0);
+            *e = c;
+            break;
+        }
+        hs.hash = 0;
+        /* Step 2: find in the GDT */
+        err = __hvfs_stat(hmi.gdt_uuid, hmi.gdt_salt, -1, &hs);
+        if (err) {
+            hvfs_err(xnet, "do internal dir stat (GDT) on '%s' failed w/ %d\n",
+                     p, err);
+            *e = c;
+            break;
+        }
+        __dtc_update(*puuid, p, hs.uuid, hs.ssalt);
+        *puuid = hs.uuid;
+        *psalt = hs.ssalt;
+    next:
+        *e = c;
+        p = e;
+    }
+
+    return err;
+}
+
+/* We have a Lease Stat Cache (LSC) to serve the getattr of the hot files
+ * locally. The MDS grants a read lease on the lookup w/ INDEX_LEASE, and we
+ * believe the cached hstat until the lease expires. The MDS holds the
+ * conflicting updates until then, thus we release our own lease before we
+ * change the file.
+ */
+struct __pfs_lsc_mgr
+{
+    struct regular_hash *ht;
+#define PFS_LSC_HSIZE_DEFAULT   (4099)
+/* the lease is counted from the request time in seconds, and the MDS tick
+ * lags at most one second, thus we drop two seconds to be safe */
+#define PFS_LSC_SLACK           (2)
+    u32 hsize;
+    atomic64_t hit, miss, release;
+} pfs_lsc_mgr;
+
+struct lsc_entry
+{
+    struct hlist_node hlist;
+    u64 puuid, psalt;           /* parent uuid and salt */
+    struct hstat hs;            /* hs.mdu.dtime is the lease */
+    time_t born;                /* the lookup request time */
+    int namelen;
+    char name[0];
+};
+
+#define LE_EXPIRE(le) ((le)->born + LEASE_TTL((le)->hs.mdu.dtime) -     \
+                       PFS_LSC_SLACK)
+
+static int __lsc_init(int hsize)
+{
+    int i;
+
+    if (hsize)
+        pfs_lsc_mgr.hsize = hsize;
+    else
+        pfs_lsc_mgr.hsize = PFS_LSC_HSIZE_DEFAULT;
+
+    pfs_lsc_mgr.ht = xmalloc(pfs_lsc_mgr.hsize * sizeof(struct regular_hash));
+    if (!pfs_lsc_mgr.ht) {
+        hvfs_err(xnet, "Lease Stat Cache hash table init failed\n");
+        return -ENOMEM;
     }
-    xlock_unlock(&rh->lock);
+
+    /* init the hash table */
+    for (i = 0; i < pfs_lsc_mgr.hsize; i++) {
+        INIT_HLIST_HEAD(&pfs_lsc_mgr.ht[i].h);
+        xlock_init(&pfs_lsc_mgr.ht[i].lock);
+    }
+    atomic64_set(&pfs_lsc_mgr.hit, 0);
+    atomic64_set(&pfs_lsc_mgr.miss, 0);
+    atomic64_set(&pfs_lsc_mgr.release, 0);
+
+    return 0;
 }
 
-static struct ltc_entry *
-__ltc_new_entry(char *pathname, void *arg0, void *arg1)
+static void __lsc_destroy(void)
 {
-    struct ltc_entry *le = NULL;
-
-    /* find the least recently used entry */
-    if (!list_empty(&pfs_ltc_mgr.lru)) {
-        xlock_lock(&pfs_ltc_mgr.lru_lock);
-        le = list_entry(pfs_ltc_mgr.lru.prev, struct ltc_entry, list);
-        /* if it is born long time ago, we reuse it! */
-        if (LE_IS_OLD(le)) {
-            /* remove from the tail */
-            list_del_init(&le->list);
-
-            xlock_unlock(&pfs_ltc_mgr.lru_lock);
-            /* remove from the hash table */
-            __ltc_remove(le);
-
-            /* install new values */
-            xfree(le->fullname);
-            le->fullname = strdup(pathname);
-            if (!le->fullname) {
-                /* failed with not enough memory! */
-                xfree(le);
-                le = NULL;
-                goto out;
-            }
-            le->uuid = (u64)arg0;
-            le->salt = (u64)arg1;
-            le->born = *g_pfs_tick;
-        } else {
-            xlock_unlock(&pfs_ltc_mgr.lru_lock);
-            goto alloc_one;
-        }
-    } else {
-    alloc_one:
-        le = xmalloc(sizeof(*le));
-        if (!le) {
-            goto out;
-        }
-        le->fullname = strdup(pathname);
-        if (!le->fullname) {
+    struct lsc_entry *le;
+    struct hlist_node *pos, *n;
+    int i;
+
+    if (!pfs_lsc_mgr.ht)
+        return;
+    for (i = 0; i < pfs_lsc_mgr.hsize; i++) {
+        hlist_for_each_entry_safe(le, pos, n, &pfs_lsc_mgr.ht[i].h, hlist) {
+            hlist_del(&le->hlist);
             xfree(le);
-            le = NULL;
-            goto out;
         }
-        le->uuid = (u64)arg0;
-        le->salt = (u64)arg1;
-        le->born = *g_pfs_tick;
     }
+    xfree(pfs_lsc_mgr.ht);
+}
 
-out:
-    return le;
+static inline
+int __lsc_hash(u64 puuid, const char *name, int namelen)
+{
+    return __murmurhash64a(name, namelen, puuid) % pfs_lsc_mgr.hsize;
 }
 
-/* Return value: 1 => hit and up2date; 2 => miss, alloc and up2date; 
- *               0 => not up2date
+/* __lsc_lookup() copies the leased hstat to @hs if the lease is still valid.
+ *
+ * Return value: 1: hit; 0: miss
  */
-static int __ltc_update(char *pathname, void *arg0, void *arg1)
+static int __lsc_lookup(u64 puuid, const char *name, struct hstat *hs)
 {
     struct regular_hash *rh;
-    struct ltc_entry *le;
-    struct hlist_node *n;
-    int found = 0, idx;
+    struct lsc_entry *le;
+    struct hlist_node *pos, *n;
+    time_t now = time(NULL);
+    int namelen, found = 0;
+
+    if (unlikely(!pfs_lsc_mgr.ht))
+        return 0;
 
-    /* ABI: arg0, and arg1 is uuid and salt value */
-    idx = __ltc_hash(pathname);
-    rh = pfs_ltc_mgr.ht + idx;
+    namelen = strlen(name);
+    rh = pfs_lsc_mgr.ht + __lsc_hash(puuid, name, namelen);
 
     xlock_lock(&rh->lock);
-    hlist_for_each_entry(le, n, &rh->h, hlist) {
-        if (strcmp(le->fullname, pathname) == 0) {
-            /* ok, we update the entry */
-            le->uuid = (u64)arg0;
-            le->salt = (u64)arg1;
-            le->born = *g_pfs_tick;
-            found = 1;
-            /* move to the head of lru list */
-            xlock_lock(&pfs_ltc_mgr.lru_lock);
-            list_del_init(&le->list);
-            list_add(&le->list, &pfs_ltc_mgr.lru);
-            xlock_unlock(&pfs_ltc_mgr.lru_lock);
+    hlist_for_each_entry_safe(le, pos, n, &rh->h, hlist) {
+        if (le->puuid == puuid && le->namelen == namelen &&
+            memcmp(le->name, name, namelen) == 0) {
+            /* keep the expired entry, __lsc_insert() or __lsc_drop() will
+             * handle it */
+            if (now < LE_EXPIRE(le)) {
+                *hs = le->hs;
+                hs->name = (char *)name;
+                found = 1;
+            }
             break;
         }
     }
-    if (unlikely(!found)) {
-        le = __ltc_new_entry(pathname, arg0, arg1);
-        if (likely(le)) {
-            found = 2;
-        }
-        /* insert to this hash list */
-        hlist_add_head(&le->hlist, &rh->h);
-        /* insert to the lru list */
-        xlock_lock(&pfs_ltc_mgr.lru_lock);
-        list_add(&le->list, &pfs_ltc_mgr.lru);
-        xlock_unlock(&pfs_ltc_mgr.lru_lock);
-    }
     xlock_unlock(&rh->lock);
-    
+
+    if (found)
+        atomic64_inc(&pfs_lsc_mgr.hit);
+    else
+        atomic64_inc(&pfs_lsc_mgr.miss);
+
     return found;
 }
 
-/* Return value: 0: miss; 1: hit; <0: error
- */
-static inline
-int __ltc_lookup(char *pathname, void *arg0, void *arg1)
+static void __lsc_insert(u64 puuid, u64 psalt, const char *name,
+                         struct hstat *hs, time_t born)
 {
     struct regular_hash *rh;
-    struct ltc_entry *le;
-    struct hlist_node *n;
-    int found = 0, idx;
+    struct lsc_entry *le, *nle;
+    struct hlist_node *pos, *n;
+    int namelen;
 
-    idx = __ltc_hash(pathname);
-    rh = pfs_ltc_mgr.ht + idx;
+    if (unlikely(!pfs_lsc_mgr.ht))
+        return;
+    if (born + LEASE_TTL(hs->mdu.dtime) - PFS_LSC_SLACK <= time(NULL))
+        return;
 
+    namelen = strlen(name);
+    nle = xmalloc(sizeof(*nle) + namelen);
+    if (!nle)
+        return;
+    nle->puuid = puuid;
+    nle->psalt = psalt;
+    nle->hs = *hs;
+    nle->hs.name = NULL;
+    nle->born = born;
+    nle->namelen = namelen;
+    memcpy(nle->name, name, namelen);
+
+    rh = pfs_lsc_mgr.ht + __lsc_hash(puuid, name, namelen);
+
+    /* replace the old entry, which lease has been overwritten by the new
+     * grant, and drop the entries surely expired on the MDS */
     xlock_lock(&rh->lock);
-    hlist_for_each_entry(le, n, &rh->h, hlist) {
-        if (LE_IS_VALID(le) && 
-            strcmp(pathname, le->fullname) == 0
-            ) {
-            *(u64 *)arg0 = le->uuid;
-            *(u64 *)arg1 = le->salt;
-            found = 1;
-            break;
+    hlist_for_each_entry_safe(le, pos, n, &rh->h, hlist) {
+        if ((le->puuid == puuid && le->namelen == namelen &&
+             memcmp(le->name, name, namelen) == 0) ||
+            time(NULL) >= LE_EXPIRE(le) + 2 * PFS_LSC_SLACK) {
+            hlist_del(&le->hlist);
+            xfree(le);
         }
     }
+    hlist_add_head(&nle->hlist, &rh->h);
     xlock_unlock(&rh->lock);
-
-    return found;
 }
 
-static inline
-void __ltc_invalid(const char *pathname)
+/* __lsc_drop() is called before we change the file (puuid, name). If we
+ * hold a lease on it, release it on the MDS, otherwise our own update would
+ * wait for it.
+ */
+static void __lsc_drop(u64 puuid, const char *name)
 {
     struct regular_hash *rh;
-    struct ltc_entry *le;
+    struct lsc_entry *le, *tle = NULL;
     struct hlist_node *pos, *n;
-    int idx;
+    int namelen;
+
+    if (unlikely(!pfs_lsc_mgr.ht))
+        return;
 
-    idx = __ltc_hash(pathname);
-    rh = pfs_ltc_mgr.ht + idx;
+    namelen = strlen(name);
+    rh = pfs_lsc_mgr.ht + __lsc_hash(puuid, name, namelen);
 
     xlock_lock(&rh->lock);
     hlist_for_each_entry_safe(le, pos, n, &rh->h, hlist) {
-        if (strcmp(pathname, le->fullname) == 0) {
-            le->born -= pfs_ltc_mgr.ttl;
+        if (le->puuid == puuid && le->namelen == namelen &&
+            memcmp(le->name, name, namelen) == 0) {
+            hlist_del(&le->hlist);
+            tle = le;
             break;
         }
     }
     xlock_unlock(&rh->lock);
+
+    if (tle) {
+        /* the lease may still live on the MDS even if it expired here */
+        __hvfs_lease_release(tle->puuid, tle->psalt, &tle->hs,
+                             tle->hs.mdu.dtime);
+        atomic64_inc(&pfs_lsc_mgr.release);
+        xfree(tle);
+    }
 }
 
 /* FUSE config support
@@ -1209,6 +2224,35 @@ static int hvfs_config_read(struct pfs_config_mgr *pcm, char *buf,
             break;
     }
 
+    /* dump the dentry translate cache statistics */
+    bs = snprintf(p, bl, "\n# Statistics\n"
+                  "dtc_hit:%ld\ndtc_nhit:%ld\ndtc_miss:%ld\n"
+                  "dtc_evict:%ld\ndtc_invalid:%ld\n"
+                  "lsc_hit:%ld\nlsc_miss:%ld\nlsc_release:%ld\n"
+                  "bhc_pages:%ld\nbhc_hit:%ld\nbhc_miss:%ld\n"
+                  "bhc_evict:%ld\nbhc_ra:%ld\nbhc_ra_drop:%ld\n"
+                  "wb_dirty:%ld\nwb_flush:%ld\nwb_throttle:%ld\n",
+                  atomic64_read(&pfs_dtc_mgr.hit),
+                  atomic64_read(&pfs_dtc_mgr.nhit),
+                  atomic64_read(&pfs_dtc_mgr.miss),
+                  atomic64_read(&pfs_dtc_mgr.evict),
+                  atomic64_read(&pfs_dtc_mgr.invalid),
+                  atomic64_read(&pfs_lsc_mgr.hit),
+                  atomic64_read(&pfs_lsc_mgr.miss),
+                  atomic64_read(&pfs_lsc_mgr.release),
+                  atomic64_read(&pfs_bhc_mgr.nr),
+                  atomic64_read(&pfs_bhc_mgr.hit),
+                  atomic64_read(&pfs_bhc_mgr.miss),
+                  atomic64_read(&pfs_bhc_mgr.evict),
+                  atomic64_read(&pfs_bhc_mgr.ra),
+                  atomic64_read(&pfs_bhc_mgr.ra_drop),
+                  atomic64_read(&pfs_wb_mgr.dirty),
+                  atomic64_read(&pfs_wb_mgr.flush),
+                  atomic64_read(&pfs_wb_mgr.throttle));
+    bs = min(bs, bl - 1);
+    p += bs;
+    bl -= bs;
+
     /* check the offset */
     if (offset >= (PCM_BUF_SIZE - bl))
         return 0;
@@ -1225,10 +2269,11 @@ static int hvfs_config_read(struct pfs_config_mgr *pcm, char *buf,
 static int hvfs_getattr(const char *pathname, struct stat *stbuf)
 {
     struct hstat hs = {0,};
-    char *dup = strdup(pathname), *path, *name, *spath = NULL;
-    char *p = NULL, *n, *s = NULL;
+    char *dup = strdup(pathname), *path, *name;
     u64 puuid = hmi.root_uuid, psalt = hmi.root_salt;
-    int err = 0;
+    u64 lease = 0, hash;
+    time_t born = 0;
+    int err = 0, flag;
 
     {
         struct soc_entry *se = __soc_lookup(pathname);
@@ -1241,67 +2286,46 @@ static int hvfs_getattr(const char *pathname, struct stat *stbuf)
     }
 
     SPLIT_PATHNAME(dup, path, name);
-    n = path;
 
     if (unlikely(hvfs_config_check(name, stbuf))) {
         goto out;
     }
 
-    spath = strdup(path);
-    err = __ltc_lookup(spath, &puuid, &psalt);
-    if (err > 0) {
-        goto hit;
-    }
-
-    /* parse the path and do __stat on each directory */
-    do {
-        p = strtok_r(n, "/", &s);
-        if (!p) {
-            /* end */
-            break;
-        }
-        hvfs_debug(xnet, "token: %s\n", p);
-        /* ok, we should do stat on this directory based on the puuid, psalt
-         * we got */
-        /* Step 1: find in the SDT, zero uuid means using name to lookup */
-        hs.name = p;
-        hs.uuid = 0;
-        err = __hvfs_stat(puuid, psalt, 0, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (SDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        puuid = hs.uuid;
-        hs.hash = 0;
-        /* Step 2: find in the GDT */
-        err = __hvfs_stat(hmi.gdt_uuid, hmi.gdt_salt, 0, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (GDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        psalt = hs.ssalt;
-    } while (!(n = NULL));
-
-    if (unlikely(err)) {
+    err = __dtc_walk(path, &puuid, &psalt);
+    if (err) {
         goto out;
     }
 
-    __ltc_update(spath, (void *)puuid, (void *)psalt);
-hit:
     /* lookup the file in the parent directory now */
     if (strlen(name) > 0) {
         /* eh, we have to lookup this file now. Otherwise, what we want to
          * lookup is the last directory, just return a result string now */
         hs.name = name;
         hs.uuid = 0;
-        err = __hvfs_stat(puuid, psalt, 0, &hs);
+        /* a leased hstat or a cached negative dentry saves the SDT lookup */
+        if (__lsc_lookup(puuid, name, &hs)) {
+            goto merge;
+        }
+        if (__dtc_lookup(puuid, name, &hs.uuid, &hs.ssalt) == -ENOENT) {
+            err = -ENOENT;
+            goto out;
+        }
+        hs.uuid = 0;
+        born = time(NULL);
+        /* do not take the lease on a file opened for write, we would update
+         * it soon and the lease only stalls us */
+        hash = hvfs_hash(puuid, (u64)name, strlen(name), HASH_SEL_EH);
+        flag = INDEX_ITE_ACTIVE;
+        if (!__odc_writing(puuid, hash))
+            flag |= INDEX_LEASE;
+        err = __hvfs_stat_ext(puuid, psalt, 0, flag, &hs);
         if (err) {
             hvfs_debug(xnet, "do internal file stat (SDT) on '%s'"
                        " failed w/ %d puuid %lx psalt %lx (%s RT %lx %lx)\n", 
                        name, err, puuid, psalt,
                        path, hmi.root_uuid, hmi.root_salt);
+            if (err == -ENOENT)
+                __dtc_update(puuid, name, 0, 0);
             goto out;
         }
         if (S_ISDIR(hs.mdu.mode)) {
@@ -1313,6 +2337,11 @@ hit:
                          name, hs.uuid, hs.hash, err);
                 goto out;
             }
+            __dtc_update(puuid, name, hs.uuid, hs.ssalt);
+        } else if ((hs.mdu.dtime & (LEASE_READ | LEASE_RECALL)) ==
+                   LEASE_READ && hs.puuid == puuid && hs.hash == hash) {
+            /* it is our lease, not the one of a link source */
+            lease = hs.mdu.dtime;
         }
     } else {
         /* check if it the root directory */
@@ -1326,6 +2355,7 @@ hit:
         }
     }
 
+merge:
     /* update hs w/ local ODC cached hstat */
     {
         struct bhhead *bhh = __odc_lookup(hs.uuid);
@@ -1346,9 +2376,17 @@ hit:
                 hs.mc = bhh->hs.mc;
                 hs.mdu.size = bhh->asize;
             }
+            /* the opened file (maybe by a hard link name) would be updated
+             * by ourself soon, do not hold the lease */
+            if (lease && (bhh->flag & BH_UPDATE)) {
+                __hvfs_lease_release(puuid, psalt, &hs, lease);
+                lease = 0;
+            }
             __put_bhhead(bhh);
         }
     }
+    if (lease)
+        __lsc_insert(puuid, psalt, name, &hs, born);
 
 pack:
     /* pack the result to stat buffer */
@@ -1374,7 +2412,6 @@ pack:
     
 out:
     xfree(dup);
-    xfree(spath);
 
     return err;
 }
@@ -1385,58 +2422,18 @@ out:
 static int hvfs_readlink(const char *pathname, char *buf, size_t size)
 {
     struct hstat hs = {0,};
-    char *dup = strdup(pathname), *path, *name, *spath = NULL;
-    char *p = NULL, *n, *s = NULL;
+    char *dup = strdup(pathname), *path, *name;
     u64 puuid = hmi.root_uuid, psalt = hmi.root_salt;
     ssize_t rlen;
     int err = 0;
 
     SPLIT_PATHNAME(dup, path, name);
-    n = path;
-
-    spath = strdup(path);
-    err = __ltc_lookup(spath, &puuid, &psalt);
-    if (err > 0) {
-        goto hit;
-    }
-
-    /* parse the path and do __stat on each directory */
-    do {
-        p = strtok_r(n, "/", &s);
-        if (!p) {
-            /* end */
-            break;
-        }
-        hvfs_debug(xnet, "token: %s\n", p);
-        /* ok, we should do stat on this directory based on the puuid, psalt
-         * we got */
-        /* Step 1: find in the SDT, zero uuid means using name to lookup */
-        hs.name = p;
-        hs.uuid = 0;
-        err = __hvfs_stat(puuid, psalt, 0, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (SDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        puuid = hs.uuid;
-        hs.hash = 0;
-        /* Step 2: find in the GDT */
-        err = __hvfs_stat(hmi.gdt_uuid, hmi.gdt_salt, 0, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (GDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        psalt = hs.ssalt;
-    } while (!(n = NULL));
 
+    err = __dtc_walk(path, &puuid, &psalt);
     if (err) {
         goto out;
     }
 
-    __ltc_update(spath, (void *)puuid, (void *)psalt);
-hit:
     /* lookup the file in the parent directory now */
     if (name && strlen(name) > 0 && strcmp(name, "/") != 0) {
         /* eh, we have to lookup this file now. Otherwise, what we want to
@@ -1483,7 +2480,6 @@ hit:
 
 out:
     xfree(dup);
-    xfree(spath);
     
     return err;
 }
@@ -1492,54 +2488,17 @@ static int hvfs_mknod(const char *pathname, mode_t mode, dev_t rdev)
 {
     struct hstat hs;
     struct mdu_update mu;
-    char *dup = strdup(pathname), *path, *name, *spath = NULL;
-    char *p = NULL, *n, *s = NULL;
+    char *dup = strdup(pathname), *path, *name;
     u64 puuid = hmi.root_uuid, psalt = hmi.root_salt;
     int err = 0;
 
     SPLIT_PATHNAME(dup, path, name);
-    n = path;
-
-    spath = strdup(path);
-    err = __ltc_lookup(spath, &puuid, &psalt);
-    if (err > 0) {
-        goto hit;
-    }
-
-    /* parse the path and do __stat on each directory */
-    do {
-        p = strtok_r(n, "/", &s);
-        if (!p) {
-            /* end */
-            break;
-        }
-        hs.name = p;
-        hs.uuid = 0;
-        /* Step 1: find in the SDT */
-        err = __hvfs_stat(puuid, psalt, -1, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (SDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        puuid = hs.uuid;
-        hs.hash = 0;
-        /* Step 2: find in the GDT */
-        err = __hvfs_stat(hmi.gdt_uuid, hmi.gdt_salt, -1, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (GDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        psalt = hs.ssalt;
-    } while (!(n = NULL));
 
+    err = __dtc_walk(path, &puuid, &psalt);
     if (err) {
         goto out;
     }
 
-    __ltc_update(spath, (void *)puuid, (void *)psalt);
-hit:
     /* create the file or dir in the parent directory now */
     hs.name = name;
     hs.uuid = 0;
@@ -1552,10 +2511,10 @@ hit:
                  name, err);
         goto out;
     }
+    __dtc_invalid(puuid, name);
 
 out:
     xfree(dup);
-    xfree(spath);
     
     return err;
 }
@@ -1564,54 +2523,17 @@ static int hvfs_mkdir(const char *pathname, mode_t mode)
 {
     struct hstat hs = {0,};
     struct mdu_update mu;
-    char *dup = strdup(pathname), *path, *name, *spath = NULL;
-    char *p = NULL, *n, *s = NULL;
+    char *dup = strdup(pathname), *path, *name;
     u64 puuid = hmi.root_uuid, psalt = hmi.root_salt, duuid;
     int err = 0;
 
     SPLIT_PATHNAME(dup, path, name);
-    n = path;
-
-    spath = strdup(path);
-    err = __ltc_lookup(spath, &puuid, &psalt);
-    if (err > 0) {
-        goto hit;
-    }
-
-    /* parse the path and do __stat on each directory */
-    do {
-        p = strtok_r(n, "/", &s);
-        if (!p) {
-            /* end */
-            break;
-        }
-        hs.name = p;
-        hs.uuid = 0;
-        /* Step 1: find in the SDT */
-        err = __hvfs_stat(puuid, psalt, -1, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (SDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        puuid = hs.uuid;
-        hs.hash = 0;
-        /* Step 2: find in the GDT */
-        err = __hvfs_stat(hmi.gdt_uuid, hmi.gdt_salt, -1, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (GDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        psalt = hs.ssalt;
-    } while (!(n = NULL));
 
+    err = __dtc_walk(path, &puuid, &psalt);
     if (err) {
         goto out;
     }
 
-    __ltc_update(spath, (void *)puuid, (void *)psalt);
-hit:
     /* create the file or dir in the parent directory now */
     hs.name = name;
     hs.uuid = 0;
@@ -1633,11 +2555,10 @@ hit:
                  name, err);
         goto out;
     }
-    __ltc_update((char *)pathname, (void *)hs.uuid, (void *)hs.ssalt);
+    __dtc_update(puuid, name, hs.uuid, hs.ssalt);
 
 out:
     xfree(dup);
-    xfree(spath);
     
     return err;
 }
@@ -1645,60 +2566,18 @@ out:
 static int hvfs_unlink(const char *pathname)
 {
     struct hstat hs = {0,};
-    char *dup = strdup(pathname), *path, *name, *spath = NULL;
-    char *p = NULL, *n, *s = NULL;
-    u64 saved_puuid = hmi.root_uuid, saved_psalt = hmi.root_salt;
-    u64 saved_hash = 0;
+    char *dup = strdup(pathname), *path, *name;
     u64 puuid = hmi.root_uuid, psalt = hmi.root_salt;
     int err = 0;
 
     SPLIT_PATHNAME(dup, path, name);
-    n = path;
-
-    spath = strdup(path);
-    err = __ltc_lookup(spath, &puuid, &psalt);
-    if (err > 0) {
-        goto hit;
-    }
-
-    /* parse the path and do __stat on each directory */
-    do {
-        p = strtok_r(n, "/", &s);
-        if (!p) {
-            /* end */
-            break;
-        }
-        hs.name = p;
-        hs.uuid = 0;
-        /* Step 1: find in the SDT */
-        saved_psalt = psalt;
-        saved_puuid = puuid;
-        err = __hvfs_stat(puuid, psalt, -1, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (SDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        saved_hash = hs.hash;
-        puuid = hs.uuid;
-        hs.hash = 0;
-        /* Step 2: find in the GDT */
-        err = __hvfs_stat(hmi.gdt_uuid, hmi.gdt_salt, -1, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (GDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        /* got current directory's salt in hs.ssalt */
-        psalt = hs.ssalt;
-    } while (!(n = NULL));
 
+    err = __dtc_walk(path, &puuid, &psalt);
     if (err) {
         goto out;
     }
+    __lsc_drop(puuid, name);
 
-    __ltc_update(spath, (void *)puuid, (void *)psalt);
-hit:
     /* finally, do delete now */
     hs.name = name;
     hs.uuid = 0;
@@ -1712,7 +2591,6 @@ hit:
 
 out:
     xfree(dup);
-    xfree(spath);
     
     return err;
 }
@@ -1720,60 +2598,17 @@ out:
 static int hvfs_rmdir(const char *pathname)
 {
     struct hstat hs = {0,};
-    char *dup = strdup(pathname), *path, *name, *spath = NULL;
-    char *p = NULL, *n, *s = NULL;
-    u64 saved_puuid = hmi.root_uuid, saved_psalt = hmi.root_salt;
-    u64 saved_hash = 0;
-    u64 puuid = hmi.root_uuid, psalt = hmi.root_salt;
-    int err = 0;
-
-    SPLIT_PATHNAME(dup, path, name);
-    n = path;
-
-    spath = strdup(path);
-    err = __ltc_lookup(spath, &puuid, &psalt);
-    if (err > 0) {
-        goto hit;
-    }
+    char *dup = strdup(pathname), *path, *name;
+    u64 puuid = hmi.root_uuid, psalt = hmi.root_salt;
+    int err = 0;
 
-    /* parse the path and do __stat on each directory */
-    do {
-        p = strtok_r(n, "/", &s);
-        if (!p) {
-            /* end */
-            break;
-        }
-        hs.name = p;
-        hs.uuid = 0;
-        /* Step 1: find in the SDT */
-        saved_psalt = psalt;
-        saved_puuid = puuid;
-        err = __hvfs_stat(puuid, psalt, -1, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (SDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        saved_hash = hs.hash;
-        puuid = hs.uuid;
-        hs.hash = 0;
-        /* Step 2: find in the GDT */
-        err = __hvfs_stat(hmi.gdt_uuid, hmi.gdt_salt, -1, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (GDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        /* got current directory's salt in hs.ssalt */
-        psalt = hs.ssalt;
-    } while (!(n = NULL));
+    SPLIT_PATHNAME(dup, path, name);
 
+    err = __dtc_walk(path, &puuid, &psalt);
     if (err) {
         goto out;
     }
 
-    __ltc_update(spath, (void *)puuid, (void *)psalt);
-hit:
     /* finally, do delete now */
     if (strlen(name) == 0 || strcmp(name, "/") == 0) {
         /* what we want to delete is the root directory, reject it */
@@ -1837,12 +2672,12 @@ hit:
                      name, err);
             goto out;
         }
-        __ltc_invalid(pathname);
+        __dtc_invalid(puuid, name);
+        __dtc_invalid_uuid(duuid);
     }
 
 out:
     xfree(dup);
-    xfree(spath);
     
     return err;
 }
@@ -1851,53 +2686,17 @@ static int hvfs_symlink(const char *from, const char *to)
 {
     struct hstat hs;
     struct mdu_update *mu;
-    char *dup = strdup(to), *path, *name, *spath = NULL;
-    char *p = NULL, *n, *s = NULL;
+    char *dup = strdup(to), *path, *name;
     u64 puuid = hmi.root_uuid, psalt = hmi.root_salt;
     int err = 0, namelen;
 
     SPLIT_PATHNAME(dup, path, name);
-    n = path;
-
-    spath = strdup(path);
-    err = __ltc_lookup(spath, &puuid, &psalt);
-    if (err > 0) {
-        goto hit;
-    }
-
-    /* parse the path and do __stat on each directory */
-    do {
-        p = strtok_r(n, "/", &s);
-        if (!p) {
-            /* end */
-            break;
-        }
-        hs.name = p;
-        hs.uuid = 0;
-        /* Step 1: find in the SDT */
-        err = __hvfs_stat(puuid, psalt, -1, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (SDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        puuid = hs.uuid;
-        hs.hash = 0;
-        /* Step 2: find in the GDT */
-        err = __hvfs_stat(hmi.gdt_uuid, hmi.gdt_salt, -1, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (GDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        psalt = hs.ssalt;
-    } while (!(n = NULL));
 
-    if (err)
+    err = __dtc_walk(path, &puuid, &psalt);
+    if (err) {
         goto out;
+    }
 
-    __ltc_update(spath, (void *)puuid, (void *)psalt);
-hit:
     /* create the file or dir in the parent directory now */
     if (strlen(name) == 0 || strcmp(name, "/") == 0) {
         hvfs_err(xnet, "Create zero-length named file or root directory?\n");
@@ -1929,6 +2728,7 @@ hit:
             xfree(mu);
             goto out;
         }
+        __dtc_invalid(puuid, name);
         xfree(mu);
     } else {
         struct column saved_c;
@@ -1963,6 +2763,7 @@ hit:
             xfree(mu);
             goto out;
         }
+        __dtc_invalid(puuid, name);
 
         /* finally, update the newly created symlink file */
         mu->valid = MU_SIZE | MU_COLUMN;
@@ -1982,7 +2783,6 @@ hit:
 
 out:
     xfree(dup);
-    xfree(spath);
     
     return err;
 }
@@ -1997,8 +2797,7 @@ static int hvfs_rename(const char *from, const char *to)
     struct link_source ls;
     struct hstat hs, saved_hs, deleted_hs = {.uuid = 0, .mdu.mode = 0,};
     char *dup = strdup(from), *dup2 = strdup(from), 
-        *path, *name, *spath = NULL, *sname;
-    char *p = NULL, *n, *s = NULL;
+        *path, *name, *sname;
     u64 puuid = hmi.root_uuid, psalt = hmi.root_salt;
     int err = 0, create_link = 0;
 
@@ -2006,51 +2805,13 @@ static int hvfs_rename(const char *from, const char *to)
     path = dirname(dup);
     name = basename(dup2);
     sname = strdup(name);
-    n = path;
-
-    spath = strdup(path);
-    err = __ltc_lookup(spath, &puuid, &psalt);
-    if (err > 0) {
-        goto hit;
-    }
-
-    /* parse the path and do __stat on each directory */
-    do {
-        p = strtok_r(n, "/", &s);
-        if (!p) {
-            /* end */
-            break;
-        }
-        hvfs_debug(xnet, "token: %s\n", p);
-        /* ok, we should do stat on this directory based on the puuid, psalt
-         * we got */
-        /* Step 1: find in the SDT, zero uuid means using name to lookup */
-        hs.name = p;
-        hs.uuid = 0;
-        err = __hvfs_stat(puuid, psalt, 0, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (SDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        puuid = hs.uuid;
-        hs.hash = 0;
-        /* Step 2: find in the GDT */
-        err = __hvfs_stat(hmi.gdt_uuid, hmi.gdt_salt, 0, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (GDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        psalt = hs.ssalt;
-    } while (!(n = NULL));
 
+    err = __dtc_walk(path, &puuid, &psalt);
     if (err) {
         goto out;
     }
+    __lsc_drop(puuid, name);
 
-    __ltc_update(spath, (void *)puuid, (void *)psalt);
-hit:
     if (name && strlen(name) > 0 && strcmp(name, "/") != 0) {
         /* eh, we have to lookup this file now. Otherwise, what we want to
          * lookup is the last directory, just return a result string now */
@@ -2083,7 +2844,9 @@ hit:
             hs.name = name;
             /* if the 'from' file is dirty, we should sync it */
             if (bhh->flag & BH_DIRTY) {
-                __bh_sync(bhh);
+                __bh_flush(bhh);
+                hs = bhh->hs;
+                hs.name = name;
             }
             __put_bhhead(bhh);
         }
@@ -2135,7 +2898,6 @@ hit:
     /* cleanup */
     xfree(dup);
     xfree(dup2);
-    xfree(spath);
 
     /* do new create now */
     dup = strdup(to);
@@ -2145,48 +2907,13 @@ hit:
 
     path = dirname(dup);
     name = basename(dup2);
-    n = path;
-
-    spath = strdup(path);
-    err = __ltc_lookup(spath, &puuid, &psalt);
-    if (err > 0) {
-        goto hit2;
-    }
-
-    /* parse the path and do __stat on each directory */
-    do {
-        p = strtok_r(n, "/", &s);
-        if (!p) {
-            /* end */
-            break;
-        }
-        hs.name = p;
-        hs.uuid = 0;
-        /* Step 1: find in the SDT */
-        err = __hvfs_stat(puuid, psalt, -1, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (SDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        puuid = hs.uuid;
-        hs.hash = 0;
-        /* Step 2: find in the GDT */
-        err = __hvfs_stat(hmi.gdt_uuid, hmi.gdt_salt, -1, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (GDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        psalt = hs.ssalt;
-    } while (!(n = NULL));
 
+    err = __dtc_walk(path, &puuid, &psalt);
     if (err) {
         goto out_rollback;
     }
+    __lsc_drop(puuid, name);
 
-    __ltc_update(spath, (void *)puuid, (void *)psalt);
-hit2:
     if (name && strlen(name) > 0 && strcmp(name, "/") != 0) {
         /* final stat on target */
         hs.name = name;
@@ -2365,7 +3092,10 @@ hit2:
                      deleted_hs.uuid, deleted_hs.hash, err);
             /* ignore this error */
         }
+        __dtc_invalid_uuid(deleted_hs.uuid);
     }
+    __dtc_invalid(saved_hs.puuid, sname);
+    __dtc_invalid(puuid, name);
 
     hvfs_err(xnet, "rename from %s(%lx,%lx) to %s(%lx,%lx)\n",
              from, saved_hs.uuid, saved_hs.hash, to, hs.uuid, hs.hash);
@@ -2373,7 +3103,6 @@ out:
     xfree(sname);
     xfree(dup);
     xfree(dup2);
-    xfree(spath);
 
     return err;
 out_rollback4:
@@ -2418,59 +3147,20 @@ static int hvfs_link(const char *from, const char *to)
     struct link_source ls;
     struct hstat hs;
     char *dup = strdup(from), *dup2 = strdup(from), 
-        *path, *name, *spath = NULL;
-    char *p = NULL, *n, *s = NULL;
+        *path, *name;
     u64 puuid = hmi.root_uuid, psalt = hmi.root_salt;
     int err = 0;
 
     /* Step 1: get the stat info of 'from' file */
     path = dirname(dup);
     name = basename(dup2);
-    n = path;
-
-    spath = strdup(path);
-    err = __ltc_lookup(spath, &puuid, &psalt);
-    if (err > 0) {
-        goto hit;
-    }
-
-    /* parse the path and do __stat on each directory */
-    do {
-        p = strtok_r(n, "/", &s);
-        if (!p) {
-            /* end */
-            break;
-        }
-        hvfs_debug(xnet, "token: %s\n", p);
-        /* ok, we should do stat on this directory based on the puuid, psalt
-         * we got */
-        /* Step 1: find in the SDT, zero uuid means using name to lookup */
-        hs.name = p;
-        hs.uuid = 0;
-        err = __hvfs_stat(puuid, psalt, 0, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (SDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        puuid = hs.uuid;
-        hs.hash = 0;
-        /* Step 2: find in the GDT */
-        err = __hvfs_stat(hmi.gdt_uuid, hmi.gdt_salt, 0, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (GDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        psalt = hs.ssalt;
-    } while (!(n = NULL));
 
+    err = __dtc_walk(path, &puuid, &psalt);
     if (err) {
         goto out;
     }
+    __lsc_drop(puuid, name);
 
-    __ltc_update(spath, (void *)puuid, (void *)psalt);
-hit:
     if (name && strlen(name) > 0 && strcmp(name, "/") != 0) {
         /* eh, we have to lookup this file now. Otherwise, what we want to
          * lookup is the last directory, just return a result string now */
@@ -2521,7 +3211,6 @@ hit:
     /* cleanup */
     xfree(dup);
     xfree(dup2);
-    xfree(spath);
 
     /* Step 2: construct the new LS entry */
     dup = strdup(to);
@@ -2531,48 +3220,12 @@ hit:
     
     path = dirname(dup);
     name = basename(dup2);
-    n = path;
-
-    spath = strdup(path);
-    err = __ltc_lookup(spath, &puuid, &psalt);
-    if (err > 0) {
-        goto hit2;
-    }
-
-    /* parse the path and do __stat on each directory */
-    do {
-        p = strtok_r(n, "/", &s);
-        if (!p) {
-            /* end */
-            break;
-        }
-        hs.name = p;
-        hs.uuid = 0;
-        /* Step 1: find in the SDT */
-        err = __hvfs_stat(puuid, psalt, -1, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (SDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        puuid = hs.uuid;
-        hs.hash = 0;
-        /* Step 2: find in the GDT */
-        err = __hvfs_stat(hmi.gdt_uuid, hmi.gdt_salt, -1, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (GDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        psalt = hs.ssalt;
-    } while (!(n = NULL));
 
+    err = __dtc_walk(path, &puuid, &psalt);
     if (err) {
         goto out;
     }
 
-    __ltc_update(spath, (void *)puuid, (void *)psalt);
-hit2:
     /* create the file or dir in the parent directory now */
     if (strlen(name) == 0 || strcmp(name, "/") == 0) {
         hvfs_err(xnet, "Create zero-length named file or root directory?\n");
@@ -2580,77 +3233,40 @@ hit2:
         goto out;
     }
     
-    hs.name = name;
-    hs.uuid = 0;
-    err = __hvfs_create(puuid, psalt, &hs, INDEX_CREATE_LINK, 
-                        (struct mdu_update *)&ls);
-    if (err) {
-        hvfs_err(xnet, "do internal create (SDT) on '%s' failed w/ %d\n",
-                 name, err);
-        goto out;
-    }
-
-out:
-    xfree(dup);
-    xfree(dup2);
-    xfree(spath);
-    
-    return err;
-}
-
-static int hvfs_chmod(const char *pathname, mode_t mode)
-{
-    struct hstat hs = {0,};
-    struct mdu_update mu;
-    char *dup = strdup(pathname), *path, *name, *spath = NULL;
-    char *p = NULL, *n, *s = NULL;
-    u64 puuid = hmi.root_uuid, psalt = hmi.root_salt;
-    int err = 0;
-
-    SPLIT_PATHNAME(dup, path, name);
-    n = path;
-
-    spath = strdup(path);
-    err = __ltc_lookup(spath, &puuid, &psalt);
-    if (err > 0) {
-        goto hit;
-    }
-
-    /* parse the path and do __stat on each directory */
-    do {
-        p = strtok_r(n, "/", &s);
-        if (!p) {
-            /* end */
-            break;
-        }
-        hs.name = p;
-        hs.uuid = 0;
-        /* Step 1: find in the SDT */
-        err = __hvfs_stat(puuid, psalt, -1, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (SDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        puuid = hs.uuid;
-        hs.hash = 0;
-        /* Step 2: find in the GDT */
-        err = __hvfs_stat(hmi.gdt_uuid, hmi.gdt_salt, -1, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (GDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        /* got current directory's salt in hs.ssalt */
-        psalt = hs.ssalt;
-    } while (!(n = NULL));
-
+    hs.name = name;
+    hs.uuid = 0;
+    err = __hvfs_create(puuid, psalt, &hs, INDEX_CREATE_LINK, 
+                        (struct mdu_update *)&ls);
     if (err) {
+        hvfs_err(xnet, "do internal create (SDT) on '%s' failed w/ %d\n",
+                 name, err);
         goto out;
     }
+    __dtc_invalid(puuid, name);
+
+out:
+    xfree(dup);
+    xfree(dup2);
     
-    __ltc_update(spath, (void *)puuid, (void *)psalt);
-hit:
+    return err;
+}
+
+static int hvfs_chmod(const char *pathname, mode_t mode)
+{
+    struct hstat hs = {0,};
+    struct mdu_update mu;
+    char *dup = strdup(pathname), *path, *name;
+    u64 puuid = hmi.root_uuid, psalt = hmi.root_salt;
+    int err = 0;
+
+    SPLIT_PATHNAME(dup, path, name);
+
+    err = __dtc_walk(path, &puuid, &psalt);
+    if (err) {
+        goto out;
+    }
+    __lsc_drop(puuid, name);
+
     mu.valid = MU_MODE;
     mu.mode = mode;
 
@@ -2694,7 +3310,6 @@ hit:
 
 out:
     xfree(dup);
-    xfree(spath);
     
     return err;    
 }
@@ -2760,6 +3375,7 @@ static int hvfs_chown(const char *pathname, uid_t uid, gid_t gid)
         }
     } else {
         /* update the final file by name */
+        __lsc_drop(puuid, name);
         hs.name = name;
         hs.uuid = 0;
         err = __hvfs_update(puuid, psalt, &hs, &mu);
@@ -2845,6 +3461,7 @@ static int hvfs_truncate(const char *pathname, off_t size)
     if (name && strlen(name) > 0 && strcmp(name, "/") != 0) {
         /* eh, we have to lookup this file now. Otherwise, what we want to
          * lookup is the last directory, just return a result string now */
+        __lsc_drop(puuid, name);
         hs.name = name;
         hs.uuid = 0;
         err = __hvfs_stat(puuid, psalt, 0, &hs);
@@ -2864,6 +3481,29 @@ static int hvfs_truncate(const char *pathname, off_t size)
         goto out;
     }
 
+    /* the write-behind data should land before the truncate */
+    {
+        struct bhhead *bhh = __odc_lookup(hs.uuid);
+        int dirty = 0;
+
+        if (bhh) {
+            if (bhh->flag & BH_DIRTY) {
+                __bh_flush(bhh);
+                dirty = 1;
+            }
+            __put_bhhead(bhh);
+        }
+        if (dirty) {
+            hs.uuid = 0;
+            err = __hvfs_stat(puuid, psalt, 0, &hs);
+            if (err) {
+                hvfs_err(xnet, "do internal file stat (SDT) on '%s' "
+                         "failed w/ %d\n", name, err);
+                goto out;
+            }
+        }
+    }
+
     /* check the file length now */
     if (size > hs.mdu.size) {
         void *data;
@@ -2967,6 +3607,10 @@ static int hvfs_ftruncate(const char *pathname, off_t size,
         return -EINVAL;
     }
 
+    /* the write-behind data should land before the truncate */
+    if (bhh->flag & BH_DIRTY)
+        __bh_flush(bhh);
+
     hs = bhh->hs;
 
     /* check the file length now */
@@ -3061,55 +3705,18 @@ static int hvfs_utime(const char *pathname, struct utimbuf *buf)
 {
     struct hstat hs = {0,};
     struct mdu_update mu;
-    char *dup = strdup(pathname), *path, *name, *spath = NULL;
-    char *p = NULL, *n, *s = NULL;
+    char *dup = strdup(pathname), *path, *name;
     u64 puuid = hmi.root_uuid, psalt = hmi.root_salt;
     int err = 0;
 
     SPLIT_PATHNAME(dup, path, name);
-    n = path;
-
-    spath = strdup(path);
-    err = __ltc_lookup(spath, &puuid, &psalt);
-    if (err > 0) {
-        goto hit;
-    }
-
-    /* parse the path and do __stat on each directory */
-    do {
-        p = strtok_r(n, "/", &s);
-        if (!p) {
-            /* end */
-            break;
-        }
-        hs.name = p;
-        hs.uuid = 0;
-        /* Step 1: find in the SDT */
-        err = __hvfs_stat(puuid, psalt, -1, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (SDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        puuid = hs.uuid;
-        hs.hash = 0;
-        /* Step 2: find in the GDT */
-        err = __hvfs_stat(hmi.gdt_uuid, hmi.gdt_salt, -1, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (GDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        /* got current directory's salt in hs.ssalt */
-        psalt = hs.ssalt;
-    } while (!(n = NULL));
 
+    err = __dtc_walk(path, &puuid, &psalt);
     if (err) {
         goto out;
     }
+    __lsc_drop(puuid, name);
 
-    __ltc_update(spath, (void *)puuid, (void *)psalt);
-hit:
     
     mu.valid = MU_ATIME | MU_MTIME;
     mu.atime = buf->actime;
@@ -3156,7 +3763,6 @@ hit:
 
 out:
     xfree(dup);
-    xfree(spath);
     
     return err;    
 }
@@ -3164,61 +3770,21 @@ out:
 static int hvfs_open(const char *pathname, struct fuse_file_info *fi)
 {
     struct hstat hs = {0,};
-    char *dup = strdup(pathname), *path, *name, *spath = NULL;
-    char *p = NULL, *n, *s = NULL;
+    char *dup = strdup(pathname), *path, *name;
     u64 puuid = hmi.root_uuid, psalt = hmi.root_salt;
     int err = 0;
 
     SPLIT_PATHNAME(dup, path, name);
-    n = path;
 
     /* check if it is the config file */
     if (hvfs_config_open(name, fi))
         goto out;
 
-    spath = strdup(path);
-    err = __ltc_lookup(spath, &puuid, &psalt);
-    if (err > 0) {
-        goto hit;
-    }
-    
-    /* parse the path and do __stat on each directory */
-    do {
-        p = strtok_r(n, "/", &s);
-        if (!p) {
-            /* end */
-            break;
-        }
-        hvfs_debug(xnet, "token: %s\n", p);
-        /* ok, we should do stat on this directory based on the puuid, psalt
-         * we got */
-        /* Step 1: find in the SDT, zero uuid means using name to lookup */
-        hs.name = p;
-        hs.uuid = 0;
-        err = __hvfs_stat(puuid, psalt, 0, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (SDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        puuid = hs.uuid;
-        hs.hash = 0;
-        /* Step 2: find in the GDT */
-        err = __hvfs_stat(hmi.gdt_uuid, hmi.gdt_salt, 0, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (GDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        psalt = hs.ssalt;
-    } while (!(n = NULL));
-
+    err = __dtc_walk(path, &puuid, &psalt);
     if (err) {
         goto out;
     }
 
-    __ltc_update(spath, (void *)puuid, (void *)psalt);
-hit:
     /* eh, we have to lookup this file now. Otherwise, what we want to lookup
      * is the last directory, just return a result string now */
     hs.name = name;
@@ -3235,6 +3801,15 @@ hit:
     }
 
     fi->fh = (u64)__get_bhhead(&hs);
+    /* we would update the mdu on write or atime, drop our lease now */
+    if ((fi->flags & O_ACCMODE) != O_RDONLY || (fi->flags & O_TRUNC) ||
+        !pfs_fuse_mgr.noatime) {
+        struct bhhead *bhh = (struct bhhead *)fi->fh;
+
+        if (bhh)
+            __set_bhh_update(bhh);
+        __lsc_drop(puuid, name);
+    }
     /* we should restat the file to detect any new file syncs */
 #ifdef FUSE_SAFE_OPEN
     {
@@ -3258,7 +3833,6 @@ hit:
 
 out:
     xfree(dup);
-    xfree(spath);
 
     return err;
 }
@@ -3269,7 +3843,7 @@ static int hvfs_read(const char *pathname, char *buf, size_t size,
     struct hstat hs;
     struct bhhead *bhh = (struct bhhead *)fi->fh;
     ssize_t rlen;
-    int err = 0, bytes = 0;
+    int err = 0;
 
     /* is config_read() ? */
     if (unlikely(bhh->flag & BH_CONFIG)) {
@@ -3279,9 +3853,18 @@ static int hvfs_read(const char *pathname, char *buf, size_t size,
 
     hs = bhh->hs;
 
+    /* issue the read-ahead window first, it overlaps w/ our own read */
+    __bh_readahead(bhh, offset, size);
+
     err = __bh_read(bhh, buf, offset, size);
     if (err == -EFBIG) {
-        /* read in the data now */
+        /* read in the holes in one request, then retry */
+        err = __bh_readin(bhh, &hs, offset, size);
+        if (err >= 0)
+            err = __bh_read(bhh, buf, offset, size);
+    }
+    if (err < 0) {
+        /* the pages are evicted or the readin failed, read it directly */
         rlen = __hvfs_fread(&hs, 0 /* column is ZERO */, (void **)&buf, 
                             &hs.mc.c, offset, size);
         if (rlen < 0) {
@@ -3295,19 +3878,7 @@ static int hvfs_read(const char *pathname, char *buf, size_t size,
             }
             goto out;
         }
-        bytes = rlen;
-        err = __bh_fill(&hs, 0, &hs.mc.c, bhh, buf, offset, rlen);
-        if (err < 0) {
-            hvfs_err(xnet, "fill the buffer cache failed w/ %d\n",
-                     err);
-            goto out;
-        }
-        /* restore the bytes */
-        err = bytes;
-    } else if (err < 0) {
-        hvfs_err(xnet, "buffer cache read '%s' failed w/ %d\n", 
-                 pathname, err);
-        goto out;
+        err = rlen;
     }
     /* return the # of bytes we read */
     if (!pfs_fuse_mgr.noatime && err > 0) {
@@ -3475,7 +4046,6 @@ static int hvfs_cached_write(const char *pathname, const char *buf,
         return -EINVAL;
 
     hs = bhh->hs;
-    __set_bhh_dirty(bhh);
     if (offset + size > bhh->asize)
         bhh->asize = offset + size;
 
@@ -3485,6 +4055,7 @@ static int hvfs_cached_write(const char *pathname, const char *buf,
                  err);
         goto out;
     }
+    __wb_dirty(bhh);
     err = size;
 
 out:
@@ -3573,14 +4144,54 @@ static int hvfs_release(const char *pathname, struct fuse_file_info *fi)
     }
 
     if (bhh->flag & BH_DIRTY) {
-        __bh_sync(bhh);
+        if (pfs_wb_mgr.t_nr) {
+            /* write-behind, kick the flushers and do not wait */
+            sem_post(&pfs_wb_mgr.sem);
+        } else
+            __bh_flush(bhh);
     }
+    /* wait for the outstanding flush of this file */
+    xlock_lock(&bhh->slock);
+    xlock_unlock(&bhh->slock);
 
     __put_bhhead(bhh);
 
     return 0;
 }
 
+/* fsync() only waits for the flush of this file
+ */
+static int hvfs_fsync(const char *pathname, int datasync,
+                      struct fuse_file_info *fi)
+{
+    struct bhhead *bhh = (struct bhhead *)fi->fh;
+
+    if (unlikely(!bhh))
+        return -EBADF;
+    if (unlikely(bhh->flag & BH_CONFIG))
+        return 0;
+
+    /* the flush error is kept in bhh->err as well, report it once */
+    __bh_flush(bhh);
+
+    return __bh_report(bhh);
+}
+
+/* flush() is called on each close(), it does not sync the write-behind data,
+ * but waits for the outstanding flush and reports the write back error.
+ */
+static int hvfs_flush(const char *pathname, struct fuse_file_info *fi)
+{
+    struct bhhead *bhh = (struct bhhead *)fi->fh;
+
+    if (unlikely(!bhh))
+        return -EBADF;
+    if (unlikely(bhh->flag & BH_CONFIG))
+        return 0;
+
+    return __bh_report(bhh);
+}
+
 typedef struct __hvfs_dir
 {
     u64 itbid;                  /* current no. of this ITB */
@@ -4007,57 +4618,18 @@ static int hvfs_setxattr(const char *pathname, const char *key,
                          const char *value, size_t size, int flags)
 {
     struct hstat hs = {0,};
-    char *dup = strdup(pathname), *path, *name, *spath = NULL;
-    char *p = NULL, *n, *s = NULL;
+    char *dup = strdup(pathname), *path, *name;
     u64 puuid = hmi.root_uuid, psalt = hmi.root_salt;
     int err = 0, column = 0;
 
     SPLIT_PATHNAME(dup, path, name);
-    n = path;
-
-    spath = strdup(path);
-    err = __ltc_lookup(spath, &puuid, &psalt);
-    if (err > 0) {
-        goto hit;
-    }
-    
-    /* parse the path and do __stat on each directory */
-    do {
-        p = strtok_r(n, "/", &s);
-        if (!p) {
-            /* end */
-            break;
-        }
-        hvfs_debug(xnet, "token: %s\n", p);
-        /* ok, we should do stat on this directory based on the puuid, psalt
-         * we got */
-        /* Step 1: find in the SDT, zero uuid means using name to lookup */
-        hs.name = p;
-        hs.uuid = 0;
-        err = __hvfs_stat(puuid, psalt, 0, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (SDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        puuid = hs.uuid;
-        hs.hash = 0;
-        /* Step 2: find in the GDT */
-        err = __hvfs_stat(hmi.gdt_uuid, hmi.gdt_salt, 0, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (GDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        psalt = hs.ssalt;
-    } while (!(n = NULL));
 
+    err = __dtc_walk(path, &puuid, &psalt);
     if (err) {
         goto out;
     }
+    __lsc_drop(puuid, name);
 
-    __ltc_update(spath, (void *)puuid, (void *)psalt);
-hit:
     hs.name = name;
     hs.uuid = 0;
     err = __hvfs_stat(puuid, psalt, 0, &hs);
@@ -4334,54 +4906,18 @@ static int hvfs_readdir_plus(const char *pathname, void *buf,
                              struct fuse_file_info *fi)
 {
     struct hstat hs = {0,};
-    char *dup = strdup(pathname), *path, *name, *spath = NULL;
-    char *p = NULL, *n, *s = NULL;
+    char *dup = strdup(pathname), *path, *name;
+    char *p = NULL;
     u64 puuid = hmi.root_uuid, psalt = hmi.root_salt;
     int err = 0;
 
     SPLIT_PATHNAME(dup, path, name);
-    n = path;
-
-    spath = strdup(path);
-    err = __ltc_lookup(spath, &puuid, &psalt);
-    if (err > 0) {
-        goto hit;
-    }
-
-    /* parse the path and do __stat on each directory */
-    do {
-        p = strtok_r(n, "/", &s);
-        if (!p) {
-            /* end */
-            break;
-        }
-        /* Step 1: find in the SDT */
-        hs.name = p;
-        hs.uuid = 0;
-        err = __hvfs_stat(puuid, psalt, 0, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (SDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        puuid = hs.uuid;
-        hs.hash = 0;
-        /* Step 2: find in the GDT */
-        err = __hvfs_stat(hmi.gdt_uuid, hmi.gdt_salt, 0, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (GDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        psalt = hs.ssalt;
-    } while (!(n = NULL));
 
+    err = __dtc_walk(path, &puuid, &psalt);
     if (err) {
         goto out;
     }
 
-    __ltc_update(spath, (void *)puuid, (void *)psalt);
-hit:
     if (name && strlen(name) > 0 && strcmp(name, "/") != 0) {
         /* stat the last dir */
         hs.name = name;
@@ -4425,7 +4961,6 @@ hit:
 
 out:
     xfree(dup);
-    xfree(spath);
     
     return err;
 }
@@ -4466,6 +5001,9 @@ realloc:
         pfs_fuse_mgr.noatime = 1;
         pfs_fuse_mgr.nodiratime = 1;
         pfs_fuse_mgr.ttl = 5;
+        pfs_fuse_mgr.bc_max = 0;
+        pfs_fuse_mgr.ra_max = 0;
+        pfs_fuse_mgr.wb_expire = 0;
     }
     
     /* setup dynamic config values */
@@ -4478,8 +5016,21 @@ realloc:
     pfs_ce_default[PC_NOATIME].uvalue = pfs_fuse_mgr.noatime;
     pfs_ce_default[PC_NODIRATIME].uvalue = pfs_fuse_mgr.nodiratime;
     
-    if (__ltc_init(pfs_fuse_mgr.ttl, 0)) {
-        hvfs_err(xnet, "LRU Translate Cache init failed. Cache DISABLED!\n");
+    if (__dtc_init(pfs_fuse_mgr.ttl, 0)) {
+        hvfs_err(xnet, "Dentry Translate Cache init failed. Cache DISABLED!\n");
+    }
+
+    if (__lsc_init(0)) {
+        hvfs_err(xnet, "Lease Stat Cache init failed. Cache DISABLED!\n");
+    }
+
+    if (__bhc_init(pfs_fuse_mgr.bc_max, pfs_fuse_mgr.ra_max)) {
+        hvfs_err(xnet, "Buffer Cache read-ahead init failed. "
+                 "Read-ahead DISABLED!\n");
+    }
+
+    if (__wb_init(pfs_fuse_mgr.wb_expire)) {
+        hvfs_err(xnet, "Write-behind init failed. Write-behind DISABLED!\n");
     }
 
     if (__odc_init(0)) {
@@ -4503,54 +5054,17 @@ static int hvfs_create_plus(const char *pathname, mode_t mode,
 {
     struct hstat hs = {.mc.c.len = 0,};
     struct mdu_update mu;
-    char *dup = strdup(pathname), *path, *name, *spath = NULL;
-    char *p = NULL, *n, *s = NULL;
+    char *dup = strdup(pathname), *path, *name;
     u64 puuid = hmi.root_uuid, psalt = hmi.root_salt;
     int err = 0;
 
     SPLIT_PATHNAME(dup, path, name);
-    n = path;
-
-    spath = strdup(path);
-    err = __ltc_lookup(spath, &puuid, &psalt);
-    if (err > 0) {
-        goto hit;
-    }
-
-    /* parse the path and do __stat on each directory */
-    do {
-        p = strtok_r(n, "/", &s);
-        if (!p) {
-            /* end */
-            break;
-        }
-        hs.name = p;
-        hs.uuid = 0;
-        /* Step 1: find in the SDT */
-        err = __hvfs_stat(puuid, psalt, -1, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (SDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        puuid = hs.uuid;
-        hs.hash = 0;
-        /* Step 2: find in the GDT */
-        err = __hvfs_stat(hmi.gdt_uuid, hmi.gdt_salt, -1, &hs);
-        if (err) {
-            hvfs_err(xnet, "do internal dir stat (GDT) on '%s' failed w/ %d\n",
-                     p, err);
-            break;
-        }
-        psalt = hs.ssalt;
-    } while (!(n = NULL));
 
+    err = __dtc_walk(path, &puuid, &psalt);
     if (err) {
         goto out;
     }
 
-    __ltc_update(spath, (void *)puuid, (void *)psalt);
-hit:
     /* create the file or dir in the parent directory now */
     hs.name = name;
     hs.uuid = 0;
@@ -4563,8 +5077,11 @@ hit:
                  name, err);
         goto out;
     }
+    __dtc_invalid(puuid, name);
 
     fi->fh = (u64)__get_bhhead(&hs);
+    if (fi->fh)
+        __set_bhh_update((struct bhhead *)fi->fh);
     /* Save the hstat in SOC cache */
     {
         struct soc_entry *se = __se_alloc(pathname, &hs);
@@ -4574,14 +5091,16 @@ hit:
 
 out:
     xfree(dup);
-    xfree(spath);
     
     return err;
 }
 
 static void hvfs_destroy(void *arg)
 {
-    __ltc_destroy();
+    __dtc_destroy();
+    __lsc_destroy();
+    __wb_destroy();
+    __bhc_destroy();
     __odc_destroy();
     __soc_destroy();
     
@@ -4607,9 +5126,9 @@ struct fuse_operations pfs_ops = {
     .read = hvfs_read,
     .write = hvfs_write,
     .statfs = hvfs_statfs_plus,
-    .flush = NULL,
+    .flush = hvfs_flush,
     .release = hvfs_release,
-    .fsync = NULL,
+    .fsync = hvfs_fsync,
     .setxattr = hvfs_setxattr,
     .getxattr = hvfs_getxattr,
     .listxattr = hvfs_listxattr,
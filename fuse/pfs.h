@@ -49,6 +49,12 @@ struct __pfs_fuse_mgr
     u32 nodiratime:1;
     u32 use_dstore:1;
     u32 ttl:8;                  /* lru translate cache ttl */
+    int bc_max;                 /* buffer cache memory bound in MB, 0 for
+                                 * default, negative for unlimited */
+    int ra_max;                 /* max read-ahead window in KB, 0 for
+                                 * default, negative to disable */
+    int wb_expire;              /* write-behind dirty expire in seconds, 0
+                                 * for default, negative to disable */
 };
 
 extern struct __pfs_fuse_mgr pfs_fuse_mgr;
@@ -161,6 +161,13 @@ int hvfs_ploop(struct file_handle *fh, int nr, ploop_func_t pf, void **data,
 int __hvfs_stat(u64 puuid, u64 psalt, int column, struct hstat *hs);
 int __hvfs_stat_ext(u64 puuid, u64 psalt, int column, u32 flag, 
                     struct hstat *hs);
+#define LEASE_WAIT_INTERVAL     (100000) /* us to wait for the read leases */
+int __hvfs_lease_release(u64 puuid, u64 psalt, struct hstat *hs, u64 lease);
+/* resolve callback: (parent uuid, name, uuid, salt) */
+typedef void (*resolve_cb_t)(u64, char *, u64, u64);
+#define RESOLVE_KEEP_LAST       0x01 /* leave the last component to caller */
+int __hvfs_resolve(char *path, u64 *puuid, u64 *psalt, u32 flag,
+                   resolve_cb_t cb);
 int __hvfs_linkadd(u64 puuid, u64 psalt, int nlink, struct hstat *hs);
 int __hvfs_linkadd_ext(u64 puuid, u64 psalt, int nlink, u32 flag,
                        struct hstat *hs);
@@ -187,6 +187,14 @@ static inline unsigned long __cmpxchg(volatile void *ptr, unsigned long old,
 #define cmpxchg(ptr, o, n)                                              \
 	((__typeof__(*(ptr)))__cmpxchg((ptr), (unsigned long)(o),           \
                                    (unsigned long)(n), sizeof(*(ptr))))
+
+/* memory barriers: x86 does not reorder stores w/ stores and loads w/ loads,
+ * thus the smp_rmb/smp_wmb only need to stop the compiler. */
+#define barrier()       asm volatile("" : : : "memory")
+#define smp_mb()        asm volatile("mfence" : : : "memory")
+#define smp_rmb()       barrier()
+#define smp_wmb()       barrier()
+#define cpu_relax()     asm volatile("rep; nop" : : : "memory")
 #endif  /* for user space only */
 
 #endif
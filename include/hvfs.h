@@ -65,10 +65,13 @@
 
 #define HVFS_CLT2MDS_DITB       0x8000000100000000 /* dump itb */
 #define HVFS_CLT2MDS_DEBUG      (HVFS_CLT2MDS_DITB)
+#define HVFS_CLT2MDS_RESOLVE    0x8000000200000000 /* resolve a multi
+                                                    * component path */
 /* NOTE: there is no *_LD in client, because we can use lookup instead */
 #define HVFS_CLT2MDS_NODHLOOKUP (                                       \
         (HVFS_CLT2MDS_STATFS | HVFS_CLT2MDS_RELEASE |                   \
-         HVFS_CLT2MDS_LIST | HVFS_CLT2MDS_COMMIT) &                     \
+         HVFS_CLT2MDS_LIST | HVFS_CLT2MDS_COMMIT |                      \
+         HVFS_CLT2MDS_RESOLVE) &                                        \
         ~HVFS_CLT2MDS_BASE)
 #define HVFS_CLT2MDS_NOCACHE (                              \
         (HVFS_CLT2MDS_LOOKUP | HVFS_CLT2MDS_NODHLOOKUP |    \
@@ -124,6 +127,7 @@
 /* end subregion for arg0 */
 #define HVFS_MDS2MDSL_WDATA     0x0000000080040000
 #define HVFS_MDS2MDSL_BTCOMMIT  0x0000000080100000
+#define HVFS_MDS2MDSL_ITB_BATCH 0x0000000080110000 /* load ITBs [a, b) */
 
 /* Client to MDSL */
 #define HVFS_CLT2MDSL_READ      0x0000000080050000
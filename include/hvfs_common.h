@@ -51,6 +51,15 @@ struct mdu
 #define HVFS_MDU_IF_PROXY       0x00000200 /* proxy read/write */
 #define HVFS_MDU_IF_LZO         0x00000400 /* data w/ lzo compressed */
 
+/* ITB codec policy of a directory, set in the GDT entry. 0 means the MDS
+ * default, otherwise it is COMPR_* + 1 */
+#define HVFS_MDU_IF_ZIP_MASK    0x000f0000
+#define HVFS_MDU_IF_ZIP_SHIFT   16
+#define HVFS_MDU_ZIP(flags)     (((flags) & HVFS_MDU_IF_ZIP_MASK) >> \
+                                 HVFS_MDU_IF_ZIP_SHIFT)
+#define HVFS_MDU_ZIP_FLAG(algo) ((((algo) + 1) << HVFS_MDU_IF_ZIP_SHIFT) & \
+                                 HVFS_MDU_IF_ZIP_MASK)
+
 #define HVFS_MDU_IF_DA          0x80000000 /* delay allocation */
 
 #define HVFS_MDU_IF_NORMAL      0x08000000 /* normal file */
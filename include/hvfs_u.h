@@ -53,6 +53,8 @@
 #include <sys/resource.h>
 #include <sched.h>
 #include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <poll.h>
 #include <sys/stat.h>
 #include <ucontext.h>
 #include <regex.h>
@@ -111,6 +111,16 @@ struct ite
     /* section for columns: 144B */
     struct column column[6];    /* 144B */
 };
+
+/* the hot fields of ITE, the same layout as the indexing section above */
+struct ite_hot
+{
+    u64 hash;
+    u64 uuid;
+    u32 flag;
+    u32 namelen;
+};
+
 #define ITE_IS_DIR(ite) ((ite)->uuid & 0x8000000000000000)
 #define ITE_IS_FILE(ite) (!((ite)->uuid & 0x8000000000000000))
 
@@ -119,6 +129,6 @@ struct ite
  */
 #define ITE_MATCH_HIT   0
 #define ITE_MATCH_MISS  1
-int ite_match(struct ite *ite, struct hvfs_index *hi);
+int ite_match(struct ite_hot *h, struct ite *ite, struct hvfs_index *hi);
 
 #endif
@@ -28,6 +28,12 @@
 #define LEASE_SHARED            0x4000000000000000
 #define LEASE_MASK              0xff00000000000000
 #define LEASE_SEQNO_MASK        0x00ffffff00000000
+/* read lease (client cache of the mdu), the lease ttl is in the flag byte */
+#define LEASE_READ              0x2000000000000000
+#define LEASE_RECALL            0x1000000000000000 /* an update is waiting */
+#define LEASE_TTL_MASK          0x0f00000000000000
+#define LEASE_TTL(v)            (((v) & LEASE_TTL_MASK) >> 56)
+#define LEASE_TTL_MAX           (15)
 
 /* the general index structure between HVFS client and MDS */
 struct hvfs_index
@@ -91,6 +97,8 @@ struct hvfs_index
 #define INDEX_ITE_SHADOW        0x02000000 /* shadow/unlinked ITE */
 
 #define INDEX_ITB_LOAD          0x10000000 /* load ITB */
+#define INDEX_LEASE             0x08000000 /* read lease: grant it on lookup,
+                                            * wait for it on update */
 #define INDEX_BIT_FLIP          0x80000000 /* need flip the bit of itbid @
                                             * client side*/
 #define INDEX_KV                0x40000000 /* K/V mode access */
@@ -174,6 +182,47 @@ struct dentry_info
     char name[0];               /* the dentry name */
 };
 
+/*
+ * used for the multi-component path resolving
+ *
+ * Layout of the resolve request (and the reply):
+ *
+ * |---resolve_req---|---path(padded to 8B)---|---resolve_entry * max---|
+ *
+ * The MDS walks the components it owns, fills the entries in place and
+ * forwards the remaining path to the next owning MDS. The reply carries the
+ * request region back to the client.
+ */
+struct resolve_entry
+{
+    u64 uuid;                   /* directory uuid */
+    u64 salt;                   /* directory salt */
+    u32 plen;                   /* prefix length of the path resolved */
+    u32 __padding;
+    struct mdu mdu;             /* GDT mdu of the directory */
+};
+
+struct resolve_req
+{
+    u64 puuid;                  /* current directory uuid */
+    u64 psalt;                  /* current directory salt */
+    u64 uuid;                   /* !0 means the GDT lookup is pending */
+    u32 off;                    /* offset of the next component */
+    u16 plen;                   /* path length */
+    u16 nr;                     /* # of resolved entries */
+    u16 max;                    /* # of entry slots */
+    u16 hops;                   /* # of MDS forwards */
+    s32 err;                    /* why we stopped */
+    char path[0];
+};
+
+#define RESOLVE_PATH_SIZE(plen)     (((plen) + 8) & ~7)
+#define RESOLVE_ENTRY(rr)   ((struct resolve_entry *)((rr)->path +      \
+                                                      RESOLVE_PATH_SIZE((rr)->plen)))
+#define RESOLVE_SIZE(plen, max) (sizeof(struct resolve_req) +           \
+                                 RESOLVE_PATH_SIZE(plen) +              \
+                                 (max) * sizeof(struct resolve_entry))
+
 /*
  * used for setattr and create
  *
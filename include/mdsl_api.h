@@ -145,6 +145,8 @@ struct itb_info
     u64 location;
     u32 master;                 /* which itb master file we writen to */
     u32 overwrite:1;            /* should we overwrite the range position? */
+    u32 gc_pin:1;               /* pinned the GC append low-water mark */
+    u32 seg_pin:1;              /* pinned the segment append low-water mark */
 };
 
 #define ITB_INFO_DISK_SIZE (sizeof(struct itb_info) - sizeof(struct list_head))
@@ -134,6 +134,19 @@ struct hvfs_txg
 #define TXG_IS_DIRTY(txg) ((txg)->dirty)
 
 /* the following regions is designed for commit threads */
+
+/* ITBs bound for the same MDSL are packed into one batch buffer and sent in
+ * one WBTXG_ITB frame */
+struct txg_wb_batch
+{
+    struct list_head list;
+    struct xnet_msg *msg;       /* in-flight msg of this batch */
+    u64 vid;
+    u32 psize, len;             /* buffer size and used length */
+    u32 nr;                     /* # of ITBs in this batch */
+    u8 data[0];
+};
+
 struct txg_wb_slice
 {
     struct hlist_node hlist;
@@ -144,6 +157,10 @@ struct txg_wb_slice
 #define TWS_NEW         0x0001
     u32 flag;
     int err;
+    struct txg_wb_batch *cur;   /* batch being filled */
+    struct list_head inflight;  /* batches sent but not replied */
+    int inflight_nr;
+    struct xnet_wait_group *wg; /* wait group of the in-flight batches */
 };
 
 #define HVFS_TXG_WB_SITE_HTSIZE         512
@@ -231,6 +248,7 @@ struct txg_wb_slice *tws_create(u64 site)
     }
     INIT_HLIST_NODE(&tws->hlist);
     INIT_LIST_HEAD(&tws->list);
+    INIT_LIST_HEAD(&tws->inflight);
     tws->site_id = site;
     tws->flag |= TWS_NEW;
     return tws;
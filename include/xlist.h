@@ -60,6 +60,19 @@ static inline void list_add_tail(struct list_head *new, struct list_head *head)
     __list_add(new, head->prev, head);
 }
 
+/* list_add_tail_rcu() adds the entry for the lockless forward walkers, the
+ * new entry is fully linked before it is published by prev->next. */
+static inline void list_add_tail_rcu(struct list_head *new,
+                                     struct list_head *head)
+{
+    struct list_head *prev = head->prev;
+
+    new->next = head;
+    new->prev = prev;
+    __atomic_store_n(&prev->next, new, __ATOMIC_RELEASE);
+    head->prev = new;
+}
+
 static inline void __list_del(struct list_head * prev, struct list_head * next)
 {
     next->prev = prev;
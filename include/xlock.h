@@ -52,6 +52,7 @@ int xrwlock_destroy(xrwlock_t *);
 /* section for lock */
 typedef pthread_mutex_t xlock_t;
 int xlock_lock(xlock_t *);
+int xlock_trylock(xlock_t *);
 int xlock_unlock(xlock_t *);
 int xlock_init(xlock_t *);
 int xlock_destroy(xlock_t *);
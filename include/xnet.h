@@ -66,6 +66,17 @@ struct xnet_msg_tx
     u64 reserved;
 };
 
+/* file range payload, it is sent after all the siov data w/o copying the
+ * file content to user space. The fd is not owned by the msg and it should
+ * be valid until the sending returns.
+ */
+struct xnet_frange
+{
+    int fd;
+    loff_t offset;
+    size_t len;
+};
+
 struct xnet_msg
 {
     struct xnet_msg_tx tx;      /* header of msg */
@@ -79,6 +90,7 @@ struct xnet_msg
     u8 state;
 #define XNET_MSG_NORMAL         0x01 /* normal allocation */
 #define XNET_MSG_CACHE          0x02 /* allocation based on cache */
+#define XNET_MSG_RBUF_CACHE     0x04 /* riov[0] is from the buffer cache */
     u8 alloc_flag;
 
     u8 riov_alen;
@@ -91,11 +103,20 @@ struct xnet_msg
 #define xm_datacheck riov
 #define xm_data riov[0].iov_base
 
+    u32 sfr_alen;
+    u32 sfr_ulen;
+    struct xnet_frange *sfr;    /* file ranges to send */
+
     struct xnet_context *xc;
     struct xnet_msg *pair;
     struct list_head list;
     void *private;
 
+    /* for async sending, see xnet_isend() */
+    void (*cb)(struct xnet_msg *, int, void *); /* completion callback */
+    void *cb_arg;
+    struct xnet_wait_group *wg;
+
     atomic_t ref;
 #ifdef USE_XNET_SIMPLE
     sem_t event;
@@ -127,6 +148,15 @@ struct xnet_context
 #endif
 };
 
+typedef void (*xnet_msg_cb_t)(struct xnet_msg *, int, void *);
+
+struct xnet_wait_group
+{
+    xcond_t cond;
+    int nr;                     /* # of in-flight msgs */
+    int err;                    /* first error of the msgs */
+};
+
 struct xnet_group_entry
 {
     u64 site_id;
@@ -155,6 +185,7 @@ struct xnet_conf
     int resend_timeout;
     int send_timeout;
     int siov_nr;
+    int pollin_nr;              /* # of poll-in threads */
     u32 magic:4;                /* magic we should use */
     u32 enable_resend:1;
     u32 pause:1;
@@ -169,11 +200,15 @@ void xnet_resend_remove(struct xnet_msg *msg)
 int xnet_unregister_type(struct xnet_context *);
 
 struct xnet_msg *xnet_alloc_msg(u8 alloc_flag);
+void *xnet_buf_alloc(size_t len);
+void xnet_buf_free(void *buf, size_t len);
+void xnet_cache_init(void);
 void xnet_free_msg(struct xnet_msg *);
 void xnet_raw_free_msg(struct xnet_msg *);
 
 int xnet_msg_add_sdata(struct xnet_msg *, void *, u32);
 int xnet_msg_add_rdata(struct xnet_msg *, void *, u32);
+int xnet_msg_add_sfile(struct xnet_msg *, int, loff_t, size_t);
 void xnet_msg_free_sdata(struct xnet_msg *);
 void xnet_msg_free_rdata(struct xnet_msg *);
 
@@ -230,11 +265,22 @@ TRACING_FLAG_DEF(xnet);
 void xnet_reset_tracing_flags(u64);
 
 extern void *mds_gwg;           /* simulate global wait group */
+struct xnet_wait_group *xnet_wait_group_create(void);
+void xnet_wait_group_destroy(struct xnet_wait_group *);
 int xnet_wait_group_add(void *, struct xnet_msg *);
 int xnet_wait_group_del(void *, struct xnet_msg *);
+int xnet_wait_group_abandon(void *, struct xnet_msg *);
+int xnet_wait_group_wait(void *);
 
 int xnet_isend(struct xnet_context *xc, struct xnet_msg *m);
 
+static inline
+void xnet_msg_set_cb(struct xnet_msg *m, xnet_msg_cb_t cb, void *arg)
+{
+    m->cb = cb;
+    m->cb_arg = arg;
+}
+
 #ifdef USE_XNET_SIMPLE
 int st_init(void);
 void st_destroy(void);
@@ -30,6 +30,12 @@ struct xnet_prof
     atomic64_t msg_free;
     atomic64_t inbytes;
     atomic64_t outbytes;
+    atomic64_t isend;           /* # of async sent msgs */
+    atomic64_t sfbytes;         /* # of bytes sent by sendfile() */
+    atomic64_t msg_cache_hit;   /* xnet_msg cache hit */
+    atomic64_t msg_cache_miss;
+    atomic64_t buf_cache_hit;   /* payload buffer cache hit */
+    atomic64_t buf_cache_miss;
 
     atomic64_t active_links;
 };
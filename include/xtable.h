@@ -37,8 +37,26 @@
 #define ITB_LOCK_GRANULARITY    16
 #endif
 
+/* ITB_INDEX_FP: keep a one byte hash fingerprint for each ITE slot, packed
+ * 64 per cache line, so that itb_search() can skip the conflict candidates
+ * w/o touching the large ITE. NOTE that this changes the ITB layout, so all
+ * the MDS/MDSL sites should be built w/ the same setting! */
+
 #define ITB_SIZE        (1 << ITB_DEPTH)
 
+/* State of the 2Q ITB cache policy, in-memory only */
+struct itb_cstate
+{
+#define ITB_CQ_NONE     0x00
+#define ITB_CQ_A1IN     0x01    /* loaded once, evicted first */
+#define ITB_CQ_AM       0x02    /* reloaded after eviction, frequent */
+    u8 q;
+    u8 ref;                     /* referenced since the last scrub pass */
+    u8 aged;                    /* survived one scrub pass in A1in */
+};
+
+struct ite_hot;
+
 /* ITB header */
 struct itbh 
 {
@@ -91,6 +109,10 @@ struct itbh
     atomic_t zlen;              /* compressed length */
 #define COMPR_NONE              (0x00)
 #define COMPR_LZO               (0x01)
+#define COMPR_ZRL               (0x02) /* zero run length, fast */
+#define COMPR_ZLZO              (0x03) /* zero run length + LZO, dense */
+#define COMPR_MAX               (0x04)
+#define COMPR_AUTO              (0x0e) /* policy only, pick one by ratio */
     u16 compress_algo;
 
     /* section for itb_index allocation */
@@ -133,6 +155,7 @@ struct itb_lock
 /* ITB defination */
 #define ITB_COW_BITMAP_LEN (sizeof(u8) * (1 << (ITB_DEPTH - 3)))
 #define ITB_COW_INDEX_LEN (sizeof(struct itb_index) * (2 << ITB_DEPTH))
+#define ITB_COW_FP_LEN (sizeof(u8) * ITB_SIZE)
 struct itb 
 {
     /* NOTE: do NOT move the struct itbh! */
@@ -140,9 +163,56 @@ struct itb
     struct itb_lock lock[(1 << ITB_DEPTH) / ITB_LOCK_GRANULARITY];
     u8 bitmap[1 << (ITB_DEPTH - 3)];
     struct itb_index index[2 << (ITB_DEPTH)]; /* double size */
+#ifdef ITB_INDEX_FP
+    u8 fp[ITB_SIZE];            /* fingerprints indexed by ITE slot */
+#endif
     struct ite ite[0];
 };
 
+/* The in-memory only states of the ITB sit after the whole ITE region, thus
+ * they are beyond h.len and never written to MDSL or sent to other MDSs. */
+struct itb_mem
+{
+    struct ite_hot *hot;        /* hot ITE array, see ITB_HOT() */
+    struct itb_cstate cs;       /* 2Q cache state */
+};
+
+/* The in-memory ITB keeps a dense array of the hot ITE fields in a separate
+ * allocation, so searching only touches the cold ITE on a likely hit.
+ * get_free_itb() and itb_reinit() allocate it, itb_reinit() rebuilds it for
+ * each ITB loaded in, and itb_free() releases it before caching the ITB in
+ * the LRU list. Thus, an active ITB costs ITB_ACTIVE_SIZE. */
+#define ITB_HOT_LEN (sizeof(struct ite_hot) * ITB_SIZE)
+#define ITB_MEM(i) ((struct itb_mem *)((i)->ite + ITB_SIZE))
+#define ITB_HOT(i) (ITB_MEM(i)->hot)
+#define ITB_CSTATE(i) (&ITB_MEM(i)->cs)
+
+#define ITB_MEM_SIZE (sizeof(struct itb) + sizeof(struct ite) * ITB_SIZE + \
+                      sizeof(struct itb_mem))
+#define ITB_ACTIVE_SIZE (ITB_MEM_SIZE + ITB_HOT_LEN)
+
+static inline void itb_hot_sync(struct itb *i, long nr)
+{
+    struct ite_hot *h = &ITB_HOT(i)[nr];
+    struct ite *e = &i->ite[nr];
+
+    h->hash = e->hash;
+    h->uuid = e->uuid;
+    h->flag = e->flag;
+    h->namelen = e->namelen;
+}
+
+#ifdef ITB_INDEX_FP
+/* fold the 64-bit hash value to the one byte fingerprint */
+static inline u8 itb_fp(u64 hash)
+{
+    hash ^= hash >> 32;
+    hash ^= hash >> 16;
+    hash ^= hash >> 8;
+    return (u8)hash;
+}
+#endif
+
 struct checkpoint 
 {
     u64 site_id;                /* remote site, virtual */
@@ -250,6 +320,7 @@ struct dir_trigger_mgr
 /* u64 mds_bitmap_cut(u64, u64); */
 void mds_bitmap_update(struct itbitmap *, struct itbitmap *);
 int mds_bitmap_load(struct dhe *, u64);
+int mds_bitmap_load_batch(struct dhe *, u64);
 void mds_bitmap_refresh(struct hvfs_index *);
 void mds_bitmap_refresh_all(u64);
 void mds_bitmap_free(struct itbitmap *);
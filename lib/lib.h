@@ -300,4 +300,14 @@ extern u64 cpu_frequency;
 int ebpy(u16 where, void *itb, void *ite, void *hi, int status,
          void *dt);
 
+/* zip.c */
+#define ZIP_LZO_WORKMEM         ((LZO1X_1_MEM_COMPRESS + 15) & ~15)
+#define HVFS_ZIP_BOUND(len)     ((len) + (len) / 8 + 256)
+#define HVFS_ZIP_WORKMEM(len)   (ZIP_LZO_WORKMEM + HVFS_ZIP_BOUND(len))
+extern int hvfs_zip_auto_ratio;
+int hvfs_zip_compress(int, void *, size_t, void *, size_t *, void *);
+int hvfs_zip_decompress(int, void *, size_t, void *, size_t *, size_t);
+int hvfs_zip_lookup(char *);
+char *hvfs_zip_name(int);
+
 #endif
@@ -448,6 +448,11 @@ int xlock_lock(xlock_t *lock)
     return pthread_mutex_lock(lock);
 }
 
+int xlock_trylock(xlock_t *lock)
+{
+    return pthread_mutex_trylock(lock);
+}
+
 int xlock_unlock(xlock_t *lock)
 {
     return pthread_mutex_unlock(lock);
@@ -0,0 +1,346 @@
+/**
+ * Copyright (c) 2009 Ma Can <ml.macana@gmail.com>
+ *                           <macan@ncic.ac.cn>
+ *
+ * Armed with EMACS.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "lib.h"
+#include "xtable.h"
+
+/* The in-tree codecs for ITB and data column payloads.
+ *
+ * COMPR_ZRL is a zero run length codec. It only squeezes out the zero runs,
+ * thus it is very fast and it is good at the sparse ITBs (most of the ITEs
+ * are free).
+ *
+ * COMPR_LZO is the minilzo LZO1X-1 codec.
+ *
+ * COMPR_ZLZO runs ZRL firstly, and then LZO on the ZRL output. It is denser
+ * than LZO on the sparse ITBs, and LZO only works on the non-zero bytes.
+ *
+ * COMPR_AUTO is not a codec. It runs ZRL firstly, if ZRL can not shrink the
+ * payload below hvfs_zip_auto_ratio percent we believe the payload is dense
+ * and skip the LZO pass.
+ */
+
+/* ZRL token:
+ *
+ * 0x00-0x7f: literal run of (token + 1) bytes, followed by the bytes
+ * 0x80-0xfe: zero run of (token - 0x7f) bytes
+ * 0xff: zero run, followed by the u32 run length
+ */
+#define ZRL_LIT_MAX     128
+#define ZRL_ZERO_SHORT  127
+#define ZRL_ZERO_LONG   0xff
+#define ZRL_ZERO_MIN    4       /* shorter zero runs are literals */
+#define ZRL_HASZERO(v)  (((v) - 0x0101010101010101UL) & ~(v) & \
+                         0x8080808080808080UL)
+
+int hvfs_zip_auto_ratio = 50;
+
+static char *hvfs_zip_names[] = {
+    [COMPR_NONE] = "none",
+    [COMPR_LZO] = "lzo",
+    [COMPR_ZRL] = "zrl",
+    [COMPR_ZLZO] = "zlzo",
+};
+
+static inline
+size_t __zrl_zero_run(u8 *p, u8 *end)
+{
+    u8 *s = p;
+
+    while (p + sizeof(u64) <= end && *(u64 *)p == 0)
+        p += sizeof(u64);
+    while (p < end && *p == 0)
+        p++;
+
+    return p - s;
+}
+
+static
+int __zrl_compress(u8 *in, size_t inlen, u8 *out, size_t *outlen)
+{
+    u8 *ip = in, *end = in + inlen, *op = out, *lit = in;
+    size_t zr, l;
+
+#define ZRL_FLUSH_LITERAL() do {                        \
+        while (lit < ip) {                              \
+            l = min((size_t)(ip - lit), (size_t)ZRL_LIT_MAX); \
+            *op++ = (u8)(l - 1);                        \
+            memcpy(op, lit, l);                         \
+            op += l;                                    \
+            lit += l;                                   \
+        }                                               \
+    } while (0)
+
+    while (ip < end) {
+        if (ip + sizeof(u64) <= end) {
+            /* skip to the first zero byte word by word */
+            u64 z = ZRL_HASZERO(*(u64 *)ip);
+
+            if (!z) {
+                ip += sizeof(u64);
+                continue;
+            }
+            ip += __builtin_ctzl(z) >> 3;
+        } else if (*ip) {
+            ip++;
+            continue;
+        }
+        zr = __zrl_zero_run(ip, end);
+        if (zr < ZRL_ZERO_MIN) {
+            ip += zr;
+            continue;
+        }
+        ZRL_FLUSH_LITERAL();
+        if (zr <= ZRL_ZERO_SHORT) {
+            *op++ = (u8)(0x7f + zr);
+        } else {
+            *op++ = ZRL_ZERO_LONG;
+            *(u32 *)op = (u32)zr;
+            op += sizeof(u32);
+        }
+        ip += zr;
+        lit = ip;
+    }
+    ZRL_FLUSH_LITERAL();
+#undef ZRL_FLUSH_LITERAL
+
+    *outlen = op - out;
+
+    return 0;
+}
+
+static
+int __zrl_decompress(u8 *in, size_t inlen, u8 *out, size_t *outlen,
+                     size_t olimit)
+{
+    u8 *ip = in, *end = in + inlen, *op = out, *oend = out + olimit;
+    size_t l;
+
+    while (ip < end) {
+        if (*ip < 0x80) {
+            l = *ip++ + 1;
+            if (ip + l > end || op + l > oend)
+                goto corrupt;
+            memcpy(op, ip, l);
+            ip += l;
+        } else {
+            if (*ip == ZRL_ZERO_LONG) {
+                if (ip + 1 + sizeof(u32) > end)
+                    goto corrupt;
+                l = *(u32 *)(ip + 1);
+                ip += 1 + sizeof(u32);
+            } else
+                l = *ip++ - 0x7f;
+            if (op + l > oend)
+                goto corrupt;
+            memset(op, 0, l);
+        }
+        op += l;
+    }
+    *outlen = op - out;
+
+    return 0;
+corrupt:
+    hvfs_err(lib, "ZRL stream corrupted @ %ld/%ld\n",
+             (long)(ip - in), (long)inlen);
+    return -EINVAL;
+}
+
+static inline
+void *__zip_scratch(void *workmem)
+{
+    return workmem + ZIP_LZO_WORKMEM;
+}
+
+/* the ZLZO stream is the u32 ZRL length followed by the LZO stream */
+static
+int __lzo_pass(u8 *in, size_t inlen, u8 *out, size_t *outlen, void *workmem)
+{
+    lzo_uint zlen = 0;
+    int err;
+
+    *(u32 *)out = (u32)inlen;
+    err = lzo1x_1_compress(in, inlen, out + sizeof(u32), &zlen, workmem);
+    if (err != LZO_E_OK) {
+        hvfs_err(lib, "LZO compress failed w/ %d\n", err);
+        return -EINVAL;
+    }
+    *outlen = zlen + sizeof(u32);
+
+    return 0;
+}
+
+/* hvfs_zip_compress()
+ *
+ * Compress @in to @out, @out should be at least HVFS_ZIP_BOUND(@inlen) bytes
+ * and @workmem should be HVFS_ZIP_WORKMEM(@inlen) bytes. Return the codec
+ * actually used, COMPR_NONE means the payload is not compressible and @out
+ * is useless.
+ */
+int hvfs_zip_compress(int algo, void *in, size_t inlen, void *out,
+                      size_t *outlen, void *workmem)
+{
+    void *scratch;
+    size_t zlen = 0, zzlen = 0;
+    int err = 0;
+
+    switch (algo) {
+    case COMPR_NONE:
+        return COMPR_NONE;
+    case COMPR_LZO:
+    {
+        lzo_uint l = 0;
+
+        err = lzo1x_1_compress(in, inlen, out, &l, workmem);
+        if (err != LZO_E_OK) {
+            hvfs_err(lib, "LZO compress failed w/ %d\n", err);
+            return -EINVAL;
+        }
+        zlen = l;
+        break;
+    }
+    case COMPR_ZRL:
+        err = __zrl_compress(in, inlen, out, &zlen);
+        break;
+    case COMPR_ZLZO:
+        scratch = __zip_scratch(workmem);
+        err = __zrl_compress(in, inlen, scratch, &zzlen);
+        if (err)
+            break;
+        err = __lzo_pass(scratch, zzlen, out, &zlen, workmem);
+        break;
+    case COMPR_AUTO:
+        scratch = __zip_scratch(workmem);
+        err = __zrl_compress(in, inlen, scratch, &zzlen);
+        if (err)
+            break;
+        if (zzlen * 100 > inlen * hvfs_zip_auto_ratio) {
+            /* dense payload, do not waste CPU on LZO */
+            memcpy(out, scratch, zzlen);
+            zlen = zzlen;
+            algo = COMPR_ZRL;
+            break;
+        }
+        err = __lzo_pass(scratch, zzlen, out, &zlen, workmem);
+        algo = COMPR_ZLZO;
+        if (!err && zlen >= zzlen) {
+            memcpy(out, scratch, zzlen);
+            zlen = zzlen;
+            algo = COMPR_ZRL;
+        }
+        break;
+    default:
+        hvfs_err(lib, "Invalid codec %d\n", algo);
+        return -EINVAL;
+    }
+
+    if (err)
+        return err;
+    if (zlen >= inlen)
+        return COMPR_NONE;
+    *outlen = zlen;
+
+    return algo;
+}
+
+/* hvfs_zip_decompress()
+ *
+ * Decompress @in to @out, at most @olimit bytes are written to @out.
+ */
+int hvfs_zip_decompress(int algo, void *in, size_t inlen, void *out,
+                        size_t *outlen, size_t olimit)
+{
+    lzo_uint l = olimit;
+    void *scratch;
+    int err = 0;
+
+    switch (algo) {
+    case COMPR_LZO:
+        err = lzo1x_decompress_safe(in, inlen, out, &l, NULL);
+        if (err != LZO_E_OK) {
+            hvfs_err(lib, "LZO decompress failed w/ %d\n", err);
+            return -EINVAL;
+        }
+        *outlen = l;
+        break;
+    case COMPR_ZRL:
+        err = __zrl_decompress(in, inlen, out, outlen, olimit);
+        break;
+    case COMPR_ZLZO:
+        if (inlen < sizeof(u32))
+            return -EINVAL;
+        l = *(u32 *)in;
+        /* the ZRL pass of at most @olimit bytes is in the bound */
+        if (l > HVFS_ZIP_BOUND(olimit)) {
+            hvfs_err(lib, "Invalid ZLZO length %ld for limit %ld\n",
+                     (long)l, (long)olimit);
+            return -EINVAL;
+        }
+        scratch = xmalloc(l);
+        if (!scratch) {
+            hvfs_err(lib, "xmalloc() ZLZO scratch buffer failed\n");
+            return -ENOMEM;
+        }
+        err = lzo1x_decompress_safe(in + sizeof(u32), inlen - sizeof(u32),
+                                    scratch, &l, NULL);
+        if (err != LZO_E_OK || l != *(u32 *)in) {
+            hvfs_err(lib, "LZO decompress failed w/ %d\n", err);
+            xfree(scratch);
+            return -EINVAL;
+        }
+        err = __zrl_decompress(scratch, l, out, outlen, olimit);
+        xfree(scratch);
+        break;
+    default:
+        hvfs_err(lib, "Invalid codec %d\n", algo);
+        return -EINVAL;
+    }
+
+    return err;
+}
+
+/* hvfs_zip_lookup()
+ *
+ * Convert the codec name to the codec id, "auto" is accepted too.
+ */
+int hvfs_zip_lookup(char *name)
+{
+    int i;
+
+    if (strcmp(name, "auto") == 0)
+        return COMPR_AUTO;
+    for (i = 0; i < COMPR_MAX; i++) {
+        if (strcmp(name, hvfs_zip_names[i]) == 0)
+            return i;
+    }
+
+    return -EINVAL;
+}
+
+char *hvfs_zip_name(int algo)
+{
+    if (algo == COMPR_AUTO)
+        return "auto";
+    if (algo < 0 || algo >= COMPR_MAX)
+        return "unknown";
+    return hvfs_zip_names[algo];
+}
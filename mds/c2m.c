@@ -205,6 +205,9 @@ void mds_lookup(struct hvfs_tx *tx)
 
     /* ABI:
      * tx.arg1: lease timestamp
+     *
+     * hi->flag w/ INDEX_LEASE asks for a read lease, which is returned in
+     * mdu.dtime.
      */
     /* sanity checking */
     if (unlikely(tx->req->tx.len < sizeof(*hi))) {
@@ -472,7 +475,8 @@ void mds_update(struct hvfs_tx *tx)
     }
 
     /* search in the CBHT */
-    hi->flag |= INDEX_MDU_UPDATE;
+    /* wait for the client read leases */
+    hi->flag |= INDEX_MDU_UPDATE | INDEX_LEASE;
     if (!hi->dlen) {
         hvfs_warning(mds, "UPDATE w/ zero length data payload.\n");
         /* FIXME: we should drop the TX */
@@ -543,7 +547,8 @@ void mds_linkadd(struct hvfs_tx *tx)
         hi->dlen = 1UL;
     
     /* search in the CBHT */
-    hi->flag |= INDEX_LINK_ADD;
+    /* wait for the client read leases */
+    hi->flag |= INDEX_LINK_ADD | INDEX_LEASE;
     err = mds_cbht_search(hi, hmr, tx->txg, &tx->txg);
 
 actually_send:
@@ -596,7 +601,8 @@ void mds_unlink(struct hvfs_tx *tx)
     }
 
     /* search in the CBHT */
-    hi->flag |= INDEX_UNLINK;
+    /* wait for the client read leases */
+    hi->flag |= INDEX_UNLINK | INDEX_LEASE;
     err = mds_cbht_search(hi, hmr, tx->txg, &tx->txg);
 
 actually_send:
@@ -988,3 +994,278 @@ void mds_snapshot(struct hvfs_tx *tx)
 
     return mds_send_reply(tx, hmr, 0);
 }
+
+/* __resolve_owner()
+ *
+ * find the ITB and the owner site of the hash value in directory puuid
+ */
+static inline
+int __resolve_owner(u64 puuid, u64 psalt, u64 hash, u64 *itbid, u64 *site)
+{
+    struct dhe *e;
+    struct chp *p;
+
+    e = mds_dh_search(&hmo.dh, puuid);
+    if (IS_ERR(e)) {
+        hvfs_debug(mds, "mds_dh_search() %lx failed w/ %ld\n",
+                   puuid, PTR_ERR(e));
+        return PTR_ERR(e);
+    }
+    *itbid = mds_get_itbid(e, hash);
+    mds_dh_put(e);
+
+    p = ring_get_point(*itbid, psalt, hmo.chring[CH_RING_MDS]);
+    if (IS_ERR(p)) {
+        hvfs_err(mds, "ring_get_point() failed w/ %ld\n", PTR_ERR(p));
+        return -ECHP;
+    }
+    *site = p->site_id;
+
+    return 0;
+}
+
+static inline
+void __resolve_hmr_reset(struct hvfs_md_reply *hmr)
+{
+    if (hmr->data)
+        xfree(hmr->data);
+    memset(hmr, 0, sizeof(*hmr));
+}
+
+/* RESOLVE
+ *
+ * Walk the path components owned by this MDS: a SDT lookup of the name in the
+ * current directory, then a GDT lookup of the directory uuid to get its
+ * salt. Once the next lookup belongs to another MDS, we forward the request
+ * w/ the resolved entries in place. We stop at links, non-directories and
+ * errors, and reply the partial result, the client resolves the remaining
+ * components by itself.
+ */
+void mds_resolve(struct hvfs_tx *tx)
+{
+    struct resolve_req *rr = NULL, *rpy;
+    struct resolve_entry *re;
+    struct hvfs_index *hi, *rhi;
+    struct hvfs_md_reply *hmr;
+    struct gdt_md *m;
+    char *name, *end;
+    u64 hash, itbid = 0, site = 0;
+    size_t len;
+    int err = 0, nr, local = 0, retry = 0;
+
+    /* sanity checking */
+    if (unlikely(tx->req->tx.len < sizeof(*rr))) {
+        hvfs_err(mds, "Invalid RESOLVE request %d received len %d\n",
+                 tx->req->tx.reqno, tx->req->tx.len);
+        err = -EINVAL;
+        goto send_err;
+    }
+
+    if (tx->req->xm_datacheck)
+        rr = tx->req->xm_data;
+    else {
+        hvfs_err(mds, "Internal error, data lossing ...\n");
+        err = -EFAULT;
+        goto send_err;
+    }
+
+    len = RESOLVE_SIZE(rr->plen, rr->max);
+    if (unlikely(tx->req->tx.len < len || rr->off > rr->plen ||
+                 rr->nr > rr->max)) {
+        hvfs_err(mds, "Invalid RESOLVE request %d received len %d\n",
+                 tx->req->tx.reqno, tx->req->tx.len);
+        err = -EINVAL;
+        goto send_err;
+    }
+
+    hvfs_debug(mds, "RESOLVE %lx %lx off %d/%d nr %d/%d hops %d\n",
+               rr->puuid, rr->psalt, rr->off, rr->plen, rr->nr, rr->max,
+               rr->hops);
+
+    hi = xzalloc(sizeof(*hi) + rr->plen);
+    if (unlikely(!hi)) {
+        hvfs_err(mds, "xzalloc() hvfs_index failed\n");
+        err = -ENOMEM;
+        goto send_err;
+    }
+    hmr = get_hmr();
+    if (unlikely(!hmr)) {
+        hvfs_err(mds, "get_hmr() failed\n");
+        xfree(hi);
+        err = -ENOMEM;
+        goto send_err;
+    }
+
+    re = RESOLVE_ENTRY(rr);
+    while (rr->nr < rr->max) {
+        if (!rr->uuid) {
+            /* Step 1: find the next component in the SDT */
+            name = rr->path + rr->off;
+            end = rr->path + rr->plen;
+            while (name < end && *name == '/')
+                name++;
+            end = name;
+            while (end < rr->path + rr->plen && *end != '/')
+                end++;
+            if (end == name) {
+                /* the whole path is resolved */
+                rr->off = rr->plen;
+                break;
+            }
+            hash = hvfs_hash(rr->puuid, (u64)name, end - name, HASH_SEL_EH);
+            err = __resolve_owner(rr->puuid, rr->psalt, hash, &itbid, &site);
+            if (err)
+                break;
+            if (site != hmo.site_id)
+                goto forward;
+
+            memset(hi, 0, sizeof(*hi));
+            hi->flag = INDEX_BY_NAME | INDEX_LOOKUP | INDEX_ITE_ACTIVE;
+            hi->namelen = end - name;
+            memcpy(hi->name, name, hi->namelen);
+            hi->puuid = rr->puuid;
+            hi->psalt = rr->psalt;
+            hi->hash = hash;
+            hi->itbid = itbid;
+            err = mds_cbht_search(hi, hmr, tx->txg, &tx->txg);
+            if (err)
+                goto check;
+            if (hmr->flag & MD_REPLY_WITH_LS) {
+                /* let the client follow the link */
+                __resolve_hmr_reset(hmr);
+                break;
+            }
+            if (!(hmr->flag & MD_REPLY_DIR)) {
+                err = -ENOTDIR;
+                __resolve_hmr_reset(hmr);
+                break;
+            }
+            rhi = hmr_extract_local(hmr, EXTRACT_HI, &nr);
+            if (!rhi) {
+                hvfs_err(mds, "extract HI failed on resolve %lx %.*s\n",
+                         rr->puuid, (int)(end - name), name);
+                err = -EFAULT;
+                __resolve_hmr_reset(hmr);
+                break;
+            }
+            rr->uuid = rhi->uuid;
+            rr->off = end - rr->path;
+            __resolve_hmr_reset(hmr);
+        }
+
+        /* Step 2: find the salt of this directory in the GDT */
+        hash = hvfs_hash_gdt(rr->uuid, hmi.gdt_salt);
+        err = __resolve_owner(hmi.gdt_uuid, hmi.gdt_salt, hash, &itbid, &site);
+        if (err)
+            break;
+        if (site != hmo.site_id)
+            goto forward;
+
+        memset(hi, 0, sizeof(*hi));
+        hi->flag = INDEX_BY_UUID | INDEX_LOOKUP | INDEX_ITE_ACTIVE;
+        hi->uuid = rr->uuid;
+        hi->puuid = hmi.gdt_uuid;
+        hi->psalt = hmi.gdt_salt;
+        hi->hash = hash;
+        hi->itbid = itbid;
+        err = mds_cbht_search(hi, hmr, tx->txg, &tx->txg);
+        if (err)
+            goto check;
+        m = hmr_extract_local(hmr, EXTRACT_MDU, &nr);
+        if (!m) {
+            hvfs_err(mds, "extract MDU failed on resolve GDT %lx\n",
+                     rr->uuid);
+            err = -EFAULT;
+            __resolve_hmr_reset(hmr);
+            break;
+        }
+        re[rr->nr].uuid = rr->uuid;
+        re[rr->nr].salt = m->salt;
+        re[rr->nr].plen = rr->off;
+        re[rr->nr].mdu = m->mdu;
+        rr->nr++;
+        rr->puuid = rr->uuid;
+        rr->psalt = m->salt;
+        rr->uuid = 0;
+        __resolve_hmr_reset(hmr);
+        atomic64_inc(&hmo.prof.mds.resolve);
+        local++;
+        retry = 0;
+        continue;
+    check:
+        __resolve_hmr_reset(hmr);
+        if ((err == -EAGAIN || err == -ESPLIT ||
+             err == -ERESTART || err == -EHWAIT) &&
+            ++retry < MDS_RESOLVE_RETRY) {
+            /* have a breath, the ITB may move, so recheck the owner */
+            sched_yield();
+            err = 0;
+            continue;
+        }
+        break;
+    }
+    goto reply;
+
+forward:
+    /* Do not bounce a forwarded request that we can not resolve anything,
+     * the rings may disagree. */
+    if ((local || !(tx->req->tx.flag & XNET_FWD)) && rr->hops < MDS_FWD_MAX) {
+        rr->hops++;
+        err = mds_do_forward(tx->req, site);
+        if (!err) {
+            atomic64_inc(&hmo.prof.mds.resolve_fwd);
+            xfree(hi);
+            xfree(hmr);
+            mds_tx_chg2forget(tx);
+            mds_tx_done(tx);
+            return;
+        }
+        rr->hops--;
+    }
+
+reply:
+    xfree(hi);
+    xfree(hmr);
+    rr->err = err;
+
+    rpy = xmalloc(len);
+    if (unlikely(!rpy)) {
+        hvfs_err(mds, "xmalloc() resolve reply failed\n");
+        err = -ENOMEM;
+        goto send_err;
+    }
+    memcpy(rpy, rr, len);
+
+    tx->rpy = xnet_alloc_msg(XNET_MSG_NORMAL);
+    if (!tx->rpy) {
+        hvfs_err(mds, "xnet_alloc_msg() failed\n");
+        xfree(rpy);
+        /* do not retry myself */
+        mds_free_tx(tx);
+        return;
+    }
+
+#ifdef XNET_EAGER_WRITEV
+    xnet_msg_add_sdata(tx->rpy, &tx->rpy->tx, sizeof(struct xnet_msg_tx));
+#endif
+    xnet_msg_add_sdata(tx->rpy, rpy, len);
+
+    xnet_msg_fill_tx(tx->rpy, XNET_MSG_RPY, XNET_NEED_DATA_FREE, hmo.site_id,
+                     tx->reqin_site);
+    xnet_msg_fill_reqno(tx->rpy, tx->req->tx.reqno);
+    xnet_msg_fill_cmd(tx->rpy, XNET_RPY_DATA, 0, 0);
+    /* match the original request at the source site */
+    tx->rpy->tx.handle = tx->req->tx.handle;
+
+    mds_tx_done(tx);
+
+    if (xnet_send(hmo.xc, tx->rpy)) {
+        hvfs_err(mds, "xnet_send() failed\n");
+        /* do not retry myself, client is forced to retry */
+    }
+    mds_tx_reply(tx);
+    return;
+
+send_err:
+    mds_send_reply_nodata(tx, err, 0);
+}
@@ -28,6 +28,41 @@
 #define SEG_BASE (16 * 1024)
 #define SEG_TOTAL (SEG_BASE)    /* # of entries */
 
+/* EH dir seqcount
+ *
+ * The dir is searched w/o eh->lock. Segments and buckets are never freed
+ * until mds_cbht_destroy(), so a stale pointer read by a racing reader is
+ * always safe to access; the reader just rechecks the seq after it got the
+ * bucket.rlock and retries if any dir update slipped in.
+ */
+static inline void cbht_dir_write_begin(struct eh *eh)
+{
+    eh->seq++;
+    smp_wmb();
+}
+
+static inline void cbht_dir_write_end(struct eh *eh)
+{
+    smp_wmb();
+    eh->seq++;
+}
+
+static inline u32 cbht_dir_read_begin(struct eh *eh)
+{
+    u32 seq;
+
+    while ((seq = *(volatile u32 *)&eh->seq) & 1)
+        sched_yield();
+    smp_rmb();
+    return seq;
+}
+
+static inline int cbht_dir_read_retry(struct eh *eh, u32 seq)
+{
+    smp_rmb();
+    return *(volatile u32 *)&eh->seq != seq;
+}
+
 int mds_seg_alloc(struct segment *s, struct eh *eh)
 {
     int err = 0;
@@ -261,11 +296,13 @@ int __cbht cbht_enlarge_dir(struct eh *eh, u32 tdepth)
             if (err)
                 goto out;
             ss = s;
-            /* add to the dir list */
-            list_add_tail(&s->list, &eh->dir);
+            /* add to the dir list, the lockless readers may see it
+             * immediately */
+            list_add_tail_rcu(&s->list, &eh->dir);
         }
     }
-    /* ok to change the depth */
+    /* ok to change the depth, after the new segments are visible */
+    smp_wmb();
     eh->dir_depth++;
     mds_cbht_prof_depth(eh->dir_depth);
 
@@ -284,6 +321,7 @@ int __cbht cbht_update_dir(struct eh *eh, struct bucket *b)
      * We use timed lock to detect livelock and retry ourself.
      */
     xrwlock_wlock(&eh->lock);
+    cbht_dir_write_begin(eh);
 
     /* enlarge dir? */
     if (atomic_read(&b->depth) > eh->dir_depth) {
@@ -295,6 +333,7 @@ int __cbht cbht_update_dir(struct eh *eh, struct bucket *b)
     err = segment_update_dir(eh, (1 << eh->dir_depth), b);
     
 out:
+    cbht_dir_write_end(eh);
     xrwlock_wunlock(&eh->lock);
     return err;
 }
@@ -476,7 +515,7 @@ int mds_cbht_init(struct eh *eh, int bdepth)
 
     /* add to the dir list */
     xrwlock_wlock(&eh->lock);
-    list_add_tail(&s->list, &eh->dir);
+    list_add_tail_rcu(&s->list, &eh->dir);
     xrwlock_wunlock(&eh->lock);
 
     return 0;
@@ -566,6 +605,7 @@ retry:
     xrwlock_rlock(&i->h.lock);
     hlist_add_head(&i->h.cbht, &be->h);
     i->h.be = be;
+    itb_cache_admit(i);
     xrwlock_runlock(&i->h.lock);
     xrwlock_wunlock(&be->lock);
 
@@ -665,6 +705,7 @@ retry:
     xrwlock_rlock(&i->h.lock);
     hlist_add_head(&i->h.cbht, &be->h);
     i->h.be = be;
+    itb_cache_admit(i);
     xrwlock_runlock(&i->h.lock);
     xrwlock_wunlock(&be->lock);
 
@@ -821,19 +862,26 @@ keepon:
  *
  * if return value is not error, then the bucket rlock is holding
  *
+ * NOTE: we do not take the eh->lock here, the dir seqcount is rechecked after
+ * we got the bucket.rlock.
+ *
  * Error Convention: kernel ptr-err!
  */
 struct bucket * __cbht mds_cbht_search_dir(u64 hash, u32 *ldepth)
 {
     struct eh *eh = &hmo.cbht;
     struct segment *s;
-    struct bucket *b = ERR_PTR(-ENOENT); /* ENOENT means can not find it */
+    struct bucket *b;
     u64 offset;
-    int found = 0, err = 0, nr = 0;
+    u32 seq, depth;
+    int found, err = 0, nr = 0;
     
 retry:
-    xrwlock_rlock(&eh->lock);
-    offset = (hash >> eh->bucket_depth) & ((1 << eh->dir_depth) - 1);
+    b = ERR_PTR(-ENOENT);       /* ENOENT means can not find it */
+    found = 0;
+    seq = cbht_dir_read_begin(eh);
+    depth = eh->dir_depth;
+    offset = (hash >> eh->bucket_depth) & ((1 << depth) - 1);
     list_for_each_entry(s, &eh->dir, list) {
         if (s->offset <= offset && offset < (s->offset + s->len)) {
             found = 1;
@@ -852,27 +900,26 @@ retry:
                 /* EBUSY: somebody wlock the bucket for spliting? */
                 /* EAGAIN: max rlock got, retry */
                 /* OK: retry myself! */
-                xrwlock_runlock(&eh->lock);
-                /* NOTE THAT: the eh->lock is under heavy using in a
-                 * create-cluster test case, a lot of threads holding the
-                 * rlock will block the bucket_split() progressing. What
-                 * should we do? */
                 sched_yield();  /* do we need this? */
                 if (unlikely(hmo.conf.cbht_slow_down)) {
                     if (nr < 12)
                         nr++;
                     xsleep(lib_random(100 << nr));
                 }
-                found = 0;
                 goto retry;
             } else if (err) {
                 b = ERR_PTR(-err);
+            } else if (cbht_dir_read_retry(eh, seq)) {
+                /* the dir has changed, this bucket may be stale */
+                xrwlock_runlock(&b->lock);
+                goto retry;
             }
         }
+    } else if (cbht_dir_read_retry(eh, seq)) {
+        goto retry;
     }
             
-    *ldepth = eh->dir_depth;
-    xrwlock_runlock(&eh->lock);
+    *ldepth = depth;
 
     return b;
 }
@@ -1043,12 +1090,23 @@ int __cbht cbht_itb_miss(struct hvfs_index *hi,
                          struct hvfs_txg **otxg)
 {
     struct itb *i, *oi;
+    struct itb_load *il;
     struct bucket *b;
     struct bucket_entry *e;
     int err = 0;
 
-    /* Step1: read the itb from mdsl */
-    i = mds_read_itb(hi->puuid, hi->psalt, hi->itbid);
+    /* Step0: wait for the in-flight load of this ITB if there is one */
+    err = itb_load_enter(hi->puuid, hi->itbid, &il);
+    if (err == -EAGAIN || err == -EHWAIT)
+        return err;
+    if (err)
+        i = ERR_PTR(err);
+    else {
+        /* Step1: read the itb from mdsl */
+        i = mds_read_itb(hi->puuid, hi->psalt, hi->itbid);
+        if (IS_ERR(i))
+            itb_load_exit(il, PTR_ERR(i));
+    }
     if (IS_ERR(i)) {
         /* read itb failed, for what? */
         if (i == ERR_PTR(-EAGAIN) || i == ERR_PTR(-EHWAIT))
@@ -1111,6 +1169,7 @@ int __cbht cbht_itb_miss(struct hvfs_index *hi,
         }
     } else {
         /* get it, do search on it */
+        atomic64_inc(&hmo.prof.ic.miss);
         /* insert into the cbht */
         err = mds_cbht_insert_bbrlocked(&hmo.cbht, i, &b, &e, &oi);
         if (err == -EEXIST) {
@@ -1119,8 +1178,11 @@ int __cbht cbht_itb_miss(struct hvfs_index *hi,
             itb_free(i);
             i = oi;
         } else if (unlikely(err)) {
+            itb_load_exit(il, err);
             goto out;
         }
+        /* the waiters can find it in CBHT now */
+        itb_load_exit(il, 0);
         err = cbht_itb_hit(i, hi, hmr, txg, otxg);
         if (err == -EAGAIN) {
             /* release all the lockes */
@@ -1193,6 +1255,7 @@ retry:
         hlist_for_each_entry(ih, pos, &be->h, cbht) {
             if (ih->puuid == hi->puuid && ih->itbid == hi->itbid) {
                 /* OK, find the itb in the CBHT */
+                itb_cache_touch((struct itb *)ih);
                 err = cbht_itb_hit((struct itb *)ih, hi, hmr, txg, otxg);
                 if (err == -EAGAIN) {
                     /* no need to release the be.rlock */
@@ -79,6 +79,11 @@ struct eh
     xrwlock_t lock;             /* protect segment list */
     u32 dir_depth;              /* depth of the directory */
     u32 bucket_depth;           /* the size of each bucket */
+    /*
+     * Note: the dir is read w/o eh->lock. Writers holding the wlock make seq
+     * odd while changing the dir, readers retry if seq changed under them.
+     */
+    u32 seq;
 
     /* operations */
     struct eh_operations *ops;
@@ -161,6 +161,45 @@ void mds_dh_destroy(struct dh *dh)
         xfree(dh->ht);
 }
 
+/* mds_dh_bitmap_index()
+ *
+ * Publish a slice in the DHE slice index, the caller should hold e->lock and
+ * the slice should already be linked on e->bitmap. If we can not get a leaf,
+ * the slice is only reachable by the list walk.
+ */
+void mds_dh_bitmap_index(struct dhe *e, struct itbitmap *b)
+{
+    struct itbitmap **leaf;
+    u64 idx = b->offset / XTABLE_BITMAP_SIZE;
+
+    if (idx >= DH_BMI_MAX)
+        return;
+    leaf = e->bmi[idx >> DH_BMI_LEAF_SHIFT];
+    if (!leaf) {
+        leaf = xzalloc(DH_BMI_LEAF_SIZE * sizeof(struct itbitmap *));
+        if (!leaf) {
+            hvfs_warning(mds, "xzalloc() DHE %lx bitmap index leaf failed\n",
+                         e->uuid);
+            return;
+        }
+        smp_wmb();
+        e->bmi[idx >> DH_BMI_LEAF_SHIFT] = leaf;
+    }
+    smp_wmb();
+    leaf[idx & (DH_BMI_LEAF_SIZE - 1)] = b;
+}
+
+static inline
+void __dh_bitmap_index_free(struct dhe *e)
+{
+    int i;
+
+    for (i = 0; i < DH_BMI_DIR_SIZE; i++) {
+        if (e->bmi[i])
+            xfree(e->bmi[i]);
+    }
+}
+
 void mds_dh_evict(struct dh *dh)
 {
     struct regular_hash *rh;
@@ -185,6 +224,7 @@ void mds_dh_evict(struct dh *dh)
                 list_del(&b->list);
                 xfree(b);
             }
+            __dh_bitmap_index_free(tpos);
             xfree(tpos);
             atomic_dec(&dh->asize);
         }
@@ -315,6 +355,7 @@ int mds_dh_remove(struct dh *dh, u64 uuid)
                 list_del(&b->list);
                 mds_bitmap_free(b);
             }
+            __dh_bitmap_index_free(e);
             xlock_destroy(&e->lock);
             xfree(e);
             atomic_dec(&dh->asize);
@@ -371,6 +412,7 @@ void mds_dh_check(time_t cur)
                     list_del(&b->list);
                     xfree(b);
                 }
+                __dh_bitmap_index_free(tpos);
                 xfree(tpos);
                 atomic_dec(&dh->asize);
             } else if (last_idx == i && 
@@ -399,6 +441,7 @@ void mds_dh_check(time_t cur)
                         list_del(&b->list);
                         xfree(b);
                     }
+                    __dh_bitmap_index_free(tpos);
                     xfree(tpos);
                     atomic_dec(&dh->asize);
                     goto retry;
@@ -489,6 +532,7 @@ struct dhe *mds_dh_load(struct dh *dh, u64 duuid)
     struct dhe *e = ERR_PTR(-ENOTEXIST);
     struct dir_trigger_mgr *dtm = NULL;
     u64 tsid;                   /* target site id */
+    u32 zip = 0;                /* ITB codec policy in GDT entry */
     int err = 0, no;
 
     msg = xnet_alloc_msg(XNET_MSG_CACHE);
@@ -618,6 +662,7 @@ struct dhe *mds_dh_load(struct dh *dh, u64 duuid)
                 }
             }
             thi.ssalt = m->salt;
+            zip = HVFS_MDU_ZIP(m->mdu.flags);
         }
         
         e = mds_dh_insert(dh, &thi);
@@ -639,6 +684,7 @@ struct dhe *mds_dh_load(struct dh *dh, u64 duuid)
         } else {
             /* install the trigger now */
             e->data = dtm;
+            e->zip = zip;
         }
     out_free_hmr:
         xfree(hmr);
@@ -727,6 +773,7 @@ struct dhe *mds_dh_load(struct dh *dh, u64 duuid)
                     }
                 }
                 rhi->ssalt = saved_salt;
+                zip = HVFS_MDU_ZIP(m->mdu.flags);
             }
             
             /* Note that, we know that the LDH will return the HI with ssalt
@@ -753,6 +800,7 @@ struct dhe *mds_dh_load(struct dh *dh, u64 duuid)
             } else {
                 /* install the trigger now */
                 e->data = dtm;
+                e->zip = zip;
             }
         }
     }
@@ -879,6 +927,7 @@ int mds_dh_reload_nolock(struct dhe *ue)
             if (thi.uuid == hmi.root_uuid)
                 thi.puuid = hmi.gdt_uuid;
             thi.psalt = hmi.gdt_salt;
+            ue->zip = HVFS_MDU_ZIP(m->mdu.flags);
             if ((m->mdu.flags & HVFS_MDU_IF_TRIG) && c &&
                 HVFS_IS_MDS(hmo.site_id)) {
                 /* load the trigger content from MDSL */
@@ -980,6 +1029,7 @@ int mds_dh_reload_nolock(struct dhe *ue)
                 rhi->puuid = hmi.gdt_uuid;
             rhi->psalt = hmi.gdt_salt;
             if (m) {
+                ue->zip = HVFS_MDU_ZIP(m->mdu.flags);
                 c = hmr_extract(hmr, EXTRACT_DC, &no);
                 if (!c) {
                     hvfs_err(mds, "hmr_extract DC failed, do not found this "
@@ -1125,6 +1175,10 @@ void mds_dh_gossip(struct dh *dh)
  *
  * Convert the hash to itbid by lookup the bitmap. This is a hot path that we
  * should optimize it hardly.
+ *
+ * The cached slices are found in the DHE slice index w/o e->lock. Slices are
+ * never removed from a live DHE, thus our DHE reference keeps them valid. We
+ * only fall back to the locked list walk on an index miss.
  */
 u64 mds_get_itbid(struct dhe *e, u64 hash)
 {
@@ -1133,6 +1187,14 @@ u64 mds_get_itbid(struct dhe *e, u64 hash)
     int err;
 
 retry:
+    b = mds_dh_bitmap_lookup(e, offset);
+    if (likely(b)) {
+        if (mds_bitmap_lookup(b, offset))
+            return offset;
+        offset = mds_bitmap_fallback(offset);
+        goto retry;
+    }
+
     xlock_lock(&e->lock);
     list_for_each_entry(b, &e->bitmap, list) {
         if (b->offset <= offset && offset < b->offset + XTABLE_BITMAP_SIZE) {
@@ -1158,7 +1220,8 @@ retry:
                 /* ok, this means that b is the last entry, we should load the
                  * next bitmap slice */
                 xlock_unlock(&e->lock);
-                err = mds_bitmap_load(e, b->offset + XTABLE_BITMAP_SIZE);
+                err = mds_bitmap_load_batch(e, b->offset +
+                                            XTABLE_BITMAP_SIZE);
                 if (err == -ENOTEXIST) {
                     /* FIXME: FATAL error this maybe a hole? */
                     offset = mds_bitmap_fallback(offset);
@@ -1174,7 +1237,7 @@ retry:
         } else if (b->offset > offset) {
             /* it means that we need to load the missing slice */
             xlock_unlock(&e->lock);
-            err = mds_bitmap_load(e, offset);
+            err = mds_bitmap_load_batch(e, offset);
             if (err == -ENOTEXIST) {
                 offset = mds_bitmap_fallback(offset);
             } else if (err) {
@@ -1190,7 +1253,7 @@ retry:
 
     /* Hoo, we have not found the bitmap slice. We need to request the
      * bitmap slice from the GDT server */
-    err = mds_bitmap_load(e, offset);
+    err = mds_bitmap_load_batch(e, offset);
     if (err == -ENOTEXIST) {
         offset = mds_bitmap_fallback(offset);
     } else if (err) {
@@ -32,17 +32,29 @@ struct dh
     atomic_t asize;
 };
 
+/* The bitmap slices of a DHE are indexed by slice number (offset /
+ * XTABLE_BITMAP_SIZE) in a two level radix. The leaves are allocated on
+ * demand under e->lock and only freed with the DHE, thus mds_get_itbid() can
+ * look up a slice w/o e->lock. Slices beyond DH_BMI_MAX are only on the
+ * list. */
+#define DH_BMI_LEAF_SHIFT       6
+#define DH_BMI_LEAF_SIZE        (1 << DH_BMI_LEAF_SHIFT)
+#define DH_BMI_DIR_SIZE         64
+#define DH_BMI_MAX              (DH_BMI_DIR_SIZE * DH_BMI_LEAF_SIZE)
+
 struct dhe
 {
     struct hlist_node hlist;    /* list in DH hash table */
     struct list_head bitmap;    /* list head of bitmap */
     xlock_t lock;               /* protect the bitmap list */
+    struct itbitmap **bmi[DH_BMI_DIR_SIZE]; /* bitmap slice index */
     u64 uuid;                   /* UUID of this directory */
     u64 puuid;                  /* UUID of the parent directory */
     u64 salt;                   /* salt of this directory */
     u64 life;                   /* when this dhe is loaded */
     time_t update;              /* reload update time */
     void *data;                 /* pointer to Trigger data (DTM) */
+    u32 zip;                    /* ITB codec policy, see HVFS_MDU_ZIP */
     atomic_t ref;               /* the reference count */
 };
 
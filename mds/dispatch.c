@@ -57,6 +57,9 @@ int mds_client_dispatch(struct xnet_msg *msg)
     case HVFS_CLT2MDS_LOOKUP:
         mds_lookup(tx);
         break;
+    case HVFS_CLT2MDS_RESOLVE:
+        mds_resolve(tx);
+        break;
     case HVFS_CLT2MDS_CREATE:
         mds_create(tx);
         break;
@@ -102,7 +102,13 @@ int mds_do_forward(struct xnet_msg *msg, u64 dsite)
     struct mds_fwd *mf = NULL, *rmf = NULL;
     struct xnet_msg *fmsg;
 
-    if (unlikely(msg->tx.flag & XNET_FWD)) {
+    if (unlikely(msg->tx.flag & XNET_FWD) &&
+        msg->tx.cmd == HVFS_CLT2MDS_RESOLVE) {
+        /* a resolve request visits the owner of each path component, thus
+         * revisiting a site is not a loop and the payload is not a
+         * hvfs_index. The hop count is bounded by mds_resolve(). */
+        relaied = 1;
+    } else if (unlikely(msg->tx.flag & XNET_FWD)) {
         atomic64_inc(&hmo.prof.mds.loop_fwd);
         /* check if this message is looped. if it is looped, we should refresh
          * the bitmap and just forward the message as normal. until receive
@@ -264,10 +270,15 @@ out:
 
 int mds_ring_update(struct xnet_msg *msg)
 {
+    struct chring *oring = hmo.chring[CH_RING_MDS];
+
     if (msg->xm_datacheck) {
         /* ok, we should call the ring update callback function */
-        if (hmo.cb_ring_update)
+        if (hmo.cb_ring_update) {
             hmo.cb_ring_update(msg->xm_data);
+            /* preload the ITBs owned by this site now */
+            mds_warmup_ring_change(oring);
+        }
     } else {
         hvfs_err(mds, "Invalid data region of ring update request from %ld\n",
                  msg->tx.ssite_id);
@@ -37,7 +37,7 @@ int mds_loadin_control(void)
 {
     if (unlikely(hmo.conf.option & HVFS_MDS_MEMLIMIT)) {
         if (unlikely(hmo.conf.memlimit < atomic_read(&hmo.prof.cbht.aitb) *
-                     (sizeof(struct itb) + ITB_SIZE * sizeof(struct ite)))) {
+                     ITB_ACTIVE_SIZE)) {
             if (!hmo.spool_modify_pause) {
                 hmo.spool_modify_pause = 1;
                 hmo.mp_ts = time(NULL);
@@ -154,13 +154,13 @@ struct itb *mds_read_itb(u64 puuid, u64 psalt, u64 itbid)
 
         /* checking the ITB */
         ASSERT(msg->pair->tx.len == atomic_read(&i->h.len), mds);
-        if (i->h.compress_algo == COMPR_LZO) {
+        if (i->h.compress_algo != COMPR_NONE) {
             /* decompress the ITB */
             int err;
             
-            err = itb_lzo_decompress(i);
+            err = itb_zip_decompress(i);
             if (err) {
-                hvfs_err(mds, "itb_lzo_decompress() failed w/ %d\n", err);
+                hvfs_err(mds, "itb_zip_decompress() failed w/ %d\n", err);
                 i = ERR_PTR(-EFAULT);
                 xnet_set_auto_free(msg->pair);
                 goto out_free;
@@ -174,11 +174,15 @@ struct itb *mds_read_itb(u64 puuid, u64 psalt, u64 itbid)
         t = mds_get_open_txg(&hmo);
         i->h.txg = t->txg;
         i->h.state = ITB_STATE_CLEAN;
+        txg_put(t);
         /* re-init */
-        itb_reinit(i);
+        if (itb_reinit(i)) {
+            i = ERR_PTR(-ENOMEM);
+            xnet_set_auto_free(msg->pair);
+            goto out_free;
+        }
         if (atomic_read(&i->h.entries) == 0)
             itb_idx_bmp_reinit(i);
-        txg_put(t);
 
         atomic64_add(atomic_read(&i->h.entries), &hmo.prof.cbht.aentry);
     }
@@ -190,6 +194,146 @@ out_free:
     return i;
 }
 
+/* __itb_drop_raw() releases the ITB got from get_free_itb_fast() before
+ * itb_reinit() succeeds, the header is copied from the ITB image.
+ */
+static inline
+void __itb_drop_raw(struct itb *i)
+{
+    xrwlock_init(&i->h.lock);
+    INIT_HLIST_NODE(&i->h.cbht);
+    itb_free(i);
+}
+
+/* mds_read_itb_batch()
+ *
+ * Load the ITBs in [begin, end) of directory @puuid stored on MDSL site
+ * @dsite w/ the batched requests. @cb is called w/ each loaded ITB, and it
+ * owns the ITB then.
+ *
+ * Return the # of ITBs loaded, or the error.
+ */
+int mds_read_itb_batch(u64 puuid, u64 dsite, u64 begin, u64 end,
+                       int (*cb)(struct itb *, void *), void *arg)
+{
+    struct storage_index si;
+    struct xnet_msg *msg;
+    struct hvfs_txg *t;
+    struct itb *i, *n;
+    u32 offset, len;
+    int err = 0, nr = 0, j;
+
+    if (unlikely(hmo.conf.option & HVFS_MDS_MEMONLY))
+        return -EINVAL;
+
+    while (begin < end) {
+        si.sic.uuid = puuid;
+        si.sic.arg0 = end;
+        si.sm.cnr = 0;              /* no data */
+        msg = xnet_alloc_msg(XNET_MSG_NORMAL);
+        if (!msg) {
+            hvfs_debug(mds, "xnet_alloc_msg() in low memory.\n");
+            return -ENOMEM;
+        }
+        xnet_msg_fill_tx(msg, XNET_MSG_REQ, XNET_NEED_REPLY,
+                         hmo.xc->site_id, dsite);
+        xnet_msg_fill_cmd(msg, HVFS_MDS2MDSL_ITB_BATCH, puuid, begin);
+#ifdef XNET_EAGER_WRITEV
+        xnet_msg_add_sdata(msg, &msg->tx, sizeof(msg->tx));
+#endif
+        xnet_msg_add_sdata(msg, &si, sizeof(si));
+
+        err = xnet_send(hmo.xc, msg);
+        if (err) {
+            hvfs_err(mds, "xnet_send() failed with %d\n", err);
+            goto out_free;
+        }
+        ASSERT(msg->pair, mds);
+        if (msg->pair->tx.err) {
+            hvfs_err(mds, "MDSL %lx respond %d w/ uuid %lx ITB [%ld,%ld) "
+                     "batched read request.\n",
+                     msg->pair->tx.ssite_id, msg->pair->tx.err,
+                     puuid, begin, end);
+            err = msg->pair->tx.err;
+            goto out_free;
+        }
+        if (msg->pair->tx.arg0 <= begin) {
+            hvfs_err(mds, "Invalid batched ITB load reply received from %lx\n",
+                     msg->pair->tx.ssite_id);
+            err = -EIO;
+            goto out_free;
+        }
+        begin = msg->pair->tx.arg0;
+
+        /* unpack the ITBs to the whole ITB buffers */
+        offset = 0;
+        for (j = 0; j < msg->pair->tx.arg1; j++) {
+            if (!msg->pair->xm_datacheck ||
+                offset + sizeof(struct itbh) > msg->pair->tx.len) {
+                err = -EIO;
+                break;
+            }
+            i = (struct itb *)(msg->pair->xm_data + offset);
+            len = atomic_read(&i->h.len);
+            if (len < sizeof(struct itbh) || len > ITB_MEM_SIZE ||
+                offset + len > msg->pair->tx.len) {
+                err = -EIO;
+                break;
+            }
+            offset += len;
+
+            n = get_free_itb_fast();
+            if (!n) {
+                err = -ENOMEM;
+                break;
+            }
+            memcpy(n, i, len);
+            if (n->h.compress_algo != COMPR_NONE) {
+                err = itb_zip_decompress(n);
+                if (err) {
+                    hvfs_err(mds, "itb_zip_decompress() failed w/ %d\n", err);
+                    __itb_drop_raw(n);
+                    err = -EFAULT;
+                    break;
+                }
+            }
+
+            /* changing the dirty info */
+            t = mds_get_open_txg(&hmo);
+            n->h.txg = t->txg;
+            n->h.state = ITB_STATE_CLEAN;
+            txg_put(t);
+            /* re-init */
+            if (itb_reinit(n)) {
+                __itb_drop_raw(n);
+                err = -ENOMEM;
+                break;
+            }
+            if (atomic_read(&n->h.entries) == 0)
+                itb_idx_bmp_reinit(n);
+
+            atomic64_add(atomic_read(&n->h.entries), &hmo.prof.cbht.aentry);
+            atomic64_inc(&hmo.prof.mdsl.itb_load);
+            nr++;
+            err = cb(n, arg);
+            if (err)
+                break;
+        }
+        if (err) {
+            hvfs_err(mds, "unpack the batched ITBs from %lx failed w/ %d\n",
+                     msg->pair->tx.ssite_id, err);
+            goto out_free;
+        }
+        xnet_free_msg(msg);
+    }
+
+    return nr;
+out_free:
+    xnet_free_msg(msg);
+
+    return err;
+}
+
 /* __itb_get_free_index
  */
 long __itb_get_free_index(struct itb *i)
@@ -340,6 +484,9 @@ int itb_add_ite(struct itb *i, struct hvfs_index *hi, void *data,
             *dtite = ite;
             memset(ite, 0, sizeof(struct ite));
             ite->hash = hi->hash;
+#ifdef ITB_INDEX_FP
+            i->fp[nr] = itb_fp(hi->hash);
+#endif
             /* setting up the ITE fields */
             if (unlikely(hi->flag & INDEX_CREATE_LINK)) {
                 ite->flag |= ITE_FLAG_LS;
@@ -385,6 +532,7 @@ int itb_add_ite(struct itb *i, struct hvfs_index *hi, void *data,
             __itb_add_index(i, offset, nr, hi->name);
             /* set up the mdu base on hi->data */
             ite_create(hi, ite);
+            itb_hot_sync(i, nr);
             /* copy the mdu into the hmr buffer */
             hi->uuid = ite->uuid;
             /* FIXME: we can optimize the kv memcpy here! */
@@ -493,6 +641,10 @@ retry:
         /* now we got a free ITB entry at position nr */
         ite = &i->ite[nr];
         memcpy(ite, e, sizeof(struct ite));
+        itb_hot_sync(i, nr);
+#ifdef ITB_INDEX_FP
+        i->fp[nr] = itb_fp(e->hash);
+#endif
         /* next step: we try to get a free index entry */
         __itb_add_index(i, offset, nr, e->s.name);
         atomic_inc(&i->h.entries);
@@ -628,14 +780,17 @@ void ite_unlink(struct ite *e, struct itb *i, u64 offset, u64 pos)
              * configration saied that :) */
             if (hmo.conf.async_unlink) {
                 e->flag = ((e->flag & ~ITE_STATE_MASK) | ITE_UNLINKED);
+                ITB_HOT(i)[e - i->ite].flag = e->flag;
                 if (unlikely(list_empty(&i->h.unlink)))
                     list_add_tail(&i->h.unlink, &hmo.async_unlink);
             } else {
                 /* delete the entry imediately */
                 itb_del_ite(i, e, offset, pos);
             }
-        } else
+        } else {
             e->flag = ((e->flag & ~ITE_STATE_MASK) | ITE_SHADOW);
+            ITB_HOT(i)[e - i->ite].flag = e->flag;
+        }
     } else if (e->flag & ITE_FLAG_LS) {
         /* FIXME: hard link file, nobody refer it, just delete it */
         e->s.mdu.nlink = 0;
@@ -1007,14 +1162,17 @@ void ite_update(struct hvfs_index *hi, struct ite *e)
 /*
  * ITE match
  *
+ * The hot fields @h are checked first, the cold ITE @e is only touched to
+ * compare the name or the KV key string.
+ *
  * Return: ITE_MATCH_MISS/ITE_MATCH_HIT
  */
-inline int ite_match(struct ite *e, struct hvfs_index *hi)
+inline int ite_match(struct ite_hot *h, struct ite *e, struct hvfs_index *hi)
 {
     /* for kv store, we just compare the key with the hash value */
     if (unlikely(hi->flag & INDEX_KV)) {
         if (hi->kvflag & HVFS_KV_STR) {
-            if (hi->hash != e->v.key)
+            if (hi->hash != h->hash)
                 return ITE_MATCH_MISS;
             else {
                 /* we reuse hi->uuid as the key length */
@@ -1028,7 +1186,7 @@ inline int ite_match(struct ite *e, struct hvfs_index *hi)
             }
         } else {
             /* defaults to KV_NORMAL */
-            if (hi->hash == e->v.key)
+            if (hi->hash == h->hash)
                 return ITE_MATCH_HIT;
             else
                 return ITE_MATCH_MISS;
@@ -1037,28 +1195,28 @@ inline int ite_match(struct ite *e, struct hvfs_index *hi)
     
     /* compare the name or uuid */
     if (unlikely(hi->flag & INDEX_ITE_SHADOW)) { 
-        if (((e->flag & ITE_STATE_MASK) != ITE_SHADOW) && 
-            ((e->flag & ITE_STATE_MASK) != ITE_UNLINKED))
+        if (((h->flag & ITE_STATE_MASK) != ITE_SHADOW) && 
+            ((h->flag & ITE_STATE_MASK) != ITE_UNLINKED))
             return ITE_MATCH_MISS;
     }
     
     if ((hi->flag & INDEX_ITE_ACTIVE) && 
-        ((e->flag & ITE_STATE_MASK) != ITE_ACTIVE))
+        ((h->flag & ITE_STATE_MASK) != ITE_ACTIVE))
         return ITE_MATCH_MISS;
 
     /* we default to access the ACTIVE ite, the shadow ite is excluded! */
-    if (unlikely((e->flag & ITE_STATE_MASK) == ITE_UNLINKED)) {
+    if (unlikely((h->flag & ITE_STATE_MASK) == ITE_UNLINKED)) {
         if (!(hi->flag & INDEX_ITE_SHADOW))
             return ITE_MATCH_MISS;
     }
 
     if (hi->flag & INDEX_BY_UUID) {
-        if (e->uuid == hi->uuid && e->hash == hi->hash) {
+        if (h->uuid == hi->uuid && h->hash == hi->hash) {
             return ITE_MATCH_HIT;
         } else
             return ITE_MATCH_MISS;
     } else if (hi->flag & INDEX_BY_NAME) {
-        if (hi->namelen == e->namelen && 
+        if (hi->namelen == h->namelen && 
             memcmp(e->s.name, hi->name, hi->namelen) == 0) {
             return ITE_MATCH_HIT;
         } else
@@ -1079,13 +1237,40 @@ int itb_cache_init(struct itb_cache *ic, int hint_size)
     
     INIT_LIST_HEAD(&ic->lru);
     atomic_set(&ic->csize, 0);
+    atomic64_set(&ic->a1in, 0);
     xlock_init(&ic->lock);
+
+    /* init the ghost table, a negative size disable the ghosts */
+    if (!hmo.conf.itb_ghost)
+        hmo.conf.itb_ghost = ITB_GHOST_DEFAULT;
+    ic->gsize = hmo.conf.itb_ghost / ITB_GHOST_PARTS;
+    if (ic->gsize < 0)
+        ic->gsize = 0;
+    for (j = 0; j < ITB_GHOST_PARTS; j++) {
+        xlock_init(&ic->ghost[j].lock);
+        ic->ghost[j].slots = NULL;
+        if (!ic->gsize)
+            continue;
+        ic->ghost[j].slots = xmalloc(ic->gsize * sizeof(struct itb_ghost));
+        if (!ic->ghost[j].slots) {
+            hvfs_err(mds, "xmalloc() ITB ghost table failed\n");
+            return -ENOMEM;
+        }
+        /* itbid -1UL means an empty slot */
+        memset(ic->ghost[j].slots, 0xff, 
+               ic->gsize * sizeof(struct itb_ghost));
+    }
+    for (j = 0; j < ITB_LOAD_PARTS; j++) {
+        xlock_init(&ic->load[j].lock);
+        INIT_HLIST_HEAD(&ic->load[j].h);
+    }
+
     if (!hint_size)
         return 0;
     
     /* pre-allocate the ITBs */
     for (j = 0; j < hint_size; j++) {
-        i = xzalloc(sizeof(struct itb) + sizeof(struct ite) * ITB_SIZE);
+        i = xzalloc(ITB_MEM_SIZE);
         if (!i) {
             hvfs_info(mds, "xzalloc() ITBs failed, continue ...\n");
             continue;
@@ -1101,16 +1286,281 @@ int itb_cache_init(struct itb_cache *ic, int hint_size)
 int itb_cache_destroy(struct itb_cache *ic)
 {
     struct itbh *pos, *n;
+    int j;
 
     list_for_each_entry_safe(pos, n, &ic->lru, list) {
         list_del(&pos->list);
         xfree(pos);
     }
+    for (j = 0; j < ITB_GHOST_PARTS; j++) {
+        xfree(ic->ghost[j].slots);
+        xlock_destroy(&ic->ghost[j].lock);
+    }
+    for (j = 0; j < ITB_LOAD_PARTS; j++) {
+        xlock_destroy(&ic->load[j].lock);
+    }
 
     return 0;
 }
 
+__thread int itb_hit_slot = -1;
+
+/* itb_cache_hit_slot()
+ *
+ * Assign the per-thread hit counter slot, round robin.
+ */
+int itb_cache_hit_slot(void)
+{
+    static atomic_t rr = {0,};
+
+    return atomic_add_return(1, &rr) & (ITB_HIT_SLOTS - 1);
+}
+
+/* mds_ic_prof() folds the per-thread hit counters to hmo.prof.ic
+ */
+void mds_ic_prof(void)
+{
+    u64 hit = 0;
+    int i;
+
+    for (i = 0; i < ITB_HIT_SLOTS; i++) {
+        hit += atomic64_read(&hmo.ic.hit[i].hit);
+    }
+    atomic64_set(&hmo.prof.ic.hit, hit);
+}
+
+/* __itb_cache_setq() moves the ITB to queue q, and keeps the A1in count
+ */
+static inline
+void __itb_cache_setq(struct itb_cstate *cs, u8 q)
+{
+    if (cs->q == ITB_CQ_A1IN)
+        atomic64_dec(&hmo.ic.a1in);
+    if (q == ITB_CQ_A1IN)
+        atomic64_inc(&hmo.ic.a1in);
+    cs->q = q;
+    cs->ref = 0;
+    cs->aged = 0;
+}
+
+/* __itb_ghost_slot()
+ *
+ * The ghost table is direct mapped by the CBHT hash, a newer ghost only
+ * overwrites an empty slot or a ghost older than ITB_GHOST_PASSES scrub
+ * intervals.
+ */
+static inline
+struct itb_ghost *__itb_ghost_slot(struct itb_cache *ic, u64 hash, 
+                                   struct itb_ghost_part **gp)
+{
+    *gp = &ic->ghost[hash & (ITB_GHOST_PARTS - 1)];
+    return (*gp)->slots + (hash / ITB_GHOST_PARTS) % ic->gsize;
+}
+
+/* itb_cache_admit()
+ *
+ * Set the 2Q queue of a newly hashed ITB. If the ghost of this ITB is alive,
+ * it has been evicted from A1in recently, so it goes to Am now.
+ *
+ * NOTE: h.hash should be set
+ */
+void itb_cache_admit(struct itb *i)
+{
+    struct itb_cstate *cs = ITB_CSTATE(i);
+    struct itb_ghost_part *gp;
+    struct itb_ghost *g;
+    u8 q = ITB_CQ_A1IN;
+
+    if (hmo.ic.gsize) {
+        g = __itb_ghost_slot(&hmo.ic, i->h.hash, &gp);
+        xlock_lock(&gp->lock);
+        if (g->puuid == i->h.puuid && g->itbid == i->h.itbid) {
+            g->itbid = -1UL;
+            q = ITB_CQ_AM;
+        }
+        xlock_unlock(&gp->lock);
+        if (q == ITB_CQ_AM)
+            atomic64_inc(&hmo.prof.ic.ghost_hit);
+    }
+    __itb_cache_setq(cs, q);
+}
+
+/* itb_cache_victim()
+ *
+ * Called by the scrub pass on a clean ITB. Return 1 if the ITB should be
+ * evicted. The referenced Am ITBs get a second chance. An A1in ITB survives
+ * its first pass if A1in is within the bound, and it is promoted to Am if it
+ * is referenced after that pass.
+ */
+int itb_cache_victim(struct itb *i)
+{
+    struct itb_cstate *cs = ITB_CSTATE(i);
+
+    switch (cs->q) {
+    case ITB_CQ_AM:
+        if (cs->ref) {
+            cs->ref = 0;
+            atomic64_inc(&hmo.prof.ic.second_chance);
+            return 0;
+        }
+        break;
+    case ITB_CQ_A1IN:
+        if (cs->aged) {
+            if (cs->ref) {
+                __itb_cache_setq(cs, ITB_CQ_AM);
+                atomic64_inc(&hmo.prof.ic.promote);
+                return 0;
+            }
+        } else if (atomic64_read(&hmo.ic.a1in) * ITB_A1IN_RATIO <=
+                   atomic64_read(&hmo.prof.cbht.aitb)) {
+            cs->aged = 1;
+            cs->ref = 0;
+            return 0;
+        }
+        break;
+    default:;
+    }
+    return 1;
+}
+
+/* itb_cache_evicted()
+ *
+ * The ITB has been unhashed from CBHT by eviction, remember its key if it
+ * comes from A1in.
+ */
+void itb_cache_evicted(struct itb *i)
+{
+    struct itb_cstate *cs = ITB_CSTATE(i);
+    struct itb_ghost_part *gp;
+    struct itb_ghost *g;
+
+    if (cs->q == ITB_CQ_AM) {
+        atomic64_inc(&hmo.prof.ic.evict_am);
+    } else {
+        atomic64_inc(&hmo.prof.ic.evict_a1);
+        if (hmo.ic.gsize) {
+            g = __itb_ghost_slot(&hmo.ic, i->h.hash, &gp);
+            xlock_lock(&gp->lock);
+            if (g->itbid == -1UL || g->ts + ITB_GHOST_PASSES *
+                hmo.conf.scrub_interval <= hmo.scrub_ts) {
+                g->puuid = i->h.puuid;
+                g->itbid = i->h.itbid;
+                g->ts = hmo.scrub_ts;
+            }
+            xlock_unlock(&gp->lock);
+        }
+    }
+    __itb_cache_setq(cs, ITB_CQ_NONE);
+}
+
+/* itb_cache_forget()
+ *
+ * The ITB is freed w/o eviction, drop it from its queue.
+ */
+void itb_cache_forget(struct itb *i)
+{
+    __itb_cache_setq(ITB_CSTATE(i), ITB_CQ_NONE);
+}
+
+/* itb_load_enter()
+ *
+ * Register an in-flight load of ITB (puuid, itbid). Return 0 w/ @ol set if
+ * we should load it, and itb_load_exit() must be called after the ITB is
+ * inserted to CBHT or the load failed. Otherwise, wait for the in-flight load
+ * and return its result: -EAGAIN if the ITB is in CBHT now, or the error of
+ * the load.
+ */
+int itb_load_enter(u64 puuid, u64 itbid, struct itb_load **ol)
+{
+    struct itb_load_part *lp;
+    struct itb_load *il;
+    struct hlist_node *pos;
+    u64 begin;
+    int err, found = 0, last = 0;
+
+    lp = &hmo.ic.load[hvfs_hash(puuid, itbid, sizeof(u64), HASH_SEL_CBHT) &
+                      (ITB_LOAD_PARTS - 1)];
+    xlock_lock(&lp->lock);
+    hlist_for_each_entry(il, pos, &lp->h, hlist) {
+        if (il->puuid == puuid && il->itbid == itbid) {
+            il->waiters++;
+            found = 1;
+            break;
+        }
+    }
+    if (!found) {
+        il = xzalloc(sizeof(*il));
+        if (!il) {
+            xlock_unlock(&lp->lock);
+            /* load it w/o coalescing */
+            *ol = NULL;
+            return 0;
+        }
+        il->puuid = puuid;
+        il->itbid = itbid;
+        sem_init(&il->sem, 0, 0);
+        hlist_add_head(&il->hlist, &lp->h);
+        xlock_unlock(&lp->lock);
+        *ol = il;
+        return 0;
+    }
+    xlock_unlock(&lp->lock);
+
+    /* wait for the in-flight load */
+    atomic64_inc(&hmo.prof.ic.coalesced);
+    begin = lib_rdtsc();
+    do {
+        err = sem_wait(&il->sem);
+    } while (err && errno == EINTR);
+    if (likely(cpu_frequency >> 20))
+        atomic64_add((lib_rdtsc() - begin) / (cpu_frequency >> 20),
+                     &hmo.prof.ic.coalesced_wait);
+
+    xlock_lock(&lp->lock);
+    err = il->err;
+    if (--il->waiters == 0 && il->done)
+        last = 1;
+    xlock_unlock(&lp->lock);
+    if (last) {
+        sem_destroy(&il->sem);
+        xfree(il);
+    }
+
+    return err ? err : -EAGAIN;
+}
+
+/* itb_load_exit()
+ *
+ * Complete the in-flight load w/ @err and wake up the waiters.
+ */
+void itb_load_exit(struct itb_load *il, int err)
+{
+    struct itb_load_part *lp;
+    int n;
+
+    if (!il)
+        return;
+    lp = &hmo.ic.load[hvfs_hash(il->puuid, il->itbid, sizeof(u64),
+                                HASH_SEL_CBHT) & (ITB_LOAD_PARTS - 1)];
+    xlock_lock(&lp->lock);
+    hlist_del(&il->hlist);
+    il->err = err;
+    il->done = 1;
+    n = il->waiters;
+    xlock_unlock(&lp->lock);
+
+    if (!n) {
+        sem_destroy(&il->sem);
+        xfree(il);
+        return;
+    }
+    while (n--)
+        sem_post(&il->sem);
+}
+
 /* get_free_itb_fast()
+ *
+ * NOTE: the ITB has no hot array, itb_reinit() allocates it.
  */
 struct itb *get_free_itb_fast(void)
 {
@@ -1132,11 +1582,12 @@ struct itb *get_free_itb_fast(void)
             mds_cbht_del(&hmo.cbht, n);
     } else {
         /* try to malloc() one */
-        n = xmalloc(sizeof(struct itb) + sizeof(struct ite) * ITB_SIZE);
+        n = xmalloc(ITB_MEM_SIZE);
         if (!n) {
             hvfs_err(mds, "xmalloc() ITB failed\n");
             return NULL;
         }
+        ITB_HOT(n) = NULL;
         atomic_inc(&hmo.ic.csize);
     }
 
@@ -1174,7 +1625,7 @@ struct itb *get_free_itb(struct hvfs_txg *txg)
         if (unlikely(hmo.conf.option & HVFS_MDS_MEMLIMIT)) {
             if (!hmo.spool_modify_pause && 
                 (unlikely(hmo.conf.memlimit <= atomic_read(&hmo.prof.cbht.aitb) * 
-                          (sizeof(struct itb) + ITB_SIZE * sizeof(struct ite))))) {
+                          ITB_ACTIVE_SIZE))) {
                 hmo.spool_modify_pause = 1;
                 hmo.mp_ts = time(NULL);
                 hvfs_err(mds, "Pause modify operations @ %s", ctime(&hmo.mp_ts));
@@ -1182,13 +1633,22 @@ struct itb *get_free_itb(struct hvfs_txg *txg)
             }
         }
         /* try to malloc() one */
-        n = xzalloc(sizeof(struct itb) + sizeof(struct ite) * ITB_SIZE);
+        n = xzalloc(ITB_MEM_SIZE);
         if (!n) {
             hvfs_err(mds, "xzalloc() ITB failed\n");
             return NULL;
         }
         atomic_inc(&hmo.ic.csize);
     }
+    memset(ITB_MEM(n), 0, sizeof(struct itb_mem));
+    ITB_HOT(n) = xmalloc(ITB_HOT_LEN);
+    if (!ITB_HOT(n)) {
+        hvfs_err(mds, "xmalloc() ITB hot array failed\n");
+        xlock_lock(&hmo.ic.lock);
+        list_add_tail(&n->h.list, &hmo.ic.lru);
+        xlock_unlock(&hmo.ic.lock);
+        return NULL;
+    }
 
     atomic_set(&n->h.len, sizeof(struct itb));
     n->h.adepth = ITB_DEPTH;
@@ -1226,12 +1686,20 @@ struct itb *get_free_itb(struct hvfs_txg *txg)
 /* itb_reinit()
  *
  * NOTE: this function only used for reinit the headers and lock region for a
- * transfered ITB.
+ * transfered ITB. @n should be a whole ITB from get_free_itb_fast(), since the
+ * in-memory states are beyond h.len.
  */
-void itb_reinit(struct itb *n)
+int itb_reinit(struct itb *n)
 {
-    int i;
+    int i, nr;
     
+    if (!ITB_HOT(n)) {
+        ITB_HOT(n) = xmalloc(ITB_HOT_LEN);
+        if (!ITB_HOT(n)) {
+            hvfs_err(mds, "xmalloc() ITB hot array failed\n");
+            return -ENOMEM;
+        }
+    }
     xrwlock_init(&n->h.lock);
 #ifdef _USE_SPINLOCK
     xspinlock_init(&n->h.ilock);
@@ -1256,6 +1724,18 @@ void itb_reinit(struct itb *n)
     }
     atomic_set(&n->h.ref, 1);
     n->h.twin = 0;
+    ITB_CSTATE(n)->q = ITB_CQ_NONE;
+    ITB_CSTATE(n)->ref = 0;
+    ITB_CSTATE(n)->aged = 0;
+
+    /* rebuild the hot array from the transfered ITE region */
+    nr = (atomic_read(&n->h.len) - (int)sizeof(struct itb)) / 
+        (int)sizeof(struct ite);
+    for (i = 0; i < nr; i++) {
+        itb_hot_sync(n, i);
+    }
+
+    return 0;
 }
 
 /* itb_idx_bmp_reinit()
@@ -1287,11 +1767,15 @@ void itb_free(struct itb *i)
     }
 
     xrwlock_destroy(&i->h.lock);
+    itb_cache_forget(i);
+    /* the cached ITBs do not hold the hot array */
+    xfree(ITB_HOT(i));
+    ITB_HOT(i) = NULL;
     
     /* check if we should truely free this itb */
     if (hlist_unhashed(&i->h.cbht) && hmo.conf.memlimit <= 
-        atomic_read(&hmo.ic.csize) *
-        (sizeof(struct itb) + ITB_SIZE * sizeof(struct ite))) {
+        atomic_read(&hmo.ic.csize) * ITB_MEM_SIZE +
+        atomic64_read(&hmo.prof.cbht.aitb) * ITB_HOT_LEN) {
         xfree(i);
         atomic_dec(&hmo.ic.csize);
     } else {
@@ -1351,8 +1835,14 @@ void itb_cow_recopy(struct itb *oi, struct itb *ni)
     
     memcpy(ni->bitmap, oi->bitmap, ITB_COW_BITMAP_LEN);
     memcpy(ni->index, oi->index, ITB_COW_INDEX_LEN);
+#ifdef ITB_INDEX_FP
+    memcpy(ni->fp, oi->fp, ITB_COW_FP_LEN);
+#endif
     memcpy(ni->ite, oi->ite,
            atomic_read(&oi->h.len) - sizeof(struct itb));
+    memcpy(ITB_HOT(ni), ITB_HOT(oi),
+           (atomic_read(&oi->h.len) - sizeof(struct itb)) / 
+           sizeof(struct ite) * sizeof(struct ite_hot));
 
     /* adjust the header for ITB split */
     atomic_set(&ni->h.entries, atomic_read(&oi->h.entries));
@@ -1417,8 +1907,10 @@ struct itb *itb_dirty(struct itb *itb, struct hvfs_txg *t, struct itb_lock *l,
             }
             itb->h.state = ITB_STATE_DIRTY;
         }
-    } else if (t->txg == itb->h.txg + 1) {
-        /* ITB accessed in the last TXG */
+    } else if (t->txg > itb->h.txg) {
+        /* ITB accessed in an older TXG. Note that, w/ the txg ring, the
+         * older TXG may still be waiting to sync even if it is not the last
+         * TXG, thus we check the state rather than the distance. */
         ASSERT(itb->h.state != ITB_STATE_COWED, mds);
         if (itb->h.state == ITB_STATE_CLEAN) {
             /* clean or already write-backed, free to use */
@@ -1460,7 +1952,7 @@ struct itb *itb_dirty(struct itb *itb, struct hvfs_txg *t, struct itb_lock *l,
                 should_retry = 1;
             else {
                 /* not moved/deleted, just COWed */
-                if ((t->txg != itb->h.txg + 1) 
+                if ((t->txg <= itb->h.txg) 
                     || (itb->h.state != ITB_STATE_DIRTY)) {
                     /* somebody already do cow (win us), we need just retrieve
                      * itb */
@@ -1475,6 +1967,9 @@ struct itb *itb_dirty(struct itb *itb, struct hvfs_txg *t, struct itb_lock *l,
                     n->h.state = ITB_STATE_DIRTY;
                     n->h.be = be;
                     hlist_add_head(&n->h.cbht, &be->h);
+                    /* the COWed ITB inherits the cache state */
+                    *ITB_CSTATE(n) = *ITB_CSTATE(itb);
+                    ITB_CSTATE(itb)->q = ITB_CQ_NONE;
 
                     /* ok, recopy the new ITEs */
                     itb_cow_recopy(itb, n);
@@ -1523,13 +2018,8 @@ struct itb *itb_dirty(struct itb *itb, struct hvfs_txg *t, struct itb_lock *l,
             txg_add_itb(t, itb);
 #endif
         }
-    } else if (t->txg > itb->h.txg + 1) {
-        ASSERT(itb->h.state != ITB_STATE_COWED, mds);
-        itb->h.txg = t->txg;
-        itb->h.state = ITB_STATE_DIRTY;
-        txg_add_itb(t, itb);
-    } else if (t->txg == itb->h.txg - 1) {
-        /* ITB accessed in the next TXG, this can happen on the changing
+    } else {
+        /* ITB accessed in a newer TXG, this can happen on the changing
          * TXG. we should put ourself on the new TXG to diminish the
          * complexity of TXG state machine */
         struct hvfs_txg *nt;
@@ -1541,7 +2031,11 @@ struct itb *itb_dirty(struct itb *itb, struct hvfs_txg *t, struct itb_lock *l,
         *otxg = nt;
         /* FIXME: itb accessed in the next TXG, so it must be dirty! */
         ASSERT((itb->h.state == ITB_STATE_DIRTY || itb->h.state == ITB_STATE_CLEAN), mds);
-        ASSERT(nt->txg == itb->h.txg, mds);
+        if (unlikely(nt->txg != itb->h.txg)) {
+            /* more TXGs have been closed since the ITB was dirtied, the ITB
+             * belongs to an older TXG of nt now */
+            return itb_dirty(itb, nt, l, otxg);
+        }
         /* Bug github.com Issue 6: incorrect aentry count.
          *
          * We have a newly loaded in itb, but we had not set it to dirty! This
@@ -1587,7 +2081,8 @@ void __data_column_hook(struct hvfs_index *hi, struct itb *itb,
 }
 
 #define LEASE_IS_TIMEOUT(v)     ((hmo.tick -                            \
-                                  (v & ~(LEASE_MASK | LEASE_SEQNO_MASK))) >= 60)
+                                  (v & ~(LEASE_MASK | LEASE_SEQNO_MASK))) >= \
+                                 ((v & LEASE_READ) ? LEASE_TTL(v) : 60))
 #define LEASE_SEQNO(v)          (atomic_inc_return(v))
 
 static inline
@@ -1611,6 +2106,14 @@ int ite_lease_check_setup(struct hvfs_index *hi, struct itb *i, struct ite *e)
     /* lease ts is ZERO, we accept this request */
     if (!e->s.mdu.dtime)
         goto setup_lease;
+    /* read lease only conflicts w/ the lock intents */
+    if (e->s.mdu.dtime & LEASE_READ) {
+        if (LEASE_IS_TIMEOUT(e->s.mdu.dtime))
+            goto setup_lease;
+        if (hi->flag & (INDEX_INTENT_EXCLUDE | INDEX_INTENT_SHARED))
+            return -ELOCKED;
+        return 0;
+    }
     /* lease magic is ok! */
     if (e->s.mdu.dtime == hi->dlen)
         goto setup_lease;
@@ -1645,6 +2148,49 @@ setup_lease:
     return 0;
 }
 
+/* Read lease lets the client cache the mdu of a regular ITE for LEASE_TTL
+ * seconds. It is granted on the lookups w/ INDEX_LEASE. The client updates
+ * w/ INDEX_LEASE get -ELOCKED until the lease expires or is released by the
+ * last holder, and LEASE_RECALL stops the new grants meanwhile.
+ */
+static inline
+void ite_lease_read_grant(struct ite *e)
+{
+    u64 value = ite_lease_get(e);
+
+    if (hmo.conf.lease_ttl <= 0 || S_ISDIR(e->s.mdu.mode) ||
+        (e->flag & ITE_FLAG_LS))
+        return;
+    /* do not break the lock leases and the recalling */
+    if (value && !LEASE_IS_TIMEOUT(value) &&
+        (!(value & LEASE_READ) || (value & LEASE_RECALL)))
+        return;
+
+    value = (((u64)LEASE_SEQNO(&hmo.lease_seqno) << 32) & LEASE_SEQNO_MASK) |
+        (u64)hmo.tick | LEASE_READ | ((u64)hmo.conf.lease_ttl << 56);
+    ite_lease_set(e, value);
+    atomic64_inc(&hmo.prof.mds.lease_grant);
+}
+
+static inline
+int ite_lease_read_check(struct ite *e)
+{
+    u64 value = ite_lease_get(e);
+
+    if (!(value & LEASE_READ))
+        return 0;
+    if (LEASE_IS_TIMEOUT(value)) {
+        ite_lease_set(e, 0);
+        return 0;
+    }
+    if (!(value & LEASE_RECALL)) {
+        ite_lease_set(e, value | LEASE_RECALL);
+        atomic64_inc(&hmo.prof.mds.lease_recall);
+    }
+
+    return -ELOCKED;
+}
+
 /**
  * Search ITE in the ITB, matched by hvfs_index
  *
@@ -1665,6 +2211,9 @@ int itb_search(struct hvfs_index *hi, struct itb *itb, void *data,
     struct itb_lock *l;
     struct ite *dtite;
     int ret = -ENOENT;
+#ifdef ITB_INDEX_FP
+    u8 fp = itb_fp(hi->hash);
+#endif
 
     /* NOTE: if we are in retrying, we know that the ITB will not COW
      * again! */
@@ -1701,7 +2250,18 @@ retry:
         if (ii->flag == ITB_INDEX_FREE)
             break;
         atomic64_inc(as);
-        ret = ite_match(&itb->ite[ii->entry], hi);
+#ifdef ITB_INDEX_FP
+        /* reject the candidate by fingerprint before touching the ITE */
+        if (itb->fp[ii->entry] != fp) {
+            atomic64_inc(&hmo.prof.itb.fp_skip);
+            ret = ITE_MATCH_MISS;
+        } else
+            ret = ite_match(&ITB_HOT(itb)[ii->entry],
+                          &itb->ite[ii->entry], hi);
+#else
+        ret = ite_match(&ITB_HOT(itb)[ii->entry],
+                          &itb->ite[ii->entry], hi);
+#endif
 
         if (ii->flag == ITB_INDEX_UNIQUE) {
             if (ret == ITE_MATCH_MISS) {
@@ -1722,6 +2282,8 @@ retry:
             if (unlikely(ret)) {
                 goto out;
             }
+            if (hi->flag & INDEX_LEASE)
+                ite_lease_read_grant(&itb->ite[ii->entry]);
             /* read MDU to buffer */
             hi->uuid = itb->ite[ii->entry].uuid;
             if (hi->flag & INDEX_KV)
@@ -1785,6 +2347,11 @@ retry:
                 ret = -EACCES;
                 goto out;
             }
+            if (hi->flag & INDEX_LEASE) {
+                ret = ite_lease_read_check(&itb->ite[ii->entry]);
+                if (ret)
+                    goto out;
+            }
             *oi = itb_dirty(itb, txg, l, otxg);
             if (unlikely((*oi) != itb)) {
                 if (!(*oi)) {
@@ -1808,6 +2375,11 @@ retry:
         } else if (hi->flag & INDEX_UNLINK) {
             /* unlink */
             hvfs_verbose(mds, "Find the ITE and unlink it.\n");
+            if (hi->flag & INDEX_LEASE) {
+                ret = ite_lease_read_check(&itb->ite[ii->entry]);
+                if (ret)
+                    goto out;
+            }
             *oi = itb_dirty(itb, txg, l, otxg);
             if (unlikely((*oi) != itb)) {
                 if (!(*oi)) {
@@ -1830,6 +2402,11 @@ retry:
                 ret = -EACCES;
                 goto out;
             }
+            if (hi->flag & INDEX_LEASE) {
+                ret = ite_lease_read_check(&itb->ite[ii->entry]);
+                if (ret)
+                    goto out;
+            }
             *oi = itb_dirty(itb, txg, l, otxg);
             if (!(*oi)) {
                 ret = -EAGAIN;
@@ -1865,7 +2442,7 @@ retry:
                             }
                         } else if (hi->dlen & LEASE_SHARED) {
                             if (itb->ite[ii->entry].s.mdu.dtime & 
-                                LEASE_EXCLUDE) {
+                                (LEASE_EXCLUDE | LEASE_READ)) {
                                 ret = -ELOCKED;
                                 goto out;
                             }
@@ -1888,7 +2465,9 @@ retry:
             }
         } else if (unlikely(hi->flag & INDEX_RELEASE)) {
             if (hi->dlen & LEASE_MASK) {
-                if (hi->dlen == itb->ite[ii->entry].s.mdu.dtime) {
+                /* a recalled read lease is released by its magic too */
+                if (hi->dlen == (itb->ite[ii->entry].s.mdu.dtime &
+                                 ~LEASE_RECALL)) {
                     ite_lease_set(&itb->ite[ii->entry], 0);
                 } else {
                     /* it is ok to get the EINVAL result for shared lease
@@ -1979,6 +2558,9 @@ int itb_search_dtriggered(struct hvfs_index *hi, struct itb *itb,
     struct dhe *e;
     struct ite *dtite;
     int ret = -ENOENT;
+#ifdef ITB_INDEX_FP
+    u8 fp = itb_fp(hi->hash);
+#endif
 
     PREPARE_DIR_TRIGGER(e, hi);
     
@@ -2017,7 +2599,18 @@ retry:
         if (ii->flag == ITB_INDEX_FREE)
             break;
         atomic64_inc(as);
-        ret = ite_match(&itb->ite[ii->entry], hi);
+#ifdef ITB_INDEX_FP
+        /* reject the candidate by fingerprint before touching the ITE */
+        if (itb->fp[ii->entry] != fp) {
+            atomic64_inc(&hmo.prof.itb.fp_skip);
+            ret = ITE_MATCH_MISS;
+        } else
+            ret = ite_match(&ITB_HOT(itb)[ii->entry],
+                          &itb->ite[ii->entry], hi);
+#else
+        ret = ite_match(&ITB_HOT(itb)[ii->entry],
+                          &itb->ite[ii->entry], hi);
+#endif
 
         if (ii->flag == ITB_INDEX_UNIQUE) {
             if (ret == ITE_MATCH_MISS) {
@@ -2041,6 +2634,8 @@ retry:
             if (unlikely(ret)) {
                 goto out;
             }
+            if (hi->flag & INDEX_LEASE)
+                ite_lease_read_grant(&itb->ite[ii->entry]);
             /* read MDU to buffer */
             hi->uuid = itb->ite[ii->entry].uuid;
             if (hi->flag & INDEX_KV)
@@ -2113,6 +2708,11 @@ retry:
                 ret = -EACCES;
                 goto out;
             }
+            if (hi->flag & INDEX_LEASE) {
+                ret = ite_lease_read_check(&itb->ite[ii->entry]);
+                if (ret)
+                    goto out;
+            }
             *oi = itb_dirty(itb, txg, l, otxg);
             if (unlikely((*oi) != itb)) {
                 if (!(*oi)) {
@@ -2142,6 +2742,11 @@ retry:
         } else if (hi->flag & INDEX_UNLINK) {
             /* unlink */
             hvfs_verbose(mds, "Find the ITE and unlink it.\n");
+            if (hi->flag & INDEX_LEASE) {
+                ret = ite_lease_read_check(&itb->ite[ii->entry]);
+                if (ret)
+                    goto out;
+            }
             *oi = itb_dirty(itb, txg, l, otxg);
             if (unlikely((*oi) != itb)) {
                 if (!(*oi)) {
@@ -2170,6 +2775,11 @@ retry:
                 ret = -EACCES;
                 goto out;
             }
+            if (hi->flag & INDEX_LEASE) {
+                ret = ite_lease_read_check(&itb->ite[ii->entry]);
+                if (ret)
+                    goto out;
+            }
             *oi = itb_dirty(itb, txg, l, otxg);
             if (!(*oi)) {
                 ret = -EAGAIN;
@@ -2214,7 +2824,7 @@ retry:
                             }
                         } else if (hi->dlen & LEASE_SHARED) {
                             if (itb->ite[ii->entry].s.mdu.dtime & 
-                                LEASE_EXCLUDE) {
+                                (LEASE_EXCLUDE | LEASE_READ)) {
                                 ret = -ELOCKED;
                                 goto out;
                             }
@@ -2243,7 +2853,9 @@ retry:
                               &itb->ite[ii->entry], hi,
                               ret, out);
             if (hi->dlen & LEASE_MASK) {
-                if (hi->dlen == itb->ite[ii->entry].s.mdu.dtime) {
+                /* a recalled read lease is released by its magic too */
+                if (hi->dlen == (itb->ite[ii->entry].s.mdu.dtime &
+                                 ~LEASE_RECALL)) {
                     ite_lease_set(&itb->ite[ii->entry], 0);
                 } else {
                     /* it is ok to get the EINVAL result for shared lease
@@ -2813,19 +3425,32 @@ void unlink_thread_destroy()
     sem_destroy(&hmo.unlink_sem);
 }
 
-/* LZO region */
-int itb_lzo_compress(struct itb *in, struct itb *tmp, struct itb **oi)
+static inline
+u64 __itb_zip_ns(struct timespec *begin, struct timespec *end)
+{
+    return (end->tv_sec - begin->tv_sec) * 1000000000UL +
+        end->tv_nsec - begin->tv_nsec;
+}
+
+/* ITB compression region
+ *
+ * @tmp should have HVFS_ZIP_BOUND() bytes for the payload. On success, *oi
+ * points to the compressed ITB, or @in if it is not compressible.
+ */
+int itb_zip_compress(struct itb *in, struct itb *tmp, struct itb **oi,
+                     int algo)
 {
+    struct timespec begin, end;
     void *workmem;
-    lzo_uint zlen = 0, inlen;
+    size_t zlen = 0, inlen;
     int err = 0;
 
     *oi = in;
 
     /* got the work memory */
-    workmem = pthread_getspecific(hmo.lzo_workmem);
+    workmem = pthread_getspecific(hmo.zip_workmem);
     if (!workmem) {
-        hvfs_err(mds, "LZO work memory lost?!\n");
+        hvfs_err(mds, "ZIP work memory lost?!\n");
         return -EFAULT;
     }
     
@@ -2833,24 +3458,33 @@ int itb_lzo_compress(struct itb *in, struct itb *tmp, struct itb **oi)
     memcpy(&tmp->h, &in->h, sizeof(tmp->h));
     inlen = atomic_read(&in->h.len) - sizeof(in->h);
 
-    err = lzo1x_1_compress((void *)in->lock, inlen,
-                           (void *)tmp->lock, &zlen, workmem);
-    if (err == LZO_E_OK) {
-        err = 0;
-    } else {
-        hvfs_err(mds, "LZO compress failed w/ %d\n", err);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &begin);
+    err = hvfs_zip_compress(algo, (void *)in->lock, inlen,
+                            (void *)tmp->lock, &zlen, workmem);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+    if (err < 0) {
+        hvfs_err(mds, "%s compress failed w/ %d\n", hvfs_zip_name(algo), err);
         goto out;
     }
+    algo = err;
+    err = 0;
+
+    /* account to the codec actually used, COMPR_NONE is the wasted CPU time
+     * on the incompressible ITBs */
+    atomic64_inc(&hmo.prof.zip[algo].nr);
+    atomic64_add(inlen, &hmo.prof.zip[algo].in);
+    atomic64_add((algo == COMPR_NONE ? inlen : zlen), &hmo.prof.zip[algo].out);
+    atomic64_add(__itb_zip_ns(&begin, &end), &hmo.prof.zip[algo].ns);
 
-    if (zlen >= inlen) {
-        hvfs_warning(mds, "This ITB %ld is impossible to compress!\n", 
-                     in->h.itbid);
+    if (algo == COMPR_NONE) {
+        hvfs_debug(mds, "This ITB %ld is impossible to compress!\n", 
+                   in->h.itbid);
         goto out;
     }
     /* exchange the zlen and len */
     atomic_set(&tmp->h.zlen, atomic_read(&tmp->h.len));
     atomic_set(&tmp->h.len, sizeof(tmp->h) + zlen);
-    tmp->h.compress_algo = COMPR_LZO;
+    tmp->h.compress_algo = algo;
     *oi = tmp;
     
 out:
@@ -2859,13 +3493,27 @@ out:
 
 /* in-position unpack the ITB
  */
-int itb_lzo_decompress(struct itb *in)
+int itb_zip_decompress(struct itb *in)
 {
-    lzo_uint outlen, inlen;
+    struct timespec begin, end;
+    size_t outlen = 0, inlen, olen;
+    int algo = in->h.compress_algo;
     int err = 0;
     void *p;
 
+    if (algo >= COMPR_MAX) {
+        hvfs_err(mds, "ITB %ld w/ invalid codec %d\n", in->h.itbid, algo);
+        return -EINVAL;
+    }
     inlen = atomic_read(&in->h.len) - sizeof(in->h);
+    olen = atomic_read(&in->h.zlen) - sizeof(in->h);
+    if (atomic_read(&in->h.zlen) < sizeof(in->h) ||
+        atomic_read(&in->h.zlen) > sizeof(struct itb) +
+        sizeof(struct ite) * ITB_SIZE) {
+        hvfs_err(mds, "ITB %ld w/ invalid length %d\n", in->h.itbid,
+                 atomic_read(&in->h.zlen));
+        return -EINVAL;
+    }
     p = xmalloc(inlen);
     if (!p) {
         hvfs_err(mds, "Unable to alloc the memory to decompress ITB!\n");
@@ -2874,14 +3522,19 @@ int itb_lzo_decompress(struct itb *in)
     }
     memcpy(p, (void *)in->lock, inlen);
     
-    err = lzo1x_decompress(p, inlen, 
-                           (void *)in->lock, &outlen, NULL);
-    if (err == LZO_E_OK && 
-        outlen == atomic_read(&in->h.zlen) - sizeof(in->h)) {
-        err = 0;
-    } else {
-        hvfs_err(mds, "LZO decompress failed w/ %d\n", err);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &begin);
+    err = hvfs_zip_decompress(algo, p, inlen, (void *)in->lock, &outlen,
+                              olen);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+    if (!err && outlen != olen) {
+        err = -EINVAL;
+    }
+    if (err) {
+        hvfs_err(mds, "%s decompress failed w/ %d\n", 
+                 hvfs_zip_name(algo), err);
     }
+    atomic64_inc(&hmo.prof.zip[algo].unzip_nr);
+    atomic64_add(__itb_zip_ns(&begin, &end), &hmo.prof.zip[algo].unzip_ns);
     /* clear the compress flag */
     in->h.compress_algo = COMPR_NONE;
     /* exchange the len back */
@@ -307,7 +307,11 @@ void mds_ausplit(struct xnet_msg *msg)
     i->h.flag = ITB_ACTIVE;
     i->h.state = ITB_STATE_DIRTY;
     /* re-init */
-    itb_reinit(i);
+    err = itb_reinit(i);
+    if (err) {
+        txg_put(t);
+        goto send_rpy;
+    }
 
     txg_add_itb(t, i);
     txg_put(t);
@@ -302,6 +302,8 @@ static void *mds_timer_thread_main(void *arg)
         mds_hb_wrapper(cur);
         /* next, checking the scrub progress */
         mds_scrub(cur);
+        /* next, checking the warm-up and the hot list */
+        mds_warmup_check(cur);
         /* next, check the dh hash table */
         mds_dh_check(cur);
         /* FIXME: */
@@ -460,6 +462,9 @@ int mds_cbht_evict_default(struct bucket *b, void *arg0, void *arg1)
 
     xrwlock_wlock(&ih->lock);
     if (ih->state == ITB_STATE_CLEAN) {
+        /* let the 2Q policy keep the referenced Am ITBs */
+        if (!itb_cache_victim((struct itb *)ih))
+            goto out_unlock;
         /* ok, this is the target to operate on */
         obe = ih->be;
         t = mds_get_open_txg(&hmo);
@@ -492,6 +497,7 @@ int mds_cbht_evict_default(struct bucket *b, void *arg0, void *arg1)
 
             hvfs_warning(mds, "DO evict on clean ITB %ld txg %ld\n", 
                          ih->itbid, ih->txg);
+            itb_cache_evicted((struct itb *)ih);
             itb_put((struct itb *)ih);
         }
         txg_put(t);
@@ -557,6 +563,7 @@ int mds_cbht_evict_all_default(struct bucket *b, void *arg0, void *arg1)
 
             hvfs_warning(mds, "DO evict on clean ITB %ld txg %ld success\n", 
                          ih->itbid, ih->txg);
+            itb_cache_evicted((struct itb *)ih);
             itb_put((struct itb *)ih);
         }
         txg_put(t);
@@ -946,7 +953,7 @@ int mds_verify(void)
             return -1;
         }
         if (hmo.conf.memlimit == 0 || hmo.conf.memlimit <
-            (sizeof(struct itb) + sizeof(struct ite) * ITB_SIZE))
+            ITB_ACTIVE_SIZE)
             return -1;
     }
     /* reset the open txg */
@@ -985,6 +992,7 @@ int mds_config(void)
     HVFS_MDS_GET_ENV_cpy(profiling_file, value);
     HVFS_MDS_GET_ENV_cpy(conf_file, value);
     HVFS_MDS_GET_ENV_cpy(log_file, value);
+    HVFS_MDS_GET_ENV_cpy(warmup_file, value);
 
     HVFS_MDS_GET_ENV_atoi(commit_threads, value);
     HVFS_MDS_GET_ENV_atoi(service_threads, value);
@@ -1013,9 +1021,14 @@ int mds_config(void)
     HVFS_MDS_GET_ENV_atoi(dh_ii, value);
     HVFS_MDS_GET_ENV_atoi(dhupdatei, value);
     HVFS_MDS_GET_ENV_atoi(txg_buf_len, value);
+    HVFS_MDS_GET_ENV_atoi(txg_ring, value);
+    HVFS_MDS_GET_ENV_atoi(txg_wb_batch_len, value);
+    HVFS_MDS_GET_ENV_atoi(txg_wb_batch_nr, value);
+    HVFS_MDS_GET_ENV_atoi(txg_wb_inflight, value);
     HVFS_MDS_GET_ENV_atoi(bc_roof, value);
     HVFS_MDS_GET_ENV_atoi(txg_ddht_size, value);
     HVFS_MDS_GET_ENV_atoi(xnet_resend_to, value);
+    HVFS_MDS_GET_ENV_atoi(xnet_pollin_nr, value);
     HVFS_MDS_GET_ENV_atoi(hb_interval, value);
     HVFS_MDS_GET_ENV_atoi(scrub_interval, value);
     HVFS_MDS_GET_ENV_atoi(gto, value);
@@ -1024,6 +1037,12 @@ int mds_config(void)
     HVFS_MDS_GET_ENV_atoi(active_ft, value);
     HVFS_MDS_GET_ENV_atoi(rdir_hsize, value);
     HVFS_MDS_GET_ENV_atoi(stacksize, value);
+    HVFS_MDS_GET_ENV_atoi(bitmap_prefetch, value);
+    HVFS_MDS_GET_ENV_atoi(itb_ghost, value);
+    HVFS_MDS_GET_ENV_atoi(warmup_threads, value);
+    HVFS_MDS_GET_ENV_atoi(warmup_max, value);
+    HVFS_MDS_GET_ENV_atoi(warmup_interval, value);
+    HVFS_MDS_GET_ENV_atoi(lease_ttl, value);
 
     HVFS_MDS_GET_kmg(memlimit, value);
 
@@ -1035,6 +1054,18 @@ int mds_config(void)
     HVFS_MDS_GET_ENV_option(opt_limited, LIMITED, value);
     HVFS_MDS_GET_ENV_option(opt_mdzip, MDZIP, value);
 
+    value = getenv("hvfs_mds_zip_algo");
+    if (value) {
+        hmo.conf.zip_algo = hvfs_zip_lookup(value);
+        if (hmo.conf.zip_algo < 0) {
+            hvfs_warning(mds, "Invalid ITB codec '%s', fallback to lzo\n",
+                         value);
+            hmo.conf.zip_algo = COMPR_LZO;
+        }
+    } else
+        hmo.conf.zip_algo = COMPR_LZO;
+    HVFS_MDS_GET_ENV_atoi(zip_ratio, value);
+
     /* default configurations */
     if (!hmo.conf.txg_buf_len) {
         hmo.conf.txg_buf_len = HVFS_MDSL_TXG_BUF_LEN;
@@ -1055,6 +1086,20 @@ int mds_config(void)
         hmo.conf.gto = 1;
     if (!hmo.conf.loadin_pressure)
         hmo.conf.loadin_pressure = 30;
+    if (!hmo.conf.bitmap_prefetch)
+        hmo.conf.bitmap_prefetch = 2;
+    if (hmo.conf.txg_wb_batch_len <= 0)
+        hmo.conf.txg_wb_batch_len = (1 << 20);
+    if (hmo.conf.txg_wb_batch_nr <= 0)
+        hmo.conf.txg_wb_batch_nr = 64;
+    if (hmo.conf.txg_wb_inflight <= 0)
+        hmo.conf.txg_wb_inflight = 4;
+    if (hmo.conf.zip_ratio > 0)
+        hvfs_zip_auto_ratio = hmo.conf.zip_ratio;
+    if (!hmo.conf.lease_ttl)
+        hmo.conf.lease_ttl = 5;
+    if (hmo.conf.lease_ttl > LEASE_TTL_MAX)
+        hmo.conf.lease_ttl = LEASE_TTL_MAX;
 
     return 0;
 }
@@ -1172,6 +1217,11 @@ int mds_init(int bdepth)
     if (err)
         goto out_scrub;
 
+    /* FIXME: init the warm-up threads */
+    err = mds_warmup_create();
+    if (err)
+        goto out_warmup;
+
     /* FIXME: init the ft gossip module */
     err = ft_init(1);
     if (err)
@@ -1218,6 +1268,7 @@ out_rpc:
 out_rdir:
 out_gossip:
 out_ft:
+out_warmup:
 out_scrub:
 out_spool:
 out_unlink:
@@ -1263,6 +1314,9 @@ void mds_destroy(void)
     /* stop the scrub thread */
     mds_scrub_destroy();
 
+    /* stop the warm-up threads */
+    mds_warmup_destroy();
+
     /* stop the unlink thread */
     unlink_thread_destroy();
 
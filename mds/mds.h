@@ -38,12 +38,85 @@
 #include "ring.h"
 #include "profile.h"
 
-/* FIXME: we should implement a ARC/DULO cache */
+/* The clean ITBs in CBHT are managed by a 2Q policy: a new ITB enters A1in
+ * and is the first to go on a scrub pass, which records its key in the ghost
+ * table (A1out). A1in is bounded to 1/ITB_A1IN_RATIO of the active ITBs,
+ * within the bound an A1in ITB survives its first scrub pass, and it is
+ * promoted to Am if it is referenced again before the next one. An ITB
+ * reloaded while its ghost is alive enters Am, and it is only evicted after a
+ * scrub pass finds it unreferenced. Thus a one-pass scan over a huge
+ * directory can not flush the hot ITBs. The ghost table is split into
+ * partitions w/ their own locks, a ghost can not be overwritten until it has
+ * lived ITB_GHOST_PASSES scrub intervals, thus a scan can not wipe out the
+ * ghosts either. */
+#define ITB_GHOST_PARTS         (16)
+#define ITB_GHOST_DEFAULT       (8192)
+#define ITB_GHOST_PASSES        (4)
+#define ITB_A1IN_RATIO          (4)
+struct itb_ghost
+{
+    u64 puuid;
+    u64 itbid;
+    time_t ts;                  /* scrub pass recorded in */
+};
+
+/* The CBHT hits are counted in per-thread slots, mds_ic_prof() folds them */
+#define ITB_HIT_SLOTS           (32)
+struct itb_hit_slot
+{
+    atomic64_t hit;
+} __attribute__((aligned(64)));
+
+struct itb_ghost_part
+{
+    xlock_t lock;
+    struct itb_ghost *slots;
+};
+
+/* The in-flight ITB loads from MDSL. The first miss on an ITB registers a
+ * load, the concurrent misses on the same ITB wait for it instead of sending
+ * the duplicate requests, then retry the CBHT search. */
+#define ITB_LOAD_PARTS          (16)
+struct itb_load
+{
+    struct hlist_node hlist;
+    u64 puuid;
+    u64 itbid;
+    sem_t sem;                  /* posted once per waiter on completion */
+    int waiters;                /* # of coalesced misses */
+    int done;
+    int err;                    /* result of the load */
+};
+
+struct itb_load_part
+{
+    xlock_t lock;
+    struct hlist_head h;
+};
+
 struct itb_cache 
 {
-    struct list_head lru;
+    struct list_head lru;       /* free ITBs */
     atomic_t csize;             /* current cache size */
     xlock_t lock;
+    int gsize;                  /* # of ghost slots per partition */
+    atomic64_t a1in;            /* # of ITBs in A1in */
+    struct itb_ghost_part ghost[ITB_GHOST_PARTS];
+    struct itb_hit_slot hit[ITB_HIT_SLOTS];
+    struct itb_load_part load[ITB_LOAD_PARTS];
+};
+
+/* The closed TXGs in flight. The head is syncing to MDSL (or is the next one
+ * to sync), the others are quiescing, i.e. waiting for their pending TXs.
+ * Only the head syncs, so the ITBs and txg_end reach MDSL in TXG order. */
+#define TXG_RING_MAX            (16)
+#define TXG_RING_DEFAULT        (2)
+struct txg_ring
+{
+    xlock_t lock;
+    int head;                   /* slot of the oldest closed TXG */
+    int nr;                     /* # of closed TXGs in the ring */
+    struct hvfs_txg *t[TXG_RING_MAX];
 };
 
 struct rdir_entry
@@ -125,9 +198,17 @@ struct mds_conf
     int async_update_N;         /* default # of processing request */
     int mp_to;                  /* timeout of modify pause */
     int txg_buf_len;            /* length of the txg buffer */
+    int txg_ring;               /* # of closed TXGs in flight */
+    int txg_wb_batch_len;       /* max bytes of an ITB write-back batch */
+    int txg_wb_batch_nr;        /* max # of ITBs in a write-back batch */
+    int txg_wb_inflight;        /* # of in-flight batches per MDSL site */
+    int zip_algo;               /* default ITB codec if MDZIP enabled */
+    int zip_ratio;              /* auto codec: skip LZO if ZRL ratio is
+                                 * above this percent */
     int bc_roof;                /* upper limmit of bitmap cache entries */
     int txg_ddht_size;          /* TXG dir delta hash table size */
     int xnet_resend_to;         /* xnet resend timeout */
+    int xnet_pollin_nr;         /* # of xnet poll-in threads */
     int hb_interval;            /* heart beat interval */
     int scrub_interval;         /* scurb interval */
     int dh_hsize;               /* dh hash table size */
@@ -137,6 +218,14 @@ struct mds_conf
     int loadin_pressure;        /* loadin memory pressure */
     int rdir_hsize;             /* rdir mgr hash table size */
     int stacksize;              /* pthread stack size */
+    int bitmap_prefetch;        /* # of adjacent bitmap slices to prefetch on
+                                 * a slice miss */
+    int itb_ghost;              /* # of ghost entries of the ITB cache */
+    int warmup_threads;         /* # of warm-up threads */
+    int warmup_max;             /* max # of ITBs in the hot list */
+    int warmup_interval;        /* hot list dump interval */
+    char *warmup_file;          /* hot list file */
+    int lease_ttl;              /* read lease ttl, <0 means no read lease */
     s8 mpcheck_sensitive;       /* sensitivity of mp check, bigger value means
                                  * more sensitive to check */
     s8 itbid_check;             /* should we do ITBID check? */
@@ -190,10 +279,10 @@ struct hvfs_mds_object
     struct chring *chring[CH_RING_NUM];
     struct mds_prof prof;
     struct mds_conf conf;
-#define TXG_NUM         2
+#define TXG_NUM         1
 #define TXG_OPEN        0
-#define TXG_WB          1
     struct hvfs_txg *txg[TXG_NUM];
+    struct txg_ring txg_ring;   /* closed TXGs, oldest first */
     struct hvfs_txc txc;
     struct itb_cache ic;
     struct bitmap_cache bc;
@@ -231,7 +320,7 @@ struct hvfs_mds_object
     pthread_t scrub_thread;
     pthread_t gossip_thread;
 
-    pthread_key_t lzo_workmem;  /* for lzo zip use */
+    pthread_key_t zip_workmem;  /* for ITB codec use */
 
     u32 timer_thread_stop:1;    /* running flag for timer thread */
     u32 commit_thread_stop:1;   /* running flag for commit thread */
@@ -367,10 +456,12 @@ void mds_cbht_scan(struct eh *, int);
 
 /* for itb.c */
 struct itb *mds_read_itb(u64, u64, u64);
+int mds_read_itb_batch(u64, u64, u64, u64, int (*)(struct itb *, void *),
+                       void *);
 void ite_update(struct hvfs_index *, struct ite *);
 struct itb *get_free_itb_fast();
 struct itb *get_free_itb(struct hvfs_txg *);
-void itb_reinit(struct itb *);
+int itb_reinit(struct itb *);
 void itb_idx_bmp_reinit(struct itb *);
 void itb_free(struct itb *);
 struct itb *itb_dirty(struct itb *, struct hvfs_txg *, struct itb_lock *,
@@ -385,6 +476,32 @@ int itb_readdir_dtriggered(struct hvfs_index *, struct itb *,
                            struct hvfs_md_reply *);
 int itb_cache_init(struct itb_cache *, int);
 int itb_cache_destroy(struct itb_cache *);
+void itb_cache_admit(struct itb *);
+int itb_load_enter(u64, u64, struct itb_load **);
+void itb_load_exit(struct itb_load *, int);
+int itb_cache_victim(struct itb *);
+void itb_cache_evicted(struct itb *);
+void itb_cache_forget(struct itb *);
+int itb_cache_hit_slot(void);
+void mds_ic_prof(void);
+extern __thread int itb_hit_slot;
+
+/* itb_cache_touch()
+ *
+ * Mark a CBHT hit, no lock needed, the scrub pass reads and clears it.
+ */
+static inline
+void itb_cache_touch(struct itb *i)
+{
+    struct itb_cstate *cs = ITB_CSTATE(i);
+
+    if (!cs->ref)
+        cs->ref = 1;
+    if (unlikely(itb_hit_slot < 0))
+        itb_hit_slot = itb_cache_hit_slot();
+    atomic64_inc(&hmo.ic.hit[itb_hit_slot].hit);
+}
+
 void itb_dump(struct itb *);
 void async_unlink(time_t t);
 int unlink_thread_init(void);
@@ -402,8 +519,8 @@ static inline void itb_put(struct itb *i)
         itb_free(i);
     }
 }
-int itb_lzo_compress(struct itb *, struct itb *, struct itb **);
-int itb_lzo_decompress(struct itb *);
+int itb_zip_compress(struct itb *, struct itb *, struct itb **, int);
+int itb_zip_decompress(struct itb *);
 
 /* for tx.c */
 struct hvfs_tx *mds_alloc_tx(u16, struct xnet_msg *);
@@ -475,6 +592,27 @@ void mds_dh_put(struct dhe *e)
 {
     atomic_dec(&e->ref);
 }
+
+/* mds_dh_bitmap_lookup()
+ *
+ * Find the slice covering offset in the DHE slice index w/o e->lock. The
+ * caller should hold a reference of the DHE.
+ */
+static inline
+struct itbitmap *mds_dh_bitmap_lookup(struct dhe *e, u64 offset)
+{
+    struct itbitmap **leaf;
+    u64 idx = offset / XTABLE_BITMAP_SIZE;
+
+    if (unlikely(idx >= DH_BMI_MAX))
+        return NULL;
+    leaf = e->bmi[idx >> DH_BMI_LEAF_SHIFT];
+    if (!leaf)
+        return NULL;
+    smp_rmb();
+    return leaf[idx & (DH_BMI_LEAF_SIZE - 1)];
+}
+void mds_dh_bitmap_index(struct dhe *, struct itbitmap *);
 void mds_dh_check(time_t cur);
 int mds_dh_init(struct dh *, int);
 void mds_dh_destroy(struct dh *);
@@ -506,6 +644,8 @@ void mds_dump_itb(struct hvfs_tx *);
 void mds_c2m_ldh(struct hvfs_tx *);
 void mds_list(struct hvfs_tx *);
 void mds_snapshot(struct hvfs_tx *);
+#define MDS_RESOLVE_RETRY       (16) /* retry # on the transient errors */
+void mds_resolve(struct hvfs_tx *);
 
 /* for m2m.c, mds 2 mds APIs */
 void mds_ldh(struct xnet_msg *msg);
@@ -541,6 +681,7 @@ int mds_spool_dispatch(struct xnet_msg *);
 int mds_spool_modify_pause(struct xnet_msg *);
 void mds_spool_itb_check(time_t);
 void mds_spool_mp_check(time_t);
+void mds_spool_prof(void);
 
 /* APIs */
 /* __txg_busy_loop_detector()
@@ -587,10 +728,26 @@ retry:
     return t;
 }
 
+/* mds_get_wb_txg()
+ *
+ * Return the oldest closed TXG, which is syncing or the next one to sync.
+ */
 static inline
 struct hvfs_txg *mds_get_wb_txg(struct hvfs_mds_object *hmo)
 {
-    return hmo->txg[TXG_WB];
+    struct txg_ring *r = &hmo->txg_ring;
+
+    return r->nr ? r->t[r->head] : NULL;
+}
+
+/* mds_txg_ring_full()
+ *
+ * Return 1 if we can not close the open TXG now.
+ */
+static inline
+int mds_txg_ring_full(struct hvfs_mds_object *hmo)
+{
+    return hmo->txg_ring.nr >= hmo->conf.txg_ring;
 }
 
 int itb_split_local(struct itb *, int, struct itb_lock *, struct hvfs_txg *,
@@ -621,6 +778,13 @@ void mds_scrub_trigger(void);
 int mds_scrub_create(void);
 void mds_scrub_destroy(void);
 
+/* warmup.c */
+#define MDS_WARMUP_MAX          (65536)
+void mds_warmup_check(time_t);
+void mds_warmup_ring_change(struct chring *);
+int mds_warmup_create(void);
+void mds_warmup_destroy(void);
+
 /* gossip.c */
 int gossip_init(void);
 void gossip_destroy(void);
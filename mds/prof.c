@@ -222,27 +222,103 @@ void dump_profiling_human(time_t t)
               atomic64_read(&hmo.prof.cbht.depth));
     hvfs_info(mds, "%16ld |  ITB Prof: active %ld, cowed %ld, "
               "async_unlink %ld, "
-              "split_submit %ld, split_local %ld\n",
+              "split_submit %ld, split_local %ld, fp_skip %ld\n",
               t, 
               atomic64_read(&hmo.prof.cbht.aitb),
               atomic64_read(&hmo.prof.itb.cowed),
               atomic64_read(&hmo.prof.itb.async_unlink),
               atomic64_read(&hmo.prof.itb.split_submit),
-              atomic64_read(&hmo.prof.itb.split_local));
-    hvfs_info(mds, "%16ld |  MDS Prof: Rsplit %ld, forward %ld, ausplit %ld\n",
+              atomic64_read(&hmo.prof.itb.split_local),
+              atomic64_read(&hmo.prof.itb.fp_skip));
+    {
+        u64 hit = atomic64_read(&hmo.prof.ic.hit);
+        u64 miss = atomic64_read(&hmo.prof.ic.miss);
+
+        hvfs_info(mds, "%16ld |  IC Prof: hit %ld, miss %ld, ratio %.2f%%, "
+                  "ghost_hit %ld, evict A1/Am %ld/%ld, 2nd_chance %ld, "
+                  "promote %ld, A1in %ld, coalesced %ld, wait %ld us\n",
+                  t, hit, miss,
+                  (hit + miss ? (double)hit * 100 / (hit + miss) : 0.0),
+                  atomic64_read(&hmo.prof.ic.ghost_hit),
+                  atomic64_read(&hmo.prof.ic.evict_a1),
+                  atomic64_read(&hmo.prof.ic.evict_am),
+                  atomic64_read(&hmo.prof.ic.second_chance),
+                  atomic64_read(&hmo.prof.ic.promote),
+                  atomic64_read(&hmo.ic.a1in),
+                  atomic64_read(&hmo.prof.ic.coalesced),
+                  atomic64_read(&hmo.prof.ic.coalesced_wait));
+    }
+    hvfs_info(mds, "%16ld |  WARMUP Prof: total %ld, pending %ld, "
+              "loaded %ld, skipped %ld, bitmap %ld, ring %ld, dumped %ld\n",
+              t,
+              atomic64_read(&hmo.prof.warmup.total),
+              atomic64_read(&hmo.prof.warmup.pending),
+              atomic64_read(&hmo.prof.warmup.loaded),
+              atomic64_read(&hmo.prof.warmup.skipped),
+              atomic64_read(&hmo.prof.warmup.bitmap),
+              atomic64_read(&hmo.prof.warmup.ring),
+              atomic64_read(&hmo.prof.warmup.dumped));
+    hvfs_info(mds, "%16ld |  MDS Prof: Rsplit %ld, forward %ld, ausplit %ld, "
+              "bitmap_out %ld, bitmap_prefetch %ld, resolve %ld/%ld, "
+              "lease %ld/%ld\n",
               t,
               atomic64_read(&hmo.prof.mds.split),
               atomic64_read(&hmo.prof.mds.forward),
-              atomic64_read(&hmo.prof.mds.ausplit));
+              atomic64_read(&hmo.prof.mds.ausplit),
+              atomic64_read(&hmo.prof.mds.bitmap_out),
+              atomic64_read(&hmo.prof.mds.bitmap_prefetch),
+              atomic64_read(&hmo.prof.mds.resolve),
+              atomic64_read(&hmo.prof.mds.resolve_fwd),
+              atomic64_read(&hmo.prof.mds.lease_grant),
+              atomic64_read(&hmo.prof.mds.lease_recall));
+    {
+        int i;
+
+        for (i = 0; i < COMPR_MAX; i++) {
+            u64 nr = atomic64_read(&hmo.prof.zip[i].nr);
+            u64 in = atomic64_read(&hmo.prof.zip[i].in);
+            u64 out = atomic64_read(&hmo.prof.zip[i].out);
+
+            if (!nr && !atomic64_read(&hmo.prof.zip[i].unzip_nr))
+                continue;
+            hvfs_info(mds, "%16ld |  ZIP Prof: %s nr %ld, ratio %.2f%%, "
+                      "cpu %ld us, unzip %ld, unzip_cpu %ld us\n",
+                      t, hvfs_zip_name(i), nr,
+                      (in ? (double)out * 100 / in : 0.0),
+                      atomic64_read(&hmo.prof.zip[i].ns) / 1000,
+                      atomic64_read(&hmo.prof.zip[i].unzip_nr),
+                      atomic64_read(&hmo.prof.zip[i].unzip_ns) / 1000);
+        }
+    }
+    hvfs_info(mds, "%16ld |  MDSL Prof: itb_load %ld, itb_wb %ld, "
+              "itb_wb_batch %ld\n",
+              t,
+              atomic64_read(&hmo.prof.mdsl.itb_load),
+              atomic64_read(&hmo.prof.mdsl.itb_wb),
+              atomic64_read(&hmo.prof.mdsl.itb_wb_batch));
     if (hmo.prof.xnet) {
         hvfs_info(mds, "%16ld |  XNET Prof: alloc %ld, free %ld, inb %ld, "
-                  "outb %ld, links %ld\n", t,
+                  "outb %ld, isend %ld, links %ld, "
+                  "mcache %ld/%ld, bcache %ld/%ld\n", t,
                   atomic64_read(&hmo.prof.xnet->msg_alloc),
                   atomic64_read(&hmo.prof.xnet->msg_free),
                   atomic64_read(&hmo.prof.xnet->inbytes),
                   atomic64_read(&hmo.prof.xnet->outbytes),
-                  atomic64_read(&hmo.prof.xnet->active_links));
+                  atomic64_read(&hmo.prof.xnet->isend),
+                  atomic64_read(&hmo.prof.xnet->active_links),
+                  atomic64_read(&hmo.prof.xnet->msg_cache_hit),
+                  atomic64_read(&hmo.prof.xnet->msg_cache_miss),
+                  atomic64_read(&hmo.prof.xnet->buf_cache_hit),
+                  atomic64_read(&hmo.prof.xnet->buf_cache_miss));
     }
+    hvfs_info(mds, "%16ld |  SPOOL Prof: total %ld, handle %ld, qdepth %ld, "
+              "steal %ld, wait %ld us\n",
+              t,
+              atomic64_read(&hmo.prof.misc.reqin_total),
+              atomic64_read(&hmo.prof.misc.reqin_handle),
+              atomic64_read(&hmo.prof.misc.reqin_qdepth),
+              atomic64_read(&hmo.prof.misc.reqin_steal),
+              atomic64_read(&hmo.prof.misc.reqin_wait));
     hvfs_info(mds, "%16ld -- ITC Prof: ftx %d, total %d\n",
               t,
               atomic_read(&hmo.txc.ftx),
@@ -251,6 +327,8 @@ void dump_profiling_human(time_t t)
 
 void dump_profiling(time_t t, struct hvfs_profile *hp)
 {
+    mds_spool_prof();
+    mds_ic_prof();
     switch (hmo.conf.prof_plot) {
     case MDS_PROF_PLOT:
         dump_profiling_plot(t);
@@ -24,6 +24,8 @@
 #ifndef __MDS_PROF_H__
 #define __MDS_PROF_H__
 
+#include "xtable.h"
+
 /* statistics for client */
 struct mds_client_prof 
 {
@@ -55,18 +57,24 @@ struct mds_mds_prof
     atomic64_t recover_split;   /* # of splits recovered */
     atomic64_t bitmap_in;       /* # of bitmap lookup IN */
     atomic64_t bitmap_out;      /* # of bitmap lookup OUT */
+    atomic64_t bitmap_prefetch; /* # of prefetched bitmap slices */
     atomic64_t forward;         /* # of forward reqeusts */
     atomic64_t loop_fwd;        /* # of looped forward requests */
     atomic64_t ausplit;         /* # of ausplit */
     atomic64_t paused_mreq;     /* # of paused modify requests */
     atomic64_t gossip_bitmap;   /* # of gossip bitmaps */
     atomic64_t gossip_ft;       /* # of gossip ft info */
+    atomic64_t resolve;         /* # of path components resolved */
+    atomic64_t resolve_fwd;     /* # of forwarded resolve requests */
+    atomic64_t lease_grant;     /* # of read leases granted */
+    atomic64_t lease_recall;    /* # of read leases recalled by updates */
 };
 
 struct mds_mdsl_prof
 {
     atomic64_t itb_load;        /* # of ITBs load from MDSL */
     atomic64_t itb_wb;          /* # of ITBs writed to MDSL */
+    atomic64_t itb_wb_batch;    /* # of ITB batches writed to MDSL */
     atomic64_t bitmap;          /* # of bitmap lookup IN */
 };
 
@@ -92,12 +100,47 @@ struct mds_cbht_prof
     atomic64_t aentry;          /* # of active entries */
 };
 
+struct mds_ic_prof
+{
+    atomic64_t hit;             /* # of ITB hits in CBHT */
+    atomic64_t miss;            /* # of ITBs loaded from MDSL */
+    atomic64_t ghost_hit;       /* # of loads admitted to Am by a ghost */
+    atomic64_t evict_a1;        /* # of ITBs evicted from A1in */
+    atomic64_t evict_am;        /* # of ITBs evicted from Am */
+    atomic64_t second_chance;   /* # of referenced Am ITBs kept by scrub */
+    atomic64_t promote;         /* # of referenced A1in ITBs moved to Am */
+    atomic64_t coalesced;       /* # of misses waited on an in-flight load */
+    atomic64_t coalesced_wait;  /* total wait time of coalesced misses (us) */
+};
+
+struct mds_warmup_prof
+{
+    atomic64_t total;           /* # of ITBs queued to warm up */
+    atomic64_t pending;         /* # of queued ITBs not handled yet */
+    atomic64_t loaded;          /* # of ITBs preloaded to CBHT */
+    atomic64_t skipped;         /* # of ITBs skipped (cached, not owned) */
+    atomic64_t bitmap;          /* # of preloaded bitmap slices */
+    atomic64_t ring;            /* # of ring changes w/ newly owned ITBs */
+    atomic64_t dumped;          /* # of ITBs in the last hot list dump */
+};
+
+struct mds_zip_prof
+{
+    atomic64_t nr;              /* # of ITBs compressed by this codec */
+    atomic64_t in;              /* input bytes */
+    atomic64_t out;             /* output bytes */
+    atomic64_t ns;              /* CPU time of compression */
+    atomic64_t unzip_nr;        /* # of ITBs decompressed */
+    atomic64_t unzip_ns;        /* CPU time of decompression */
+};
+
 struct mds_itb_prof 
 {
     atomic64_t conflict;        /* # of conflicts in ITB */
     atomic64_t pseudo_conflict; /* # of pseudo conflicts in ITB */
     atomic64_t rsearch_depth;   /* total read search depth */
     atomic64_t wsearch_depth;   /* total write search depth */
+    atomic64_t fp_skip;         /* # of probes rejected by fingerprint */
     atomic64_t cowed;           /* # of COWed ITBs */
     atomic64_t async_unlink;    /* # of async unlinks */
     atomic64_t split_submit;    /* # of submitted ITB splits */
@@ -114,6 +157,9 @@ struct mds_misc_prof
     atomic64_t au_dd;           /* # of dir delta */
     atomic64_t au_ddr;          /* # of dir delta reply */
     atomic64_t reqin_drop;      /* # of dropped requets */
+    atomic64_t reqin_qdepth;    /* # of requests queued in spool */
+    atomic64_t reqin_steal;     /* # of requests stolen by idle threads */
+    atomic64_t reqin_wait;      /* total queue wait time of requests (us) */
 };
 
 struct mds_prof
@@ -126,6 +172,9 @@ struct mds_prof
     struct mds_txg_prof txg;
     struct mds_cbht_prof cbht;
     struct mds_itb_prof itb;
+    struct mds_ic_prof ic;
+    struct mds_warmup_prof warmup;
+    struct mds_zip_prof zip[COMPR_MAX]; /* COMPR_NONE: incompressible ITBs */
     struct mds_misc_prof misc;
     struct xnet_prof *xnet;
 };
@@ -29,13 +29,38 @@
 #include "ring.h"
 #include "lib.h"
 
+/* Each service thread owns one request queue. The receive path pushes
+ * requests onto a lock-free LIFO stack (q->head) and the consumer drains the
+ * whole stack in one shot into a private FIFO chain (q->fifo_*), thus the
+ * producers never touch the consumer's lock. An idle thread steals requests
+ * from the other queues before it goes to sleep.
+ *
+ * While a msg is queued, msg->list.next is the chain link and msg->list.prev
+ * holds the enqueue TSC for wait time accounting. The list_head is
+ * re-inited on dequeue.
+ */
+#define SPOOL_IDLE_WAIT_US      (10 * 1000) /* max idle wait before steal */
+
+struct spool_queue
+{
+    struct xnet_msg * volatile head; /* lock-free push stack */
+    u8 idle;                    /* owner is waiting for requests */
+
+    xlock_t lock;               /* protect the FIFO chain */
+    struct xnet_msg *fifo_head, *fifo_tail;
+    sem_t sem;
+
+    atomic64_t depth;           /* # of queued requests */
+    atomic64_t steal;           /* # of requests stolen by this thread */
+    atomic64_t wait;            /* total queue wait time (us) */
+} __attribute__((aligned(64)));
+
 struct spool_mgr
 {
-    struct list_head reqin;
+    struct spool_queue *sq;     /* per-thread request queues */
+    int nr;                     /* # of queues */
     struct list_head modify_req; /* for suspending modify requests */
-    xlock_t rin_lock;
     xlock_t pmreq_lock;
-    sem_t rin_sem;
 };
 
 struct spool_thread_arg
@@ -44,18 +69,168 @@ struct spool_thread_arg
 };
 
 static struct spool_mgr spool_mgr;
+static __thread u32 spool_rr = 0;
+
+#define SPOOL_MSG_NEXT(msg) ((struct xnet_msg *)((msg)->list.next))
+#define SPOOL_MSG_TSC(msg) ((u64)((msg)->list.prev))
+
+static inline
+void __spool_push(struct spool_queue *q, struct xnet_msg *msg)
+{
+    struct xnet_msg *old;
+
+    msg->list.prev = (struct list_head *)lib_rdtsc();
+    do {
+        old = q->head;
+        msg->list.next = (struct list_head *)old;
+    } while (cmpxchg(&q->head, old, msg) != old);
+    atomic64_inc(&q->depth);
+}
+
+/* __spool_drain() moves all the pushed requests to the FIFO chain in one
+ * batch. Caller should hold the q->lock.
+ */
+static inline
+void __spool_drain(struct spool_queue *q)
+{
+    struct xnet_msg *old, *pos, *prev = NULL, *last;
+
+    if (!q->head)
+        return;
+    do {
+        old = q->head;
+    } while (cmpxchg(&q->head, old, NULL) != old);
+
+    /* reverse the LIFO chain */
+    last = old;
+    while (old) {
+        pos = SPOOL_MSG_NEXT(old);
+        old->list.next = (struct list_head *)prev;
+        prev = old;
+        old = pos;
+    }
+    last->list.next = NULL;
+
+    if (q->fifo_tail)
+        q->fifo_tail->list.next = (struct list_head *)prev;
+    else
+        q->fifo_head = prev;
+    q->fifo_tail = last;
+}
+
+/* __spool_pop() gets one request from the queue. Caller should hold the
+ * q->lock.
+ */
+static inline
+struct xnet_msg *__spool_pop(struct spool_queue *q)
+{
+    struct xnet_msg *msg;
+
+    if (!q->fifo_head)
+        __spool_drain(q);
+    msg = q->fifo_head;
+    if (!msg)
+        return NULL;
+    q->fifo_head = SPOOL_MSG_NEXT(msg);
+    if (!q->fifo_head)
+        q->fifo_tail = NULL;
+    atomic64_dec(&q->depth);
+
+    return msg;
+}
+
+static inline
+void __spool_account(struct spool_queue *q, struct xnet_msg *msg)
+{
+    u64 tsc = lib_rdtsc(), qtsc = SPOOL_MSG_TSC(msg);
+
+    if (likely(tsc > qtsc && cpu_frequency))
+        atomic64_add((tsc - qtsc) / (cpu_frequency >> 20), &q->wait);
+    INIT_LIST_HEAD(&msg->list);
+}
+
+static
+struct xnet_msg *spool_dequeue(int tid)
+{
+    struct spool_queue *q = &spool_mgr.sq[tid];
+    struct xnet_msg *msg;
+
+    xlock_lock(&q->lock);
+    msg = __spool_pop(q);
+    xlock_unlock(&q->lock);
+    if (msg)
+        __spool_account(q, msg);
+
+    return msg;
+}
+
+/* spool_steal() tries to get one request from the other queues. We never
+ * wait on a busy queue lock.
+ */
+static
+struct xnet_msg *spool_steal(int tid)
+{
+    struct spool_queue *q;
+    struct xnet_msg *msg = NULL;
+    int i, idx;
+
+    for (i = 1; i < spool_mgr.nr; i++) {
+        idx = (tid + i) % spool_mgr.nr;
+        q = &spool_mgr.sq[idx];
+        if (!atomic64_read(&q->depth))
+            continue;
+        if (xlock_trylock(&q->lock))
+            continue;
+        msg = __spool_pop(q);
+        xlock_unlock(&q->lock);
+        if (msg) {
+            __spool_account(q, msg);
+            atomic64_inc(&spool_mgr.sq[tid].steal);
+            break;
+        }
+    }
+
+    return msg;
+}
 
 int mds_spool_dispatch(struct xnet_msg *msg)
 {
-    xlock_lock(&spool_mgr.rin_lock);
-    list_add_tail(&msg->list, &spool_mgr.reqin);
-    xlock_unlock(&spool_mgr.rin_lock);
+    struct spool_queue *q;
+    int i, idx;
+
+    /* prefer an idle thread, otherwise round-robin */
+    idx = spool_rr++ % spool_mgr.nr;
+    for (i = 0; i < spool_mgr.nr; i++) {
+        if (spool_mgr.sq[(idx + i) % spool_mgr.nr].idle) {
+            idx = (idx + i) % spool_mgr.nr;
+            break;
+        }
+    }
+    q = &spool_mgr.sq[idx];
+    __spool_push(q, msg);
     atomic64_inc(&hmo.prof.misc.reqin_total);
-    sem_post(&spool_mgr.rin_sem);
+    sem_post(&q->sem);
 
     return 0;
 }
 
+/* mds_spool_prof() folds the per-thread queue stats to hmo.prof.misc
+ */
+void mds_spool_prof(void)
+{
+    u64 depth = 0, steal = 0, wait = 0;
+    int i;
+
+    for (i = 0; i < spool_mgr.nr; i++) {
+        depth += atomic64_read(&spool_mgr.sq[i].depth);
+        steal += atomic64_read(&spool_mgr.sq[i].steal);
+        wait += atomic64_read(&spool_mgr.sq[i].wait);
+    }
+    atomic64_set(&hmo.prof.misc.reqin_qdepth, depth);
+    atomic64_set(&hmo.prof.misc.reqin_steal, steal);
+    atomic64_set(&hmo.prof.misc.reqin_wait, wait);
+}
+
 int mds_spool_modify_pause(struct xnet_msg *msg)
 {
     xlock_lock(&spool_mgr.pmreq_lock);
@@ -71,8 +246,8 @@ void mds_spool_modify_resume(void)
 {
     int i;
 
-    for (i = 0; i < hmo.conf.spool_threads; i++) {
-        sem_post(&spool_mgr.rin_sem);
+    for (i = 0; i < spool_mgr.nr; i++) {
+        sem_post(&spool_mgr.sq[i].sem);
     }
 }
 
@@ -86,12 +261,12 @@ void mds_spool_itb_check(time_t t)
     if (!(hmo.conf.option & HVFS_MDS_MEMLIMIT))
         return;
     if (hmo.conf.memlimit < atomic64_read(&hmo.prof.cbht.aitb) *
-        (sizeof(struct itb) + sizeof(struct ite) * ITB_SIZE)) {
+        ITB_ACTIVE_SIZE) {
         /* we want to evict some clean ITBs */
         if (++memory_pressure == hmo.conf.loadin_pressure) {
             if (!TXG_IS_DIRTY(hmo.txg[TXG_OPEN]))
                 goto skip;
-            if (hmo.txg[TXG_WB] != NULL)
+            if (mds_txg_ring_full(&hmo))
                 goto skip;
             if (!txg_switch(&hmi, &hmo)) {
                 hvfs_info(mds, "Entering new txg %ld (loadin forced)\n", 
@@ -117,7 +292,7 @@ void mds_spool_mp_check(time_t t)
     
     /* check to see if we should resume the modify requests' handling */
     if (hmo.conf.memlimit > atomic64_read(&hmo.prof.cbht.aitb) * 
-        (sizeof(struct itb) + sizeof(struct ite) * ITB_SIZE)) {
+        ITB_ACTIVE_SIZE) {
         /* ok, we disable the scrub thread now */
         hmo.conf.option |= HVFS_MDS_NOSCRUB;
         hmo.conf.scrub_interval = 600;
@@ -132,7 +307,7 @@ void mds_spool_mp_check(time_t t)
         {
             if (!TXG_IS_DIRTY(hmo.txg[TXG_OPEN]))
                 goto skip;
-            if (hmo.txg[TXG_WB] != NULL)
+            if (mds_txg_ring_full(&hmo))
                 goto skip;
             if (!txg_switch(&hmi, &hmo)) {
                 hvfs_info(mds, "Entering new txg %ld (mp forced)\n", 
@@ -173,7 +348,7 @@ void mds_spool_mp_check(time_t t)
 }
 
 static inline
-int __serv_request(void)
+int __serv_request(int tid)
 {
     struct xnet_msg *msg = NULL, *pos, *n;
 
@@ -193,16 +368,12 @@ int __serv_request(void)
         }
     }
     
-    xlock_lock(&spool_mgr.rin_lock);
-    list_for_each_entry_safe(pos, n, &spool_mgr.reqin, list) {
-        list_del_init(&pos->list);
-        msg = pos;
-        break;
+    msg = spool_dequeue(tid);
+    if (!msg) {
+        msg = spool_steal(tid);
+        if (!msg)
+            return -EHSTOP;
     }
-    xlock_unlock(&spool_mgr.rin_lock);
-
-    if (!msg)
-        return -EHSTOP;
 
     /* ok, deal with it, we just calling the secondary dispatcher */
     ASSERT(msg->xc, mds);
@@ -226,6 +397,8 @@ static
 void *spool_main(void *arg)
 {
     struct spool_thread_arg *sta = (struct spool_thread_arg *)arg;
+    struct spool_queue *q = &spool_mgr.sq[sta->tid];
+    struct timespec ts;
     sigset_t set;
     int err = 0;
 
@@ -237,14 +410,23 @@ void *spool_main(void *arg)
                                              * errs */
     
     while (!hmo.spool_thread_stop) {
-        err = sem_wait(&spool_mgr.rin_sem);
-        if (err == EINTR)
+        /* wait for a while, then try to steal from the other threads */
+        q->idle = 1;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += SPOOL_IDLE_WAIT_US * 1000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        err = sem_timedwait(&q->sem, &ts);
+        q->idle = 0;
+        if (err < 0 && errno == EINTR)
             continue;
         hvfs_debug(mds, "Service thread %d wakeup to handle the requests.\n",
                    sta->tid);
         /* trying to handle more and more requsts. */
         while (1) {
-            err = __serv_request();
+            err = __serv_request(sta->tid);
             if (err == -EHSTOP)
                 break;
             else if (err) {
@@ -262,20 +444,33 @@ int mds_spool_create(void)
     int i, err = 0;
     
     /* init the mgr struct */
-    INIT_LIST_HEAD(&spool_mgr.reqin);
     INIT_LIST_HEAD(&spool_mgr.modify_req);
-    xlock_init(&spool_mgr.rin_lock);
     xlock_init(&spool_mgr.pmreq_lock);
-    sem_init(&spool_mgr.rin_sem, 0, 0);
     hmo.spool_modify_pause = 0;
 
     /* init service threads' pool */
     if (!hmo.conf.spool_threads)
         hmo.conf.spool_threads = 4;
 
+    /* init the per-thread request queues */
+    err = posix_memalign((void **)&spool_mgr.sq, 64, hmo.conf.spool_threads *
+                         sizeof(struct spool_queue));
+    if (err) {
+        hvfs_err(mds, "posix_memalign() spool queues failed\n");
+        return -ENOMEM;
+    }
+    memset(spool_mgr.sq, 0, hmo.conf.spool_threads *
+           sizeof(struct spool_queue));
+    for (i = 0; i < hmo.conf.spool_threads; i++) {
+        xlock_init(&spool_mgr.sq[i].lock);
+        sem_init(&spool_mgr.sq[i].sem, 0, 0);
+    }
+    spool_mgr.nr = hmo.conf.spool_threads;
+
     hmo.spool_thread = xzalloc(hmo.conf.spool_threads * sizeof(pthread_t));
     if (!hmo.spool_thread) {
         hvfs_err(mds, "xzalloc() pthread_t failed\n");
+        free(spool_mgr.sq);
         return -ENOMEM;
     }
 
@@ -306,11 +501,15 @@ void mds_spool_destroy(void)
     int i;
 
     hmo.spool_thread_stop = 1;
-    for (i = 0; i < hmo.conf.spool_threads; i++) {
-        sem_post(&spool_mgr.rin_sem);
+    for (i = 0; i < spool_mgr.nr; i++) {
+        sem_post(&spool_mgr.sq[i].sem);
     }
     for (i = 0; i < hmo.conf.spool_threads; i++) {
         pthread_join(*(hmo.spool_thread + i), NULL);
     }
-    sem_destroy(&spool_mgr.rin_sem);
+    for (i = 0; i < spool_mgr.nr; i++) {
+        sem_destroy(&spool_mgr.sq[i].sem);
+        xlock_destroy(&spool_mgr.sq[i].lock);
+    }
+    free(spool_mgr.sq);
 }
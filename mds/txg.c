@@ -30,7 +30,7 @@
 static pthread_key_t itb_key;
 
 static pthread_once_t itb_key_once = PTHREAD_ONCE_INIT;
-static pthread_once_t lzo_key_once = PTHREAD_ONCE_INIT;
+static pthread_once_t zip_key_once = PTHREAD_ONCE_INIT;
 
 static void
 make_tmp_itb()
@@ -39,9 +39,9 @@ make_tmp_itb()
 }
 
 static void
-make_lzo_workmem()
+make_zip_workmem()
 {
-    pthread_key_create(&hmo.lzo_workmem, NULL);
+    pthread_key_create(&hmo.zip_workmem, NULL);
 }
 
 int txg_lookup_rdir(struct hvfs_txg *txg, u64 uuid)
@@ -170,11 +170,41 @@ int txg_init(u64 txg)
 
     /* init the global txg array */
     hmo.txg[TXG_OPEN] = t;
-    hmo.txg[TXG_WB] = NULL;
+
+    /* init the ring of closed txgs */
+    if (hmo.conf.txg_ring <= 0)
+        hmo.conf.txg_ring = TXG_RING_DEFAULT;
+    if (hmo.conf.txg_ring > TXG_RING_MAX)
+        hmo.conf.txg_ring = TXG_RING_MAX;
+    xlock_init(&hmo.txg_ring.lock);
+    hmo.txg_ring.head = 0;
+    hmo.txg_ring.nr = 0;
 
     return 0;
 }
 
+/* txg_ring_pop()
+ *
+ * Remove the synced head TXG from the ring. Return 1 if there are more TXGs
+ * waiting to sync.
+ */
+static inline
+int txg_ring_pop(struct hvfs_txg *t)
+{
+    struct txg_ring *r = &hmo.txg_ring;
+    int more;
+
+    xlock_lock(&r->lock);
+    ASSERT(r->nr > 0 && r->t[r->head] == t, mds);
+    r->t[r->head] = NULL;
+    r->head = (r->head + 1) % TXG_RING_MAX;
+    r->nr--;
+    more = r->nr;
+    xlock_unlock(&r->lock);
+
+    return more;
+}
+
 static inline
 void TXG_COMMITED(u64 txg)
 {
@@ -197,12 +227,13 @@ int TXG_IS_COMMITED(u64 txg)
 
 /* txg_switch()
  *
- * NOTE: only one thread can call this function, and the WB txg should be
- * commited BEFORE calling this function!
+ * NOTE: only one thread can call this function, and there should be a free
+ * slot in the txg ring BEFORE calling this function!
  */
 int txg_switch(struct hvfs_mds_info *hmi, struct hvfs_mds_object *hmo)
 {
-    struct hvfs_txg *nt;
+    struct txg_ring *r = &hmo->txg_ring;
+    struct hvfs_txg *nt, *ot;
     static atomic_t ref = {.counter = 0,};
     int err = 0;
     
@@ -211,6 +242,11 @@ int txg_switch(struct hvfs_mds_info *hmi, struct hvfs_mds_object *hmo)
         atomic_dec(&ref);
         return 0;
     }
+    /* make sure there is a free slot in the ring */
+    if (mds_txg_ring_full(hmo)) {
+        err = -EBUSY;
+        goto out;
+    }
     /* alloc a txg */
     nt = txg_alloc();
     if (!nt) {
@@ -220,17 +256,19 @@ int txg_switch(struct hvfs_mds_info *hmi, struct hvfs_mds_object *hmo)
     }
     TXG_SET_TIME(nt);
 
-    /* make sure the WB txg is commited */
-    ASSERT(hmo->txg[TXG_WB] == NULL, mds);
-
     /* atomic inc the txg # */
     nt->txg = atomic64_inc_return(&hmi->mi_txg);
     
-    /* the current opened txg is going into WB state */
-    txg_get(hmo->txg[TXG_OPEN]);
-    hmo->txg[TXG_WB] = hmo->txg[TXG_OPEN];
-    hmo->txg[TXG_WB]->state = TXG_STATE_WB;
-    txg_put(hmo->txg[TXG_OPEN]);
+    /* the current opened txg is going into WB state, queue it at the ring
+     * tail */
+    ot = hmo->txg[TXG_OPEN];
+    txg_get(ot);
+    ot->state = TXG_STATE_WB;
+    xlock_lock(&r->lock);
+    r->t[(r->head + r->nr) % TXG_RING_MAX] = ot;
+    r->nr++;
+    xlock_unlock(&r->lock);
+    txg_put(ot);
 
     /* atomic swith to the current opened txg */
     hmo->txg[TXG_OPEN] = nt;
@@ -273,14 +311,14 @@ void txg_changer(time_t t)
             return;
         }
     }
-    /* then, check if the writeback slot is free */
-    if (hmo.txg[TXG_WB] != NULL) {
+    /* then, check if there is a free slot in the txg ring */
+    if (mds_txg_ring_full(&hmo)) {
         return;
     }
     /* ok, we can switch the txg */
     err = txg_switch(&hmi, &hmo);
     if (err) {
-        hvfs_err(mds, "txg_switch() failed w/ low memory.\n");
+        hvfs_err(mds, "txg_switch() failed w/ %d.\n", err);
     } else {
         hvfs_info(mds, "Entering new txg %ld\n", hmo.txg[TXG_OPEN]->txg);
         sem_post(&hmo.commit_sem);
@@ -320,7 +358,7 @@ void txg_change_immediately(void)
     /* waiting for the txg changing */
     do {
         if (hmo.txg[TXG_OPEN]->txg > old_txg) {
-            if (hmo.txg[TXG_WB] == NULL || old != hmo.txg[TXG_WB]) {
+            if (TXG_IS_COMMITED(old_txg)) {
                 hvfs_info(mds, "Clearance of txg %ld to MDSL.\n", old_txg);
                 break;
             }
@@ -477,6 +515,155 @@ int txg_prepare_begin(struct commit_thread_arg *cta, struct hvfs_txg *t)
     return 0;
 }
 
+/* tws_batch_reap()
+ *
+ * Wait for all the in-flight batches of this slice and free them.
+ */
+static
+void tws_batch_reap(struct commit_thread_arg *cta, struct txg_wb_slice *tws)
+{
+    struct txg_wb_batch *pos, *n;
+    int err;
+
+    if (!tws->inflight_nr)
+        return;
+
+    err = xnet_wait_group_wait(tws->wg);
+    if (err) {
+        hvfs_err(mds, "Wait ITB batches @ TXG %ld to site %lx failed w/ %d\n",
+                 cta->wbt->txg, tws->site_id, err);
+    }
+    list_for_each_entry_safe(pos, n, &tws->inflight, list) {
+        list_del(&pos->list);
+        if (!xnet_wait_group_abandon(tws->wg, pos->msg)) {
+            /* still in flight, it is freed on the late reply. The batch
+             * buffer has been sent, it is safe to free it. */
+            hvfs_err(mds, "Write back %d ITBs to site %lx w/o reply\n",
+                     pos->nr, tws->site_id);
+            tws->err = -ETIMEDOUT;
+            xfree(pos);
+            continue;
+        } else if (!pos->msg->pair) {
+            hvfs_err(mds, "Write back %d ITBs to site %lx w/o reply\n",
+                     pos->nr, tws->site_id);
+            tws->err = -ETIMEDOUT;
+        } else if (pos->msg->pair->tx.err) {
+            hvfs_err(mds, "Write back %d ITBs to site %lx failed w/ %d\n",
+                     pos->nr, tws->site_id, pos->msg->pair->tx.err);
+            tws->err = pos->msg->pair->tx.err;
+        }
+        xnet_free_msg(pos->msg);
+        xfree(pos);
+    }
+    tws->inflight_nr = 0;
+}
+
+/* tws_batch_flush()
+ *
+ * Send the current batch of this slice asynchronously. The batch buffer is
+ * released in tws_batch_reap() after MDSL replied.
+ */
+static
+int tws_batch_flush(struct commit_thread_arg *cta, struct txg_wb_slice *tws)
+{
+    struct txg_wb_batch *b = tws->cur;
+    struct xnet_msg *msg;
+    int err = 0;
+
+    if (!b)
+        return 0;
+    tws->cur = NULL;
+
+    if (!tws->wg) {
+        tws->wg = xnet_wait_group_create();
+        if (!tws->wg) {
+            err = -ENOMEM;
+            goto out_free;
+        }
+    }
+    msg = xnet_alloc_msg(XNET_MSG_CACHE);
+    if (!msg) {
+        hvfs_err(mds, "xnet_alloc_msg() failed.\n");
+        err = -ENOMEM;
+        goto out_free;
+    }
+    xnet_msg_fill_tx(msg, XNET_MSG_REQ, XNET_NEED_REPLY,
+                     hmo.site_id, tws->site_id);
+    xnet_msg_fill_cmd(msg, HVFS_MDS2MDSL_WBTXG, HVFS_WBTXG_ITB, cta->wbt->txg);
+    msg->tx.reserved = b->vid;
+#ifdef XNET_EAGER_WRITEV
+    xnet_msg_add_sdata(msg, &msg->tx, sizeof(msg->tx));
+#endif
+    xnet_msg_add_sdata(msg, b->data, b->len);
+
+    xnet_wait_group_add(tws->wg, msg);
+    err = xnet_isend(hmo.xc, msg);
+    if (err) {
+        hvfs_err(mds, "Write back %d ITBs to site %lx failed w/ %d\n",
+                 b->nr, tws->site_id, err);
+        xnet_wait_group_del(tws->wg, msg);
+        xnet_free_msg(msg);
+        goto out_free;
+    }
+    b->msg = msg;
+    list_add_tail(&b->list, &tws->inflight);
+    atomic64_inc(&hmo.prof.mdsl.itb_wb_batch);
+
+    /* bound the memory pinned by in-flight batches */
+    if (++tws->inflight_nr >= hmo.conf.txg_wb_inflight)
+        tws_batch_reap(cta, tws);
+
+    return 0;
+out_free:
+    tws->err = err;
+    xfree(b);
+    return err;
+}
+
+/* tws_batch_add()
+ *
+ * Copy the ITB to the current batch of this slice, flush the batch if it is
+ * full.
+ */
+static
+int tws_batch_add(struct commit_thread_arg *cta, struct txg_wb_slice *tws,
+                  struct itb *itb, u64 vid)
+{
+    struct txg_wb_batch *b = tws->cur;
+    u32 len = atomic_read(&itb->h.len);
+    int err = 0;
+
+    if (b && b->len + len > b->psize) {
+        err = tws_batch_flush(cta, tws);
+        b = NULL;
+    }
+    if (!b) {
+        u32 psize = max(len, (u32)hmo.conf.txg_wb_batch_len);
+
+        b = xmalloc(sizeof(*b) + psize);
+        if (!b) {
+            hvfs_err(mds, "xmalloc() ITB batch buffer failed.\n");
+            tws->err = -ENOMEM;
+            return -ENOMEM;
+        }
+        INIT_LIST_HEAD(&b->list);
+        b->msg = NULL;
+        b->vid = vid;
+        b->psize = psize;
+        b->len = 0;
+        b->nr = 0;
+        tws->cur = b;
+    }
+    memcpy(b->data + b->len, itb, len);
+    b->len += len;
+    b->nr++;
+
+    if (b->nr >= hmo.conf.txg_wb_batch_nr || b->len >= b->psize)
+        err = tws_batch_flush(cta, tws);
+
+    return err;
+}
+
 /* txg_wb_itb_ll()
  *
  * NOTE: low level ITB write back function.
@@ -511,19 +698,27 @@ int txg_wb_itb_ll(struct commit_thread_arg *cta, struct itb *itb)
         goto out;
     }
 
-    /* Step 1.inf: prepare the xnet msg a litte earlier */
-    msg = xnet_alloc_msg(XNET_MSG_CACHE);
-    if (!msg) {
-        hvfs_err(mds, "xnet_alloc_msg() failed.\n");
-        err = -ENOMEM;
-        goto out;
-    }
     /* Step 2: lookup in the CTA hash table */
     tws = tws_find_create(cta, p->site_id);
     if (!tws) {
         hvfs_err(mds, "tws_find_create() failed.\n");
         err = -ENOMEM;
-        goto out_free_msg;
+        goto out;
+    }
+    if (!IS_TWS_NEW(tws)) {
+        /* TXG_BEGIN has been accepted by this site, batch the ITB */
+        err = tws_batch_add(cta, tws, itb, p->vid);
+        tws->nr++;
+        tws->len += atomic_read(&itb->h.len);
+        atomic64_inc(&hmo.prof.mdsl.itb_wb);
+        goto out;
+    }
+
+    msg = xnet_alloc_msg(XNET_MSG_CACHE);
+    if (!msg) {
+        hvfs_err(mds, "xnet_alloc_msg() failed.\n");
+        err = -ENOMEM;
+        goto out;
     }
     /* Step 3: construct the xnet_msg to send it to the destination */
     xnet_msg_fill_tx(msg, XNET_MSG_REQ, 0, 
@@ -579,10 +774,6 @@ int txg_wb_itb_ll(struct commit_thread_arg *cta, struct itb *itb)
     xnet_free_msg(msg);
     atomic64_inc(&hmo.prof.mdsl.itb_wb);
 
-    return err;
-
-out_free_msg:
-    xnet_raw_free_msg(msg);
 out:
     return err;
 }
@@ -647,8 +838,16 @@ int txg_wb_bcast_end(struct commit_thread_arg *cta, int err)
 {
     struct txg_wb_slice *pos, *n;
 
+    /* kick the tail batches of all the sites first, thus they are written
+     * back in parallel */
+    list_for_each_entry(pos, &cta->tws_list, list) {
+        tws_batch_flush(cta, pos);
+    }
     list_for_each_entry_safe(pos, n, &cta->tws_list, list) {
-        pos->err = err;
+        tws_batch_reap(cta, pos);
+        if (!pos->err)
+            pos->err = err;
+        xnet_wait_group_destroy(pos->wg);
         err = __send_txg_end(pos, cta);
         if (err) {
             hvfs_err(mds, "send_txg_end @ TXG %ld failed w/ %d\n",
@@ -663,6 +862,45 @@ int txg_wb_bcast_end(struct commit_thread_arg *cta, int err)
     return err;
 }
 
+/* the codec policies of the directories seen in one TXG write back, then we
+ * search the DH once per directory, not once per ITB */
+#define TXG_ZIP_CACHE_BITS      4
+struct txg_zip_cache
+{
+    u64 puuid[1 << TXG_ZIP_CACHE_BITS];
+    int algo[1 << TXG_ZIP_CACHE_BITS]; /* -1 means an empty slot */
+};
+
+/* txg_zip_algo()
+ *
+ * NOTE: the ITB codec policy in the directory's GDT entry overrides the MDS
+ * default.
+ */
+static inline
+int txg_zip_algo(struct itb *i, struct txg_zip_cache *zc)
+{
+    struct dhe *e;
+    int algo = COMPR_NONE, slot;
+
+    slot = hash_64(i->h.puuid, TXG_ZIP_CACHE_BITS);
+    if (zc->algo[slot] >= 0 && zc->puuid[slot] == i->h.puuid)
+        return zc->algo[slot];
+
+    if (hmo.conf.option & HVFS_MDS_MDZIP)
+        algo = hmo.conf.zip_algo;
+
+    e = mds_dh_search(&hmo.dh, i->h.puuid);
+    if (!IS_ERR(e)) {
+        if (e->zip)
+            algo = e->zip - 1;
+        mds_dh_put(e);
+        zc->puuid[slot] = i->h.puuid;
+        zc->algo[slot] = algo;
+    }
+
+    return algo;
+}
+
 /* txg_wb_itb()
  *
  * NOTE: write back the ITBs to their own site, 
@@ -673,8 +911,10 @@ int txg_wb_itb(struct commit_thread_arg *cta, struct hvfs_txg *t,
 {
     struct itbh *ih, *n;
     struct itb *i, *tmpi = NULL, *swap = NULL;
+    struct txg_zip_cache zc;
     int err = 0, failed = 0;
 
+    memset(zc.algo, -1, sizeof(zc.algo));
     /* try to get the temp itb now */
     tmpi = pthread_getspecific(itb_key);
     if (unlikely(!tmpi)) {
@@ -721,20 +961,22 @@ int txg_wb_itb(struct commit_thread_arg *cta, struct hvfs_txg *t,
             }
             xrwlock_wunlock(&ih->lock);
             if (tmpi) {
-                if (hmo.conf.option & HVFS_MDS_MDZIP) {
+                int algo = txg_zip_algo(tmpi, &zc);
+
+                if (algo != COMPR_NONE) {
                     /* reset some regions to ZERO to decrease zip size */
                     memset(tmpi->lock, 0, sizeof(tmpi->lock));
-                    /* do lzo compress now */
-                    err = itb_lzo_compress(tmpi, 
+                    /* do compress now */
+                    err = itb_zip_compress(tmpi, 
                                            (struct itb *)
                                            ((void *)tmpi + 
                                             (sizeof(struct itb) + 
                                              sizeof(struct ite) * 
                                              ITB_SIZE)),
-                                           &tmpi);
+                                           &tmpi, algo);
                     if (err) {
-                        hvfs_err(mds, "do LZO compress on ITB %ld "
-                                 "failed w/ %d\n",
+                        hvfs_err(mds, "do %s compress on ITB %ld "
+                                 "failed w/ %d\n", hvfs_zip_name(algo),
                                  tmpi->h.itbid, err);
                     }
                 }
@@ -788,28 +1030,33 @@ void *txg_commit(void *arg)
     /* init the itb memory key */
     pthread_once(&itb_key_once, make_tmp_itb);
     if (pthread_getspecific(itb_key) == NULL) {
-        /* alloc the tmp ITB now */
-        void *i = xmalloc((sizeof(struct itb) + 
-                           sizeof(struct ite) * ITB_SIZE) * 2);
+        /* alloc the tmp ITB now, the second half is the compressed ITB */
+        void *i = xmalloc(sizeof(struct itb) + 
+                          sizeof(struct ite) * ITB_SIZE +
+                          HVFS_ZIP_BOUND(sizeof(struct itb) + 
+                                         sizeof(struct ite) * ITB_SIZE));
         if (!i) {
             HVFS_BUGON("Allocate TLS tmp itb failed!");
         }
         pthread_setspecific(itb_key, i);
         hvfs_info(mds, "Alloc thread specific ITB memory %ldB\n", 
-                  (sizeof(struct itb) + 
-                   sizeof(struct ite) * ITB_SIZE) * 2);
+                  sizeof(struct itb) + 
+                  sizeof(struct ite) * ITB_SIZE +
+                  HVFS_ZIP_BOUND(sizeof(struct itb) + 
+                                 sizeof(struct ite) * ITB_SIZE));
     }
 
-    /* init the lzo memory key */
-    pthread_once(&lzo_key_once, make_lzo_workmem);
-    if (pthread_getspecific(hmo.lzo_workmem) == NULL) {
-        /* alloc the LZO work memory now */
-        void *p = xmalloc(LZO1X_1_MEM_COMPRESS + (sizeof(lzo_align_t) - 1));
+    /* init the zip memory key */
+    pthread_once(&zip_key_once, make_zip_workmem);
+    if (pthread_getspecific(hmo.zip_workmem) == NULL) {
+        /* alloc the codec work memory now */
+        void *p = xmalloc(HVFS_ZIP_WORKMEM(sizeof(struct itb) + 
+                                           sizeof(struct ite) * ITB_SIZE));
 
         if (!p) {
-            HVFS_BUGON("Failed to allocate lzo work memroy!");
+            HVFS_BUGON("Failed to allocate zip work memroy!");
         }
-        pthread_setspecific(hmo.lzo_workmem, p);
+        pthread_setspecific(hmo.zip_workmem, p);
     }
 
     while (!hmo.commit_thread_stop) {
@@ -818,8 +1065,9 @@ void *txg_commit(void *arg)
             continue;
         hvfs_debug(mds, "Commit thread %d wakeup to progress the TXG"
                    " writeback.\n", cta->tid);
-        /* ok, we should commit the dirty TXG to the MDSL */
-        t = hmo.txg[TXG_WB];
+        /* ok, we should commit the oldest closed TXG to the MDSL, the
+         * younger ones have to wait for it */
+        t = mds_get_wb_txg(&hmo);
         if (!t)
             continue;
         /* Step1: wait for any pending TXs */
@@ -838,7 +1086,7 @@ void *txg_commit(void *arg)
             mcond_timedwait(&t->cond, &ts);
             hvfs_debug(mds, "%p><--%ld--><\n", 
                        t, atomic64_read(&t->tx_pending));
-            if (t != hmo.txg[TXG_WB]) {
+            if (t != mds_get_wb_txg(&hmo)) {
                 goto retry;
             }
         }
@@ -858,7 +1106,9 @@ void *txg_commit(void *arg)
         CTA_FINA(cta);
         end = time(NULL);
         
-        hmo.txg[TXG_WB] = NULL;
+        /* kick the next closed TXG, if any */
+        if (txg_ring_pop(t))
+            sem_post(&hmo.commit_sem);
         /* free the TXG */
         hvfs_info(mds, "TXG %ld is released (free:%d, clean:%d, ntkwn:%d) %ld s.\n", 
                   t->txg, freed, clean, notknown, (end - begin));
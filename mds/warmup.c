@@ -0,0 +1,722 @@
+/**
+ * Copyright (c) 2009 Ma Can <ml.macana@gmail.com>
+ *                           <macan@ncic.ac.cn>
+ *
+ * Armed with EMACS.
+ * Time-stamp: <2011-05-06 10:12:37 macan>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "hvfs.h"
+#include "mds.h"
+#include "xtable.h"
+#include "tx.h"
+#include "xnet.h"
+#include "ring.h"
+#include "lib.h"
+
+/* MDS warm-up
+ *
+ * The hot ITB keys in CBHT are dumped to the hot list file periodically. On
+ * startup, the warm-up threads replay the hot list after the rings are
+ * ready: they load the DHEs and bitmap slices, and load the ITBs owned by
+ * this site in batches from MDSL. On a ring change, the ITBs in the cached
+ * bitmap slices which are owned by this site now are loaded either. The
+ * requests are served at the same time, a request racing w/ the warm-up just
+ * loads the ITB itself and the warm-up one is dropped on inserting.
+ */
+
+#define MDS_WARMUP_MAGIC        0x484f544d /* "HOTM" */
+#define MDS_WARMUP_GAP          8 /* max itbid gap to merge into one batch */
+
+struct warmup_hdr
+{
+    u32 magic;
+    u32 nr;
+    u64 site_id;
+};
+
+struct warmup_entry
+{
+    u64 puuid;
+    u64 itbid;
+};
+
+/* ITBs of one directory to load, itbids are sorted */
+struct warmup_req
+{
+    struct list_head list;
+    u64 puuid;
+    int nr;
+    u64 itbid[0];
+};
+
+struct warmup_ctx
+{
+    u64 puuid;
+    u64 salt;
+    u64 dsite;
+};
+
+struct warmup_mgr
+{
+    struct list_head queue;
+    xlock_t qlock;
+    sem_t qsem;
+    pthread_t *threads;
+    struct chring *oring;       /* MDS ring before the last ring change */
+    char file[256];             /* hot list file */
+    time_t dump_ts;
+    int nr;                     /* # of warm-up threads */
+    u8 replayed;                /* hot list has been replayed */
+    u8 replay;                  /* replay the hot list */
+    u8 dump;                    /* dump the hot list */
+    u8 ring;                    /* rescan after a ring change */
+    u8 stop;
+};
+
+static struct warmup_mgr warmup_mgr;
+
+static inline
+int __warmup_entry_cmp(const void *a, const void *b)
+{
+    const struct warmup_entry *x = a, *y = b;
+
+    if (x->puuid != y->puuid)
+        return (x->puuid < y->puuid) ? -1 : 1;
+    if (x->itbid != y->itbid)
+        return (x->itbid < y->itbid) ? -1 : 1;
+    return 0;
+}
+
+static inline
+u64 __warmup_site(u64 itbid, u64 salt, struct chring *r)
+{
+    struct chp *p;
+
+    if (!r)
+        return -1UL;
+    p = ring_get_point(itbid, salt, r);
+    if (IS_ERR(p))
+        return -1UL;
+    return p->site_id;
+}
+
+/* __warmup_queue()
+ *
+ * Queue the sorted entries to the warm-up threads, one request per
+ * directory.
+ */
+static void __warmup_queue(struct warmup_entry *we, int nr)
+{
+    struct warmup_req *wr;
+    int i, j;
+
+    for (i = 0; i < nr; i = j) {
+        for (j = i + 1; j < nr && we[j].puuid == we[i].puuid; j++)
+            ;
+        wr = xzalloc(sizeof(*wr) + (j - i) * sizeof(u64));
+        if (!wr) {
+            hvfs_err(mds, "xzalloc() warm-up request failed\n");
+            atomic64_add(nr - i, &hmo.prof.warmup.skipped);
+            return;
+        }
+        INIT_LIST_HEAD(&wr->list);
+        wr->puuid = we[i].puuid;
+        for (wr->nr = 0; wr->nr < j - i; wr->nr++)
+            wr->itbid[wr->nr] = we[i + wr->nr].itbid;
+        atomic64_add(wr->nr, &hmo.prof.warmup.total);
+        atomic64_add(wr->nr, &hmo.prof.warmup.pending);
+
+        xlock_lock(&warmup_mgr.qlock);
+        list_add_tail(&wr->list, &warmup_mgr.queue);
+        xlock_unlock(&warmup_mgr.qlock);
+        sem_post(&warmup_mgr.qsem);
+    }
+}
+
+/* __warmup_dump()
+ *
+ * Collect the ITB keys in CBHT to the hot list file. The Am or referenced
+ * ITBs go first, then the A1in ones if there is room.
+ */
+static void __warmup_dump(void)
+{
+    struct eh *eh = &hmo.cbht;
+    struct warmup_entry *hot, *warm;
+    struct warmup_hdr hdr;
+    struct segment *s;
+    struct bucket *b;
+    struct bucket_entry *be;
+    struct itbh *ih;
+    struct hlist_node *pos;
+    struct itb_cstate *cs;
+    char tmp[sizeof(warmup_mgr.file) + 8];
+    FILE *fp;
+    u64 offset, j;
+    int max = hmo.conf.warmup_max, hnr = 0, wnr = 0;
+
+    hot = xmalloc(max * sizeof(*hot));
+    warm = xmalloc(max * sizeof(*warm));
+    if (!hot || !warm) {
+        hvfs_err(mds, "xmalloc() hot list failed\n");
+        goto out;
+    }
+
+    xrwlock_rlock(&eh->lock);
+    list_for_each_entry(s, &eh->dir, list) {
+        if (!s->seg)
+            continue;
+        for (offset = 0; offset < s->len && hnr < max; offset++) {
+            b = *(((struct bucket **)s->seg) + offset);
+            if (atomic_read(&b->active) == 0)
+                continue;
+            xrwlock_rlock(&b->lock);
+            for (j = 0; j < (1 << eh->bucket_depth); j++) {
+                be = b->content + j;
+                xrwlock_rlock(&be->lock);
+                hlist_for_each_entry(ih, pos, &be->h, cbht) {
+                    cs = ITB_CSTATE((struct itb *)ih);
+                    if (cs->q == ITB_CQ_AM || cs->ref) {
+                        if (hnr < max) {
+                            hot[hnr].puuid = ih->puuid;
+                            hot[hnr].itbid = ih->itbid;
+                            hnr++;
+                        }
+                    } else if (wnr < max) {
+                        warm[wnr].puuid = ih->puuid;
+                        warm[wnr].itbid = ih->itbid;
+                        wnr++;
+                    }
+                }
+                xrwlock_runlock(&be->lock);
+            }
+            xrwlock_runlock(&b->lock);
+        }
+    }
+    xrwlock_runlock(&eh->lock);
+
+    if (hnr + wnr == 0)
+        goto out;
+    if (wnr > max - hnr)
+        wnr = max - hnr;
+    memcpy(hot + hnr, warm, wnr * sizeof(*warm));
+    hnr += wnr;
+    qsort(hot, hnr, sizeof(*hot), __warmup_entry_cmp);
+
+    /* write to the temp file and rename it, a crash never leaves a partial
+     * hot list */
+    snprintf(tmp, sizeof(tmp), "%s.tmp", warmup_mgr.file);
+    fp = fopen(tmp, "w");
+    if (!fp) {
+        hvfs_err(mds, "fopen() hot list '%s' failed w/ %s\n",
+                 tmp, strerror(errno));
+        goto out;
+    }
+    hdr.magic = MDS_WARMUP_MAGIC;
+    hdr.nr = hnr;
+    hdr.site_id = hmo.site_id;
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        fwrite(hot, sizeof(*hot), hnr, fp) != hnr) {
+        hvfs_err(mds, "fwrite() hot list '%s' failed w/ %s\n",
+                 tmp, strerror(errno));
+        fclose(fp);
+        unlink(tmp);
+        goto out;
+    }
+    if (fclose(fp)) {
+        hvfs_err(mds, "fclose() hot list '%s' failed w/ %s\n",
+                 tmp, strerror(errno));
+        unlink(tmp);
+        goto out;
+    }
+    if (rename(tmp, warmup_mgr.file)) {
+        hvfs_err(mds, "rename() hot list to '%s' failed w/ %s\n",
+                 warmup_mgr.file, strerror(errno));
+        unlink(tmp);
+        goto out;
+    }
+    hvfs_debug(mds, "Dump %d hot ITBs to '%s'\n", hnr, warmup_mgr.file);
+    atomic64_set(&hmo.prof.warmup.dumped, hnr);
+
+out:
+    xfree(hot);
+    xfree(warm);
+}
+
+/* __warmup_replay()
+ *
+ * Read the hot list file and queue the entries.
+ */
+static void __warmup_replay(void)
+{
+    struct warmup_entry *we;
+    struct warmup_hdr hdr;
+    FILE *fp;
+
+    fp = fopen(warmup_mgr.file, "r");
+    if (!fp) {
+        if (errno != ENOENT)
+            hvfs_err(mds, "fopen() hot list '%s' failed w/ %s\n",
+                     warmup_mgr.file, strerror(errno));
+        return;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        hdr.magic != MDS_WARMUP_MAGIC) {
+        hvfs_warning(mds, "Invalid hot list '%s', ignore it\n",
+                     warmup_mgr.file);
+        goto out_close;
+    }
+    if (hdr.nr > hmo.conf.warmup_max)
+        hdr.nr = hmo.conf.warmup_max;
+    if (!hdr.nr)
+        goto out_close;
+
+    we = xmalloc(hdr.nr * sizeof(*we));
+    if (!we) {
+        hvfs_err(mds, "xmalloc() hot list failed\n");
+        goto out_close;
+    }
+    hdr.nr = fread(we, sizeof(*we), hdr.nr, fp);
+    hvfs_info(mds, "Warm up %d hot ITBs from '%s' (site %lx)\n",
+              hdr.nr, warmup_mgr.file, hdr.site_id);
+    __warmup_queue(we, hdr.nr);
+    xfree(we);
+
+out_close:
+    fclose(fp);
+}
+
+/* __warmup_rescan()
+ *
+ * Queue the ITBs in the cached bitmap slices which are owned by this site
+ * now but not before the ring change.
+ */
+static void __warmup_rescan(struct chring *oring)
+{
+    struct dh *dh = &hmo.dh;
+    struct regular_hash *rh;
+    struct hlist_node *pos;
+    struct itbitmap *b;
+    struct dhe *e, **es = NULL, **t;
+    struct warmup_entry *we;
+    u64 itbid;
+    int i, j, enr = 0, esize = 0, nr = 0, max = hmo.conf.warmup_max;
+
+    /* pin the DHEs, mds_dh_check() waits for the references */
+    for (i = 0; i < dh->hsize; i++) {
+        rh = dh->ht + i;
+        xlock_lock(&rh->lock);
+        hlist_for_each_entry(e, pos, &rh->h, hlist) {
+            if (enr == esize) {
+                esize = (esize ? esize * 2 : 64);
+                t = xrealloc(es, esize * sizeof(*es));
+                if (!t) {
+                    hvfs_err(mds, "xrealloc() DHE array failed\n");
+                    xlock_unlock(&rh->lock);
+                    goto out_put;
+                }
+                es = t;
+            }
+            atomic_inc(&e->ref);
+            es[enr++] = e;
+        }
+        xlock_unlock(&rh->lock);
+    }
+
+out_put:
+    we = xmalloc(max * sizeof(*we));
+    if (!we)
+        hvfs_err(mds, "xmalloc() warm-up list failed\n");
+    for (i = 0; i < enr; i++) {
+        e = es[i];
+        xlock_lock(&e->lock);
+        list_for_each_entry(b, &e->bitmap, list) {
+            if (!we || nr >= max)
+                break;
+            for (j = find_first_bit((unsigned long *)b->array,
+                                    XTABLE_BITMAP_SIZE);
+                 j < XTABLE_BITMAP_SIZE && nr < max;
+                 j = find_next_bit((unsigned long *)b->array,
+                                   XTABLE_BITMAP_SIZE, j + 1)) {
+                itbid = b->offset + j;
+                if (__warmup_site(itbid, e->salt,
+                                  hmo.chring[CH_RING_MDS]) != hmo.site_id)
+                    continue;
+                if (__warmup_site(itbid, e->salt, oring) == hmo.site_id)
+                    continue;
+                we[nr].puuid = e->uuid;
+                we[nr].itbid = itbid;
+                nr++;
+            }
+        }
+        xlock_unlock(&e->lock);
+        mds_dh_put(e);
+    }
+    xfree(es);
+
+    if (nr) {
+        hvfs_info(mds, "Warm up %d newly owned ITBs on ring change\n", nr);
+        atomic64_inc(&hmo.prof.warmup.ring);
+        __warmup_queue(we, nr);
+    }
+    xfree(we);
+}
+
+/* __warmup_pressure()
+ *
+ * Stop warming up at 80% of the ITB memory limit, leave the rest to the
+ * demand loads.
+ */
+static inline
+int __warmup_pressure(void)
+{
+    if (!(hmo.conf.option & HVFS_MDS_MEMLIMIT))
+        return 0;
+    return (atomic64_read(&hmo.prof.cbht.aitb) * ITB_ACTIVE_SIZE >
+            hmo.conf.memlimit / 10 * 8);
+}
+
+/* __warmup_bitmap()
+ *
+ * Load the bitmap slice covering @itbid if it is not cached.
+ */
+static void __warmup_bitmap(struct dhe *e, u64 itbid)
+{
+    struct itbitmap *b;
+    u64 offset = BITMAP_ROUNDDOWN(itbid);
+    int err;
+
+    xlock_lock(&e->lock);
+    list_for_each_entry(b, &e->bitmap, list) {
+        if (b->offset == offset) {
+            xlock_unlock(&e->lock);
+            return;
+        }
+    }
+    xlock_unlock(&e->lock);
+
+    err = mds_bitmap_load(e, offset);
+    if (!err)
+        atomic64_inc(&hmo.prof.warmup.bitmap);
+    else if (err != -ENOTEXIST)
+        hvfs_debug(mds, "Warm up DHE %lx bitmap %ld failed w/ %d\n",
+                   e->uuid, offset, err);
+}
+
+/* __warmup_insert()
+ *
+ * Callback of mds_read_itb_batch(), insert the ITB to CBHT if this site owns
+ * it and nobody has loaded it.
+ */
+static int __warmup_insert(struct itb *i, void *arg)
+{
+    struct warmup_ctx *wc = arg;
+    struct bucket *b;
+    struct bucket_entry *e;
+    struct itb *oi;
+    int err;
+
+    if (i->h.puuid != wc->puuid ||
+        __warmup_site(i->h.itbid, wc->salt,
+                      hmo.chring[CH_RING_MDS]) != hmo.site_id ||
+        __warmup_site(i->h.itbid, wc->salt,
+                      hmo.chring[CH_RING_MDSL]) != wc->dsite)
+        goto drop;
+
+    err = mds_cbht_insert_bbrlocked(&hmo.cbht, i, &b, &e, &oi);
+    if (err == -EEXIST) {
+        xrwlock_runlock(&e->lock);
+        xrwlock_runlock(&b->lock);
+        goto drop;
+    } else if (err) {
+        hvfs_err(mds, "Warm up ITB %lx:%ld insert failed w/ %d\n",
+                 i->h.puuid, i->h.itbid, err);
+        goto drop;
+    }
+    xrwlock_runlock(&e->lock);
+    xrwlock_runlock(&b->lock);
+    atomic64_inc(&hmo.prof.warmup.loaded);
+
+    return 0;
+drop:
+    atomic64_sub(atomic_read(&i->h.entries), &hmo.prof.cbht.aentry);
+    itb_free(i);
+    return 0;
+}
+
+/* __warmup_load()
+ *
+ * Load the ITBs of one directory. The ITBs not owned by this site or already
+ * in CBHT are skipped, the others are loaded in batches of nearby itbids
+ * stored on the same MDSL site.
+ */
+static void __warmup_load(struct warmup_req *wr)
+{
+    struct warmup_ctx wc;
+    struct dhe *e;
+    u64 begin, last;
+    int i, j, err;
+
+    e = mds_dh_search(&hmo.dh, wr->puuid);
+    if (IS_ERR(e)) {
+        hvfs_debug(mds, "Warm up DHE %lx failed w/ %ld\n",
+                   wr->puuid, PTR_ERR(e));
+        atomic64_add(wr->nr, &hmo.prof.warmup.skipped);
+        return;
+    }
+    wc.puuid = wr->puuid;
+    wc.salt = e->salt;
+
+    for (i = 0; i < wr->nr; i = j) {
+        if (unlikely(warmup_mgr.stop) || __warmup_pressure()) {
+            atomic64_add(wr->nr - i, &hmo.prof.warmup.skipped);
+            break;
+        }
+        j = i + 1;
+        begin = wr->itbid[i];
+        if (i == 0 || BITMAP_ROUNDDOWN(begin) !=
+            BITMAP_ROUNDDOWN(wr->itbid[i - 1]))
+            __warmup_bitmap(e, begin);
+        if (__warmup_site(begin, wc.salt,
+                          hmo.chring[CH_RING_MDS]) != hmo.site_id ||
+            mds_cbht_exist_check(&hmo.cbht, wc.puuid, begin) == -EEXIST) {
+            atomic64_inc(&hmo.prof.warmup.skipped);
+            continue;
+        }
+        wc.dsite = __warmup_site(begin, wc.salt, hmo.chring[CH_RING_MDSL]);
+        if (wc.dsite == -1UL) {
+            atomic64_inc(&hmo.prof.warmup.skipped);
+            continue;
+        }
+        /* merge the nearby itbids on the same MDSL site */
+        last = begin;
+        while (j < wr->nr && wr->itbid[j] - last <= MDS_WARMUP_GAP &&
+               __warmup_site(wr->itbid[j], wc.salt,
+                             hmo.chring[CH_RING_MDSL]) == wc.dsite) {
+            last = wr->itbid[j];
+            j++;
+        }
+        err = mds_read_itb_batch(wc.puuid, wc.dsite, begin, last + 1,
+                                 __warmup_insert, &wc);
+        if (err < 0) {
+            hvfs_debug(mds, "Warm up ITB %lx:[%ld,%ld] from %lx "
+                       "failed w/ %d\n",
+                       wc.puuid, begin, last, wc.dsite, err);
+            atomic64_add(j - i, &hmo.prof.warmup.skipped);
+        } else if (err < j - i)
+            atomic64_add(j - i - err, &hmo.prof.warmup.skipped);
+    }
+    mds_dh_put(e);
+}
+
+static
+void *warmup_main(void *arg)
+{
+    struct warmup_req *wr;
+    struct chring *oring;
+    sigset_t set;
+    int err = 0;
+
+    /* first, let us block the SIGALRM and SIGCHLD */
+    sigemptyset(&set);
+    sigaddset(&set, SIGALRM);
+    sigaddset(&set, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &set, NULL); /* oh, we do not care about the
+                                             * errs */
+    while (!warmup_mgr.stop) {
+        err = sem_wait(&warmup_mgr.qsem);
+        if (err < 0 && errno == EINTR)
+            continue;
+        if (unlikely(warmup_mgr.stop))
+            break;
+
+        wr = NULL;
+        oring = NULL;
+        xlock_lock(&warmup_mgr.qlock);
+        if (warmup_mgr.replay) {
+            warmup_mgr.replay = 0;
+            xlock_unlock(&warmup_mgr.qlock);
+            __warmup_replay();
+            warmup_mgr.replayed = 1;
+            continue;
+        }
+        if (warmup_mgr.ring) {
+            warmup_mgr.ring = 0;
+            oring = warmup_mgr.oring;
+            xlock_unlock(&warmup_mgr.qlock);
+            __warmup_rescan(oring);
+            continue;
+        }
+        if (warmup_mgr.dump) {
+            warmup_mgr.dump = 0;
+            xlock_unlock(&warmup_mgr.qlock);
+            __warmup_dump();
+            continue;
+        }
+        if (!list_empty(&warmup_mgr.queue)) {
+            wr = list_first_entry(&warmup_mgr.queue, struct warmup_req,
+                                  list);
+            list_del(&wr->list);
+        }
+        xlock_unlock(&warmup_mgr.qlock);
+
+        if (wr) {
+            __warmup_load(wr);
+            atomic64_sub(wr->nr, &hmo.prof.warmup.pending);
+            xfree(wr);
+        }
+    }
+
+    pthread_exit(0);
+}
+
+/* mds_warmup_check()
+ *
+ * Called by the timer thread. Replay the hot list once the rings are ready,
+ * and dump the hot list periodically after that.
+ */
+void mds_warmup_check(time_t t)
+{
+    if (!warmup_mgr.nr)
+        return;
+    if (hmo.state < HMO_STATE_RUNNING || !hmo.xc ||
+        !hmo.chring[CH_RING_MDS] || !hmo.chring[CH_RING_MDSL])
+        return;
+
+    if (!warmup_mgr.file[0]) {
+        if (hmo.conf.warmup_file)
+            snprintf(warmup_mgr.file, sizeof(warmup_mgr.file), "%s",
+                     hmo.conf.warmup_file);
+        else
+            snprintf(warmup_mgr.file, sizeof(warmup_mgr.file),
+                     "./HOT-mds.%lx", hmo.site_id);
+    }
+
+    if (!warmup_mgr.dump_ts) {
+        warmup_mgr.dump_ts = t;
+        warmup_mgr.replay = 1;
+        sem_post(&warmup_mgr.qsem);
+        return;
+    }
+    if (!warmup_mgr.replayed || hmo.conf.warmup_interval <= 0)
+        return;
+    if (t < warmup_mgr.dump_ts + hmo.conf.warmup_interval)
+        return;
+    warmup_mgr.dump_ts = t;
+    warmup_mgr.dump = 1;
+    sem_post(&warmup_mgr.qsem);
+}
+
+/* mds_warmup_ring_change()
+ *
+ * Called after the rings are updated, @oring is the MDS ring before the
+ * change. The old rings are never freed, thus it is safe to keep it.
+ */
+void mds_warmup_ring_change(struct chring *oring)
+{
+    if (!warmup_mgr.nr || oring == hmo.chring[CH_RING_MDS])
+        return;
+    xlock_lock(&warmup_mgr.qlock);
+    /* keep the oldest ring if the last rescan has not started */
+    if (!warmup_mgr.ring)
+        warmup_mgr.oring = oring;
+    warmup_mgr.ring = 1;
+    xlock_unlock(&warmup_mgr.qlock);
+    sem_post(&warmup_mgr.qsem);
+}
+
+int mds_warmup_create(void)
+{
+    pthread_attr_t attr;
+    int err = 0, stacksize, i;
+
+    memset(&warmup_mgr, 0, sizeof(warmup_mgr));
+    INIT_LIST_HEAD(&warmup_mgr.queue);
+    xlock_init(&warmup_mgr.qlock);
+    sem_init(&warmup_mgr.qsem, 0, 0);
+
+    if (!hmo.conf.warmup_threads)
+        hmo.conf.warmup_threads = 2;
+    if (!hmo.conf.warmup_max)
+        hmo.conf.warmup_max = MDS_WARMUP_MAX;
+    if (!hmo.conf.warmup_interval)
+        hmo.conf.warmup_interval = 300;
+    if (hmo.conf.warmup_threads < 0 || hmo.conf.warmup_max < 0 ||
+        hmo.conf.option & HVFS_MDS_MEMONLY) {
+        hvfs_info(mds, "MDS warm-up is disabled.\n");
+        return 0;
+    }
+
+    /* init the thread stack size */
+    err = pthread_attr_init(&attr);
+    if (err) {
+        hvfs_err(mds, "Init pthread attr failed\n");
+        goto out;
+    }
+    stacksize = (hmo.conf.stacksize > (1 << 20) ?
+                 hmo.conf.stacksize : (2 << 20));
+    err = pthread_attr_setstacksize(&attr, stacksize);
+    if (err) {
+        hvfs_err(mds, "set thread stack size to %d failed w/ %d\n",
+                 stacksize, err);
+        goto out;
+    }
+
+    warmup_mgr.threads = xzalloc(hmo.conf.warmup_threads *
+                                 sizeof(pthread_t));
+    if (!warmup_mgr.threads) {
+        hvfs_err(mds, "xzalloc() pthread_t failed\n");
+        err = -ENOMEM;
+        goto out;
+    }
+    for (i = 0; i < hmo.conf.warmup_threads; i++) {
+        err = pthread_create(&warmup_mgr.threads[i], &attr, &warmup_main,
+                             NULL);
+        if (err) {
+            hvfs_err(mds, "create warm-up thread failed w/ '%s'\n",
+                     strerror(errno));
+            err = -errno;
+            goto out;
+        }
+        warmup_mgr.nr++;
+    }
+
+out:
+    return err;
+}
+
+void mds_warmup_destroy(void)
+{
+    struct warmup_req *wr, *n;
+    int i;
+
+    warmup_mgr.stop = 1;
+    for (i = 0; i < warmup_mgr.nr; i++)
+        sem_post(&warmup_mgr.qsem);
+    for (i = 0; i < warmup_mgr.nr; i++)
+        pthread_join(warmup_mgr.threads[i], NULL);
+    warmup_mgr.nr = 0;
+    xfree(warmup_mgr.threads);
+    warmup_mgr.threads = NULL;
+
+    list_for_each_entry_safe(wr, n, &warmup_mgr.queue, list) {
+        list_del(&wr->list);
+        xfree(wr);
+    }
+    sem_destroy(&warmup_mgr.qsem);
+}
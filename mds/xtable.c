@@ -566,6 +566,7 @@ int mds_bitmap_load(struct dhe *e, u64 offset)
                         if (b->offset > bitmap->offset) {
                             /* insert previous this entry */
                             list_add_tail(&bitmap->list, &b->list);
+                            mds_dh_bitmap_index(e, bitmap);
                             processed = 1;
                             break;
                         }
@@ -583,6 +584,7 @@ int mds_bitmap_load(struct dhe *e, u64 offset)
                         if (b->offset + XTABLE_BITMAP_SIZE == b->offset) {
                             /* ok, insert ourself prior this slice */
                             list_add(&bitmap->list, &b->list);
+                            mds_dh_bitmap_index(e, bitmap);
                             /* clear the END flag */
                             b->flag &= ~BITMAP_END;
                             processed = 1;
@@ -597,10 +599,12 @@ int mds_bitmap_load(struct dhe *e, u64 offset)
                         }
                         /* ok, insert this bitmap slice to the end */
                         list_add_tail(&bitmap->list, &e->bitmap);
+                        mds_dh_bitmap_index(e, bitmap);
                     }
                 } else {
                     /* ok, this is an empty list */
                     list_add_tail(&bitmap->list, &e->bitmap);
+                    mds_dh_bitmap_index(e, bitmap);
                 }
                 xlock_unlock(&e->lock);
             } else {
@@ -629,6 +633,7 @@ int mds_bitmap_load(struct dhe *e, u64 offset)
                     if (b->offset > bitmap->offset) {
                         /* insert previous this entry */
                         list_add_tail(&bitmap->list, &b->list);
+                        mds_dh_bitmap_index(e, bitmap);
                         processed = 1;
                         break;
                     }
@@ -646,6 +651,7 @@ int mds_bitmap_load(struct dhe *e, u64 offset)
                     if (b->offset + XTABLE_BITMAP_SIZE == bitmap->offset) {
                         /* ok, insert ourself prior this slice */
                         list_add(&bitmap->list, &b->list);
+                        mds_dh_bitmap_index(e, bitmap);
                         b->flag &= ~BITMAP_END;
                         processed = 1;
                         break;
@@ -659,10 +665,12 @@ int mds_bitmap_load(struct dhe *e, u64 offset)
                     }
                     /* ok, insert this bitmap slice to the end */
                     list_add_tail(&bitmap->list, &e->bitmap);
+                    mds_dh_bitmap_index(e, bitmap);
                 }
             } else {
                 /* ok, this is an empty list */
                 list_add_tail(&bitmap->list, &e->bitmap);
+                mds_dh_bitmap_index(e, bitmap);
             }
             xlock_unlock(&e->lock);
         }
@@ -718,6 +726,7 @@ int mds_bitmap_load(struct dhe *e, u64 offset)
                 if (b->offset > bitmap->offset) {
                     /* insert previous this entry */
                     list_add_tail(&bitmap->list, &b->list);
+                    mds_dh_bitmap_index(e, bitmap);
                     processed = 1;
                     xnet_clear_auto_free(msg->pair);
                     break;
@@ -736,6 +745,7 @@ int mds_bitmap_load(struct dhe *e, u64 offset)
                 if (b->offset + XTABLE_BITMAP_SIZE == bitmap->offset) {
                     /* ok, insert ourself prior this slice */
                     list_add(&bitmap->list, &b->list);
+                    mds_dh_bitmap_index(e, bitmap);
                     /* clear the END flag */
                     b->flag &= ~BITMAP_END;
                     processed = 1;
@@ -752,6 +762,7 @@ int mds_bitmap_load(struct dhe *e, u64 offset)
                 }
                 /* ok, insert this bitmap slice to the end */
                 list_add_tail(&bitmap->list, &e->bitmap);
+                mds_dh_bitmap_index(e, bitmap);
                 xnet_clear_auto_free(msg->pair);
             }
         } else {
@@ -760,6 +771,7 @@ int mds_bitmap_load(struct dhe *e, u64 offset)
             
             /* ok, this is an empty list */
             list_add_tail(&bitmap->list, &e->bitmap);
+            mds_dh_bitmap_index(e, bitmap);
             /* FIXME: XNET clear the auto free flag */
             for (i = 0; i < 100; i++) {
                 sprintf(line + 2 * i, "%02x", bitmap->array[i]);
@@ -777,6 +789,40 @@ out_free:
     return err;
 }
 
+/* mds_bitmap_load_batch()
+ *
+ * Load the slice @offset, then prefetch up to hmo.conf.bitmap_prefetch
+ * following slices that are not cached yet. A miss on one slice is usually
+ * followed by misses on its neighbours when a directory grows, so we pay the
+ * round trips at once instead of stalling at each slice boundary.
+ *
+ * Return Value: the result of loading the slice @offset
+ */
+int mds_bitmap_load_batch(struct dhe *e, u64 offset)
+{
+    struct itbitmap *b;
+    int err, i;
+
+    err = mds_bitmap_load(e, offset);
+    if (err)
+        return err;
+
+    offset = BITMAP_ROUNDDOWN(offset);
+    for (i = 0; i < hmo.conf.bitmap_prefetch; i++) {
+        b = mds_dh_bitmap_lookup(e, offset);
+        if (!b || b->flag & BITMAP_END)
+            break;
+        offset += XTABLE_BITMAP_SIZE;
+        if (mds_dh_bitmap_lookup(e, offset))
+            continue;
+        if (mds_bitmap_load(e, offset))
+            break;
+        atomic64_inc(&hmo.prof.mds.bitmap_prefetch);
+    }
+
+    return 0;
+}
+
 /* mds_bitmap_free()
  */
 void mds_bitmap_free(struct itbitmap *b)
@@ -799,6 +845,7 @@ int __mds_bitmap_insert(struct dhe *e, struct itbitmap *b)
             if (pos->offset > b->offset) {
                 /* insert previous this entry */
                 list_add_tail(&b->list, &pos->list);
+                mds_dh_bitmap_index(e, b);
                 processed = 1;
                 err = 0;
                 break;
@@ -810,6 +857,7 @@ int __mds_bitmap_insert(struct dhe *e, struct itbitmap *b)
             }
             if (b->offset == pos->offset + XTABLE_BITMAP_SIZE) {
                 list_add(&b->list, &pos->list);
+                mds_dh_bitmap_index(e, b);
                 /* we should clear the OLD BITMAP_END flag */
                 if (pos->flag & BITMAP_END) {
                     pos->flag &= ~BITMAP_END;
@@ -829,11 +877,13 @@ int __mds_bitmap_insert(struct dhe *e, struct itbitmap *b)
             }
             /* ok, insert this bitmap slice to the end */
             list_add_tail(&b->list, &e->bitmap);
+            mds_dh_bitmap_index(e, b);
             err = 0;
         }
     } else {
         /* ok, this is an empty list */
         list_add_tail(&b->list, &e->bitmap);
+        mds_dh_bitmap_index(e, b);
         err = 0;
     }
     xlock_unlock(&e->lock);
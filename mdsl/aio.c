@@ -26,9 +26,15 @@
 #include "mdsl.h"
 #include "ring.h"
 #include "lib.h"
+#ifdef MDSL_AIO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#endif
 
 #define MDSL_AIO_SYNC_SIZE_DEFAULT      (8 * 1024 * 1024)
 #define MDSL_AIO_MAX_QDEPTH             (8)
+#define MDSL_AIO_URING_QDEPTH           (64)
 #define MDSL_AIO_EXPECT_BW              (64 * 1024 * 1024)
 #define MDSL_AIO_SYNC_SIZE_MAX          (MDSL_AIO_EXPECT_BW)
 
@@ -50,6 +56,28 @@
             dir = 1;                            \
     } while (0)
 
+#ifdef MDSL_AIO_URING
+/* A minimal io_uring w/ the raw syscalls, we only need the submission and
+ * completion rings, thus there is no dependency on liburing. The uring thread
+ * never blocks in io_uring_enter(), it sleeps on an eventfd, which is
+ * signaled by the kernel on each completion and by the submitters.
+ */
+struct aio_uring
+{
+    int fd;
+    int efd;                    /* eventfd registered w/ the ring */
+    u32 depth;                  /* # of SQ entries */
+    u32 inflight;               /* only touched by the uring thread */
+    u32 unsubmitted;            /* SQEs filled but not accepted yet */
+    u32 *sq_head, *sq_tail, *sq_mask, *sq_array;
+    u32 *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_sz, cq_ring_sz;
+};
+#endif
+
 struct aio_mgr
 {
     struct list_head queue;
@@ -66,6 +94,13 @@ struct aio_mgr
     u16 bw_direction;           /* 0 means larger, 1 means smaller */
     u16 bw_adjust_rounds;       /* if bw_direction is 1, adjust_rounds can be
                                  * at most 15 */
+#define MDSL_AIO_ENGINE_THREAD  0
+#define MDSL_AIO_ENGINE_URING   1
+    int engine;
+    int nr_threads;             /* # of threads we actually started */
+#ifdef MDSL_AIO_URING
+    struct aio_uring uring;
+#endif
 };
 
 struct aio_thread_arg
@@ -82,6 +117,8 @@ struct aio_request
     loff_t foff;
     int type;
     int fd;
+#define AIO_REQ_DUPFD           0x01 /* fd is dup()ed by us, close it */
+    int flags;
 };
 
 static struct aio_mgr aio_mgr;
@@ -271,6 +308,21 @@ int mdsl_aio_submit_request(void *addr, u64 len, u64 mlen, loff_t foff,
     ar->type = type;
     ar->fd = fd;
 
+    /* The blocking threads only touch the mapping for the SYNC requests,
+     * while the uring requests act on the fd, which might be closed by the
+     * fd cleanup before the request is submitted. Hold our own reference,
+     * except the TRUNC request, which owns and closes the fd. */
+    if (aio_mgr.engine == MDSL_AIO_ENGINE_URING &&
+        type != MDSL_AIO_SYNC_UNMAP_TRUNC) {
+        ar->fd = dup(fd);
+        if (ar->fd < 0) {
+            hvfs_err(mdsl, "dup() fd %d for AIO failed w/ %d\n", fd, errno);
+            xfree(ar);
+            return -EBADF;
+        }
+        ar->flags |= AIO_REQ_DUPFD;
+    }
+
     INIT_LIST_HEAD(&ar->list);
     xlock_lock(&aio_mgr.qlock);
     list_add_tail(&ar->list, &aio_mgr.queue);
@@ -281,10 +333,22 @@ int mdsl_aio_submit_request(void *addr, u64 len, u64 mlen, loff_t foff,
     return 0;
 }
 
+static inline
+void __aio_kick(void)
+{
+#ifdef MDSL_AIO_URING
+    if (aio_mgr.engine == MDSL_AIO_ENGINE_URING) {
+        eventfd_write(aio_mgr.uring.efd, 1);
+        return;
+    }
+#endif
+    sem_post(&aio_mgr.qsem);
+}
+
 void mdsl_aio_start(void)
 {
     __mdsl_aio_qdcheck(MDSL_AIO_QDCHECK_LOCK);
-    sem_post(&aio_mgr.qsem);
+    __aio_kick();
 }
 
 int mdsl_aio_queue_empty(void)
@@ -292,6 +356,125 @@ int mdsl_aio_queue_empty(void)
     return list_empty(&aio_mgr.queue);
 }
 
+static inline
+void __aio_request_free(struct aio_request *ar)
+{
+    if (ar->flags & AIO_REQ_DUPFD)
+        close(ar->fd);
+    xfree(ar);
+}
+
+/* The completion halves of the requests. They are shared by the blocking
+ * threads and the uring engine, and release the request.
+ */
+static
+int __done_sync_unmap_request(struct aio_request *ar)
+{
+    int err = 0;
+
+    atomic64_add(ar->len, &hmo.prof.storage.wbytes);
+    posix_madvise(ar->addr, ar->mlen, POSIX_MADV_DONTNEED);
+
+#ifdef MDSL_ACC_SYNC
+    err = ar->foff - aio_sync_length() - ar->mlen;
+    if (err < 0)
+        err = 0;
+#ifdef MDSL_DROP_CACHE
+    posix_fadvise(ar->fd, err, 
+                  (ar->mlen << 1) + aio_sync_length(), POSIX_FADV_DONTNEED);
+#endif
+
+#else  /* MDSL_ACC_SYNC */
+
+#ifdef MDSL_DROP_CACHE
+    posix_fadvise(ar->fd, ar->foff, ar->mlen, POSIX_FADV_DONTNEED);
+#endif
+
+#endif  /* MDSL_ACC_SYNC */
+    err = munmap(ar->addr, ar->mlen);
+    if (err) {
+        hvfs_err(mdsl, "AIO UNMAP region [%p,%ld] failed w/ %d\n",
+                 ar->addr, ar->mlen, errno);
+        err = -errno;
+    }
+    hvfs_debug(mdsl, "ASYNC FLUSH foff %lx addr %p, done.\n", 
+               ar->foff, ar->addr);
+    __aio_request_free(ar);
+
+    return err;
+}
+
+static
+int __done_sync_unmap_xsync_request(struct aio_request *ar)
+{
+    int err = 0;
+
+    atomic64_add(ar->len, &hmo.prof.storage.wbytes);
+    /* madvise and fadvise have no use with calling MS_ASYNC */
+#if 0
+    posix_madvise(ar->addr, ar->mlen, POSIX_MADV_DONTNEED);
+    posix_fadvise(ar->fd, ar->foff, ar->mlen, POSIX_FADV_DONTNEED);
+#endif
+    err = munmap(ar->addr, ar->mlen);
+    if (err) {
+        hvfs_err(mdsl, "AIO UNMAP region [%p,%ld] failed w/ %d\n",
+                 ar->addr, ar->mlen, errno);
+        err = -errno;
+    }
+    hvfs_debug(mdsl, "ASYNC FLUSH foff %lx addr %p, done.\n", 
+               ar->foff, ar->addr);
+    __aio_request_free(ar);
+
+    return err;
+}
+
+static
+int __done_sync_unmap_trunc_request(struct aio_request *ar)
+{
+    int err = 0;
+
+    atomic64_add(ar->len, &hmo.prof.storage.wbytes);
+    posix_madvise(ar->addr, ar->mlen, POSIX_MADV_DONTNEED);
+    posix_fadvise(ar->fd, ar->foff, ar->mlen, POSIX_FADV_DONTNEED);
+    err = munmap(ar->addr, ar->mlen);
+    if (err) {
+        hvfs_err(mdsl, "AIO UNMAP region [%p,%ld] failed w/ %d\n",
+                 ar->addr, ar->mlen, errno);
+        err = -errno;
+    }
+    err = ftruncate(ar->fd, PAGE_ROUNDUP(ar->foff + ar->len,
+                                         getpagesize()));
+    if (err) {
+        hvfs_err(mdsl, "AIO TRUNC region [%p,%ld] failed w/ %d\n",
+                 ar->addr, ar->len, errno);
+        err = -errno;
+    }
+    /* FIXME: close the file? */
+    close(ar->fd);
+    atomic64_add(-ar->mlen, &hmo.storage.memcache);
+    hvfs_debug(mdsl, "ASYNC FLUSH foff %lx addr %p, done.\n",
+               ar->foff, ar->addr);
+    __aio_request_free(ar);
+
+    return err;
+}
+
+static
+int __done_odirect_request(struct aio_request *ar, int bw)
+{
+    if (bw >= 0) {
+        if (bw < ar->len) {
+            hvfs_err(mdsl, "Should we support O_DIRECT redo?\n");
+        }
+        atomic64_add(ar->len, &hmo.prof.storage.wbytes);
+    }
+    /* we should release the buffer now */
+    xfree(ar->addr);
+    __aio_request_free(ar);
+
+    return 0;
+}
+
 int __serv_sync_request(struct aio_request *ar)
 {
     int err = 0;
@@ -302,7 +485,7 @@ int __serv_sync_request(struct aio_request *ar)
                  ar->addr, ar->len, errno);
         err = -errno;
     }
-    xfree(ar);
+    __aio_request_free(ar);
 
     return err;
 }
@@ -345,36 +528,7 @@ int __serv_sync_unmap_request(struct aio_request *ar)
         err = -errno;
     }
 #endif
-    atomic64_add(ar->len, &hmo.prof.storage.wbytes);
-    posix_madvise(ar->addr, ar->mlen, POSIX_MADV_DONTNEED);
-
-#ifdef MDSL_ACC_SYNC
-    err = ar->foff - aio_sync_length() - ar->mlen;
-    if (err < 0)
-        err = 0;
-#ifdef MDSL_DROP_CACHE
-    posix_fadvise(ar->fd, err, 
-                  (ar->mlen << 1) + aio_sync_length(), POSIX_FADV_DONTNEED);
-#endif
-
-#else  /* MDSL_ACC_SYNC */
-
-#ifdef MDSL_DROP_CACHE
-    posix_fadvise(ar->fd, ar->foff, ar->mlen, POSIX_FADV_DONTNEED);
-#endif
-
-#endif  /* MDSL_ACC_SYNC */
-    err = munmap(ar->addr, ar->mlen);
-    if (err) {
-        hvfs_err(mdsl, "AIO UNMAP region [%p,%ld] failed w/ %d\n",
-                 ar->addr, ar->mlen, errno);
-        err = -errno;
-    }
-    hvfs_debug(mdsl, "ASYNC FLUSH foff %lx addr %p, done.\n", 
-               ar->foff, ar->addr);
-    xfree(ar);
-
-    return err;
+    return __done_sync_unmap_request(ar);
 }
 
 int __serv_sync_unmap_xsync_request(struct aio_request *ar)
@@ -397,23 +551,7 @@ int __serv_sync_unmap_xsync_request(struct aio_request *ar)
         err = -errno;
     }
 #endif
-    atomic64_add(ar->len, &hmo.prof.storage.wbytes);
-    /* madvise and fadvise have no use with calling MS_ASYNC */
-#if 0
-    posix_madvise(ar->addr, ar->mlen, POSIX_MADV_DONTNEED);
-    posix_fadvise(ar->fd, ar->foff, ar->mlen, POSIX_FADV_DONTNEED);
-#endif
-    err = munmap(ar->addr, ar->mlen);
-    if (err) {
-        hvfs_err(mdsl, "AIO UNMAP region [%p,%ld] failed w/ %d\n",
-                 ar->addr, ar->mlen, errno);
-        err = -errno;
-    }
-    hvfs_debug(mdsl, "ASYNC FLUSH foff %lx addr %p, done.\n", 
-               ar->foff, ar->addr);
-    xfree(ar);
-
-    return err;
+    return __done_sync_unmap_xsync_request(ar);
 }
 
 int __serv_sync_unmap_trunc_request(struct aio_request *ar)
@@ -426,30 +564,7 @@ int __serv_sync_unmap_trunc_request(struct aio_request *ar)
                  ar->addr, ar->len, errno);
         err = -errno;
     }
-    atomic64_add(ar->len, &hmo.prof.storage.wbytes);
-    posix_madvise(ar->addr, ar->mlen, POSIX_MADV_DONTNEED);
-    posix_fadvise(ar->fd, ar->foff, ar->mlen, POSIX_FADV_DONTNEED);
-    err = munmap(ar->addr, ar->mlen);
-    if (err) {
-        hvfs_err(mdsl, "AIO UNMAP region [%p,%ld] failed w/ %d\n",
-                 ar->addr, ar->mlen, errno);
-        err = -errno;
-    }
-    err = ftruncate(ar->fd, PAGE_ROUNDUP(ar->foff + ar->len,
-                                         getpagesize()));
-    if (err) {
-        hvfs_err(mdsl, "AIO TRUNC region [%p,%ld] failed w/ %d\n",
-                 ar->addr, ar->len, errno);
-        err = -errno;
-    }
-    /* FIXME: close the file? */
-    close(ar->fd);
-    atomic64_add(-ar->mlen, &hmo.storage.memcache);
-    hvfs_debug(mdsl, "ASYNC FLUSH foff %lx addr %p, done.\n",
-               ar->foff, ar->addr);
-    xfree(ar);
-
-    return err;
+    return __done_sync_unmap_trunc_request(ar);
 }
 
 int __serv_odirect_request(struct aio_request *ar)
@@ -466,21 +581,26 @@ int __serv_odirect_request(struct aio_request *ar)
         err = -errno;
         goto out;
     }
-    if (bw < len) {
-        hvfs_err(mdsl, "Should we support O_DIRECT redo?\n");
-    }
-
-    atomic64_add(len, &hmo.prof.storage.wbytes);
-    /* we should release the buffer now */
-    xfree(ar->addr);
-    xfree(ar);
+    err = __done_odirect_request(ar, bw);
 out:            
     return err;
 }
 
+/* The READ request fills the submitter owned buffer @addr, it is mostly
+ * used to warm up the page cache.
+ */
 int __serv_read_request(struct aio_request *ar)
 {
-    int err = 0;
+    int err = 0, br;
+
+    br = pread(ar->fd, ar->addr, ar->len, ar->foff);
+    if (br < 0) {
+        hvfs_err(mdsl, "pread fd %d failed w/ %d[len %ld, foff %lx]\n",
+                 ar->fd, errno, ar->len, ar->foff);
+        err = -errno;
+    } else
+        atomic64_add(br, &hmo.prof.storage.rbytes);
+    __aio_request_free(ar);
 
     return err;
 }
@@ -583,6 +703,346 @@ void *aio_main(void *arg)
     pthread_exit(0);
 }
 
+#ifdef MDSL_AIO_URING
+/* The uring engine
+ *
+ * ONE thread moves the requests from the queue to the SQ ring in batches, at
+ * most hmo.conf.aio_qdepth requests are in flight. The SYNC requests are
+ * translated to the ranged fdatasync (the same as msync(MS_SYNC) on the
+ * shared file mapping) and XSYNC to the non-waiting sync_file_range, while
+ * the munmap() and friends are done on completion.
+ */
+static inline
+int __uring_setup_syscall(u32 entries, struct io_uring_params *p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline
+int __uring_enter(int fd, u32 to_submit, u32 min_complete, u32 flags)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                   flags, NULL, 0);
+}
+
+/* check that the kernel knows all the opcodes we are going to use */
+static
+int __uring_probe(struct aio_uring *u)
+{
+    u8 ops[] = {IORING_OP_WRITE, IORING_OP_READ, IORING_OP_FSYNC,
+                IORING_OP_SYNC_FILE_RANGE,};
+    struct io_uring_probe *probe;
+    int nr = 256, err, i;
+
+    probe = xzalloc(sizeof(*probe) + nr * sizeof(struct io_uring_probe_op));
+    if (!probe) {
+        hvfs_err(mdsl, "xzalloc() io_uring probe failed\n");
+        return -ENOMEM;
+    }
+    err = syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_PROBE,
+                  probe, nr);
+    if (err < 0) {
+        err = -errno;
+        goto out;
+    }
+    for (i = 0; i < sizeof(ops); i++) {
+        if (ops[i] > probe->last_op ||
+            !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+            hvfs_warning(mdsl, "io_uring opcode %d is not supported\n",
+                         ops[i]);
+            err = -ENOSYS;
+            goto out;
+        }
+    }
+out:
+    xfree(probe);
+    return err;
+}
+
+static
+void __uring_destroy(struct aio_uring *u)
+{
+    if (u->sqes)
+        munmap(u->sqes, u->depth * sizeof(struct io_uring_sqe));
+    if (u->cq_ring && u->cq_ring != u->sq_ring)
+        munmap(u->cq_ring, u->cq_ring_sz);
+    if (u->sq_ring)
+        munmap(u->sq_ring, u->sq_ring_sz);
+    if (u->fd > 0)
+        close(u->fd);
+    if (u->efd > 0)
+        close(u->efd);
+    memset(u, 0, sizeof(*u));
+}
+
+static
+int __uring_init(struct aio_uring *u, u32 depth)
+{
+    struct io_uring_params p;
+    int err = 0;
+
+    memset(u, 0, sizeof(*u));
+    memset(&p, 0, sizeof(p));
+    u->fd = __uring_setup_syscall(depth, &p);
+    if (u->fd < 0) {
+        err = -errno;
+        u->fd = 0;
+        return err;
+    }
+    u->depth = p.sq_entries;
+
+    u->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(u32);
+    u->cq_ring_sz = p.cq_off.cqes + p.cq_entries * 
+        sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        u->sq_ring_sz = max(u->sq_ring_sz, u->cq_ring_sz);
+        u->cq_ring_sz = u->sq_ring_sz;
+    }
+    u->sq_ring = mmap(NULL, u->sq_ring_sz, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (u->sq_ring == MAP_FAILED) {
+        err = -errno;
+        u->sq_ring = NULL;
+        goto out_destroy;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        u->cq_ring = u->sq_ring;
+    } else {
+        u->cq_ring = mmap(NULL, u->cq_ring_sz, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, u->fd, 
+                          IORING_OFF_CQ_RING);
+        if (u->cq_ring == MAP_FAILED) {
+            err = -errno;
+            u->cq_ring = NULL;
+            goto out_destroy;
+        }
+    }
+    u->sqes = mmap(NULL, u->depth * sizeof(struct io_uring_sqe),
+                   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) {
+        err = -errno;
+        u->sqes = NULL;
+        goto out_destroy;
+    }
+
+    u->sq_head = u->sq_ring + p.sq_off.head;
+    u->sq_tail = u->sq_ring + p.sq_off.tail;
+    u->sq_mask = u->sq_ring + p.sq_off.ring_mask;
+    u->sq_array = u->sq_ring + p.sq_off.array;
+    u->cq_head = u->cq_ring + p.cq_off.head;
+    u->cq_tail = u->cq_ring + p.cq_off.tail;
+    u->cq_mask = u->cq_ring + p.cq_off.ring_mask;
+    u->cqes = u->cq_ring + p.cq_off.cqes;
+
+    err = __uring_probe(u);
+    if (err)
+        goto out_destroy;
+
+    /* the completions are signaled to the eventfd */
+    u->efd = eventfd(0, EFD_CLOEXEC);
+    if (u->efd < 0) {
+        err = -errno;
+        u->efd = 0;
+        goto out_destroy;
+    }
+    err = syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_EVENTFD,
+                  &u->efd, 1);
+    if (err < 0) {
+        err = -errno;
+        goto out_destroy;
+    }
+
+    return 0;
+out_destroy:
+    __uring_destroy(u);
+    return err;
+}
+
+static
+void __uring_prep(struct io_uring_sqe *sqe, struct aio_request *ar)
+{
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = ar->fd;
+    sqe->off = ar->foff;
+    sqe->user_data = (u64)(unsigned long)ar;
+
+    switch (ar->type) {
+    case MDSL_AIO_ODIRECT:
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->addr = (u64)(unsigned long)ar->addr;
+        sqe->len = DISK_SEC_ROUND_UP(ar->len);
+        break;
+    case MDSL_AIO_READ:
+        sqe->opcode = IORING_OP_READ;
+        sqe->addr = (u64)(unsigned long)ar->addr;
+        sqe->len = ar->len;
+        break;
+    case MDSL_AIO_SYNC_UNMAP_XSYNC:
+        sqe->opcode = IORING_OP_SYNC_FILE_RANGE;
+        sqe->len = ar->len;
+        sqe->sync_range_flags = SYNC_FILE_RANGE_WRITE;
+        break;
+    case MDSL_AIO_SYNC:
+    case MDSL_AIO_SYNC_UNMAP:
+    case MDSL_AIO_SYNC_UNMAP_TRUNC:
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->len = ar->len;
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        break;
+    default:
+        hvfs_err(mdsl, "Invalid aio_request type %x\n", ar->type);
+        sqe->opcode = IORING_OP_NOP;
+    }
+}
+
+/* __uring_fill()
+ *
+ * Move the queued requests to the SQ ring, return the # of new SQEs.
+ */
+static
+int __uring_fill(struct aio_uring *u)
+{
+    struct aio_request *pos, *n;
+    u32 tail = *u->sq_tail, idx;
+    int nr = 0;
+
+    xlock_lock(&aio_mgr.qlock);
+    list_for_each_entry_safe(pos, n, &aio_mgr.queue, list) {
+        if (u->inflight + nr >= u->depth ||
+            u->inflight + nr >= hmo.conf.aio_qdepth)
+            break;
+        list_del_init(&pos->list);
+        idx = tail & *u->sq_mask;
+        __uring_prep(u->sqes + idx, pos);
+        u->sq_array[idx] = idx;
+        tail++;
+        nr++;
+    }
+    xlock_unlock(&aio_mgr.qlock);
+
+    if (nr) {
+        __atomic_store_n(u->sq_tail, tail, __ATOMIC_RELEASE);
+        u->inflight += nr;
+        u->unsubmitted += nr;
+        atomic64_add(nr, &hmo.prof.storage.aio_handled);
+    }
+
+    return nr;
+}
+
+/* __uring_submit()
+ *
+ * Pass the filled SQEs to the kernel w/o waiting for any completion.
+ */
+static
+void __uring_submit(struct aio_uring *u)
+{
+    int err;
+
+    if (!u->unsubmitted)
+        return;
+    err = __uring_enter(u->fd, u->unsubmitted, 0, 0);
+    if (err < 0) {
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            hvfs_err(mdsl, "io_uring_enter() failed w/ %d\n", errno);
+        return;
+    }
+    u->unsubmitted -= err;
+}
+
+static
+void __uring_complete(struct aio_request *ar, int res)
+{
+    int err = 0;
+
+    if (res < 0) {
+        hvfs_err(mdsl, "AIO uring request type %x fd %d [%lx,%ld] "
+                 "failed w/ %d\n", ar->type, ar->fd, ar->foff, ar->len, res);
+    }
+
+    switch (ar->type) {
+    case MDSL_AIO_SYNC:
+        __aio_request_free(ar);
+        break;
+    case MDSL_AIO_SYNC_UNMAP:
+        err = __done_sync_unmap_request(ar);
+        break;
+    case MDSL_AIO_SYNC_UNMAP_TRUNC:
+        err = __done_sync_unmap_trunc_request(ar);
+        break;
+    case MDSL_AIO_SYNC_UNMAP_XSYNC:
+        err = __done_sync_unmap_xsync_request(ar);
+        break;
+    case MDSL_AIO_ODIRECT:
+        /* the buffer is useless even if the write failed */
+        err = __done_odirect_request(ar, res);
+        break;
+    case MDSL_AIO_READ:
+        if (res > 0)
+            atomic64_add(res, &hmo.prof.storage.rbytes);
+        __aio_request_free(ar);
+        break;
+    default:
+        __aio_request_free(ar);
+    }
+    if (err) {
+        hvfs_err(mdsl, "Complete AIO uring request failed w/ %d\n", err);
+    }
+}
+
+static
+int __uring_reap(struct aio_uring *u)
+{
+    struct io_uring_cqe *cqe;
+    u32 head = *u->cq_head, tail;
+    int nr = 0;
+
+    tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        cqe = u->cqes + (head & *u->cq_mask);
+        __uring_complete((struct aio_request *)(unsigned long)cqe->user_data,
+                         cqe->res);
+        head++;
+        nr++;
+        u->inflight--;
+        __mdsl_aio_qdcheck(MDSL_AIO_QDCHECK_UNLOCK);
+    }
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+
+    return nr;
+}
+
+static
+void *aio_uring_main(void *arg)
+{
+    struct aio_uring *u = &aio_mgr.uring;
+    eventfd_t v;
+    sigset_t set;
+
+    /* first, let us block the SIGALRM and SIGCHLD */
+    sigemptyset(&set);
+    sigaddset(&set, SIGALRM);
+    sigaddset(&set, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &set, NULL); /* oh, we do not care about the
+                                             * errs */
+    while (!hmo.aio_thread_stop || u->inflight || 
+           !mdsl_aio_queue_empty()) {
+        __uring_fill(u);
+        __uring_submit(u);
+        if (__uring_reap(u))
+            continue;
+        /* nothing completed, sleep until a completion or a new request is
+         * signaled. The eventfd counter keeps the signals raised since our
+         * last read, thus no wakeup is lost. */
+        if (eventfd_read(u->efd, &v) < 0 && errno != EINTR &&
+            errno != EAGAIN) {
+            hvfs_err(mdsl, "read uring eventfd failed w/ %d\n", errno);
+        }
+    }
+    pthread_exit(0);
+}
+#endif
 
 int mdsl_aio_create(void)
 {
@@ -610,9 +1070,30 @@ int mdsl_aio_create(void)
     xlock_init(&aio_mgr.qlock);
     xlock_init(&aio_mgr.bwlock);
     sem_init(&aio_mgr.qsem, 0, 0);
-    sem_init(&aio_mgr.qdsem, 0, MDSL_AIO_MAX_QDEPTH);
     aio_mgr.pending_writes = 0;
     aio_mgr.bw_stride = MDSL_AIO_BW_STRIDE;
+    aio_mgr.engine = MDSL_AIO_ENGINE_THREAD;
+
+#ifdef MDSL_AIO_URING
+    if (!(hmo.conf.option & HVFS_MDSL_AIO_NOURING)) {
+        if (!hmo.conf.aio_qdepth)
+            hmo.conf.aio_qdepth = MDSL_AIO_URING_QDEPTH;
+        err = __uring_init(&aio_mgr.uring, hmo.conf.aio_qdepth);
+        if (err) {
+            hvfs_warning(mdsl, "io_uring setup failed w/ %d, fallback to "
+                         "the AIO threads\n", err);
+            hmo.conf.aio_qdepth = 0;
+            err = 0;
+        } else {
+            aio_mgr.engine = MDSL_AIO_ENGINE_URING;
+            hvfs_info(mdsl, "AIO uring engine w/ queue depth %d\n",
+                      hmo.conf.aio_qdepth);
+        }
+    }
+#endif
+    if (!hmo.conf.aio_qdepth)
+        hmo.conf.aio_qdepth = MDSL_AIO_MAX_QDEPTH;
+    sem_init(&aio_mgr.qdsem, 0, hmo.conf.aio_qdepth);
 
     if (!hmo.conf.aio_sync_len) {
         hmo.conf.aio_sync_len = MDSL_AIO_SYNC_SIZE_DEFAULT;
@@ -639,21 +1120,33 @@ int mdsl_aio_create(void)
     /* init aio threads' pool */
     if (!hmo.conf.aio_threads)
         hmo.conf.aio_threads = 4;
+    /* the uring engine needs only ONE thread */
+    if (aio_mgr.engine == MDSL_AIO_ENGINE_URING)
+        aio_mgr.nr_threads = 1;
+    else
+        aio_mgr.nr_threads = hmo.conf.aio_threads;
 
-    hmo.aio_thread = xzalloc(hmo.conf.aio_threads * sizeof(pthread_t));
+    hmo.aio_thread = xzalloc(aio_mgr.nr_threads * sizeof(pthread_t));
     if (!hmo.aio_thread) {
         hvfs_err(mdsl, "xzalloc() pthread_t failed\n");
         return -ENOMEM;
     }
 
-    ata = xzalloc(hmo.conf.aio_threads * sizeof(struct aio_thread_arg));
+#ifdef MDSL_AIO_URING
+    if (aio_mgr.engine == MDSL_AIO_ENGINE_URING) {
+        err = pthread_create(hmo.aio_thread, &attr, &aio_uring_main, NULL);
+        goto out;
+    }
+#endif
+
+    ata = xzalloc(aio_mgr.nr_threads * sizeof(struct aio_thread_arg));
     if (!ata) {
         hvfs_err(mdsl, "xzalloc() struct aio_thread_arg failed\n");
         err = -ENOMEM;
         goto out_free;
     }
 
-    for (i = 0; i < hmo.conf.aio_threads; i++) {
+    for (i = 0; i < aio_mgr.nr_threads; i++) {
         (ata + i)->tid = i;
         err = pthread_create(hmo.aio_thread + i, &attr, &aio_main,
                              ata + i);
@@ -673,11 +1166,15 @@ void mdsl_aio_destroy(void)
     int i;
 
     hmo.aio_thread_stop = 1;
-    for (i = 0; i < hmo.conf.aio_threads; i++) {
-        sem_post(&aio_mgr.qsem);
+    for (i = 0; i < aio_mgr.nr_threads; i++) {
+        __aio_kick();
     }
-    for (i = 0; i < hmo.conf.aio_threads; i++) {
+    for (i = 0; i < aio_mgr.nr_threads; i++) {
         pthread_join(*(hmo.aio_thread + i), NULL);
     }
+#ifdef MDSL_AIO_URING
+    if (aio_mgr.engine == MDSL_AIO_ENGINE_URING)
+        __uring_destroy(&aio_mgr.uring);
+#endif
     sem_destroy(&aio_mgr.qsem);
 }
@@ -68,14 +68,54 @@ void __mdsl_send_rpy(struct xnet_msg *msg, struct iovec iov[], int nr,
     xnet_free_msg(rpy);
 }
 
+/* __mdsl_send_rpy_sfile() send the data reply from the file ranges w/o
+ * copying them to user space
+ */
+static inline
+void __mdsl_send_rpy_sfile(struct xnet_msg *msg, struct xnet_frange fr[],
+                           int nr)
+{
+    struct xnet_msg *rpy;
+    int err, i;
+
+    rpy = xnet_alloc_msg(XNET_MSG_NORMAL);
+    if (unlikely(!rpy)) {
+        hvfs_err(mdsl, "xnet_alloc_msg() failed\n");
+        /* do not retry myself */
+        return;
+    }
+
+#ifdef XNET_EAGER_WRITEV
+    xnet_msg_add_sdata(rpy, &rpy->tx, sizeof(rpy->tx));
+#endif
+    xnet_msg_fill_tx(rpy, XNET_MSG_RPY, 0, hmo.site_id, msg->tx.ssite_id);
+    xnet_msg_fill_reqno(rpy, msg->tx.reqno);
+    xnet_msg_fill_cmd(rpy, XNET_RPY_DATA, 0, 0);
+    /* match the original request at the source site */
+    rpy->tx.handle = msg->tx.handle;
+
+    for (i = 0; i < nr; i++) {
+        xnet_msg_add_sfile(rpy, fr[i].fd, fr[i].offset, fr[i].len);
+    }
+
+    err = xnet_send(hmo.xc, rpy);
+    if (err) {
+        hvfs_err(mdsl, "xnet_send() to %lx failed w/ %d.\n", 
+                 rpy->tx.dsite_id, err);
+    }
+    xnet_free_msg(rpy);
+}
+
 void mdsl_read(struct xnet_msg *msg)
 {
-    struct fdhash_entry *fde;
+    struct fdhash_entry **fde;
     struct mdsl_storage_access msa;
     struct storage_index *si;
+    struct xnet_frange *fr;
     struct iovec *iov;
     struct proxy_args *pa = NULL;
-    int err = 0, i;
+    u64 total = 0;
+    int err = 0, i, zcopy;
     
     /* ABI:
      * @xm_data: storage_index {
@@ -110,13 +150,20 @@ void mdsl_read(struct xnet_msg *msg)
 
     /* We should iterate on the client's column_req vector and read each entry
      * to the result buffer */
-    iov = xzalloc(sizeof(struct iovec) * si->scd.cnr);
+    iov = xzalloc((sizeof(struct iovec) + sizeof(struct xnet_frange) +
+                   sizeof(struct fdhash_entry *)) * si->scd.cnr);
     if (!iov) {
         hvfs_err(mdsl, "xzalloc() iovec failed.\n");
         err = -ENOMEM;
         goto send_rpy;
     }
+    fr = (void *)iov + sizeof(struct iovec) * si->scd.cnr;
+    fde = (void *)fr + sizeof(struct xnet_frange) * si->scd.cnr;
 
+    /* lookup all the data files first. If all the columns can be read from
+     * the page cache, we send them w/ sendfile() instead of copying them to
+     * the user space. */
+    zcopy = !(si->scd.flag & SCD_PROXY);
     for (i = 0; i < si->scd.cnr; i++) {
         /* prepare to get the data file */
         if (unlikely(si->scd.flag & SCD_PROXY)) {
@@ -128,40 +175,69 @@ void mdsl_read(struct xnet_msg *msg)
             }
             pa->uuid = si->sic.arg0;
             pa->cno = si->scd.cr[i].cno;
-            fde = mdsl_storage_fd_lookup_create(si->sic.uuid,
-                                                MDSL_STORAGE_NORMAL,
-                                                (u64)pa);
+            fde[i] = mdsl_storage_fd_lookup_create(si->sic.uuid,
+                                                   MDSL_STORAGE_NORMAL,
+                                                   (u64)pa);
             /* read from the beginning */
-            msa.offset = 0;
+            fr[i].offset = 0;
         } else {
-            fde = mdsl_storage_fd_lookup_create(si->sic.uuid, 
-                                                MDSL_STORAGE_DATA,
-                                                si->scd.cr[i].cno);
-            msa.offset = si->scd.cr[i].file_offset + si->scd.cr[i].req_offset;
+            fde[i] = mdsl_storage_fd_lookup_create(si->sic.uuid, 
+                                                   MDSL_STORAGE_DATA,
+                                                   si->scd.cr[i].cno);
+            fr[i].offset = si->scd.cr[i].file_offset + 
+                si->scd.cr[i].req_offset;
         }
 
-        if (unlikely(IS_ERR(fde))) {
+        if (unlikely(IS_ERR(fde[i]))) {
             hvfs_err(mdsl, "lookup create %lx data column %ld failed w/ %ld\n",
-                     si->sic.uuid, si->scd.cr[i].cno, PTR_ERR(fde));
-            err = PTR_ERR(fde);
+                     si->sic.uuid, si->scd.cr[i].cno, PTR_ERR(fde[i]));
+            err = PTR_ERR(fde[i]);
+            fde[i] = NULL;
             goto cleanup_send_rpy;
         }
+        fr[i].len = si->scd.cr[i].req_len;
+        total += fr[i].len;
 
+        if (zcopy && mdsl_storage_fd_sendfile(fde[i], fr[i].offset, 
+                                              fr[i].len))
+            zcopy = 0;
+        fr[i].fd = fde[i]->fd;
+    }
+    if (total < MDSL_STORAGE_SENDFILE_MIN)
+        zcopy = 0;
+
+    if (zcopy) {
+        /* the fdes are held until the reply is sent */
+        __mdsl_send_rpy_sfile(msg, fr, si->scd.cnr);
+        for (i = 0; i < si->scd.cnr; i++) {
+            mdsl_storage_fd_put(fde[i]);
+        }
+        atomic64_add(total, &hmi.mi_bread);
+        atomic64_add(total, &hmo.prof.storage.rbytes);
+        atomic64_inc(&hmo.prof.storage.rreq);
+
+        xnet_free_msg(msg);
+        xfree(iov);
+
+        return;
+    }
+
+    for (i = 0; i < si->scd.cnr; i++) {
         /* prepare the data region */
         iov[i].iov_base = xmalloc(si->scd.cr[i].req_len);
         if (!iov[i].iov_base) {
             hvfs_err(mdsl, "xmalloc data column %ld storage failed.\n",
                      si->scd.cr[i].cno);
             err = -ENOMEM;
-            mdsl_storage_fd_put(fde);
             goto cleanup_send_rpy;
         }
         iov[i].iov_len = si->scd.cr[i].req_len;
 
         /* read the data now */
+        msa.offset = fr[i].offset;
         msa.iov = &iov[i];
         msa.iov_nr = 1;
-        err = mdsl_storage_fd_read(fde, &msa);
+        err = mdsl_storage_fd_read(fde[i], &msa);
         if (err) {
             hvfs_err(mdsl, "read the dir %lx data column %ld "
                      "foffset %ld offset %ld len %ld failed w/ %d\n",
@@ -169,11 +245,11 @@ void mdsl_read(struct xnet_msg *msg)
                      si->scd.cr[i].file_offset,
                      si->scd.cr[i].req_offset,
                      si->scd.cr[i].req_len, err);
-            mdsl_storage_fd_put(fde);
             goto cleanup_send_rpy;
         }
         /* put the fde */
-        mdsl_storage_fd_put(fde);
+        mdsl_storage_fd_put(fde[i]);
+        fde[i] = NULL;
         /* accumulate to hmi */
         atomic64_add(si->scd.cr[i].req_len, &hmi.mi_bread);
     }
@@ -187,10 +263,12 @@ void mdsl_read(struct xnet_msg *msg)
 
     return;
 cleanup_send_rpy:
-    /* free the iov now */
+    /* free the iov and put the fdes now */
     for (i = 0; i < si->scd.cnr; i++) {
         if (iov[i].iov_base)
             xfree(iov[i].iov_base);
+        if (fde[i])
+            mdsl_storage_fd_put(fde[i]);
     }
     xfree(iov);
 send_rpy:
@@ -36,6 +36,10 @@ int mdsl_mds_dispatch(struct xnet_msg *msg)
         mdsl_itb(msg);
         atomic_dec(&itb_loads);
         break;
+    case HVFS_MDS2MDSL_ITB_BATCH:
+        mdsl_itb_batch(msg);
+        atomic_dec(&itb_loads);
+        break;
     case HVFS_MDS2MDSL_BITMAP:
         mdsl_bitmap(msg);
         break;
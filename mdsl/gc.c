@@ -196,6 +196,7 @@ int mdsl_gc_tx_itb(u64 duuid, int gen, struct fdhash_entry *omd)
     }
     /* final step, atomic change to the new itb file and do cleanups */
     omd->mdisk.itb_master++;
+    mdsl_itbc_invalidate(duuid);
     /* FIXME: cleanup range files(Brange-* and old itb file) */
     err = __mdisk_write(omd, NULL);
     if (err) {
@@ -582,6 +583,12 @@ int mdsl_gc_md(u64 duuid)
     struct fdhash_entry *fde, *itbf;
     u64 last_offset, gc_offset;
     int err = 0, round = 0, master;
+
+    /* the GC rebuilds the range files from the itb file, which drops the
+     * ITBs in the segments. The segments are cleaned by
+     * mdsl_segment_clean(). */
+    if (hmo.conf.option & HVFS_MDSL_SEGMENT)
+        return 0;
     
     /* Step 0: prepare: open the md file */
     fde = mdsl_storage_fd_lookup_create(duuid, MDSL_STORAGE_MD, 0);
@@ -691,3 +698,525 @@ out_cleanup:
     mdsl_storage_fd_put(itbf);
     goto out_put;
 }
+
+/* Online GC of the itb files
+ *
+ * mdsl_gc_md() rewrites the whole itb file and locks up the MD file at the
+ * end, which blocks the loads and write-backs of this directory. The online
+ * GC picks the itb file w/ the max dead ratio, and sweeps at most
+ * conf.gc_bytes of it in each pass:
+ *
+ * 1. the live ITBs are appended to the tail of the same itb file, and the
+ *    range entries are swapped by __range_write_cas(). If the ITB has been
+ *    overwritten in the meantime, the CAS fails and the copy is dead;
+ * 2. the swept slice is punched out in the next pass. The readers who got
+ *    the old location before the swap have one gc interval to finish.
+ *
+ * The ITBs of the uncommitted TXGs are not in the range files yet, thus we
+ * never sweep beyond toe_pending_location(). An ITB is linked to its TOE
+ * only after itb_append() returns, thus itb_append() pins the itb file tail
+ * before writing, and we never sweep beyond the min pin either.
+ */
+static inline
+struct regular_hash *__gc_bucket(u64 duuid)
+{
+    return hmo.gc.ht + hash_64(duuid, MDSL_GC_HBITS);
+}
+
+static
+void __gc_stat_free(struct mdsl_gc_stat *st)
+{
+    struct mdsl_gc_pin *pin, *n;
+
+    list_for_each_entry_safe(pin, n, &st->pins, list) {
+        list_del(&pin->list);
+        xfree(pin);
+    }
+    xfree(st);
+}
+
+int mdsl_gc_init(void)
+{
+    int i;
+
+    hmo.gc.ht = xmalloc((1 << MDSL_GC_HBITS) * sizeof(struct regular_hash));
+    if (!hmo.gc.ht) {
+        hvfs_err(mdsl, "xmalloc() GC stat hash table failed\n");
+        return -ENOMEM;
+    }
+    for (i = 0; i < (1 << MDSL_GC_HBITS); i++) {
+        INIT_HLIST_HEAD(&(hmo.gc.ht + i)->h);
+        xlock_init(&(hmo.gc.ht + i)->lock);
+    }
+    hmo.gc.victim = NULL;
+
+    return 0;
+}
+
+void mdsl_gc_destroy(void)
+{
+    struct mdsl_gc_stat *st;
+    struct hlist_node *pos, *n;
+    int i;
+
+    if (!hmo.gc.ht)
+        return;
+    for (i = 0; i < (1 << MDSL_GC_HBITS); i++) {
+        xlock_lock(&(hmo.gc.ht + i)->lock);
+        hlist_for_each_entry_safe(st, pos, n, &(hmo.gc.ht + i)->h, hlist) {
+            hlist_del(&st->hlist);
+            __gc_stat_free(st);
+        }
+        xlock_unlock(&(hmo.gc.ht + i)->lock);
+    }
+    xfree(hmo.gc.ht);
+    hmo.gc.ht = NULL;
+    hmo.gc.victim = NULL;
+}
+
+/* holding the bucket lock */
+static
+struct mdsl_gc_stat *__gc_stat_lookup(struct regular_hash *rh, u64 duuid)
+{
+    struct mdsl_gc_stat *st;
+    struct hlist_node *pos;
+
+    hlist_for_each_entry(st, pos, &rh->h, hlist) {
+        if (st->duuid == duuid)
+            return st;
+    }
+    st = xzalloc(sizeof(*st));
+    if (!st) {
+        hvfs_err(mdsl, "xzalloc() GC stat failed\n");
+        return NULL;
+    }
+    INIT_HLIST_NODE(&st->hlist);
+    INIT_LIST_HEAD(&st->pins);
+    st->duuid = duuid;
+    hlist_add_head(&st->hlist, &rh->h);
+
+    return st;
+}
+
+static
+void __gc_account(u64 duuid, int nr, int dead)
+{
+    struct regular_hash *rh;
+    struct mdsl_gc_stat *st;
+
+    if (!(hmo.conf.option & HVFS_MDSL_ONLINE_GC) || !hmo.gc.ht)
+        return;
+
+    rh = __gc_bucket(duuid);
+    xlock_lock(&rh->lock);
+    st = __gc_stat_lookup(rh, duuid);
+    if (st) {
+        st->nr += nr;
+        st->dead += dead;
+        if (st->dead > st->nr)
+            st->dead = st->nr;
+    }
+    xlock_unlock(&rh->lock);
+}
+
+void mdsl_gc_itb_append(u64 duuid)
+{
+    __gc_account(duuid, 1, 0);
+}
+
+void mdsl_gc_itb_dead(u64 duuid)
+{
+    __gc_account(duuid, 0, 1);
+}
+
+/* mdsl_gc_append_begin() publishes that the ITB of @ii is being appended to
+ * the itb file at or after offset @floor. The pin is released by
+ * mdsl_gc_append_end() after @ii is linked to its TOE.
+ */
+int mdsl_gc_append_begin(struct itb_info *ii, u64 floor)
+{
+    struct regular_hash *rh;
+    struct mdsl_gc_stat *st;
+    struct mdsl_gc_pin *pin;
+
+    if (!(hmo.conf.option & HVFS_MDSL_ONLINE_GC) || !hmo.gc.ht)
+        return 0;
+
+    pin = xzalloc(sizeof(*pin));
+    if (!pin) {
+        hvfs_err(mdsl, "xzalloc() GC pin failed\n");
+        return -ENOMEM;
+    }
+    INIT_LIST_HEAD(&pin->list);
+    pin->ii = ii;
+    pin->floor = floor;
+
+    rh = __gc_bucket(ii->duuid);
+    xlock_lock(&rh->lock);
+    st = __gc_stat_lookup(rh, ii->duuid);
+    if (st) {
+        list_add_tail(&pin->list, &st->pins);
+        ii->gc_pin = 1;
+    }
+    xlock_unlock(&rh->lock);
+    if (!st) {
+        xfree(pin);
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+void mdsl_gc_append_end(struct itb_info *ii)
+{
+    struct regular_hash *rh;
+    struct mdsl_gc_stat *st;
+    struct mdsl_gc_pin *pin = NULL, *n;
+    struct hlist_node *pos;
+
+    if (!ii->gc_pin || !hmo.gc.ht)
+        return;
+    ii->gc_pin = 0;
+
+    rh = __gc_bucket(ii->duuid);
+    xlock_lock(&rh->lock);
+    hlist_for_each_entry(st, pos, &rh->h, hlist) {
+        if (st->duuid != ii->duuid)
+            continue;
+        list_for_each_entry_safe(pin, n, &st->pins, list) {
+            if (pin->ii == ii) {
+                list_del(&pin->list);
+                xfree(pin);
+                break;
+            }
+        }
+        break;
+    }
+    xlock_unlock(&rh->lock);
+}
+
+/* the sweep limit of the ITBs in flight */
+static
+u64 __gc_append_lwm(struct mdsl_gc_stat *st)
+{
+    struct regular_hash *rh = __gc_bucket(st->duuid);
+    struct mdsl_gc_pin *pin;
+    u64 lwm = -1UL;
+
+    xlock_lock(&rh->lock);
+    list_for_each_entry(pin, &st->pins, list) {
+        if (pin->floor < lwm)
+            lwm = pin->floor;
+    }
+    xlock_unlock(&rh->lock);
+
+    return lwm;
+}
+
+/* pick the itb file w/ the max dead ratio */
+static
+struct mdsl_gc_stat *__gc_pick_victim(void)
+{
+    struct mdsl_gc_stat *st, *victim = NULL;
+    struct hlist_node *pos;
+    u32 best = 0, ratio;
+    int i;
+
+    for (i = 0; i < (1 << MDSL_GC_HBITS); i++) {
+        xlock_lock(&(hmo.gc.ht + i)->lock);
+        hlist_for_each_entry(st, pos, &(hmo.gc.ht + i)->h, hlist) {
+            if (st->dead < MDSL_GC_MIN_DEAD)
+                continue;
+            ratio = (u64)st->dead * 100 / st->nr;
+            if (ratio >= hmo.conf.gc_ratio && ratio > best) {
+                best = ratio;
+                victim = st;
+            }
+        }
+        xlock_unlock(&(hmo.gc.ht + i)->lock);
+    }
+
+    return victim;
+}
+
+static
+void __gc_stat_remove(struct mdsl_gc_stat *st)
+{
+    struct regular_hash *rh = __gc_bucket(st->duuid);
+
+    xlock_lock(&rh->lock);
+    hlist_del(&st->hlist);
+    xlock_unlock(&rh->lock);
+    __gc_stat_free(st);
+}
+
+/* punch out the slice swept in the last pass */
+static
+void __gc_punch(struct mdsl_gc_stat *st, struct fdhash_entry *itbf)
+{
+    u64 to = st->grace & ~((u64)getpagesize() - 1);
+    int err;
+
+    if (to <= st->punched)
+        return;
+    err = fallocate(itbf->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                    st->punched, to - st->punched);
+    if (err) {
+        hvfs_warning(mdsl, "punch itb file %lx [%ld,%ld) failed w/ %d\n",
+                     st->duuid, st->punched, to, errno);
+    } else
+        atomic64_add(to - st->punched, &hmo.prof.storage.gc_reclaimed);
+    st->punched = to;
+}
+
+/* sweep from st->cursor to @stable within the budget */
+static
+int __gc_sweep(struct mdsl_gc_stat *st, struct fdhash_entry *md,
+               struct fdhash_entry *itbf, u64 stable)
+{
+    struct itbh h;
+    struct itb *itb;
+    struct iovec iov;
+    struct mdsl_storage_access msa = {
+        .iov = &iov,
+        .iov_nr = 1,
+    };
+    struct mmap_args ma = {0, };
+    struct itb_info ii;
+    range_t *range;
+    u64 offset = st->cursor, location, budget = 0;
+    int len, err = 0, moved = 0, dead = 0;
+
+    if (!offset) {
+        /* the itb file starts at 1 */
+        offset = 1;
+    }
+
+    while (offset + sizeof(h) <= stable && budget < hmo.conf.gc_bytes) {
+        iov.iov_base = &h;
+        iov.iov_len = sizeof(h);
+        msa.offset = offset;
+        err = mdsl_storage_fd_read(itbf, &msa);
+        if (err)
+            break;
+        len = atomic_read(&h.len);
+        if (!len) {
+            /* the padding left by append_buf_destroy() */
+            offset = PAGE_ROUNDUP(offset + 1, getpagesize());
+            continue;
+        }
+        if (len < sizeof(h)) {
+            hvfs_err(mdsl, "Invalid ITB length %d in itb file %lx @ %ld, "
+                     "abort the round\n", len, st->duuid, offset);
+            err = -EINVAL;
+            break;
+        }
+        if (offset + len > stable) {
+            /* the ITB crosses the window, end the round before it */
+            if (stable == st->end)
+                st->end = offset;
+            break;
+        }
+        budget += len;
+
+        err = __mdisk_lookup(md, MDSL_MDISK_RANGE, h.itbid, &range);
+        if (err == -ENOENT) {
+            err = 0;
+            dead++;
+            offset += len;
+            continue;
+        } else if (err)
+            break;
+        ma.win = MDSL_STORAGE_DEFAULT_RANGE_SIZE;
+        ma.foffset = 0;
+        ma.range_id = range->range_id;
+        ma.range_begin = range->begin;
+        ma.flag = MA_OFFICIAL;
+        err = __range_lookup(st->duuid, h.itbid, &ma, &location);
+        if (err)
+            break;
+        if (location != offset) {
+            dead++;
+            offset += len;
+            continue;
+        }
+
+        /* it is alive, move it to the tail */
+        itb = xmalloc(len);
+        if (!itb) {
+            hvfs_err(mdsl, "xmalloc() ITB buffer failed\n");
+            err = -ENOMEM;
+            break;
+        }
+        iov.iov_base = itb;
+        iov.iov_len = len;
+        msa.offset = offset;
+        err = mdsl_storage_fd_read(itbf, &msa);
+        if (err) {
+            xfree(itb);
+            break;
+        }
+        memset(&ii, 0, sizeof(ii));
+        ii.duuid = st->duuid;
+        ii.itbid = h.itbid;
+        err = itb_gc_append(st->master, itb, &ii);
+        xfree(itb);
+        if (err)
+            break;
+        err = __range_write_cas(st->duuid, h.itbid, &ma, offset, 
+                                ii.location);
+        if (err == -EAGAIN) {
+            /* overwritten by the write-back, our copy is dead */
+            __gc_account(st->duuid, 1, 1);
+            err = 0;
+        } else if (err)
+            break;
+        else {
+            moved++;
+            atomic64_add(len, &hmo.prof.storage.gc_moved);
+        }
+        offset += len;
+    }
+
+    hvfs_debug(mdsl, "GC itb file %lx @ %ld/%ld: moved %d, dead %d ITBs\n",
+               st->duuid, offset, st->end, moved, dead);
+    st->cursor = offset;
+    st->moved += moved;
+
+    return err;
+}
+
+/* finish the round, the stats are exact now */
+static
+void __gc_round_done(struct mdsl_gc_stat *st)
+{
+    struct regular_hash *rh = __gc_bucket(st->duuid);
+
+    xlock_lock(&rh->lock);
+    st->nr = st->moved + (st->nr - st->rnr);
+    st->dead = st->dead - st->rdead;
+    if (st->dead > st->nr)
+        st->dead = st->nr;
+    xlock_unlock(&rh->lock);
+    hvfs_info(mdsl, "GC itb file %lx round done @ %ld, moved %d ITBs\n",
+              st->duuid, st->end, st->moved);
+}
+
+/* mdsl_gc_online() runs one pass of the online GC
+ */
+int mdsl_gc_online(void)
+{
+    char path[HVFS_MAX_NAME_LEN] = {0, };
+    struct fdhash_entry *md, *itbf;
+    struct mdsl_gc_stat *st;
+    struct timeval begin, end;
+    u64 stable;
+    u32 master;
+    int err = 0;
+
+    if (!(hmo.conf.option & HVFS_MDSL_ONLINE_GC) ||
+        hmo.conf.option & HVFS_MDSL_SEGMENT || !hmo.gc.ht)
+        return 0;
+
+    gettimeofday(&begin, NULL);
+    st = hmo.gc.victim;
+    if (!st) {
+        st = __gc_pick_victim();
+        if (!st)
+            return 0;
+        /* start the round, sweep in the next pass */
+        st->end = 0;
+        hmo.gc.victim = st;
+    }
+
+    /* do not recreate the deleted directory */
+    sprintf(path, "%s/%lx/%lx", HVFS_MDSL_HOME, hmo.site_id, st->duuid);
+    if (access(path, F_OK)) {
+        hmo.gc.victim = NULL;
+        __gc_stat_remove(st);
+        goto out;
+    }
+
+    md = mdsl_storage_fd_lookup_create(st->duuid, MDSL_STORAGE_MD, 0);
+    if (IS_ERR(md)) {
+        hvfs_err(mdsl, "lookup create MD file failed w/ %ld\n", PTR_ERR(md));
+        err = PTR_ERR(md);
+        goto out;
+    }
+    if (!md->mdisk.ranges && !md->mdisk.new_range) {
+        hmo.gc.victim = NULL;
+        goto out_put;
+    }
+    master = md->mdisk.itb_master;
+    itbf = mdsl_storage_fd_lookup_create(st->duuid, MDSL_STORAGE_ITB, master);
+    if (IS_ERR(itbf)) {
+        hvfs_err(mdsl, "lookup create ITB file failed w/ %ld\n", 
+                 PTR_ERR(itbf));
+        err = PTR_ERR(itbf);
+        goto out_put;
+    }
+    if (st->master != master) {
+        /* a new itb file, e.g. by mdsl_gc_md() */
+        st->cursor = st->grace = st->punched = 0;
+        st->master = master;
+        st->end = 0;
+    }
+
+    if (!st->end) {
+        /* never sweep the mmapped window of the appender */
+        st->end = mdsl_storage_fd_max_offset(itbf);
+        if ((itbf->state == FDE_ABUF || itbf->state == FDE_ABUF_UNMAPPED) &&
+            itbf->abuf.file_offset < st->end)
+            st->end = itbf->abuf.file_offset;
+        if (st->end == -1UL || st->end <= st->cursor) {
+            hmo.gc.victim = NULL;
+            goto out_put_itbf;
+        }
+        xlock_lock(&__gc_bucket(st->duuid)->lock);
+        st->rnr = st->nr;
+        st->rdead = st->dead;
+        xlock_unlock(&__gc_bucket(st->duuid)->lock);
+        st->moved = 0;
+        goto out_put_itbf;
+    }
+
+    /* Step 1: reclaim the slice swept in the last pass */
+    __gc_punch(st, itbf);
+
+    /* Step 2: sweep the next slice */
+    stable = min(st->end, toe_pending_location(st->duuid, master));
+    stable = min(stable, __gc_append_lwm(st));
+    err = __gc_sweep(st, md, itbf, stable);
+    if (err) {
+        hvfs_err(mdsl, "GC itb file %lx failed w/ %d\n", st->duuid, err);
+        if (err == -EINVAL) {
+            /* do not pick it again until there are more dead ITBs */
+            xlock_lock(&__gc_bucket(st->duuid)->lock);
+            st->dead = 0;
+            xlock_unlock(&__gc_bucket(st->duuid)->lock);
+            st->end = 0;
+            hmo.gc.victim = NULL;
+            goto out_put_itbf;
+        }
+    }
+
+    /* Step 3: the round is done after the last slice is punched out */
+    if (st->cursor + sizeof(struct itbh) > st->end &&
+        st->grace == st->cursor &&
+        st->punched == (st->grace & ~((u64)getpagesize() - 1))) {
+        __gc_round_done(st);
+        hmo.gc.victim = NULL;
+    }
+    st->grace = st->cursor;
+
+out_put_itbf:
+    mdsl_storage_fd_put(itbf);
+out_put:
+    mdsl_storage_fd_put(md);
+out:
+    gettimeofday(&end, NULL);
+    atomic64_add((end.tv_sec - begin.tv_sec) * 1000000 +
+                 end.tv_usec - begin.tv_usec, &hmo.prof.storage.gc_stall);
+
+    return err;
+}
@@ -0,0 +1,621 @@
+/**
+ * Copyright (c) 2009 Ma Can <ml.macana@gmail.com>
+ *                           <macan@ncic.ac.cn>
+ *
+ * Armed with EMACS.
+ * Time-stamp: <2011-03-02 13:12:00 macan>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "hvfs.h"
+#include "xnet.h"
+#include "mdsl.h"
+
+/* ITB cache of the MDSL
+ *
+ * The ITB load path looks up the MD file, the mdisk ranges and the mmaped
+ * range file for each ITB. The range slice cache keeps copies of the
+ * MDSL_RSC_SLOTS locations around the hot itbids, a hit needs only ONE hash
+ * lookup.
+ *
+ * The MDS loads the ITBs of a cold directory in itbid order. We track the
+ * last loaded itbid of each directory, the loads w/ small forward strides
+ * (the ring scatters the itbids to the MDSLs) double the read-ahead window,
+ * and the read-ahead thread prefetches the ITBs in the window. The prefetched
+ * ITB is handed to the reply on hit, thus it is loaded only once.
+ *
+ * All the range writes call mdsl_itbc_update(), which bumps the sequence
+ * number, patches the cached slice and drops the prefetched ITB. The fillers
+ * check the sequence number before inserting, a copy racing w/ the range
+ * write is just dropped.
+ */
+
+static inline
+struct hlist_head *__itbc_bucket(struct hlist_head *ht, u64 duuid, u64 arg)
+{
+    return ht + hash_64(duuid ^ arg, MDSL_ITBC_HBITS);
+}
+
+/* holding the rsc_lock */
+static
+struct mdsl_rsc_entry *__rsc_lookup(u64 duuid, u64 begin)
+{
+    struct mdsl_rsc_entry *e;
+    struct hlist_node *pos;
+
+    hlist_for_each_entry(e, pos, __itbc_bucket(hmo.itbc.rsc, duuid, begin),
+                         hlist) {
+        if (e->duuid == duuid && e->begin == begin)
+            return e;
+    }
+
+    return NULL;
+}
+
+/* holding the itb_lock */
+static
+struct mdsl_ra_entry *__ra_lookup(u64 duuid, u64 itbid)
+{
+    struct mdsl_ra_entry *e;
+    struct hlist_node *pos;
+
+    hlist_for_each_entry(e, pos, __itbc_bucket(hmo.itbc.itb, duuid, itbid),
+                         hlist) {
+        if (e->duuid == duuid && e->itbid == itbid)
+            return e;
+    }
+
+    return NULL;
+}
+
+/* holding the itb_lock */
+static
+void __ra_remove(struct mdsl_ra_entry *e)
+{
+    hlist_del(&e->hlist);
+    list_del(&e->lru);
+    hmo.itbc.itb_bytes -= atomic_read(&e->itb->h.len);
+}
+
+static
+void __rsc_insert(struct mdsl_rsc_entry *e, u64 seq)
+{
+    struct mdsl_rsc_entry *v;
+
+    xlock_lock(&hmo.itbc.rsc_lock);
+    if (seq != atomic64_read(&hmo.itbc.seq) ||
+        __rsc_lookup(e->duuid, e->begin)) {
+        xlock_unlock(&hmo.itbc.rsc_lock);
+        xfree(e);
+        return;
+    }
+    if (hmo.itbc.rsc_nr >= hmo.conf.rsc_size) {
+        v = list_entry(hmo.itbc.rsc_lru.prev, struct mdsl_rsc_entry, lru);
+        hlist_del(&v->hlist);
+        list_del(&v->lru);
+        xfree(v);
+        hmo.itbc.rsc_nr--;
+    }
+    hlist_add_head(&e->hlist, __itbc_bucket(hmo.itbc.rsc, e->duuid,
+                                            e->begin));
+    list_add(&e->lru, &hmo.itbc.rsc_lru);
+    hmo.itbc.rsc_nr++;
+    xlock_unlock(&hmo.itbc.rsc_lock);
+}
+
+/* mdsl_itb_locate() returns the location and the itb file master of ITB
+ * @itbid. Return -ENOTEXIST if there is no range covering @itbid, and
+ * -ENOENT if the ITB does not exist.
+ */
+int mdsl_itb_locate(u64 duuid, u64 itbid, u64 *location, u64 *master)
+{
+    struct mdsl_rsc_entry *e;
+    struct fdhash_entry *fde;
+    struct mmap_args ma;
+    range_t *range;
+    u64 begin, seq, lo, hi;
+    int err = 0;
+
+    begin = itbid & ~(MDSL_RSC_SLOTS - 1);
+    xlock_lock(&hmo.itbc.rsc_lock);
+    e = __rsc_lookup(duuid, begin);
+    if (e && itbid >= e->lo && itbid < e->hi) {
+        *location = e->loc[itbid - begin];
+        *master = e->master;
+        list_move(&e->lru, &hmo.itbc.rsc_lru);
+        xlock_unlock(&hmo.itbc.rsc_lock);
+        atomic64_inc(&hmo.prof.mds.rsc_hit);
+        goto out_check;
+    }
+    xlock_unlock(&hmo.itbc.rsc_lock);
+    atomic64_inc(&hmo.prof.mds.rsc_miss);
+
+    seq = atomic64_read(&hmo.itbc.seq);
+    fde = mdsl_storage_fd_lookup_create(duuid, MDSL_STORAGE_MD, 0);
+    if (IS_ERR(fde)) {
+        hvfs_err(mdsl, "lookup create MD file failed w/ %ld\n", PTR_ERR(fde));
+        return PTR_ERR(fde);
+    }
+    if (!fde->mdisk.ranges && !fde->mdisk.new_range) {
+        err = -ENOTEXIST;
+        goto out_put;
+    }
+    err = __mdisk_lookup(fde, MDSL_MDISK_RANGE, itbid, &range);
+    if (err) {
+        if (err == -ENOENT)
+            err = -ENOTEXIST;
+        goto out_put;
+    }
+    ma.win = MDSL_STORAGE_DEFAULT_RANGE_SIZE;
+    ma.foffset = 0;
+    ma.range_id = range->range_id;
+    ma.range_begin = range->begin;
+    ma.flag = MA_OFFICIAL;
+    lo = max(begin, range->begin);
+    hi = min(begin + MDSL_RSC_SLOTS, range->end);
+    *master = fde->mdisk.itb_master;
+    mdsl_storage_fd_put(fde);
+
+    e = xzalloc(sizeof(*e));
+    if (!e) {
+        /* fallback to the range file */
+        err = __range_lookup(duuid, itbid, &ma, location);
+        if (err)
+            return err;
+        goto out_check;
+    }
+    INIT_HLIST_NODE(&e->hlist);
+    INIT_LIST_HEAD(&e->lru);
+    e->duuid = duuid;
+    e->begin = begin;
+    e->lo = lo;
+    e->hi = hi;
+    e->master = *master;
+    err = __range_read_slice(duuid, &ma, lo, hi - lo, e->loc + (lo - begin));
+    if (err) {
+        xfree(e);
+        return err;
+    }
+    *location = e->loc[itbid - begin];
+    __rsc_insert(e, seq);
+
+out_check:
+    if (!*location)
+        err = -ENOENT;
+    return err;
+
+out_put:
+    mdsl_storage_fd_put(fde);
+    return err;
+}
+
+/* mdsl_itb_read() reads the whole ITB at @location to a new buffer */
+struct itb *mdsl_itb_read(u64 duuid, u64 location, u64 master)
+{
+    struct iovec iov;
+    struct mdsl_storage_access msa = {
+        .iov = &iov,
+        .iov_nr = 1,
+    };
+    struct fdhash_entry *fde;
+    struct itbh h;
+    struct itb *itb;
+    int err = 0;
+
+    fde = mdsl_segment_itb_fd(duuid, master, &location);
+    if (IS_ERR(fde)) {
+        hvfs_err(mdsl, "lookup create ITB file failed w/ %ld\n", PTR_ERR(fde));
+        return (void *)fde;
+    }
+
+    msa.offset = location;
+    iov.iov_base = &h;
+    iov.iov_len = sizeof(h);
+    err = mdsl_storage_fd_read(fde, &msa);
+    if (err) {
+        hvfs_err(mdsl, "fd read failed w/ %d\n", err);
+        itb = ERR_PTR(err);
+        goto out_put;
+    }
+    if (atomic_read(&h.len) < sizeof(h) ||
+        atomic_read(&h.len) > ITB_MEM_SIZE) {
+        hvfs_err(mdsl, "ITB %lx/%ld @ %ld has invalid len %d\n",
+                 duuid, h.itbid, location, atomic_read(&h.len));
+        itb = ERR_PTR(-EFAULT);
+        goto out_put;
+    }
+
+    itb = xmalloc(atomic_read(&h.len));
+    if (!itb) {
+        hvfs_err(mdsl, "xmalloc ITB (len %d) failed\n", atomic_read(&h.len));
+        itb = ERR_PTR(-ENOMEM);
+        goto out_put;
+    }
+    memcpy(itb, &h, sizeof(h));
+    if (atomic_read(&h.len) > sizeof(h)) {
+        msa.offset = location + sizeof(h);
+        iov.iov_base = (void *)itb + sizeof(h);
+        iov.iov_len = atomic_read(&h.len) - sizeof(h);
+        err = mdsl_storage_fd_read(fde, &msa);
+        if (err) {
+            hvfs_err(mdsl, "fd read failed w/ %d\n", err);
+            xfree(itb);
+            itb = ERR_PTR(err);
+        }
+    }
+
+out_put:
+    mdsl_storage_fd_put(fde);
+    return itb;
+}
+
+/* mdsl_itbc_get() takes the prefetched ITB out of the cache */
+struct itb *mdsl_itbc_get(u64 duuid, u64 itbid)
+{
+    struct mdsl_ra_entry *e;
+    struct itb *itb = NULL;
+
+    xlock_lock(&hmo.itbc.itb_lock);
+    e = __ra_lookup(duuid, itbid);
+    if (e) {
+        __ra_remove(e);
+        itb = e->itb;
+    }
+    xlock_unlock(&hmo.itbc.itb_lock);
+
+    if (e) {
+        xfree(e);
+        atomic64_inc(&hmo.prof.mds.ra_hit);
+    }
+
+    return itb;
+}
+
+static
+void __itbc_prefetch(u64 duuid, u64 itbid)
+{
+    struct mdsl_ra_entry *e, *v;
+    struct itb *itb;
+    u64 location, master, seq;
+    int err, len;
+
+    xlock_lock(&hmo.itbc.itb_lock);
+    e = __ra_lookup(duuid, itbid);
+    xlock_unlock(&hmo.itbc.itb_lock);
+    if (e)
+        return;
+
+    seq = atomic64_read(&hmo.itbc.seq);
+    err = mdsl_itb_locate(duuid, itbid, &location, &master);
+    if (err)
+        return;
+    itb = mdsl_itb_read(duuid, location, master);
+    if (IS_ERR(itb))
+        return;
+    len = atomic_read(&itb->h.len);
+
+    e = xmalloc(sizeof(*e));
+    if (!e) {
+        xfree(itb);
+        return;
+    }
+    INIT_HLIST_NODE(&e->hlist);
+    INIT_LIST_HEAD(&e->lru);
+    e->duuid = duuid;
+    e->itbid = itbid;
+    e->itb = itb;
+
+    xlock_lock(&hmo.itbc.itb_lock);
+    if (seq != atomic64_read(&hmo.itbc.seq) || len > hmo.conf.ra_cache ||
+        __ra_lookup(duuid, itbid)) {
+        xlock_unlock(&hmo.itbc.itb_lock);
+        xfree(itb);
+        xfree(e);
+        return;
+    }
+    while (hmo.itbc.itb_bytes + len > hmo.conf.ra_cache) {
+        v = list_entry(hmo.itbc.itb_lru.prev, struct mdsl_ra_entry, lru);
+        __ra_remove(v);
+        xfree(v->itb);
+        xfree(v);
+    }
+    hlist_add_head(&e->hlist, __itbc_bucket(hmo.itbc.itb, duuid, itbid));
+    list_add(&e->lru, &hmo.itbc.itb_lru);
+    hmo.itbc.itb_bytes += len;
+    xlock_unlock(&hmo.itbc.itb_lock);
+    atomic64_inc(&hmo.prof.mds.ra_issue);
+}
+
+/* mdsl_itbc_access() detects the sequential ITB loads of a directory and
+ * queues the read-ahead request.
+ */
+void mdsl_itbc_access(u64 duuid, u64 itbid)
+{
+    struct mdsl_ra_state *st = NULL;
+    struct mdsl_ra_req *rr = NULL;
+    struct hlist_node *pos;
+    struct hlist_head *hh;
+    u64 gap;
+
+    if (hmo.conf.option & HVFS_MDSL_NO_RA || !hmo.itbc.ra)
+        return;
+
+    hh = __itbc_bucket(hmo.itbc.ra, duuid, 0);
+    xlock_lock(&hmo.itbc.ra_lock);
+    hlist_for_each_entry(st, pos, hh, hlist) {
+        if (st->duuid == duuid)
+            break;
+    }
+    if (!pos) {
+        if (hmo.itbc.ra_nr >= MDSL_RA_STATES) {
+            /* reuse the LRU state */
+            st = list_entry(hmo.itbc.ra_lru.prev, struct mdsl_ra_state, lru);
+            hlist_del(&st->hlist);
+            list_del(&st->lru);
+        } else {
+            st = xmalloc(sizeof(*st));
+            if (!st) {
+                xlock_unlock(&hmo.itbc.ra_lock);
+                return;
+            }
+            hmo.itbc.ra_nr++;
+        }
+        st->duuid = duuid;
+        st->last = itbid;
+        st->ra_end = 0;
+        st->window = 0;
+        hlist_add_head(&st->hlist, hh);
+        list_add(&st->lru, &hmo.itbc.ra_lru);
+        xlock_unlock(&hmo.itbc.ra_lock);
+        return;
+    }
+    list_move(&st->lru, &hmo.itbc.ra_lru);
+
+    gap = max(st->window, MDSL_RA_MIN);
+    if (itbid > st->last && itbid - st->last <= gap) {
+        if (!st->window)
+            st->window = MDSL_RA_MIN;
+        else
+            st->window = min(st->window << 1, hmo.conf.ra_max);
+    } else {
+        st->window = 0;
+        st->ra_end = 0;
+    }
+    st->last = itbid;
+
+    /* issue the next window when the loads pass the half of the last one */
+    if (st->window && itbid + (st->window >> 1) >= st->ra_end) {
+        rr = xmalloc(sizeof(*rr));
+        if (rr) {
+            INIT_LIST_HEAD(&rr->list);
+            rr->duuid = duuid;
+            rr->begin = max(st->ra_end, itbid + 1);
+            rr->end = itbid + 1 + st->window;
+            st->ra_end = rr->end;
+        }
+    }
+    xlock_unlock(&hmo.itbc.ra_lock);
+
+    if (rr) {
+        xlock_lock(&hmo.itbc.qlock);
+        list_add_tail(&rr->list, &hmo.itbc.queue);
+        xlock_unlock(&hmo.itbc.qlock);
+        sem_post(&hmo.itbc.qsem);
+    }
+}
+
+/* mdsl_itbc_update() is called after the range entry of ITB @itbid is
+ * changed to @location */
+void mdsl_itbc_update(u64 duuid, u64 itbid, u64 location)
+{
+    struct mdsl_rsc_entry *e;
+    struct mdsl_ra_entry *re;
+
+    if (!hmo.itbc.rsc)
+        return;
+
+    xlock_lock(&hmo.itbc.rsc_lock);
+    atomic64_inc(&hmo.itbc.seq);
+    e = __rsc_lookup(duuid, itbid & ~(MDSL_RSC_SLOTS - 1));
+    if (e && itbid >= e->lo && itbid < e->hi)
+        e->loc[itbid - e->begin] = location;
+    xlock_unlock(&hmo.itbc.rsc_lock);
+
+    xlock_lock(&hmo.itbc.itb_lock);
+    re = __ra_lookup(duuid, itbid);
+    if (re)
+        __ra_remove(re);
+    xlock_unlock(&hmo.itbc.itb_lock);
+    if (re) {
+        xfree(re->itb);
+        xfree(re);
+    }
+}
+
+/* mdsl_itbc_invalidate() drops all the cached slices and ITBs of directory
+ * @duuid, the itb file is switched or deleted */
+void mdsl_itbc_invalidate(u64 duuid)
+{
+    struct mdsl_rsc_entry *e, *en;
+    struct mdsl_ra_entry *re, *ren;
+
+    if (!hmo.itbc.rsc)
+        return;
+
+    xlock_lock(&hmo.itbc.rsc_lock);
+    atomic64_inc(&hmo.itbc.seq);
+    list_for_each_entry_safe(e, en, &hmo.itbc.rsc_lru, lru) {
+        if (e->duuid == duuid) {
+            hlist_del(&e->hlist);
+            list_del(&e->lru);
+            xfree(e);
+            hmo.itbc.rsc_nr--;
+        }
+    }
+    xlock_unlock(&hmo.itbc.rsc_lock);
+
+    xlock_lock(&hmo.itbc.itb_lock);
+    list_for_each_entry_safe(re, ren, &hmo.itbc.itb_lru, lru) {
+        if (re->duuid == duuid) {
+            __ra_remove(re);
+            xfree(re->itb);
+            xfree(re);
+        }
+    }
+    xlock_unlock(&hmo.itbc.itb_lock);
+}
+
+static
+void *itbc_ra_main(void *arg)
+{
+    struct mdsl_ra_req *rr;
+    sigset_t set;
+    u64 itbid;
+    int err;
+
+    /* first, let us block the SIGALRM and SIGCHLD */
+    sigemptyset(&set);
+    sigaddset(&set, SIGALRM);
+    sigaddset(&set, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &set, NULL); /* oh, we do not care about the
+                                             * errs */
+    while (!hmo.itbc.stop) {
+        err = sem_wait(&hmo.itbc.qsem);
+        if (err < 0 && errno == EINTR)
+            continue;
+        while (!hmo.itbc.stop) {
+            xlock_lock(&hmo.itbc.qlock);
+            if (list_empty(&hmo.itbc.queue)) {
+                xlock_unlock(&hmo.itbc.qlock);
+                break;
+            }
+            rr = list_entry(hmo.itbc.queue.next, struct mdsl_ra_req, list);
+            list_del(&rr->list);
+            xlock_unlock(&hmo.itbc.qlock);
+
+            for (itbid = rr->begin; itbid < rr->end && !hmo.itbc.stop;
+                 itbid++) {
+                __itbc_prefetch(rr->duuid, itbid);
+            }
+            xfree(rr);
+        }
+    }
+    pthread_exit(0);
+}
+
+int mdsl_itbc_init(void)
+{
+    pthread_attr_t attr;
+    int i, err = 0, stacksize;
+
+    hmo.itbc.rsc = xmalloc(3 * (1 << MDSL_ITBC_HBITS) *
+                           sizeof(struct hlist_head));
+    if (!hmo.itbc.rsc) {
+        hvfs_err(mdsl, "xmalloc() ITB cache hash tables failed\n");
+        return -ENOMEM;
+    }
+    hmo.itbc.itb = hmo.itbc.rsc + (1 << MDSL_ITBC_HBITS);
+    hmo.itbc.ra = hmo.itbc.itb + (1 << MDSL_ITBC_HBITS);
+    for (i = 0; i < 3 * (1 << MDSL_ITBC_HBITS); i++) {
+        INIT_HLIST_HEAD(hmo.itbc.rsc + i);
+    }
+    INIT_LIST_HEAD(&hmo.itbc.rsc_lru);
+    INIT_LIST_HEAD(&hmo.itbc.itb_lru);
+    INIT_LIST_HEAD(&hmo.itbc.ra_lru);
+    INIT_LIST_HEAD(&hmo.itbc.queue);
+    xlock_init(&hmo.itbc.rsc_lock);
+    xlock_init(&hmo.itbc.itb_lock);
+    xlock_init(&hmo.itbc.ra_lock);
+    xlock_init(&hmo.itbc.qlock);
+    sem_init(&hmo.itbc.qsem, 0, 0);
+    hmo.itbc.rsc_nr = 0;
+    hmo.itbc.ra_nr = 0;
+    hmo.itbc.itb_bytes = 0;
+    atomic64_set(&hmo.itbc.seq, 0);
+    hmo.itbc.stop = 0;
+
+    /* set default ITB cache configs */
+    if (hmo.conf.rsc_size <= 0)
+        hmo.conf.rsc_size = MDSL_RSC_SIZE;
+    if (!hmo.conf.ra_cache)
+        hmo.conf.ra_cache = MDSL_RA_CACHE;
+    if (hmo.conf.ra_max < MDSL_RA_MIN)
+        hmo.conf.ra_max = MDSL_RA_MAX;
+    if (!hmo.conf.itb_batch)
+        hmo.conf.itb_batch = MDSL_ITB_BATCH;
+
+    /* init the thread stack size */
+    err = pthread_attr_init(&attr);
+    if (err) {
+        hvfs_err(mdsl, "Init pthread attr failed\n");
+        goto out;
+    }
+    stacksize = (hmo.conf.stacksize > (1 << 20) ?
+                 hmo.conf.stacksize : (2 << 20));
+    err = pthread_attr_setstacksize(&attr, stacksize);
+    if (err) {
+        hvfs_err(mdsl, "set thread stack size to %d failed w/ %d\n",
+                 stacksize, err);
+        goto out;
+    }
+    err = pthread_create(&hmo.itbc.thread, &attr, &itbc_ra_main, NULL);
+    if (err) {
+        hvfs_err(mdsl, "create the read-ahead thread failed w/ %d\n", err);
+        goto out;
+    }
+
+out:
+    return err;
+}
+
+void mdsl_itbc_destroy(void)
+{
+    struct mdsl_rsc_entry *e, *en;
+    struct mdsl_ra_entry *re, *ren;
+    struct mdsl_ra_state *st, *stn;
+    struct mdsl_ra_req *rr, *rrn;
+
+    if (!hmo.itbc.rsc)
+        return;
+
+    hmo.itbc.stop = 1;
+    sem_post(&hmo.itbc.qsem);
+    pthread_join(hmo.itbc.thread, NULL);
+    sem_destroy(&hmo.itbc.qsem);
+
+    list_for_each_entry_safe(rr, rrn, &hmo.itbc.queue, list) {
+        list_del(&rr->list);
+        xfree(rr);
+    }
+    list_for_each_entry_safe(e, en, &hmo.itbc.rsc_lru, lru) {
+        list_del(&e->lru);
+        xfree(e);
+    }
+    list_for_each_entry_safe(re, ren, &hmo.itbc.itb_lru, lru) {
+        list_del(&re->lru);
+        xfree(re->itb);
+        xfree(re);
+    }
+    list_for_each_entry_safe(st, stn, &hmo.itbc.ra_lru, lru) {
+        list_del(&st->lru);
+        xfree(st);
+    }
+    xfree(hmo.itbc.rsc);
+    hmo.itbc.rsc = NULL;
+    hmo.itbc.itb = NULL;
+    hmo.itbc.ra = NULL;
+}
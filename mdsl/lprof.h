@@ -40,6 +40,11 @@ struct mdsl_mds_prof
     atomic64_t itb;             /* # of itb loading */
     atomic64_t bitmap;          /* # of bitmap loading */
     atomic64_t txg;             /* # of txg writing */
+    atomic64_t itb_batch;       /* # of batched itb loading */
+    atomic64_t rsc_hit;         /* # of range slice cache hits */
+    atomic64_t rsc_miss;        /* # of range slice cache misses */
+    atomic64_t ra_hit;          /* # of itb loads hit the prefetched ITBs */
+    atomic64_t ra_issue;        /* # of ITBs prefetched */
 };
 
 struct mdsl_mdsl_prof
@@ -55,6 +60,8 @@ struct mdsl_misc_prof
     atomic64_t reqin_handle;    /* # of handled requests */
     atomic_t tcc_size;          /* total # of TCC */
     atomic_t tcc_used;          /* used # of TCC */
+    atomic64_t tcc_spill;       /* # of TOE records spilled to temp file */
+    atomic64_t tcc_replay;      /* # of TOE records replayed from temp file */
 };
 
 struct mdsl_storage_prof
@@ -66,6 +73,9 @@ struct mdsl_storage_prof
     atomic64_t cpbytes;         /* # of bytes copied to mmap region */
     atomic64_t aio_submitted;
     atomic64_t aio_handled;
+    atomic64_t gc_reclaimed;    /* # of bytes punched out by online GC */
+    atomic64_t gc_moved;        /* # of live bytes moved by online GC */
+    atomic64_t gc_stall;        /* # of usecs spent in online GC passes */
     atomic_t pread;             /* # of concurrent reads' length */
     atomic_t prreads;           /* # of concurrent reads */
 };
@@ -79,9 +79,11 @@ void __mdsl_send_rpy(struct xnet_msg *msg)
 }
 
 /* @flag: 1 means we are sending ITB; 0 means we are sending other data
+ * @fr: if not NULL, this file range is sent after the iov data
  */
 static inline
-void __mdsl_send_rpy_data(struct xnet_msg *msg, struct iovec iov[], int nr, int flag)
+void __mdsl_send_rpy_data(struct xnet_msg *msg, struct iovec iov[], int nr,
+                          struct xnet_frange *fr, int flag)
 {
     struct xnet_msg *rpy;
     int i;
@@ -99,6 +101,8 @@ void __mdsl_send_rpy_data(struct xnet_msg *msg, struct iovec iov[], int nr, int
     for (i = 0; i < nr; i++) {
         xnet_msg_add_sdata(rpy, iov[i].iov_base, iov[i].iov_len);
     }
+    if (fr)
+        xnet_msg_add_sfile(rpy, fr->fd, fr->offset, fr->len);
     xnet_msg_fill_tx(rpy, XNET_MSG_RPY, XNET_NEED_DATA_FREE, 
                      hmo.site_id, msg->tx.ssite_id);
     xnet_msg_fill_reqno(rpy, msg->tx.reqno);
@@ -115,6 +119,28 @@ void __mdsl_send_rpy_data(struct xnet_msg *msg, struct iovec iov[], int nr, int
     xnet_free_msg(rpy);
 }
 
+/* wait for the opening toe of site @site committed to disk */
+static inline
+void __mdsl_itb_wait_toe(u64 site)
+{
+    struct txg_open_entry *toe;
+    int err = 0;
+
+    toe = toe_lookup_recent(site);
+    if (toe) {
+        struct timespec ts;
+        
+        /* we should wait here */
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += 60;
+        xcond_lock(&toe->wcond);
+        while (!toe->state && err == 0)
+            err = xcond_timedwait(&toe->wcond, &ts);
+        xcond_unlock(&toe->wcond);
+        toe_put(toe);
+    }
+}
+
 void mdsl_itb(struct xnet_msg *msg)
 {
     struct iovec itb_iov[2] = {{0,}, };
@@ -122,14 +148,12 @@ void mdsl_itb(struct xnet_msg *msg)
         .iov = &itb_iov[0],
         .iov_nr = 1,
     };
-    struct mmap_args ma;
     struct fdhash_entry *fde;
-    struct txg_open_entry *toe;
-    range_t *range;
+    struct fdhash_entry *sfde = NULL;
+    struct xnet_frange fr;
     struct itb *itb;
     void *data = NULL;
-    u64 location;
-    int master;
+    u64 location, master;
     int data_len = 0;
     int err = 0;
 
@@ -140,6 +164,21 @@ void mdsl_itb(struct xnet_msg *msg)
     hvfs_debug(mdsl, "Recv ITB load requst <%ld,%ld> from site %lx\n",
                msg->tx.arg0, msg->tx.arg1, msg->tx.ssite_id);
 
+    /* first, we should check if there is a opening toe, if there is, we just
+     * wait until it is committed to disk */
+    __mdsl_itb_wait_toe(msg->tx.ssite_id);
+
+    /* then, we can safely access the storage file */
+    mdsl_itbc_access(msg->tx.arg0, msg->tx.arg1);
+    itb = mdsl_itbc_get(msg->tx.arg0, msg->tx.arg1);
+    if (itb) {
+        /* the whole ITB is prefetched */
+        itb_iov[0].iov_base = itb;
+        itb_iov[0].iov_len = atomic_read(&itb->h.len);
+        __mdsl_send_rpy_data(msg, itb_iov, 1, NULL, 1);
+        goto out_free;
+    }
+
     /* Bugfix: for lzo compressed ITB, there is only header */
     itb = xmalloc(sizeof(itb->h));
     if (!itb) {
@@ -148,59 +187,16 @@ void mdsl_itb(struct xnet_msg *msg)
         goto out;
     }
 
-    /* first, we should check if there is a opening toe, if there is, we just
-     * wait until it is committed to disk */
-    toe = toe_lookup_recent(msg->tx.ssite_id);
-    if (toe) {
-        struct timespec ts;
-        
-        /* we should wait here */
-        clock_gettime(CLOCK_REALTIME, &ts);
-        ts.tv_sec += 60;
-        xcond_lock(&toe->wcond);
-        while (!toe->state && err == 0)
-            err = xcond_timedwait(&toe->wcond, &ts);
-        xcond_unlock(&toe->wcond);
-        toe_put(toe);
-    }
-    
-    /* then, we can safely access the storage file */
-    fde = mdsl_storage_fd_lookup_create(msg->tx.arg0, MDSL_STORAGE_MD, 0);
-    if (IS_ERR(fde)) {
-        hvfs_err(mdsl, "lookup create MD file failed w/ %ld\n", PTR_ERR(fde));
-        err = PTR_ERR(fde);
-        goto out;
-    }
-    if (!fde->mdisk.ranges && !fde->mdisk.new_range) {
-        err = -ENOENT;
-        goto out_put2;
-    }
-    ma.win = MDSL_STORAGE_DEFAULT_RANGE_SIZE;
-
-    err = __mdisk_lookup(fde, MDSL_MDISK_RANGE, msg->tx.arg1, &range);
-    if (err == -ENOENT) {
-        goto out_put2;
-    }
-    ma.foffset = 0;
-    ma.range_id = range->range_id;
-    ma.range_begin = range->begin;
-    ma.flag = MA_OFFICIAL;
-
-    err = __range_lookup(msg->tx.arg0, msg->tx.arg1, &ma, &location);
+    err = mdsl_itb_locate(msg->tx.arg0, msg->tx.arg1, &location, &master);
     if (err) {
-        goto out_put2;
-    }
-    if (!location) {
-        err = -ENOENT;
-        goto out_put2;
+        if (err == -ENOTEXIST)
+            err = -ENOENT;
+        goto out;
     }
-    
-    master = fde->mdisk.itb_master;
-    mdsl_storage_fd_put(fde);
 
-    /* ok, get the itb location now, try to read the itb in file itb-* */
-    fde = mdsl_storage_fd_lookup_create(msg->tx.arg0, MDSL_STORAGE_ITB, 
-                                        master);
+    /* ok, get the itb location now, try to read the itb in file itb-* or
+     * in the segment file */
+    fde = mdsl_segment_itb_fd(msg->tx.arg0, master, &location);
     if (IS_ERR(fde)) {
         hvfs_err(mdsl, "lookup create ITB file failed w/ %ld\n", PTR_ERR(fde));
         err = PTR_ERR(fde);
@@ -219,7 +215,16 @@ void mdsl_itb(struct xnet_msg *msg)
     hvfs_warning(mdsl, "Read ITB %ld len %d to %lx\n", 
                  itb->h.itbid, atomic_read(&itb->h.len), msg->tx.ssite_id);
     data_len = atomic_read(&itb->h.len) - sizeof(itb->h);
-    if (data_len > 0) {
+    if (data_len >= MDSL_STORAGE_SENDFILE_MIN &&
+        !mdsl_storage_fd_sendfile(fde, location + sizeof(itb->h), data_len)) {
+        /* send the data region from the page cache, hold the fde until the
+         * reply is sent */
+        fr.fd = fde->fd;
+        fr.offset = location + sizeof(itb->h);
+        fr.len = data_len;
+        atomic_inc(&fde->ref);
+        sfde = fde;
+    } else if (data_len > 0) {
         data = xmalloc(data_len);
         if (!data) {
             hvfs_err(mdsl, "try to alloc memory for ITB data region (len %d) "
@@ -253,19 +258,135 @@ out:
         itb_iov[0].iov_base = itb;
         itb_iov[0].iov_len = sizeof(itb->h);
         err = 1;
-        if (data_len) {
+        if (data) {
             itb_iov[1].iov_base = data;
             itb_iov[1].iov_len = data_len;
             err++;
         }
-        __mdsl_send_rpy_data(msg, itb_iov, err, 1);
+        __mdsl_send_rpy_data(msg, itb_iov, err, sfde ? &fr : NULL, 1);
+        if (sfde)
+            mdsl_storage_fd_put(sfde);
     }
 
+out_free:
     xnet_set_auto_free(msg);
     xnet_free_msg(msg);
     return;
 }
 
+/* mdsl_itb_batch() loads the existing ITBs in [begin, end) of a directory.
+ * The reply is bounded by hmo.conf.itb_batch bytes, the MDS should continue
+ * from the returned itbid.
+ */
+void mdsl_itb_batch(struct xnet_msg *msg)
+{
+    struct storage_index *si;
+    struct xnet_msg *rpy;
+    struct iovec *iov = NULL;
+    struct itb *itb;
+    u64 itbid, end, location, master, total = 0;
+    int nr = 0, err = 0, i;
+
+    /* API:
+     * tx.arg0: puuid
+     * tx.arg1: begin itbid
+     * si.sic.arg0: end itbid (exclusive)
+     *
+     * Reply: the ITBs packed one by one, tx.arg0 is the next itbid to load,
+     * tx.arg1 is the # of ITBs.
+     */
+    itbid = msg->tx.arg1;
+    if (msg->tx.len < sizeof(*si) || !msg->xm_datacheck) {
+        hvfs_err(mdsl, "Invalid batched ITB load request from %lx\n",
+                 msg->tx.ssite_id);
+        err = -EINVAL;
+        goto out;
+    }
+    si = msg->xm_data;
+    end = si->sic.arg0;
+    hvfs_debug(mdsl, "Recv batched ITB load request <%ld,[%ld,%ld)> from "
+               "site %lx\n", msg->tx.arg0, itbid, end, msg->tx.ssite_id);
+
+    iov = xmalloc(MDSL_ITB_BATCH_NR * sizeof(*iov));
+    if (!iov) {
+        hvfs_err(mdsl, "xmalloc ITB iovs failed\n");
+        err = -ENOMEM;
+        goto out;
+    }
+
+    __mdsl_itb_wait_toe(msg->tx.ssite_id);
+
+    while (itbid < end && nr < MDSL_ITB_BATCH_NR &&
+           total < hmo.conf.itb_batch) {
+        itb = mdsl_itbc_get(msg->tx.arg0, itbid);
+        if (!itb) {
+            err = mdsl_itb_locate(msg->tx.arg0, itbid, &location, &master);
+            if (err == -ENOTEXIST) {
+                /* no range covers this slice */
+                itbid = (itbid | (MDSL_RSC_SLOTS - 1)) + 1;
+                err = 0;
+                continue;
+            } else if (err == -ENOENT) {
+                itbid++;
+                err = 0;
+                continue;
+            } else if (err)
+                break;
+            itb = mdsl_itb_read(msg->tx.arg0, location, master);
+            if (IS_ERR(itb)) {
+                err = PTR_ERR(itb);
+                break;
+            }
+        }
+        iov[nr].iov_base = itb;
+        iov[nr].iov_len = atomic_read(&itb->h.len);
+        total += iov[nr].iov_len;
+        nr++;
+        itbid++;
+    }
+    if (itbid > end)
+        itbid = end;
+    /* reply the loaded ITBs, report the error on the next request */
+    if (nr)
+        err = 0;
+    atomic64_inc(&hmo.prof.mds.itb_batch);
+
+out:
+    if (err) {
+        __mdsl_send_err_rpy(msg, err);
+    } else {
+        rpy = xnet_alloc_msg(XNET_MSG_NORMAL);
+        if (!rpy) {
+            hvfs_err(mdsl, "xnet_alloc_msg() failed\n");
+            for (i = 0; i < nr; i++)
+                xfree(iov[i].iov_base);
+            goto out_free;
+        }
+#ifdef XNET_EAGER_WRITEV
+        xnet_msg_add_sdata(rpy, &rpy->tx, sizeof(struct xnet_msg_tx));
+#endif
+        for (i = 0; i < nr; i++) {
+            xnet_msg_add_sdata(rpy, iov[i].iov_base, iov[i].iov_len);
+        }
+        xnet_msg_fill_tx(rpy, XNET_MSG_RPY, XNET_NEED_DATA_FREE,
+                         hmo.site_id, msg->tx.ssite_id);
+        xnet_msg_fill_reqno(rpy, msg->tx.reqno);
+        xnet_msg_fill_cmd(rpy, XNET_RPY_DATA, itbid, nr);
+        /* match the original request at the source site */
+        rpy->tx.handle = msg->tx.handle;
+
+        if (xnet_send(hmo.xc, rpy)) {
+            hvfs_err(mdsl, "xnet_send() failed\n");
+        }
+        xnet_free_msg(rpy);
+    }
+
+out_free:
+    xfree(iov);
+    xnet_set_auto_free(msg);
+    xnet_free_msg(msg);
+}
+
 static inline
 int __bmmap_find_nr(union bmmap_disk *bd, int nr)
 {
@@ -492,7 +613,7 @@ void mdsl_bitmap(struct xnet_msg *msg)
     }
     /* Step 3: prepare the reply and send it */
 out_reply:
-    __mdsl_send_rpy_data(msg, &iov, 1, 0);
+    __mdsl_send_rpy_data(msg, &iov, 1, NULL, 0);
     
 out_put:    
     mdsl_storage_fd_put(fde);
@@ -992,66 +1113,94 @@ void mdsl_wbtxg(struct xnet_msg *msg)
     if (msg->tx.arg0 & HVFS_WBTXG_ITB) {
         struct itb *i;
         struct txg_open_entry *toe;
+        int err = 0, ret;
         
         /* sanity checking */
         if (len < sizeof(struct itbh)) {
             hvfs_err(mdsl, "Invalid WBTXG request %d received from %lx\n",
                      msg->tx.reqno, msg->tx.ssite_id);
+            if ((msg->tx.flag & XNET_NEED_REPLY) &&
+                !(msg->tx.arg0 & HVFS_WBTXG_BEGIN))
+                __mdsl_send_err_rpy(msg, -EINVAL);
             goto out;
         }
-        if (data) {
+        /* Note that, one frame may carry a batch of ITBs packed back to
+         * back, we iterate on them by the ITB length */
+        toe = toe_lookup(msg->tx.ssite_id, msg->tx.arg1);
+        while (data && len >= sizeof(struct itbh)) {
             struct itb_info *ii;
             
             i = data;
+            if (atomic_read(&i->h.len) < sizeof(struct itbh) ||
+                atomic_read(&i->h.len) > len) {
+                hvfs_err(mdsl, "Invalid ITB length %d in WBTXG request %d "
+                         "from %lx\n", atomic_read(&i->h.len),
+                         msg->tx.reqno, msg->tx.ssite_id);
+                err = -EINVAL;
+                break;
+            }
             hvfs_warning(mdsl, "Recv commited ITB %ld from site %lx\n",
                          i->h.itbid, msg->tx.ssite_id);
 
             /* find the toe now */
-            toe = toe_lookup(msg->tx.ssite_id, msg->tx.arg1);
             if (!toe) {
                 hvfs_err(mdsl, "ITB %ld[%ld] toe lookup <%lx,%ld> failed\n",
                          i->h.itbid, i->h.puuid, msg->tx.ssite_id, 
                          msg->tx.arg1);
-                toe_to_tmpfile(TXG_OPEN_ENTRY_DISK_ITB,
-                               msg->tx.ssite_id, msg->tx.arg1,
-                               i);
+                if (toe_to_tmpfile(TXG_OPEN_ENTRY_DISK_ITB,
+                                   msg->tx.ssite_id, msg->tx.arg1,
+                                   i))
+                    err = -EIO;
                 goto end_itb;
             }
 
             ii = xzalloc(sizeof(struct itb_info));
             if (!ii) {
                 hvfs_warning(mdsl, "xzalloc() itb_info failed\n");
-            } else
-                INIT_LIST_HEAD(&ii->list);
+                err = -ENOMEM;
+                goto end_itb;
+            }
+            INIT_LIST_HEAD(&ii->list);
 
             /* append the ITB to disk file, get the location and filling the
              * itb_info */
             ii->duuid = i->h.puuid;
             ii->itbid = i->h.itbid;
-            if (itb_append(i, ii, msg->tx.ssite_id, msg->tx.arg1)) {
+            ret = itb_append(i, ii, msg->tx.ssite_id, msg->tx.arg1);
+            if (ret < 0) {
                 hvfs_err(mdsl, "Append itb <%lx.%ld.%ld> to disk file failed\n",
                          msg->tx.ssite_id, msg->tx.arg1, i->h.itbid);
                 xfree(ii);
+                err = -EIO;
+                goto end_itb;
+            } else if (ret > 0) {
+                /* spilled to the temp file, reload it on TXG_END */
+                xfree(ii);
                 goto end_itb;
             }
             
             /* save the itb_info to open entry */
-            if (ii) {
-                xlock_lock(&toe->itb_lock);
-                list_add_tail(&ii->list, &toe->itb);
-                xlock_unlock(&toe->itb_lock);
-                atomic_inc(&toe->itb_nr);
-            }
+            xlock_lock(&toe->itb_lock);
+            list_add_tail(&ii->list, &toe->itb);
+            xlock_unlock(&toe->itb_lock);
+            mdsl_gc_append_end(ii);
+            mdsl_segment_append_end(ii);
+            atomic_inc(&toe->itb_nr);
         end_itb:
             /* adjust the data pointer */
-            data += atomic_read(&i->h.len);
             len -= atomic_read(&i->h.len);
+            data += atomic_read(&i->h.len);
         }
+        /* the batched ITB frames need a reply after all the ITBs are
+         * appended, while the TXG_BEGIN frame has been replied above */
+        if ((msg->tx.flag & XNET_NEED_REPLY) &&
+            !(msg->tx.arg0 & HVFS_WBTXG_BEGIN))
+            __mdsl_send_err_rpy(msg, err);
     }
     if (msg->tx.arg0 & HVFS_WBTXG_END) {
         struct txg_end *te;
         struct txg_open_entry *toe;
-        int err = 0, abort = 0;
+        int err = 0, abort = 0, spilled = 0;
 
         if (len < sizeof(struct txg_end)) {
             hvfs_err(mdsl, "Invalid WBTXG END request %d received from %lx\n",
@@ -1084,11 +1233,19 @@ void mdsl_wbtxg(struct xnet_msg *msg)
             /* find the toe now */
             toe = toe_lookup(te->site_id, te->txg);
             if (!toe) {
-                hvfs_err(mdsl, "txg_end [%ld,%ld] toe lookup failed\n",
-                         te->site_id, te->txg);
-                toe_to_tmpfile(TXG_OPEN_ENTRY_DISK_END,
-                               te->site_id, te->txg, te);
-                goto out_complete;
+                /* the TXG_BEGIN may be spilled to the temp file */
+                toe = toe_from_tmpfile(te->site_id, te->txg);
+                if (IS_ERR(toe)) {
+                    hvfs_err(mdsl, "txg_end [%ld,%ld] toe lookup failed\n",
+                             te->site_id, te->txg);
+                    err = PTR_ERR(toe);
+                    goto out_reply;
+                }
+                spilled = 1;
+            } else {
+                /* reload the ITBs spilled by itb_append() */
+                if (toe_load_tmpfile(te->site_id, te->txg, toe, NULL) > 0)
+                    spilled = 1;
             }
 
             /* ok, check the itb_nr now */
@@ -1125,6 +1282,10 @@ void mdsl_wbtxg(struct xnet_msg *msg)
                 hvfs_err(mdsl, "TXG %ld wb aborted by %d from site %lx\n",
                          te->txg, abort, te->site_id);
             }
+            /* mark the spilled records committed for the restart replay */
+            if (spilled)
+                toe_to_tmpfile(TXG_OPEN_ENTRY_DISK_END, te->site_id,
+                               te->txg, te);
         out_complete:
             toe_deactive(toe);
             xcond_lock(&toe->wcond);
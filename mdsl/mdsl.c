@@ -174,6 +174,17 @@ void mdsl_hb_wrapper(time_t t)
     hmo.cb_hb(&hmo);
 }
 
+void mdsl_segment_wrapper(time_t t)
+{
+    static time_t prev = 0;
+
+    if (t < prev + hmo.conf.gc_interval)
+        return;
+    prev = t;
+    mdsl_segment_clean();
+    mdsl_gc_online();
+}
+
 static void *mdsl_timer_thread_main(void *arg)
 {
     sigset_t set;
@@ -203,6 +214,8 @@ static void *mdsl_timer_thread_main(void *arg)
         mdsl_storage_pending_io();
         /* check the fd hash table */
         mdsl_storage_fd_limit_check(cur);
+        /* clean the segments or the itb files incrementally */
+        mdsl_segment_wrapper(cur);
         /* keep page cache clean if there are a lot of page cache entries */
         mdsl_storage_fd_pagecache_cleanup();
         /* do heart beat */
@@ -355,6 +368,7 @@ int mdsl_config(void)
     HVFS_MDSL_GET_ENV_cpy(log_file, value);
 
     HVFS_MDSL_GET_ENV_atoi(spool_threads, value);
+    HVFS_MDSL_GET_ENV_atoi(xnet_pollin_nr, value);
     HVFS_MDSL_GET_ENV_atoi(ring_vid_max, value);
     HVFS_MDSL_GET_ENV_atoi(tcc_size, value);
     HVFS_MDSL_GET_ENV_atoi(prof_plot, value);
@@ -369,15 +383,30 @@ int mdsl_config(void)
     HVFS_MDSL_GET_ENV_atoi(disk_low_load, value);
     HVFS_MDSL_GET_ENV_atoi(aio_expect_bw, value);
     HVFS_MDSL_GET_ENV_atoi(expection, value);
+    HVFS_MDSL_GET_ENV_atoi(aio_threads, value);
+    HVFS_MDSL_GET_ENV_atoi(aio_qdepth, value);
 
     HVFS_MDSL_GET_kmg(memlimit, value);
     HVFS_MDSL_GET_kmg(pcct, value);
     HVFS_MDSL_GET_ENV_atol(fdlimit, value);
     HVFS_MDSL_GET_ENV_atol(mclimit, value);
+    HVFS_MDSL_GET_ENV_atol(segment_size, value);
+    HVFS_MDSL_GET_ENV_atol(segment_clean_bytes, value);
+    HVFS_MDSL_GET_ENV_atoi(segment_clean_ratio, value);
+    HVFS_MDSL_GET_ENV_atol(gc_bytes, value);
+    HVFS_MDSL_GET_ENV_atoi(gc_ratio, value);
+    HVFS_MDSL_GET_ENV_atoi(rsc_size, value);
+    HVFS_MDSL_GET_ENV_atoi(ra_max, value);
+    HVFS_MDSL_GET_ENV_atol(ra_cache, value);
+    HVFS_MDSL_GET_ENV_atol(itb_batch, value);
 
     HVFS_MDSL_GET_ENV_option(write_drop, WDROP, value);
     HVFS_MDSL_GET_ENV_option(memlimit, MEMLIMIT, value);
     HVFS_MDSL_GET_ENV_option(radical_del, RADICAL_DEL, value);
+    HVFS_MDSL_GET_ENV_option(segment, SEGMENT, value);
+    HVFS_MDSL_GET_ENV_option(aio_nouring, AIO_NOURING, value);
+    HVFS_MDSL_GET_ENV_option(online_gc, ONLINE_GC, value);
+    HVFS_MDSL_GET_ENV_option(no_ra, NO_RA, value);
 
     /* set default mdsl home */
     if (!hmo.conf.mdsl_home) {
@@ -427,6 +456,21 @@ int mdsl_config(void)
         hmo.conf.pcct = (1UL << 32); /* 4GB */
 #endif
 
+    /* set default segment store configs */
+    if (!hmo.conf.segment_size)
+        hmo.conf.segment_size = MDSL_SEGMENT_DEFAULT_SIZE;
+    if (!hmo.conf.segment_clean_bytes)
+        hmo.conf.segment_clean_bytes = MDSL_SEGMENT_CLEAN_BYTES;
+    if (hmo.conf.segment_clean_ratio <= 0 ||
+        hmo.conf.segment_clean_ratio > 100)
+        hmo.conf.segment_clean_ratio = MDSL_SEGMENT_CLEAN_RATIO;
+
+    /* set default online GC configs */
+    if (!hmo.conf.gc_bytes)
+        hmo.conf.gc_bytes = MDSL_GC_BYTES;
+    if (hmo.conf.gc_ratio <= 0 || hmo.conf.gc_ratio > 100)
+        hmo.conf.gc_ratio = MDSL_GC_RATIO;
+
     /* set default disk low load to 1MB/10s */
     if (!hmo.conf.disk_low_load)
         hmo.conf.disk_low_load = (1 << 20);
@@ -450,6 +494,7 @@ void mdsl_help(void)
                " hvfs_mdsl_conf_file            config file name.\n"
                " hvfs_mdsl_log_file             log file name.\n"
                " hvfs_mdsl_spool_threads        spool threads nr.\n"
+               " hvfs_mdsl_xnet_pollin_nr       xnet poll-in threads nr.\n"
                " hvfs_mdsl_ring_vid_max         max virtual id for each site.\n"
                " hvfs_mdsl_tcc_size             TCC cache size.\n"
                " hvfs_mdsl_prof_plot            output for gnuplot.\n"
@@ -457,6 +502,12 @@ void mdsl_help(void)
                "                                wakeup interval for prof thread.\n"
                " hvfs_mdsl_gc_interval          wakeup interval for gc thread.\n"
                " hvfs_mdsl_opt_write_drop       drop the writes to this MDSL.\n"
+               " hvfs_mdsl_opt_segment          append ITBs to shared segments.\n"
+               " hvfs_mdsl_opt_online_gc        GC the itb files in background.\n"
+               " hvfs_mdsl_opt_no_ra            do not prefetch the ITBs.\n"
+               " hvfs_mdsl_ra_max               max ITB read-ahead window.\n"
+               " hvfs_mdsl_aio_qdepth           max in-flight AIO requests.\n"
+               " hvfs_mdsl_opt_aio_nouring      use AIO threads, not io_uring.\n"
         );
     hvfs_plain(mdsl, "Any questions please contacts Ma Can <macan@ncic.ac.cn>\n");
 }
@@ -505,6 +556,11 @@ int mdsl_init(void)
     err = mdsl_aio_create();
     if (err)
         goto out_aio;
+
+    /* replay the TOE records spilled to the temp file */
+    err = mdsl_tcc_replay();
+    if (err)
+        goto out_replay;
     
     /* mask the SIGUSR1 signal for main thread */
     {
@@ -518,6 +574,7 @@ int mdsl_init(void)
     /* ok to run */
     hmo.state = HMO_STATE_RUNNING;
 
+out_replay:
 out_aio:
 out_spool:
 out_storage:
@@ -42,6 +42,8 @@ extern u32 hvfs_mdsl_tracing_flags;
 #define MDSL_STORAGE_DEFAULT_CHUNK              (4 * 1024 * 1024)
 #define MDSL_STORAGE_ITB_DEFAULT_CHUNK          (64 * 1024 * 1024)
 #define MDSL_STORAGE_DATA_DEFAULT_CHUNK         (64 * 1024 * 1024)
+/* reads smaller than this are copied, otherwise sent by sendfile() */
+#define MDSL_STORAGE_SENDFILE_MIN               (64 * 1024)
 
 /* mmap window */
 struct mmap_window 
@@ -208,11 +210,18 @@ struct txg_compact_cache
     xlock_t active_lock;
     xlock_t wbed_lock;
     atomic_t size, used;
+    int tmp_ref;                /* # of replayers reading the temp file,
+                                 * protected by storage.tmp_fd_lock */
 };
 
+/* The temp file is an append-only log of the TOE records we can not hold in
+ * memory. Each record is the on-disk part of txg_open_entry_disk (from @type)
+ * followed by @len bytes payload. The in-memory part indexes the records of
+ * the pending TXGs in the tcc.tmp_list. */
 struct txg_open_entry_disk
 {
     struct list_head list;
+    loff_t offset;              /* payload offset in the temp file */
 #define TXG_OPEN_ENTRY_DISK_BEGIN       0x01
 #define TXG_OPEN_ENTRY_DISK_ITB         0x02
 #define TXG_OPEN_ENTRY_DISK_DIR         0x04
@@ -227,10 +236,147 @@ struct txg_open_entry_disk
     u64 txg;
 };
 
+#define TOE_DISK_HDR_OFFSET     offsetof(struct txg_open_entry_disk, type)
+#define TOE_DISK_HDR_SIZE       (sizeof(struct txg_open_entry_disk) - \
+                                 TOE_DISK_HDR_OFFSET)
+#define TOE_DISK_MAX_LEN        (64 * 1024 * 1024)
+
 struct directw_log
 {
 };
 
+/* The segment store appends the ITBs of all the directories to the shared
+ * segment files. The ITB location saved in the range file is the segment id
+ * (starting from 1) and the offset in the segment file, thus the range files
+ * are the index from (duuid, itbid) to the segment offset. The locations w/o
+ * segment id are in the per-directory itb file.
+ */
+#define MDSL_SEGMENT_UUID       0
+#define MDSL_SEGMENT_SHIFT      40
+#define MDSL_SEGMENT_LOC(id, offset)                    \
+    (((u64)(id) << MDSL_SEGMENT_SHIFT) | (offset))
+#define MDSL_SEGMENT_ID(loc)    ((loc) >> MDSL_SEGMENT_SHIFT)
+#define MDSL_SEGMENT_OFFSET(loc)                        \
+    ((loc) & ((1UL << MDSL_SEGMENT_SHIFT) - 1))
+#define MDSL_SEGMENT_DEFAULT_SIZE       (1UL << 30)
+#define MDSL_SEGMENT_CLEAN_BYTES        (64UL << 20)
+#define MDSL_SEGMENT_CLEAN_RATIO        50
+
+struct mdsl_segment_stat
+{
+    u32 nr;                     /* # of ITBs appended */
+    u32 dead;                   /* # of ITBs overwritten */
+};
+
+struct mdsl_segment_mgr
+{
+    xlock_t lock;
+    struct mdsl_segment_stat *stat; /* indexed by the segment id */
+    u64 head;                   /* the segment accepting appends */
+    u64 size;                   /* # of stat entries */
+    u64 victim;                 /* the segment being cleaned */
+    u64 voffset;                /* clean cursor in the victim segment */
+    struct list_head pins;      /* ITBs appended but not in a TOE yet */
+    int loaded;
+};
+
+/* The online GC sweeps the per-directory itb file in slices. The live ITBs
+ * are appended to the file tail again, and the swept slice is punched out
+ * after a grace period. The stats are in-memory, they are rebuilt by the
+ * sweeping after restart. */
+struct mdsl_gc_stat
+{
+    struct hlist_node hlist;
+    u64 duuid;
+    u32 nr;                     /* # of ITBs appended */
+    u32 dead;                   /* # of ITBs overwritten */
+    u32 rnr, rdead;             /* nr and dead when this round started */
+    u32 moved;                  /* # of live ITBs moved in this round */
+    u32 master;                 /* the itb file being swept */
+    u64 cursor;                 /* sweep cursor in the itb file */
+    u64 end;                    /* sweep end of this round */
+    u64 grace;                  /* swept offset of the last pass */
+    u64 punched;                /* reclaimed up to this offset */
+    struct list_head pins;      /* ITBs appended but not in a TOE yet */
+};
+
+struct mdsl_gc_pin
+{
+    struct list_head list;
+    struct itb_info *ii;
+    u64 floor;                  /* the ITB is appended at or after it */
+};
+
+struct mdsl_gc_mgr
+{
+#define MDSL_GC_HBITS           10
+    struct regular_hash *ht;
+    struct mdsl_gc_stat *victim;
+};
+
+/* The range slice cache keeps copies of the hot slices of the range files,
+ * and the read-ahead prefetches the neighbouring ITBs of the sequential ITB
+ * loads of a directory. Both caches are updated by mdsl_itbc_update() on
+ * every range write. */
+#define MDSL_RSC_SHIFT          9
+#define MDSL_RSC_SLOTS          (1UL << MDSL_RSC_SHIFT)
+struct mdsl_rsc_entry
+{
+    struct hlist_node hlist;
+    struct list_head lru;
+    u64 duuid;
+    u64 begin;                  /* first itbid of this slice */
+    u64 lo, hi;                 /* itbids [lo, hi) are covered by the range */
+    u64 master;                 /* itb_master when this slice is copied */
+    u64 loc[MDSL_RSC_SLOTS];
+};
+
+struct mdsl_ra_entry
+{
+    struct hlist_node hlist;
+    struct list_head lru;
+    u64 duuid;
+    u64 itbid;
+    struct itb *itb;            /* the whole ITB w/ itb->h.len bytes */
+};
+
+struct mdsl_ra_state
+{
+    struct hlist_node hlist;
+    struct list_head lru;
+    u64 duuid;
+    u64 last;                   /* last loaded itbid */
+    u64 ra_end;                 /* prefetched up to this itbid */
+    int window;                 /* read-ahead window in itbids */
+};
+
+struct mdsl_ra_req
+{
+    struct list_head list;
+    u64 duuid;
+    u64 begin, end;
+};
+
+struct mdsl_itbc_mgr
+{
+#define MDSL_ITBC_HBITS         10
+    struct hlist_head *rsc;     /* range slices */
+    struct hlist_head *itb;     /* prefetched ITBs */
+    struct hlist_head *ra;      /* read-ahead states */
+    struct list_head rsc_lru, itb_lru, ra_lru;
+    xlock_t rsc_lock, itb_lock, ra_lock;
+    int rsc_nr, ra_nr;
+    u64 itb_bytes;              /* bytes of the prefetched ITBs */
+    atomic64_t seq;             /* bumped on each range change */
+
+    /* the read-ahead thread */
+    struct list_head queue;
+    xlock_t qlock;
+    sem_t qsem;
+    pthread_t thread;
+    int stop;
+};
+
 struct mdsl_storage
 {
 #define MDSL_STORAGE_FDHASH_SIZE        2048
@@ -267,12 +413,22 @@ struct mdsl_conf
     /* NOTE: # of profiling thread is always ONE */
     int spool_threads;          /* # of service threads */
     int aio_threads;            /* # of io threads */
+    int xnet_pollin_nr;         /* # of xnet poll-in threads */
 
     /* misc configs */
     u64 memlimit;               /* memlimit of the TCC */
     u64 fdlimit;                /* fd limit of the mem cache */
     u64 mclimit;                /* memcache threshold */
     u64 pcct;                   /* pagecache cleanup threshold */
+    u64 segment_size;           /* seal the head segment at this size */
+    u64 segment_clean_bytes;    /* bytes scanned by each cleaning pass */
+    int segment_clean_ratio;    /* clean the segment w/ more dead ITBs (%) */
+    u64 gc_bytes;               /* bytes swept by each online GC pass */
+    int gc_ratio;               /* GC the itb file w/ more dead ITBs (%) */
+    u64 ra_cache;               /* memory limit of the prefetched ITBs */
+    u64 itb_batch;              /* max bytes of a batched ITB load reply */
+    int ra_max;                 /* max read-ahead window in itbids */
+    int rsc_size;               /* # of cached range slices */
     int itb_falloc;             /* # of itb file chunk to pre-alloc */
     int ring_vid_max;           /* max # of vid in the ring(AUTO) */
     int tcc_size;               /* # of tcc cache size */
@@ -291,6 +447,7 @@ struct mdsl_conf
     int rread_max;              /* the concurrent random read max value */
     u32 aio_sync_len;           /* sync chunnk size for AIO */
     u32 aio_expect_bw;          /* user expected IO bandwidth per disk */
+    int aio_qdepth;             /* max # of in-flight AIO requests */
 #define MDSL_PROF_NONE          0x00
 #define MDSL_PROF_PLOT          0x01
 #define MDSL_PROF_HUMAN         0x02
@@ -307,6 +464,12 @@ struct mdsl_conf
 #define HVFS_MDSL_MEMLIMIT      0x02 /* limit the TCC memory usage */
 #define HVFS_MDSL_RADICAL_DEL   0x04 /* radical delete the memory resource for
                                       * deleted directory */
+#define HVFS_MDSL_SEGMENT       0x08 /* append the ITBs to the shared segment
+                                      * files */
+#define HVFS_MDSL_AIO_NOURING   0x10 /* use the AIO threads even if io_uring
+                                      * is available */
+#define HVFS_MDSL_ONLINE_GC     0x20 /* GC the itb files in background */
+#define HVFS_MDSL_NO_RA         0x40 /* do not prefetch the ITBs */
     u64 option;
 };
 
@@ -318,6 +481,9 @@ struct hvfs_mdsl_object
     struct txg_compact_cache tcc;
     struct mdsl_storage storage;
     struct directw_log dl;
+    struct mdsl_segment_mgr segment;
+    struct mdsl_gc_mgr gc;
+    struct mdsl_itbc_mgr itbc;
 
 #define CH_RING_NUM     3
 #define CH_RING_MDS     0
@@ -388,7 +554,8 @@ extern atomic_t itb_loads;
 static inline
 int mdsl_dispatch_check(struct xnet_msg *msg)
 {
-    if (msg->tx.cmd == HVFS_MDS2MDSL_ITB) {
+    if (msg->tx.cmd == HVFS_MDS2MDSL_ITB ||
+        msg->tx.cmd == HVFS_MDS2MDSL_ITB_BATCH) {
         if (atomic_inc_return(&itb_loads) >= hmo.conf.spool_threads) {
             atomic_dec(&itb_loads);
             return 1;
@@ -400,6 +567,7 @@ int mdsl_dispatch_check(struct xnet_msg *msg)
 
 /* m2ml.c */
 void mdsl_itb(struct xnet_msg *);
+void mdsl_itb_batch(struct xnet_msg *);
 void mdsl_bitmap(struct xnet_msg *);
 void mdsl_wbtxg(struct xnet_msg *);
 void mdsl_wdata(struct xnet_msg *);
@@ -425,6 +593,11 @@ void toe_put(struct txg_open_entry *);
 int itb_append(struct itb *, struct itb_info *, u64, u64);
 int toe_to_tmpfile(int, u64, u64, void *);
 int toe_to_tmpfile_N(int, u64, u64, void *, int);
+int toe_load_tmpfile(u64, u64, struct txg_open_entry *, struct txg_end *);
+struct txg_open_entry *toe_from_tmpfile(u64, u64);
+int mdsl_tcc_replay(void);
+u64 toe_pending_location(u64, u32);
+u64 toe_pending_segment(void);
 void toe_active(struct txg_open_entry *);
 void toe_deactive(struct txg_open_entry *);
 void toe_wait(struct txg_open_entry *, int);
@@ -440,6 +613,7 @@ void toe_wait(struct txg_open_entry *, int);
 #define MDSL_STORAGE_ITB_ODIRECT        0x0005
 #define MDSL_STORAGE_BITMAP     0x0006
 #define MDSL_STORAGE_NORMAL     0x0007
+#define MDSL_STORAGE_SEGMENT    0x0008
 
 #define MDSL_STORAGE_LOG        0x0100
 #define MDSL_STORAGE_SPLIT_LOG  0x0200
@@ -458,7 +632,14 @@ struct fdhash_entry *mdsl_storage_fd_lookup_create(u64, int, u64);
 static inline
 void mdsl_storage_fd_put(struct fdhash_entry *fde)
 {
-    atomic_dec(&fde->ref);
+    if (unlikely(fde->type == MDSL_STORAGE_SEGMENT)) {
+        /* __segment_release() waits for the last reference */
+        xcond_lock(&fde->cond);
+        if (atomic_dec_return(&fde->ref) == 1)
+            xcond_broadcast(&fde->cond);
+        xcond_unlock(&fde->cond);
+    } else
+        atomic_dec(&fde->ref);
 }
 void mdsl_storage_pending_io(void);
 int mdsl_storage_clean_dir(u64);
@@ -470,10 +651,14 @@ int mdsl_storage_fd_write(struct fdhash_entry *fde,
                           struct mdsl_storage_access *msa);
 int mdsl_storage_fd_read(struct fdhash_entry *fde, 
                          struct mdsl_storage_access *msa);
+int mdsl_storage_fd_sendfile(struct fdhash_entry *fde, loff_t offset,
+                             size_t len);
 int mdsl_storage_dir_make_exist(char *path);
 int __range_lookup(u64, u64, struct mmap_args *, u64 *);
 int __range_write(u64, u64, struct mmap_args *, u64);
 int __range_write_conditional(u64, u64, struct mmap_args *, u64);
+int __range_write_cas(u64, u64, struct mmap_args *, u64, u64);
+int __range_read_slice(u64, struct mmap_args *, u64, u64, u64 *);
 int __mdisk_lookup(struct fdhash_entry *, int, u64, range_t **);
 int __mdisk_add_range(struct fdhash_entry *, u64, u64, u64);
 int mdsl_storage_toe_commit(struct txg_open_entry *, struct txg_end *);
@@ -492,6 +677,7 @@ int __mdisk_lookup_nolock(struct fdhash_entry *fde, int op, u64 arg,
 int __mdisk_add_range_nolock(struct fdhash_entry *fde, u64 begin, u64 end, 
                              u64 range_id);
 void __mdisk_range_sort(void *ranges, size_t size);
+void append_buf_destroy(struct fdhash_entry *fde);
 int append_buf_destroy_async(struct fdhash_entry *fde);
 
 /* defines for buf flush */
@@ -519,6 +705,41 @@ int mdsl_aio_submit_request(void *addr, u64 len, u64, loff_t, int, int);
 void mdsl_aio_start(void);
 
 /* gc.c */
+#define MDSL_GC_BYTES           (16UL << 20)
+#define MDSL_GC_RATIO           50
+#define MDSL_GC_MIN_DEAD        16
 int mdsl_gc_md(u64);
+int mdsl_gc_init(void);
+void mdsl_gc_destroy(void);
+void mdsl_gc_itb_append(u64);
+void mdsl_gc_itb_dead(u64);
+int mdsl_gc_append_begin(struct itb_info *, u64);
+void mdsl_gc_append_end(struct itb_info *);
+int mdsl_gc_online(void);
+
+/* itbc.c */
+#define MDSL_RSC_SIZE           1024
+#define MDSL_RA_CACHE           (64UL << 20)
+#define MDSL_RA_MIN             16
+#define MDSL_RA_MAX             256
+#define MDSL_RA_STATES          1024
+#define MDSL_ITB_BATCH          (4UL << 20)
+#define MDSL_ITB_BATCH_NR       512 /* bounded by IOV_MAX */
+int mdsl_itbc_init(void);
+void mdsl_itbc_destroy(void);
+int mdsl_itb_locate(u64, u64, u64 *, u64 *);
+struct itb *mdsl_itb_read(u64, u64, u64);
+struct itb *mdsl_itbc_get(u64, u64);
+void mdsl_itbc_access(u64, u64);
+void mdsl_itbc_update(u64, u64, u64);
+void mdsl_itbc_invalidate(u64);
+
+/* segment.c */
+int mdsl_segment_write(struct itb *, struct itb_info *);
+void mdsl_segment_append_end(struct itb_info *);
+struct fdhash_entry *mdsl_segment_itb_fd(u64, u64, u64 *);
+void mdsl_segment_dead(u64);
+int mdsl_segment_clean(void);
+void mdsl_segment_destroy(void);
 
 #endif
@@ -223,17 +223,40 @@ void dump_profiling_human(time_t t)
     
     if (hmo.prof.xnet) {
         hvfs_info(mdsl, "%16ld |  XNET Prof: alloc %ld, free %ld, inb %ld, "
-                  "outb %ld, links %ld\n", t,
+                  "outb %ld, sfb %ld, links %ld, mcache %ld/%ld, "
+                  "bcache %ld/%ld\n", t,
                   atomic64_read(&hmo.prof.xnet->msg_alloc),
                   atomic64_read(&hmo.prof.xnet->msg_free),
                   atomic64_read(&hmo.prof.xnet->inbytes),
                   atomic64_read(&hmo.prof.xnet->outbytes),
-                  atomic64_read(&hmo.prof.xnet->active_links));
+                  atomic64_read(&hmo.prof.xnet->sfbytes),
+                  atomic64_read(&hmo.prof.xnet->active_links),
+                  atomic64_read(&hmo.prof.xnet->msg_cache_hit),
+                  atomic64_read(&hmo.prof.xnet->msg_cache_miss),
+                  atomic64_read(&hmo.prof.xnet->buf_cache_hit),
+                  atomic64_read(&hmo.prof.xnet->buf_cache_miss));
     }
-    hvfs_info(mdsl, "%16ld -- MISC Prof: reqin_total %ld, reqin_handle %ld\n",
+    hvfs_info(mdsl, "%16ld -- MISC Prof: reqin_total %ld, reqin_handle %ld, "
+              "tcc_spill %ld, tcc_replay %ld\n",
               t,
               atomic64_read(&hmo.prof.misc.reqin_total),
-              atomic64_read(&hmo.prof.misc.reqin_handle));
+              atomic64_read(&hmo.prof.misc.reqin_handle),
+              atomic64_read(&hmo.prof.misc.tcc_spill),
+              atomic64_read(&hmo.prof.misc.tcc_replay));
+    hvfs_info(mdsl, "%16ld -- GC   Prof: reclaimed %ld, moved %ld, "
+              "stall %ld us\n",
+              t,
+              atomic64_read(&hmo.prof.storage.gc_reclaimed),
+              atomic64_read(&hmo.prof.storage.gc_moved),
+              atomic64_read(&hmo.prof.storage.gc_stall));
+    hvfs_info(mdsl, "%16ld -- ITBC Prof: batch %ld, rsc %ld/%ld, "
+              "ra %ld/%ld\n",
+              t,
+              atomic64_read(&hmo.prof.mds.itb_batch),
+              atomic64_read(&hmo.prof.mds.rsc_hit),
+              atomic64_read(&hmo.prof.mds.rsc_miss),
+              atomic64_read(&hmo.prof.mds.ra_hit),
+              atomic64_read(&hmo.prof.mds.ra_issue));
 }
 
 void mdsl_dump_profiling(time_t t, struct hvfs_profile *hp)
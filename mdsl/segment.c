@@ -0,0 +1,579 @@
+/**
+ * Copyright (c) 2009 Ma Can <ml.macana@gmail.com>
+ *                           <macan@ncic.ac.cn>
+ *
+ * Armed with EMACS.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#include "hvfs.h"
+#include "xnet.h"
+#include "mdsl.h"
+#include <dirent.h>
+
+/* Segment store for ITBs
+ *
+ * With HVFS_MDSL_SEGMENT, the ITBs of all the directories are appended to
+ * the head segment "segment/seg-N". The head segment is sealed when it grows
+ * over conf.segment_size, then a new segment accepts the appends. Thus, only
+ * the head segment holds an append buffer and the # of opened ITB files do
+ * not depend on the # of directories. Note that the md, range and data files
+ * are still per-directory, e.g. the cleaner opens the md file to look up
+ * the range of each ITB.
+ *
+ * The range files still map (duuid, itbid) to the ITB location, while the
+ * location carries the segment id. The segment cleaner moves the live ITBs
+ * of the sealed segment w/ many overwritten ITBs to the head segment, then
+ * unlinks the victim segment.
+ *
+ * The ITBs of the uncommitted TXGs are not in the range files yet, thus the
+ * cleaner never picks or sweeps the segments at or beyond the min segment of
+ * the active TOEs. An ITB is linked to its TOE only after itb_append()
+ * returns, thus mdsl_segment_write() pins the head segment before writing,
+ * and the cleaner never goes beyond the min pin either.
+ */
+
+static
+struct mdsl_segment_stat *__segment_stat(u64 id)
+{
+    struct mdsl_segment_stat *p;
+    u64 size;
+
+    if (id >= hmo.segment.size) {
+        size = max(id + 1, hmo.segment.size << 1);
+        p = xrealloc(hmo.segment.stat, size * sizeof(*p));
+        if (!p) {
+            hvfs_err(mdsl, "xrealloc() segment stat failed\n");
+            return NULL;
+        }
+        memset(p + hmo.segment.size, 0,
+               (size - hmo.segment.size) * sizeof(*p));
+        hmo.segment.stat = p;
+        hmo.segment.size = size;
+    }
+
+    return hmo.segment.stat + id;
+}
+
+/* __segment_save() saves the segment stat, holding the segment lock */
+static
+void __segment_save(void)
+{
+    char path[HVFS_MAX_NAME_LEN] = {0, };
+    long bw, bl = 0, len;
+    int fd;
+
+    sprintf(path, "%s/%lx/segment/stat", HVFS_MDSL_HOME, hmo.site_id);
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        hvfs_err(mdsl, "open file '%s' failed w/ %d\n", path, errno);
+        return;
+    }
+    len = hmo.segment.size * sizeof(struct mdsl_segment_stat);
+    while (bl < len) {
+        bw = pwrite(fd, (void *)hmo.segment.stat + bl, len - bl, bl);
+        if (bw <= 0) {
+            hvfs_err(mdsl, "pwrite to fd %d failed w/ %d\n", fd, errno);
+            break;
+        }
+        bl += bw;
+    }
+    close(fd);
+}
+
+/* __segment_load() finds the segment files and loads the segment stat. The
+ * new appends always go to a new segment. The stat may be stale after a
+ * crash, while the cleaner checks the liveness of each ITB anyway.
+ */
+static
+int __segment_load(void)
+{
+    char path[HVFS_MAX_NAME_LEN] = {0, };
+    struct dirent *ent;
+    struct stat st;
+    DIR *d;
+    u64 id, last = 0;
+    long br, len;
+    int fd, err = 0;
+
+    if (likely(hmo.segment.loaded))
+        return 0;
+
+    xlock_lock(&hmo.segment.lock);
+    if (hmo.segment.loaded)
+        goto out_unlock;
+
+    sprintf(path, "%s/%lx/segment", HVFS_MDSL_HOME, hmo.site_id);
+    err = mdsl_storage_dir_make_exist(path);
+    if (err) {
+        hvfs_err(mdsl, "segment dir %s do not exist %d.\n", path, err);
+        goto out_unlock;
+    }
+    d = opendir(path);
+    if (!d) {
+        hvfs_err(mdsl, "opendir %s failed w/ %d\n", path, errno);
+        err = -errno;
+        goto out_unlock;
+    }
+    while ((ent = readdir(d)) != NULL) {
+        if (sscanf(ent->d_name, "seg-%ld", &id) == 1 && id > last)
+            last = id;
+    }
+    closedir(d);
+
+    if (!__segment_stat(last + 1)) {
+        err = -ENOMEM;
+        goto out_unlock;
+    }
+    sprintf(path, "%s/%lx/segment/stat", HVFS_MDSL_HOME, hmo.site_id);
+    fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        if (!fstat(fd, &st)) {
+            len = min((long)st.st_size, (long)((last + 1) *
+                                               sizeof(struct mdsl_segment_stat)));
+            br = pread(fd, hmo.segment.stat, len, 0);
+            if (br < len) {
+                hvfs_warning(mdsl, "Read segment stat %ld/%ld, ignore it\n",
+                             br, len);
+                memset(hmo.segment.stat, 0,
+                       hmo.segment.size * sizeof(struct mdsl_segment_stat));
+            }
+        }
+        close(fd);
+    }
+    hmo.segment.head = last + 1;
+    hmo.segment.loaded = 1;
+    hvfs_info(mdsl, "Segment store head segment %ld\n", hmo.segment.head);
+
+out_unlock:
+    xlock_unlock(&hmo.segment.lock);
+
+    return err;
+}
+
+/* mdsl_segment_write() appends the ITB to the head segment and fills the
+ * ii->location. The head segment is pinned until the caller links @ii to its
+ * TOE and calls mdsl_segment_append_end().
+ */
+int mdsl_segment_write(struct itb *itb, struct itb_info *ii)
+{
+    struct fdhash_entry *fde;
+    struct iovec itb_iov = {
+        .iov_base = itb,
+        .iov_len = atomic_read(&itb->h.len),
+    };
+    struct mdsl_storage_access msa = {
+        .iov = &itb_iov,
+        .arg = ii,
+        .iov_nr = 1,
+    };
+    struct mdsl_segment_stat *st;
+    struct mdsl_gc_pin *pin;
+    u64 head, offset;
+    int err, sealed = 0;
+
+    err = __segment_load();
+    if (err)
+        return err;
+
+    pin = xzalloc(sizeof(*pin));
+    if (!pin) {
+        hvfs_err(mdsl, "xzalloc() segment pin failed\n");
+        return -ENOMEM;
+    }
+    INIT_LIST_HEAD(&pin->list);
+    pin->ii = ii;
+    xlock_lock(&hmo.segment.lock);
+    head = hmo.segment.head;
+    pin->floor = head;
+    list_add_tail(&pin->list, &hmo.segment.pins);
+    ii->seg_pin = 1;
+    xlock_unlock(&hmo.segment.lock);
+
+    fde = mdsl_storage_fd_lookup_create(MDSL_SEGMENT_UUID,
+                                        MDSL_STORAGE_SEGMENT, head);
+    if (IS_ERR(fde)) {
+        hvfs_err(mdsl, "lookup create segment %ld failed w/ %ld\n",
+                 head, PTR_ERR(fde));
+        mdsl_segment_append_end(ii);
+        return PTR_ERR(fde);
+    }
+    err = mdsl_storage_fd_write(fde, &msa);
+    if (err) {
+        hvfs_err(mdsl, "storage_fd_write failed w/ %d\n", err);
+        mdsl_storage_fd_put(fde);
+        mdsl_segment_append_end(ii);
+        return err;
+    }
+    offset = mdsl_storage_fd_max_offset(fde);
+    mdsl_storage_fd_put(fde);
+
+    xlock_lock(&hmo.segment.lock);
+    st = __segment_stat(MDSL_SEGMENT_ID(ii->location));
+    if (st)
+        st->nr++;
+    if (offset != -1UL && offset >= hmo.conf.segment_size &&
+        head == hmo.segment.head) {
+        /* seal the head segment, the next append goes to a new one */
+        hmo.segment.head++;
+        __segment_save();
+        sealed = 1;
+    }
+    xlock_unlock(&hmo.segment.lock);
+    if (sealed) {
+        hvfs_info(mdsl, "Seal segment %ld w/ %ld bytes\n", head, offset);
+    }
+
+    /* accumulate to hmi */
+    atomic64_add(itb_iov.iov_len, &hmi.mi_bused);
+
+    return 0;
+}
+
+void mdsl_segment_append_end(struct itb_info *ii)
+{
+    struct mdsl_gc_pin *pin;
+
+    if (!ii->seg_pin)
+        return;
+    ii->seg_pin = 0;
+
+    xlock_lock(&hmo.segment.lock);
+    list_for_each_entry(pin, &hmo.segment.pins, list) {
+        if (pin->ii == ii) {
+            list_del(&pin->list);
+            xfree(pin);
+            break;
+        }
+    }
+    xlock_unlock(&hmo.segment.lock);
+}
+
+/* the clean limit of the ITBs in flight, holding the segment lock */
+static
+u64 __segment_append_lwm(void)
+{
+    struct mdsl_gc_pin *pin;
+    u64 lwm = -1UL;
+
+    list_for_each_entry(pin, &hmo.segment.pins, list) {
+        if (pin->floor < lwm)
+            lwm = pin->floor;
+    }
+
+    return lwm;
+}
+
+/* mdsl_segment_itb_fd() returns the fde holding the ITB @location, and
+ * converts @location to the offset in the file.
+ */
+struct fdhash_entry *mdsl_segment_itb_fd(u64 duuid, u64 master,
+                                         u64 *location)
+{
+    u64 id = MDSL_SEGMENT_ID(*location);
+
+    if (!id)
+        return mdsl_storage_fd_lookup_create(duuid, MDSL_STORAGE_ITB,
+                                             master);
+    *location = MDSL_SEGMENT_OFFSET(*location);
+
+    return mdsl_storage_fd_lookup_create(MDSL_SEGMENT_UUID,
+                                         MDSL_STORAGE_SEGMENT, id);
+}
+
+/* mdsl_segment_dead() accounts the overwritten ITB @location */
+void mdsl_segment_dead(u64 location)
+{
+    struct mdsl_segment_stat *st;
+
+    if (!MDSL_SEGMENT_ID(location) || __segment_load())
+        return;
+
+    xlock_lock(&hmo.segment.lock);
+    st = __segment_stat(MDSL_SEGMENT_ID(location));
+    if (st && st->dead < st->nr)
+        st->dead++;
+    xlock_unlock(&hmo.segment.lock);
+}
+
+/* pick the sealed segment below @limit w/ the max dead ratio, holding the
+ * segment lock. Skip the segment just sealed, the appenders may still be
+ * writing it. */
+static
+u64 __segment_pick_victim(u64 limit)
+{
+    struct mdsl_segment_stat *st;
+    u64 id, victim = 0;
+    u32 best = 0, ratio;
+
+    for (id = 1; id + 1 < hmo.segment.head && id < limit; id++) {
+        st = hmo.segment.stat + id;
+        if (!st->nr)
+            continue;
+        ratio = (u64)st->dead * 100 / st->nr;
+        if (ratio >= hmo.conf.segment_clean_ratio && ratio > best) {
+            best = ratio;
+            victim = id;
+        }
+    }
+
+    return victim;
+}
+
+static
+int __segment_itb_lookup(u64 duuid, u64 itbid, struct mmap_args *ma,
+                         u64 *location)
+{
+    char path[HVFS_MAX_NAME_LEN] = {0, };
+    struct fdhash_entry *fde;
+    range_t *range;
+    int err = 0;
+
+    /* do not recreate the deleted directory */
+    sprintf(path, "%s/%lx/%lx", HVFS_MDSL_HOME, hmo.site_id, duuid);
+    if (access(path, F_OK))
+        return -ENOENT;
+
+    fde = mdsl_storage_fd_lookup_create(duuid, MDSL_STORAGE_MD, 0);
+    if (IS_ERR(fde)) {
+        hvfs_err(mdsl, "lookup create MD file failed w/ %ld\n",
+                 PTR_ERR(fde));
+        return PTR_ERR(fde);
+    }
+    if (!fde->mdisk.ranges && !fde->mdisk.new_range) {
+        err = -ENOENT;
+        goto out_put;
+    }
+    err = __mdisk_lookup(fde, MDSL_MDISK_RANGE, itbid, &range);
+    if (err)
+        goto out_put;
+    ma->win = MDSL_STORAGE_DEFAULT_RANGE_SIZE;
+    ma->foffset = 0;
+    ma->range_id = range->range_id;
+    ma->range_begin = range->begin;
+    ma->flag = MA_OFFICIAL;
+
+    err = __range_lookup(duuid, itbid, ma, location);
+
+out_put:
+    mdsl_storage_fd_put(fde);
+
+    return err;
+}
+
+/* release the cleaned segment, return 1 if the segment is busy */
+static
+int __segment_release(struct fdhash_entry *fde, u64 id)
+{
+    char path[HVFS_MAX_NAME_LEN] = {0, };
+
+    if (atomic_read(&fde->ref) > 1)
+        return 1;
+    mdsl_storage_fd_remove(fde);
+    /* wait for the readers who got the fde before removing, they wake us
+     * up in mdsl_storage_fd_put() */
+    xcond_lock(&fde->cond);
+    while (atomic_read(&fde->ref) > 1)
+        xcond_wait(&fde->cond);
+    xcond_unlock(&fde->cond);
+    if (fde->state == FDE_ABUF)
+        append_buf_destroy(fde);
+    close(fde->fd);
+    xfree(fde);
+
+    sprintf(path, "%s/%lx/segment/seg-%ld", HVFS_MDSL_HOME, hmo.site_id, id);
+    if (unlink(path) < 0) {
+        hvfs_err(mdsl, "unlink segment %s failed w/ %d\n", path, errno);
+    }
+
+    return 0;
+}
+
+/* mdsl_segment_clean() scans at most conf.segment_clean_bytes of the victim
+ * segment in each call, the cursor is saved for the next call.
+ */
+int mdsl_segment_clean(void)
+{
+    struct fdhash_entry *fde;
+    struct mmap_args ma = {0, };
+    struct iovec iov;
+    struct mdsl_storage_access msa = {
+        .iov = &iov,
+        .iov_nr = 1,
+    };
+    struct itb_info ii;
+    struct itbh h;
+    struct itb *itb = NULL;
+    u64 id, offset, end, location, cur, limit, budget = 0;
+    int moved = 0, dead = 0, len, err = 0;
+
+    if (!(hmo.conf.option & HVFS_MDSL_SEGMENT))
+        return 0;
+    err = __segment_load();
+    if (err)
+        return err;
+
+    /* Step 1: pick the victim segment below the pending ITBs */
+    limit = toe_pending_segment();
+    xlock_lock(&hmo.segment.lock);
+    limit = min(limit, __segment_append_lwm());
+    if (!hmo.segment.victim) {
+        hmo.segment.victim = __segment_pick_victim(limit);
+        hmo.segment.voffset = 0;
+    }
+    id = hmo.segment.victim;
+    offset = hmo.segment.voffset;
+    xlock_unlock(&hmo.segment.lock);
+    if (!id)
+        return 0;
+    if (id >= limit) {
+        /* retry in the next call after the TXGs are committed */
+        hvfs_debug(mdsl, "Segment %ld has pending ITBs, delay cleaning\n",
+                   id);
+        return 0;
+    }
+
+    fde = mdsl_storage_fd_lookup_create(MDSL_SEGMENT_UUID,
+                                        MDSL_STORAGE_SEGMENT, id);
+    if (IS_ERR(fde)) {
+        hvfs_err(mdsl, "lookup create segment %ld failed w/ %ld\n",
+                 id, PTR_ERR(fde));
+        err = PTR_ERR(fde);
+        if (err == -ENOENT)
+            goto out_reset;
+        return err;
+    }
+    end = mdsl_storage_fd_max_offset(fde);
+    if (end == -1UL) {
+        err = -EINVAL;
+        goto out_put;
+    }
+
+    /* Step 2: move the live ITBs to the head segment */
+    while (offset + sizeof(h) <= end &&
+           budget < hmo.conf.segment_clean_bytes) {
+        iov.iov_base = &h;
+        iov.iov_len = sizeof(h);
+        msa.offset = offset;
+        err = mdsl_storage_fd_read(fde, &msa);
+        if (err)
+            goto out_put;
+        len = atomic_read(&h.len);
+        if (!len) {
+            /* the padding left by append_buf_destroy() */
+            offset = PAGE_ROUNDUP(offset + 1, getpagesize());
+            continue;
+        }
+        if (len < sizeof(h) || offset + len > end) {
+            hvfs_err(mdsl, "Invalid ITB length %d in segment %ld @ %ld, "
+                     "skip the tail\n", len, id, offset);
+            offset = end;
+            break;
+        }
+        budget += len;
+        location = MDSL_SEGMENT_LOC(id, offset);
+        if (__segment_itb_lookup(h.puuid, h.itbid, &ma, &cur) ||
+            cur != location) {
+            dead++;
+            offset += len;
+            continue;
+        }
+
+        itb = xmalloc(len);
+        if (!itb) {
+            hvfs_err(mdsl, "xmalloc() ITB buffer failed\n");
+            err = -ENOMEM;
+            goto out_put;
+        }
+        iov.iov_base = itb;
+        iov.iov_len = len;
+        msa.offset = offset;
+        err = mdsl_storage_fd_read(fde, &msa);
+        if (err)
+            goto out_free;
+        memset(&ii, 0, sizeof(ii));
+        ii.duuid = h.puuid;
+        ii.itbid = h.itbid;
+        err = mdsl_segment_write(itb, &ii);
+        if (err)
+            goto out_free;
+        /* the range may be updated by mdsl_storage_update_range() since
+         * the lookup, then our copy is dead */
+        err = __range_write_cas(h.puuid, h.itbid, &ma, location,
+                                ii.location);
+        mdsl_segment_append_end(&ii);
+        if (err == -EAGAIN) {
+            mdsl_segment_dead(ii.location);
+            err = 0;
+        }
+        xfree(itb);
+        itb = NULL;
+        if (err)
+            goto out_put;
+        moved++;
+        offset += len;
+    }
+
+    hvfs_info(mdsl, "Clean segment %ld @ %ld/%ld: moved %d, dead %d ITBs\n",
+              id, offset, end, moved, dead);
+    if (offset < end)
+        goto out_put;
+
+    /* Step 3: release the victim segment */
+    if (__segment_release(fde, id)) {
+        /* busy, retry in the next call */
+        goto out_put;
+    }
+out_reset:
+    xlock_lock(&hmo.segment.lock);
+    memset(hmo.segment.stat + id, 0, sizeof(struct mdsl_segment_stat));
+    hmo.segment.victim = 0;
+    hmo.segment.voffset = 0;
+    __segment_save();
+    xlock_unlock(&hmo.segment.lock);
+
+    return 0;
+
+out_free:
+    xfree(itb);
+out_put:
+    mdsl_storage_fd_put(fde);
+    xlock_lock(&hmo.segment.lock);
+    hmo.segment.voffset = offset;
+    xlock_unlock(&hmo.segment.lock);
+
+    return err;
+}
+
+void mdsl_segment_destroy(void)
+{
+    struct mdsl_gc_pin *pin, *n;
+
+    if (!hmo.segment.loaded)
+        return;
+
+    xlock_lock(&hmo.segment.lock);
+    list_for_each_entry_safe(pin, n, &hmo.segment.pins, list) {
+        list_del(&pin->list);
+        xfree(pin);
+    }
+    __segment_save();
+    xfree(hmo.segment.stat);
+    hmo.segment.stat = NULL;
+    hmo.segment.loaded = 0;
+    xlock_unlock(&hmo.segment.lock);
+}
@@ -108,7 +108,8 @@ int append_buf_create(struct fdhash_entry *fde, char *name, int state)
     if (state == FDE_FREE)
         return 0;
     
-    if (fde->type == MDSL_STORAGE_ITB) {
+    if (fde->type == MDSL_STORAGE_ITB ||
+        fde->type == MDSL_STORAGE_SEGMENT) {
         buf_len = hmo.conf.itb_file_chunk;
     } else if (fde->type == MDSL_STORAGE_DATA) {
         buf_len = hmo.conf.data_file_chunk;
@@ -432,6 +433,10 @@ int append_buf_write(struct fdhash_entry *fde, struct mdsl_storage_access *msa)
             if (fde->type == MDSL_STORAGE_ITB) {
                 ((struct itb_info *)msa->arg)->location = 
                     fde->abuf.file_offset + fde->abuf.offset;
+            } else if (fde->type == MDSL_STORAGE_SEGMENT) {
+                ((struct itb_info *)msa->arg)->location =
+                    MDSL_SEGMENT_LOC(fde->arg, fde->abuf.file_offset +
+                                     fde->abuf.offset);
             } else if (fde->type == MDSL_STORAGE_DATA) {
                 *((u64 *)msa->arg) = fde->abuf.file_offset +
                     fde->abuf.offset;
@@ -726,6 +731,18 @@ int mdsl_storage_init(void)
     xlock_init(&hmo.storage.lru_lock);
     xlock_init(&hmo.storage.txg_fd_lock);
     xlock_init(&hmo.storage.tmp_fd_lock);
+    xlock_init(&hmo.segment.lock);
+    INIT_LIST_HEAD(&hmo.segment.pins);
+    err = mdsl_gc_init();
+    if (err) {
+        hvfs_err(mdsl, "init the online GC failed w/ %d\n", err);
+        return err;
+    }
+    err = mdsl_itbc_init();
+    if (err) {
+        hvfs_err(mdsl, "init the ITB cache failed w/ %d\n", err);
+        return err;
+    }
 
     /* init the global fds */
     err = mdsl_storage_dir_make_exist(HVFS_MDSL_HOME);
@@ -739,6 +756,13 @@ int mdsl_storage_init(void)
         hvfs_err(mdsl, "open file '%s' faield w/ %d\n", path, errno);
         return -errno;
     }
+    /* the temp file for the TOE records spilled by the TCC */
+    sprintf(path, "%s/tmp_txg", HVFS_MDSL_HOME);
+    hmo.storage.tmp_txg_fd = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if (hmo.storage.tmp_txg_fd < 0) {
+        hvfs_err(mdsl, "open file '%s' faield w/ %d\n", path, errno);
+        return -errno;
+    }
     return 0;
 }
 
@@ -749,6 +773,9 @@ void mdsl_storage_destroy(void)
     time_t begin, current;
     int i, notdone, force_close = 0;
 
+    /* stop the read-ahead before closing the files */
+    mdsl_itbc_destroy();
+
     begin = time(NULL);
     do {
         current = time(NULL);
@@ -765,7 +792,8 @@ void mdsl_storage_destroy(void)
                 if (atomic_read(&fde->ref) == 0 || force_close) {
                     hvfs_debug(mdsl, "Final close fd %d.\n", fde->fd);
                     if (fde->type == MDSL_STORAGE_ITB ||
-                        fde->type == MDSL_STORAGE_DATA) {
+                        fde->type == MDSL_STORAGE_DATA ||
+                        fde->type == MDSL_STORAGE_SEGMENT) {
                         append_buf_destroy(fde);
                     } else if (fde->type == MDSL_STORAGE_ITB_ODIRECT) {
                         odirect_destroy(fde);
@@ -787,6 +815,11 @@ void mdsl_storage_destroy(void)
             xlock_unlock(&(hmo.storage.fdhash + i)->lock);
         }
     } while (notdone);
+
+    mdsl_segment_destroy();
+    mdsl_gc_destroy();
+    fsync(hmo.storage.tmp_txg_fd);
+    close(hmo.storage.tmp_txg_fd);
 }
 
 
@@ -1115,6 +1148,7 @@ int mdsl_storage_clean_dir(u64 duuid)
     
     /* Step 1: add this deleted dir to a memory list */
     mdsl_storage_deleted_dir(duuid);
+    mdsl_itbc_invalidate(duuid);
 
     /* Step 2: try to clean the memcache now */
     for (i = 0; i < hmo.conf.storage_fdhash_size; i++) {
@@ -1749,6 +1783,63 @@ int __range_write(u64 duuid, u64 itbid, struct mmap_args *ma, u64 location)
         goto out;
     }
     *((u64 *)(fde->mwin.addr) + (itbid - fde->mwin.offset)) = location;
+    mdsl_itbc_update(duuid, itbid, location);
+
+    mdsl_storage_fd_put(fde);
+out:
+    return err;
+}
+
+/* __range_read_slice() copies the locations of [begin, begin + nr) out */
+int __range_read_slice(u64 duuid, struct mmap_args *ma, u64 begin, u64 nr,
+                       u64 *out)
+{
+    struct fdhash_entry *fde;
+    int err = 0;
+
+    fde = mdsl_storage_fd_lookup_create(duuid, MDSL_STORAGE_RANGE, (u64)ma);
+    if (IS_ERR(fde)) {
+        hvfs_err(mdsl, "lookup create %lx/%ld range %ld failed\n",
+                 duuid, begin, ma->range_id);
+        err = PTR_ERR(fde);
+        goto out;
+    }
+    if (begin < fde->mwin.offset || (begin - fde->mwin.offset + nr) * 
+        sizeof(u64) > fde->mwin.len) {
+        err = -EINVAL;
+        goto out_put;
+    }
+    memcpy(out, (u64 *)(fde->mwin.addr) + (begin - fde->mwin.offset),
+           nr * sizeof(u64));
+
+out_put:
+    mdsl_storage_fd_put(fde);
+out:
+    return err;
+}
+
+/* __range_write_cas() changes the location from @old to @location, return
+ * -EAGAIN if the location has been changed by others.
+ */
+int __range_write_cas(u64 duuid, u64 itbid, struct mmap_args *ma, u64 old,
+                      u64 location)
+{
+    struct fdhash_entry *fde;
+    int err = 0;
+
+    fde = mdsl_storage_fd_lookup_create(duuid, MDSL_STORAGE_RANGE, (u64)ma);
+    if (IS_ERR(fde)) {
+        hvfs_err(mdsl, "lookup create %lx/%ld range %ld failed\n",
+                 duuid, itbid, ma->range_id);
+        err = PTR_ERR(fde);
+        goto out;
+    }
+    if (!__sync_bool_compare_and_swap((u64 *)(fde->mwin.addr) + 
+                                      (itbid - fde->mwin.offset),
+                                      old, location))
+        err = -EAGAIN;
+    else
+        mdsl_itbc_update(duuid, itbid, location);
 
     mdsl_storage_fd_put(fde);
 out:
@@ -1768,8 +1859,10 @@ int __range_write_conditional(u64 duuid, u64 itbid, struct mmap_args *ma,
         err = PTR_ERR(fde);
         goto out;
     }
-    if (*((u64 *)(fde->mwin.addr) + (itbid - fde->mwin.offset)) == 0)
+    if (*((u64 *)(fde->mwin.addr) + (itbid - fde->mwin.offset)) == 0) {
         *((u64 *)(fde->mwin.addr) + (itbid - fde->mwin.offset)) = location;
+        mdsl_itbc_update(duuid, itbid, location);
+    }
 
     mdsl_storage_fd_put(fde);
 out:
@@ -2178,7 +2271,10 @@ int mdsl_storage_fd_init(struct fdhash_entry *fde)
      */
 
     /* make sure the duuid dir exist */
-    sprintf(path, "%s/%lx/%lx", HVFS_MDSL_HOME, hmo.site_id, fde->uuid);
+    if (fde->type == MDSL_STORAGE_SEGMENT)
+        sprintf(path, "%s/%lx/segment", HVFS_MDSL_HOME, hmo.site_id);
+    else
+        sprintf(path, "%s/%lx/%lx", HVFS_MDSL_HOME, hmo.site_id, fde->uuid);
     err = mdsl_storage_dir_make_exist(path);
     if (err) {
         hvfs_err(mdsl, "duuid dir %s do not exist %d.\n", path, err);
@@ -2206,6 +2302,21 @@ int mdsl_storage_fd_init(struct fdhash_entry *fde)
             goto out;
         }
         break;
+    case MDSL_STORAGE_SEGMENT:
+        sprintf(path, "%s/%lx/segment/seg-%ld", HVFS_MDSL_HOME, hmo.site_id,
+                fde->arg);
+        /* do not recreate the cleaned segment */
+        if (fde->state == FDE_FREE && fde->arg != hmo.segment.head &&
+            access(path, F_OK)) {
+            err = -ENOENT;
+            goto out;
+        }
+        err = append_buf_create(fde, path, FDE_ABUF);
+        if (err) {
+            hvfs_err(mdsl, "append buf create failed w/ %d\n", err);
+            goto out;
+        }
+        break;
     case MDSL_STORAGE_ITB_ODIRECT:
         sprintf(path, "%s/%lx/%lx/itb-%ld", HVFS_MDSL_HOME, hmo.site_id,
                 fde->uuid, fde->arg);
@@ -2496,6 +2607,57 @@ out_failed:
     return err;
 }
 
+/* mdsl_storage_fd_sendfile() check whether the region [offset, offset + len)
+ * can be sent from fde->fd directly (e.g. by sendfile()). The region should
+ * be read from the page cache, thus we only accept the states which are read
+ * by pread().
+ *
+ * Return value: 0 means ok; otherwise, the caller should fallback to
+ * mdsl_storage_fd_read().
+ */
+int mdsl_storage_fd_sendfile(struct fdhash_entry *fde, loff_t offset,
+                             size_t len)
+{
+    int err = 0;
+
+retry:
+    switch (fde->state) {
+    case FDE_ABUF:
+    case FDE_NORMAL:
+    case FDE_ABUF_UNMAPPED:
+        break;
+    case FDE_ODIRECT:
+        /* the tail region may be in the odirect buffer */
+        if (offset + len > fde->odirect.file_offset)
+            err = -EAGAIN;
+        break;
+    case FDE_OPEN:
+        err = mdsl_storage_fd_init(fde);
+        if (err) {
+            hvfs_err(mdsl, "try to change state failed w/ %d\n", err);
+            break;
+        }
+        goto retry;
+    default:
+        err = -EINVAL;
+    }
+
+    if (!err) {
+        struct stat st;
+
+        /* the region must be on the file already, otherwise sendfile()
+         * would hit EOF in the middle of the frame */
+        if (fstat(fde->fd, &st) < 0) {
+            hvfs_err(mdsl, "fstat(%d) failed w/ %s\n", fde->fd,
+                     strerror(errno));
+            err = -errno;
+        } else if (offset + len > st.st_size)
+            err = -EAGAIN;
+    }
+
+    return err;
+}
+
 /* Return value:
  *
  * 1: means that we should remove the entry
@@ -2700,8 +2862,27 @@ int mdsl_storage_update_range(struct txg_open_entry *toe)
         hvfs_debug(mdsl, "write II %lx %ld to location %ld\n",
                    pos->duuid, pos->itbid, pos->location);
 
-        if (pos->overwrite)
-            err = __range_write(pos->duuid, pos->itbid, &ma, pos->location);
+        if (pos->overwrite) {
+            u64 old;
+
+            /* the cleaner may move the old ITB concurrently, thus swap the
+             * location by CAS to account the ITB we really overwrite */
+            do {
+                err = __range_lookup(pos->duuid, pos->itbid, &ma, &old);
+                if (err)
+                    break;
+                err = __range_write_cas(pos->duuid, pos->itbid, &ma, old,
+                                        pos->location);
+            } while (err == -EAGAIN);
+            /* account the overwritten ITB in the segment store or the
+             * itb file */
+            if (!err && old && old != pos->location) {
+                if (MDSL_SEGMENT_ID(old))
+                    mdsl_segment_dead(old);
+                else
+                    mdsl_gc_itb_dead(pos->duuid);
+            }
+        }
         else
             err = __range_write_conditional(pos->duuid, pos->itbid, &ma, 
                                             pos->location);
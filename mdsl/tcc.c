@@ -62,13 +62,22 @@ int mdsl_tcc_init(void)
 
 void mdsl_tcc_destroy(void)
 {
-    /* do not need to free any items */
+    struct txg_open_entry_disk *pos, *n;
+
+    /* do not need to free any items, but the temp file index. The spilled
+     * records are still in the temp file for the next replay. */
+    list_for_each_entry_safe(pos, n, &hmo.tcc.tmp_list, list) {
+        list_del(&pos->list);
+        xfree(pos);
+    }
     xlock_destroy(&hmo.tcc.free_lock);
     xlock_destroy(&hmo.tcc.active_lock);
     xlock_destroy(&hmo.tcc.wbed_lock);
 }
 
-struct txg_open_entry *get_txg_open_entry(struct txg_compact_cache *tcc)
+static
+struct txg_open_entry *__get_txg_open_entry(struct txg_compact_cache *tcc,
+                                            int force)
 {
     struct list_head *l = NULL;
     struct txg_open_entry *toe = ERR_PTR(-EINVAL);
@@ -85,7 +94,7 @@ struct txg_open_entry *get_txg_open_entry(struct txg_compact_cache *tcc)
         toe = list_entry(l, struct txg_open_entry, list);
     } else {
         /* we should alloc a new TOE here! */
-        if (unlikely(hmo.conf.option & HVFS_MDSL_MEMLIMIT)) {
+        if (unlikely(hmo.conf.option & HVFS_MDSL_MEMLIMIT) && !force) {
             if (hmo.conf.memlimit <= atomic_read(&tcc->size) * 
                 sizeof(struct txg_open_entry)) {
                 /* if we do not have enough space, we should just write the
@@ -107,7 +116,11 @@ struct txg_open_entry *get_txg_open_entry(struct txg_compact_cache *tcc)
     /* init the TOE now */
     INIT_LIST_HEAD(&toe->list);
     INIT_LIST_HEAD(&toe->itb);
+    /* the TOE may be reused from the free list */
+    memset(&toe->begin, 0, sizeof(toe->begin));
     toe->other_region = NULL;
+    toe->osize = 0;
+    toe->state = 0;
     mcond_init(&toe->cond);
     xcond_init(&toe->wcond);
     xlock_init(&toe->itb_lock);
@@ -117,6 +130,11 @@ struct txg_open_entry *get_txg_open_entry(struct txg_compact_cache *tcc)
     return toe;
 }
 
+struct txg_open_entry *get_txg_open_entry(struct txg_compact_cache *tcc)
+{
+    return __get_txg_open_entry(tcc, 0);
+}
+
 void toe_put(struct txg_open_entry *toe)
 {
     if (atomic_dec_return(&toe->ref) == 0 && toe->state)
@@ -170,6 +188,57 @@ struct txg_open_entry *toe_lookup(u64 site, u64 txg)
     return toe;
 }
 
+/* toe_pending_location() returns the min location of @duuid's ITBs in the
+ * itb file @master which are appended by the uncommitted TXGs, -1UL if there
+ * is none. The range files are updated on TXG_END, thus the GC should not
+ * touch these ITBs.
+ */
+u64 toe_pending_location(u64 duuid, u32 master)
+{
+    struct txg_open_entry *toe;
+    struct itb_info *ii;
+    u64 location = -1UL;
+
+    xlock_lock(&hmo.tcc.active_lock);
+    list_for_each_entry(toe, &hmo.tcc.active_list, list) {
+        xlock_lock(&toe->itb_lock);
+        list_for_each_entry(ii, &toe->itb, list) {
+            if (ii->duuid == duuid && ii->master == master &&
+                ii->location < location)
+                location = ii->location;
+        }
+        xlock_unlock(&toe->itb_lock);
+    }
+    xlock_unlock(&hmo.tcc.active_lock);
+
+    return location;
+}
+
+/* toe_pending_segment() returns the min segment id holding the ITBs of the
+ * uncommitted TXGs, -1UL if there is none. The segment cleaner should not
+ * touch these segments.
+ */
+u64 toe_pending_segment(void)
+{
+    struct txg_open_entry *toe;
+    struct itb_info *ii;
+    u64 id = -1UL;
+
+    xlock_lock(&hmo.tcc.active_lock);
+    list_for_each_entry(toe, &hmo.tcc.active_list, list) {
+        xlock_lock(&toe->itb_lock);
+        list_for_each_entry(ii, &toe->itb, list) {
+            if (MDSL_SEGMENT_ID(ii->location) &&
+                MDSL_SEGMENT_ID(ii->location) < id)
+                id = MDSL_SEGMENT_ID(ii->location);
+        }
+        xlock_unlock(&toe->itb_lock);
+    }
+    xlock_unlock(&hmo.tcc.active_lock);
+
+    return id;
+}
+
 struct txg_open_entry *toe_lookup_recent(u64 site)
 {
     struct txg_open_entry *toe = NULL, *pos;
@@ -250,6 +319,16 @@ int itb_append(struct itb *itb, struct itb_info *ii, u64 site, u64 txg)
         master = fde->mdisk.itb_master;
         ii->master = master;
         mdsl_storage_fd_put(fde);
+
+        if (hmo.conf.option & HVFS_MDSL_SEGMENT) {
+            /* append to the shared segment instead of "[target dir]/itb" */
+            err = mdsl_segment_write(itb, ii);
+            if (err) {
+                hvfs_err(mdsl, "segment write failed w/ %d\n", err);
+                goto write_to_tmpfile;
+            }
+            return 0;
+        }
         
         fde = mdsl_storage_fd_lookup_create(itb->h.puuid, MDSL_STORAGE_ITB, 
                                             master);
@@ -257,11 +336,20 @@ int itb_append(struct itb *itb, struct itb_info *ii, u64 site, u64 txg)
             hvfs_err(mdsl, "lookup create failed w/ %ld\n", PTR_ERR(fde));
             goto write_to_tmpfile;
         }
+        /* the ITB is not in any TOE until the caller links the itb_info,
+         * hold off the GC until then */
+        ii->duuid = itb->h.puuid;
+        err = mdsl_gc_append_begin(ii, mdsl_storage_fd_max_offset(fde));
+        if (err) {
+            mdsl_storage_fd_put(fde);
+            goto write_to_tmpfile;
+        }
         /* write here */
         err = mdsl_storage_fd_write(fde, &msa);
         if (err) {
             hvfs_err(mdsl, "storage_fd_write failed w/ %d\n", err);
             mdsl_storage_fd_put(fde);
+            mdsl_gc_append_end(ii);
             goto write_to_tmpfile;
         }
         hvfs_debug(mdsl, "Write ITB %ld[%lx] len %d to storage file off "
@@ -281,29 +369,560 @@ int itb_append(struct itb *itb, struct itb_info *ii, u64 site, u64 txg)
         mdsl_storage_fd_put(fde);
         /* accumulate to hmi */
         atomic64_add(itb_iov.iov_len, &hmi.mi_bused);
+        mdsl_gc_itb_append(itb->h.puuid);
     } else {
     write_to_tmpfile:
-        /* write to tmp file */
-        toe_to_tmpfile(TXG_OPEN_ENTRY_DISK_ITB, site, txg, itb);
+        /* write to tmp file, it is appended again when the TXG_END
+         * arrives */
+        err = toe_to_tmpfile(TXG_OPEN_ENTRY_DISK_ITB, site, txg, itb);
+        if (!err)
+            err = 1;
     }
     
     return err;
 }
 
+static
+int __toe_tmpfile_write(void *data, size_t len, loff_t offset)
+{
+    long bw, bl = 0;
+
+    while (bl < len) {
+        bw = pwrite(hmo.storage.tmp_txg_fd, data + bl, len - bl,
+                    offset + bl);
+        if (bw <= 0) {
+            hvfs_err(mdsl, "pwrite to fd %d failed w/ %d\n",
+                     hmo.storage.tmp_txg_fd, errno);
+            return -errno;
+        }
+        bl += bw;
+    }
+
+    return 0;
+}
+
+static
+int __toe_tmpfile_read(void *data, size_t len, loff_t offset)
+{
+    long br, bl = 0;
+
+    while (bl < len) {
+        br = pread(hmo.storage.tmp_txg_fd, data + bl, len - bl,
+                   offset + bl);
+        if (br < 0) {
+            hvfs_err(mdsl, "pread from fd %d failed w/ %d\n",
+                     hmo.storage.tmp_txg_fd, errno);
+            return -errno;
+        } else if (br == 0) {
+            hvfs_err(mdsl, "pread from fd %d reach EOF @ %ld\n",
+                     hmo.storage.tmp_txg_fd, (long)(offset + bl));
+            return -EINVAL;
+        }
+        bl += br;
+    }
+
+    return 0;
+}
+
+/* __toe_spill() append one record to the temp file. The TXG_END record is
+ * not indexed, it just marks that the TXG has been committed.
+ */
+static
+int __toe_spill(int flag, u64 site, u64 txg, void *data, u32 len)
+{
+    struct txg_open_entry_disk hdr, *toed = NULL;
+    loff_t offset;
+    int err = 0;
+
+    hdr.type = flag;
+    hdr.len = len;
+    hdr.ssite = site;
+    hdr.txg = txg;
+
+    if (flag != TXG_OPEN_ENTRY_DISK_END) {
+        toed = xzalloc(sizeof(*toed));
+        if (!toed) {
+            hvfs_err(mdsl, "xzalloc() txg_open_entry_disk failed, "
+                     "TOE <%lx,%ld> record %x lost\n", site, txg, flag);
+            return -ENOMEM;
+        }
+        *toed = hdr;
+        INIT_LIST_HEAD(&toed->list);
+    }
+
+    xlock_lock(&hmo.storage.tmp_fd_lock);
+    offset = lseek(hmo.storage.tmp_txg_fd, 0, SEEK_END);
+    if (offset < 0) {
+        hvfs_err(mdsl, "lseek to end of fd %d failed w/ %d\n",
+                 hmo.storage.tmp_txg_fd, errno);
+        err = -errno;
+        goto out_unlock;
+    }
+    err = __toe_tmpfile_write((void *)&hdr + TOE_DISK_HDR_OFFSET,
+                              TOE_DISK_HDR_SIZE, offset);
+    if (!err)
+        err = __toe_tmpfile_write(data, len, offset + TOE_DISK_HDR_SIZE);
+    if (err) {
+        /* cut the partial record, otherwise the replay stops here */
+        if (ftruncate(hmo.storage.tmp_txg_fd, offset) < 0) {
+            hvfs_err(mdsl, "truncate fd %d to %ld failed w/ %d\n",
+                     hmo.storage.tmp_txg_fd, (long)offset, errno);
+        }
+        goto out_unlock;
+    }
+    if (toed) {
+        toed->offset = offset + TOE_DISK_HDR_SIZE;
+        list_add_tail(&toed->list, &hmo.tcc.tmp_list);
+        toed = NULL;
+    } else if (list_empty(&hmo.tcc.tmp_list) && !hmo.tcc.tmp_ref) {
+        /* all the spilled TXGs are committed, reset the temp file */
+        if (ftruncate(hmo.storage.tmp_txg_fd, 0) < 0) {
+            hvfs_err(mdsl, "truncate fd %d failed w/ %d\n",
+                     hmo.storage.tmp_txg_fd, errno);
+        }
+    }
+    atomic64_inc(&hmo.prof.misc.tcc_spill);
+
+out_unlock:
+    xlock_unlock(&hmo.storage.tmp_fd_lock);
+    xfree(toed);
+
+    return err;
+}
+
 int toe_to_tmpfile(int flag, u64 site, u64 txg, void *data)
 {
+    u32 len;
+
     if (unlikely(hmo.conf.option & HVFS_MDSL_WDROP))
         return 0;
 
-    return 0;
+    switch (flag) {
+    case TXG_OPEN_ENTRY_DISK_BEGIN:
+        len = sizeof(struct txg_begin);
+        break;
+    case TXG_OPEN_ENTRY_DISK_ITB:
+        len = atomic_read(&((struct itb *)data)->h.len);
+        break;
+    case TXG_OPEN_ENTRY_DISK_END:
+        len = sizeof(struct txg_end);
+        break;
+    default:
+        hvfs_err(mdsl, "Invalid TOE record type %x\n", flag);
+        return -EINVAL;
+    }
+
+    return __toe_spill(flag, site, txg, data, len);
 }
 
 int toe_to_tmpfile_N(int flag, u64 site, u64 txg, void *data, int nr)
 {
+    u32 len;
+
     if (unlikely(hmo.conf.option & HVFS_MDSL_WDROP))
         return 0;
     if (!nr)
         return 0;
 
+    switch (flag) {
+    case TXG_OPEN_ENTRY_DISK_DIR:
+    case TXG_OPEN_ENTRY_DISK_DIR_R:
+        len = nr * sizeof(struct hvfs_dir_delta);
+        break;
+    case TXG_OPEN_ENTRY_DISK_BITMAP:
+        len = nr * sizeof(struct bitmap_delta);
+        break;
+    case TXG_OPEN_ENTRY_DISK_CKPT:
+        len = nr * sizeof(struct checkpoint);
+        break;
+    case TXG_OPEN_ENTRY_DISK_RDIR:
+        len = nr * sizeof(u64);
+        break;
+    default:
+        hvfs_err(mdsl, "Invalid TOE record type %x\n", flag);
+        return -EINVAL;
+    }
+
+    return __toe_spill(flag, site, txg, data, len);
+}
+
+static inline
+int __toe_osize(struct txg_begin *tb)
+{
+    return tb->dir_delta_nr * sizeof(struct hvfs_dir_delta) +
+        tb->rdd_nr * sizeof(struct hvfs_dir_delta) +
+        tb->bitmap_delta_nr * sizeof(struct bitmap_delta) +
+        tb->ckpt_nr * sizeof(struct checkpoint) +
+        tb->rd_nr * sizeof(u64);
+}
+
+/* the regions are saved in the order of the WBTXG_BEGIN frame */
+static inline
+int __toe_region_offset(struct txg_begin *tb, int type)
+{
+    int offset = 0;
+
+    switch (type) {
+    case TXG_OPEN_ENTRY_DISK_RDIR:
+        offset += tb->ckpt_nr * sizeof(struct checkpoint);
+        /* fall through */
+    case TXG_OPEN_ENTRY_DISK_CKPT:
+        offset += tb->bitmap_delta_nr * sizeof(struct bitmap_delta);
+        /* fall through */
+    case TXG_OPEN_ENTRY_DISK_BITMAP:
+        offset += tb->rdd_nr * sizeof(struct hvfs_dir_delta);
+        /* fall through */
+    case TXG_OPEN_ENTRY_DISK_DIR_R:
+        offset += tb->dir_delta_nr * sizeof(struct hvfs_dir_delta);
+        /* fall through */
+    case TXG_OPEN_ENTRY_DISK_DIR:
+    default:;
+    }
+
+    return offset;
+}
+
+static inline
+int __toe_disk_valid(struct txg_open_entry_disk *toed)
+{
+    switch (toed->type) {
+    case TXG_OPEN_ENTRY_DISK_BEGIN:
+        return toed->len == sizeof(struct txg_begin);
+    case TXG_OPEN_ENTRY_DISK_END:
+        return toed->len == sizeof(struct txg_end);
+    case TXG_OPEN_ENTRY_DISK_ITB:
+        return toed->len >= sizeof(struct itbh) &&
+            toed->len <= TOE_DISK_MAX_LEN;
+    case TXG_OPEN_ENTRY_DISK_DIR:
+    case TXG_OPEN_ENTRY_DISK_DIR_R:
+    case TXG_OPEN_ENTRY_DISK_BITMAP:
+    case TXG_OPEN_ENTRY_DISK_CKPT:
+    case TXG_OPEN_ENTRY_DISK_RDIR:
+        return toed->len <= TOE_DISK_MAX_LEN;
+    default:;
+    }
+
+    return 0;
+}
+
+static
+int __toe_load_record(struct txg_open_entry_disk *toed,
+                      struct txg_open_entry *toe, struct txg_end *te)
+{
+    struct itb_info *ii;
+    struct itb *itb;
+    void *data;
+    int offset, err = 0;
+
+    data = xmalloc(toed->len);
+    if (!data) {
+        hvfs_err(mdsl, "xmalloc() TOE record buffer failed\n");
+        return -ENOMEM;
+    }
+    err = __toe_tmpfile_read(data, toed->len, toed->offset);
+    if (err)
+        goto out_free;
+
+    switch (toed->type) {
+    case TXG_OPEN_ENTRY_DISK_BEGIN:
+        toe->begin = *(struct txg_begin *)data;
+        toe->osize = __toe_osize(&toe->begin);
+        if (toe->osize && !toe->other_region) {
+            toe->other_region = xzalloc(toe->osize);
+            if (!toe->other_region) {
+                hvfs_err(mdsl, "xzalloc() TOE %p other_region failed\n",
+                         toe);
+                err = -ENOMEM;
+            }
+        }
+        break;
+    case TXG_OPEN_ENTRY_DISK_ITB:
+        itb = data;
+        if (atomic_read(&itb->h.len) != toed->len) {
+            hvfs_err(mdsl, "Invalid spilled ITB %ld length %d vs %d\n",
+                     itb->h.itbid, atomic_read(&itb->h.len), toed->len);
+            err = -EINVAL;
+            break;
+        }
+        ii = xzalloc(sizeof(*ii));
+        if (!ii) {
+            hvfs_err(mdsl, "xzalloc() itb_info failed\n");
+            err = -ENOMEM;
+            break;
+        }
+        INIT_LIST_HEAD(&ii->list);
+        ii->duuid = itb->h.puuid;
+        ii->itbid = itb->h.itbid;
+        err = itb_append(itb, ii, toed->ssite, toed->txg);
+        if (err) {
+            xfree(ii);
+            if (err > 0)
+                err = -EIO;
+            break;
+        }
+        xlock_lock(&toe->itb_lock);
+        list_add_tail(&ii->list, &toe->itb);
+        xlock_unlock(&toe->itb_lock);
+        mdsl_gc_append_end(ii);
+        mdsl_segment_append_end(ii);
+        atomic_inc(&toe->itb_nr);
+        break;
+    case TXG_OPEN_ENTRY_DISK_DIR:
+    case TXG_OPEN_ENTRY_DISK_DIR_R:
+    case TXG_OPEN_ENTRY_DISK_BITMAP:
+    case TXG_OPEN_ENTRY_DISK_CKPT:
+    case TXG_OPEN_ENTRY_DISK_RDIR:
+        offset = __toe_region_offset(&toe->begin, toed->type);
+        if (!toe->other_region || offset + toed->len > toe->osize) {
+            hvfs_err(mdsl, "TOE <%lx,%ld> region %x [%d,%d) overflow %d\n",
+                     toed->ssite, toed->txg, toed->type, offset,
+                     offset + toed->len, toe->osize);
+            err = -EINVAL;
+            break;
+        }
+        memcpy(toe->other_region + offset, data, toed->len);
+        if (toed->type == TXG_OPEN_ENTRY_DISK_RDIR) {
+            /* the removed dirs have not been cleaned in mdsl_wbtxg() */
+            u64 *rd = data;
+            int i;
+
+            for (i = 0; i < toed->len / sizeof(u64); i++) {
+                hvfs_warning(mdsl, "Remove dir %lx\n", *(rd + i));
+                err = mdsl_storage_clean_dir(*(rd + i));
+                if (err) {
+                    hvfs_err(mdsl, "storage clean dir %lx failed w/ %d\n",
+                             *(rd + i), err);
+                }
+            }
+            err = 0;
+        }
+        break;
+    case TXG_OPEN_ENTRY_DISK_END:
+        if (te)
+            *te = *(struct txg_end *)data;
+        break;
+    default:
+        err = -EINVAL;
+    }
+
+out_free:
+    xfree(data);
+
+    return err;
+}
+
+static
+void __toe_tmpfile_drop(u64 site, u64 txg)
+{
+    struct txg_open_entry_disk *pos, *n;
+
+    xlock_lock(&hmo.storage.tmp_fd_lock);
+    list_for_each_entry_safe(pos, n, &hmo.tcc.tmp_list, list) {
+        if (pos->ssite == site && pos->txg == txg) {
+            list_del(&pos->list);
+            xfree(pos);
+        }
+    }
+    xlock_unlock(&hmo.storage.tmp_fd_lock);
+}
+
+/* toe_load_tmpfile()
+ *
+ * Replay the spilled records of TXG <site,txg> to @toe in order. The ITBs
+ * are appended to the storage files now. Return the # of records loaded.
+ */
+int toe_load_tmpfile(u64 site, u64 txg, struct txg_open_entry *toe,
+                     struct txg_end *te)
+{
+    struct txg_open_entry_disk *pos, *n;
+    LIST_HEAD(records);
+    int nr = 0, err;
+
+    xlock_lock(&hmo.storage.tmp_fd_lock);
+    list_for_each_entry_safe(pos, n, &hmo.tcc.tmp_list, list) {
+        if (pos->ssite == site && pos->txg == txg)
+            list_move_tail(&pos->list, &records);
+    }
+    if (list_empty(&records)) {
+        xlock_unlock(&hmo.storage.tmp_fd_lock);
+        return 0;
+    }
+    hmo.tcc.tmp_ref++;
+    xlock_unlock(&hmo.storage.tmp_fd_lock);
+
+    list_for_each_entry_safe(pos, n, &records, list) {
+        err = __toe_load_record(pos, toe, te);
+        if (err) {
+            hvfs_err(mdsl, "Replay TOE <%lx,%ld> record %x @ %ld failed "
+                     "w/ %d, maybe data loss.\n",
+                     site, txg, pos->type, (long)pos->offset, err);
+        } else
+            nr++;
+        list_del(&pos->list);
+        xfree(pos);
+    }
+    /* the failed ITBs are spilled again by itb_append(), but they can not
+     * be committed w/ this TXG any more */
+    __toe_tmpfile_drop(site, txg);
+
+    xlock_lock(&hmo.storage.tmp_fd_lock);
+    hmo.tcc.tmp_ref--;
+    xlock_unlock(&hmo.storage.tmp_fd_lock);
+    atomic64_add(nr, &hmo.prof.misc.tcc_replay);
+
+    return nr;
+}
+
+/* toe_from_tmpfile()
+ *
+ * Rebuild the TOE of TXG <site,txg> whose TXG_BEGIN has been spilled to the
+ * temp file. The TOE is active while its ITBs are appended, thus the GC sees
+ * them in toe_pending_location(); the caller should deactive it after the
+ * range files are updated.
+ */
+struct txg_open_entry *toe_from_tmpfile(u64 site, u64 txg)
+{
+    struct txg_open_entry_disk *pos;
+    struct txg_open_entry *toe;
+    struct itb_info *ii, *n;
+    int found = 0, err;
+
+    xlock_lock(&hmo.storage.tmp_fd_lock);
+    list_for_each_entry(pos, &hmo.tcc.tmp_list, list) {
+        if (pos->ssite == site && pos->txg == txg &&
+            pos->type == TXG_OPEN_ENTRY_DISK_BEGIN) {
+            found = 1;
+            break;
+        }
+    }
+    xlock_unlock(&hmo.storage.tmp_fd_lock);
+    if (!found)
+        return ERR_PTR(-ENOENT);
+
+    /* the replay should not be blocked by the memlimit */
+    toe = __get_txg_open_entry(&hmo.tcc, 1);
+    if (IS_ERR(toe)) {
+        hvfs_err(mdsl, "get txg_open_entry failed\n");
+        return toe;
+    }
+    toe_active(toe);
+
+    err = toe_load_tmpfile(site, txg, toe, NULL);
+    if (err >= 0 && (toe->begin.site_id != site || toe->begin.txg != txg))
+        err = -EINVAL;
+    if (err < 0) {
+        hvfs_err(mdsl, "Rebuild TOE <%lx,%ld> failed w/ %d\n",
+                 site, txg, err);
+        toe_deactive(toe);
+        /* the appended ITBs are never referenced, let the GC reclaim them */
+        list_for_each_entry_safe(ii, n, &toe->itb, list) {
+            if (MDSL_SEGMENT_ID(ii->location))
+                mdsl_segment_dead(ii->location);
+            else
+                mdsl_gc_itb_dead(ii->duuid);
+            list_del(&ii->list);
+            xfree(ii);
+        }
+        put_txg_open_entry(toe);
+        return ERR_PTR(err);
+    }
+
+    return toe;
+}
+
+/* mdsl_tcc_replay()
+ *
+ * Replay the temp file on restart. The TXGs w/ a TXG_END record have been
+ * committed. Other TXGs are not complete, we do not know how many ITBs they
+ * should carry, thus they are kept pending until the MDS resends the
+ * TXG_END, then mdsl_wbtxg() rebuilds them by toe_from_tmpfile().
+ */
+int mdsl_tcc_replay(void)
+{
+    struct txg_open_entry_disk hdr, *toed, *pos, *n;
+    LIST_HEAD(pending);
+    loff_t offset = 0, fsize;
+    u64 site, txg;
+    int nr = 0, begin, err = 0;
+
+    fsize = lseek(hmo.storage.tmp_txg_fd, 0, SEEK_END);
+    if (fsize < 0) {
+        hvfs_err(mdsl, "lseek to end of fd %d failed w/ %d\n",
+                 hmo.storage.tmp_txg_fd, errno);
+        return -errno;
+    } else if (fsize == 0)
+        return 0;
+
+    /* Step 1: rebuild the index */
+    while (offset + TOE_DISK_HDR_SIZE <= fsize) {
+        err = __toe_tmpfile_read((void *)&hdr + TOE_DISK_HDR_OFFSET,
+                                 TOE_DISK_HDR_SIZE, offset);
+        if (err)
+            break;
+        if (!__toe_disk_valid(&hdr) ||
+            offset + TOE_DISK_HDR_SIZE + hdr.len > fsize) {
+            hvfs_warning(mdsl, "Torn TOE record @ %ld, ignore the tail\n",
+                         (long)offset);
+            break;
+        }
+        if (hdr.type == TXG_OPEN_ENTRY_DISK_END) {
+            __toe_tmpfile_drop(hdr.ssite, hdr.txg);
+        } else {
+            toed = xzalloc(sizeof(*toed));
+            if (!toed) {
+                hvfs_err(mdsl, "xzalloc() txg_open_entry_disk failed\n");
+                return -ENOMEM;
+            }
+            *toed = hdr;
+            INIT_LIST_HEAD(&toed->list);
+            toed->offset = offset + TOE_DISK_HDR_SIZE;
+            list_add_tail(&toed->list, &hmo.tcc.tmp_list);
+        }
+        offset += TOE_DISK_HDR_SIZE + hdr.len;
+    }
+
+    /* Step 2: drop the TXGs w/o TXG_BEGIN, they can not be rebuilt */
+    while (!list_empty(&hmo.tcc.tmp_list)) {
+        toed = list_entry(hmo.tcc.tmp_list.next, struct txg_open_entry_disk,
+                          list);
+        site = toed->ssite;
+        txg = toed->txg;
+        begin = 0;
+        list_for_each_entry(pos, &hmo.tcc.tmp_list, list) {
+            if (pos->ssite == site && pos->txg == txg &&
+                pos->type == TXG_OPEN_ENTRY_DISK_BEGIN) {
+                begin = 1;
+                break;
+            }
+        }
+        if (begin)
+            nr++;
+        else
+            hvfs_warning(mdsl, "Drop the spilled TXG <%lx,%ld> w/o "
+                         "TXG_BEGIN\n", site, txg);
+        list_for_each_entry_safe(pos, n, &hmo.tcc.tmp_list, list) {
+            if (pos->ssite != site || pos->txg != txg)
+                continue;
+            if (begin)
+                list_move_tail(&pos->list, &pending);
+            else {
+                list_del(&pos->list);
+                xfree(pos);
+            }
+        }
+    }
+    list_for_each_entry_safe(pos, n, &pending, list) {
+        list_move_tail(&pos->list, &hmo.tcc.tmp_list);
+    }
+
+    if (list_empty(&hmo.tcc.tmp_list)) {
+        /* all the spilled TXGs are settled, reset the temp file */
+        if (ftruncate(hmo.storage.tmp_txg_fd, 0) < 0) {
+            hvfs_err(mdsl, "truncate fd %d failed w/ %d\n",
+                     hmo.storage.tmp_txg_fd, errno);
+        }
+    }
+    hvfs_info(mdsl, "Keep %d spilled TXG(s) pending for the TXG_END.\n", nr);
+
     return 0;
 }
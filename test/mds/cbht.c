@@ -923,11 +923,198 @@ out_free2:
     goto out_free;
 }
 
+struct rs_args
+{
+    int tid;
+    int k, x;                   /* the inserted entries */
+    long loops;                 /* # of lookups in this thread */
+    pthread_barrier_t *pb;
+    double acc;                 /* lookup time in us */
+};
+
+/* rs_main_thread()
+ *
+ * NOTE: This function is used to test the read scaling of CBHT. All threads
+ * lookup the pre-inserted entries in random order w/o synchronization.
+ */
+void *rs_main_thread(void *arg)
+{
+    struct rs_args *ra = (struct rs_args *)arg;
+    struct timeval begin, end;
+    struct hvfs_md_reply hmr;
+    char name[HVFS_MAX_NAME_LEN];
+    u64 seed = ra->tid * 2654435761UL + 1, flag;
+    long l;
+    int i, j;
+
+    pthread_barrier_wait(ra->pb);
+
+    lib_timer_start(&begin);
+    for (l = 0; l < ra->loops; l++) {
+        /* cheap LCG, lib_random() is serialized in libc */
+        seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+        i = (seed >> 33) % ra->k;
+        j = (seed >> 13) % ra->x;
+        sprintf(name, "macan-%d-%d", i, j);
+        flag = INDEX_LOOKUP | INDEX_BY_NAME | INDEX_ITE_ACTIVE;
+        lookup_ite(0, i, name, flag, &hmr);
+    }
+    lib_timer_stop(&end);
+    lib_timer_acc(&begin, &end, &ra->acc);
+
+    pthread_barrier_wait(ra->pb);
+
+    pthread_exit(0);
+}
+
+/* rs_main()
+ *
+ * Read scaling benchmark: insert k * x entries by one thread, then lookup
+ * them w/ 1, 2, 4, ... up to 'rscale' threads and report the throughput.
+ */
+int rs_main(int argc, char *argv[])
+{
+    struct mdu_update mu;
+    struct hvfs_md_reply hmr;
+    struct rs_args *ra;
+    pthread_t *t;
+    pthread_barrier_t pb;
+    char name[HVFS_MAX_NAME_LEN];
+    char *value;
+    double base = 0.0, tput, lat;
+    long loops = 0;
+    int i, j, k, x, bdepth, icsize, threads, n;
+    int err = 0;
+
+    if (argc == 5) {
+        k = atoi(argv[1]);
+        x = atoi(argv[2]);
+        bdepth = atoi(argv[3]);
+        icsize = atoi(argv[4]);
+    } else {
+        k = 100;
+        x = 500;
+        bdepth = 4;
+        icsize = 50;
+    }
+    /* do not trigger ITB split */
+    if (x > (ITB_SIZE >> 1))
+        x = ITB_SIZE >> 1;
+    threads = atoi(getenv("rscale"));
+    if (threads <= 0)
+        threads = 1;
+    value = getenv("rsloop");
+    if (value)
+        loops = atol(value);
+    if (loops <= 0)
+        loops = (long)k * x;
+
+    hvfs_info(mds, "CBHT READ SCALING TESTing...(%d,%d,%d,%d) "
+              "up to %d threads, %ld lookups/thread\n",
+              k, x, bdepth, icsize, threads, loops);
+    lib_init();
+    mds_pre_init();
+    err = mds_init(bdepth);
+    if (err) {
+        hvfs_err(mds, "mds_cbht_init failed %d\n", err);
+        goto out;
+    }
+    /* init misc configrations */
+    hmo.site_id = HVFS_MDS(0);
+    hmi.gdt_salt = lib_random(0xfffffff);
+    hmo.gossip_thread_stop = 1;
+    hmo.scrub_thread_stop = 1;
+    hmo.conf.itbid_check = 0;
+    /* allow creating any ITB w/o the split history */
+    hmo.conf.option |= HVFS_MDS_LIMITED;
+    ring_add(&hmo.chring[CH_RING_MDS], HVFS_MDS(0));
+
+    /* insert the GDT DH */
+    dh_insert(hmi.gdt_uuid, hmi.gdt_uuid, hmi.gdt_salt);
+    bitmap_insert(0, 0);
+    itb_cache_init(&hmo.ic, icsize);
+
+    /* insert the ite! */
+    memset(&mu, 0, sizeof(mu));
+    for (i = 0; i < k; i++) {
+        for (j = 0; j < x; j++) {
+            mu.valid = MU_MODE | MU_UID;
+            mu.mode = i;
+            mu.uid = j;
+            sprintf(name, "macan-%d-%d", i, j);
+            insert_ite(0, i, name, &mu, &hmr);
+        }
+    }
+    hvfs_info(mds, "Insert %d ites is done, CBHT dir depth %d\n", 
+              k * x, hmo.cbht.dir_depth);
+
+    t = xzalloc(threads * sizeof(pthread_t));
+    ra = xzalloc(threads * sizeof(struct rs_args));
+    if (!t || !ra) {
+        hvfs_err(mds, "xzalloc() threads failed.\n");
+        err = ENOMEM;
+        goto out_free;
+    }
+
+    hvfs_info(mds, "%8s %14s %14s %8s\n", "threads", "lookup/s", 
+              "us/lookup", "scale");
+    n = 1;
+    do {
+        pthread_barrier_init(&pb, NULL, n + 1);
+        for (i = 0; i < n; i++) {
+            ra[i].tid = i;
+            ra[i].k = k;
+            ra[i].x = x;
+            ra[i].loops = loops;
+            ra[i].pb = &pb;
+            ra[i].acc = 0.0;
+            err = pthread_create(&t[i], NULL, rs_main_thread, &ra[i]);
+            if (err) {
+                hvfs_err(mds, "pthread_create err %d\n", err);
+                goto out_free;
+            }
+        }
+        /* start and wait */
+        pthread_barrier_wait(&pb);
+        pthread_barrier_wait(&pb);
+        for (i = 0; i < n; i++) {
+            pthread_join(t[i], NULL);
+        }
+        pthread_barrier_destroy(&pb);
+
+        lat = 0.0;
+        for (i = 0; i < n; i++) {
+            lat += ra[i].acc;
+        }
+        lat /= (double)n * loops;
+        tput = n * 1000000.0 / lat;
+        if (n == 1)
+            base = tput;
+        hvfs_info(mds, "%8d %14.0lf %14.3lf %8.2lf\n", n, tput, lat, 
+                  tput / base);
+        if (n == threads)
+            break;
+        n = min(n * 2, threads);
+    } while (1);
+    hvfs_info(mds, "Total lookup miss %ld.\n", atomic64_read(&miss));
+
+out_free:
+    xfree(t);
+    xfree(ra);
+out:
+    return err;
+}
+
 int main(int argc, char *argv[])
 {
     int err;
 
     atomic64_set(&miss, 0);
+    if (getenv("rscale")) {
+        /* read scaling benchmark */
+        err = rs_main(argc, argv);
+        goto out;
+    }
     if (argc == 6) {
         /* may be multi-thread test */
         argc--;
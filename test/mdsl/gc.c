@@ -92,16 +92,85 @@ void preload_dir(u64 duuid)
     }
 }
 
+/* racer_commit() updates the range entry of the appended ITB, as the
+ * TXG_END does. Return the old location in @old.
+ */
+int racer_commit(u64 duuid, struct itb *itb, struct itb_info *ii, u64 *old)
+{
+    struct fdhash_entry *fde;
+    struct mmap_args ma = {0, };
+    range_t *range;
+    int err;
+
+    *old = 0;
+    /* open the md file and try to update the ranges */
+    fde = mdsl_storage_fd_lookup_create(duuid, MDSL_STORAGE_MD, 0);
+    if (IS_ERR(fde)) {
+        hvfs_err(mdsl, "lookup create MD file failed w/ %ld\n",
+                 PTR_ERR(fde));
+        return PTR_ERR(fde);
+    }
+    if (ii->master < fde->mdisk.itb_master) {
+        hvfs_info(mdsl, "Drop obsolete itb %ld appending %ld\n",
+                  itb->h.itbid, ii->location);
+        err = -EAGAIN;
+        goto put_fde;
+    }
+    ma.win = MDSL_STORAGE_DEFAULT_RANGE_SIZE;
+relookup:
+    xlock_lock(&fde->lock);
+    err = __mdisk_lookup_nolock(fde, MDSL_MDISK_RANGE, itb->h.itbid,
+                                &range);
+    if (err == -ENOENT) {
+        /* create a new range now */
+        u64 i;
+        
+        i = MDSL_STORAGE_idx2range(itb->h.itbid);
+        __mdisk_add_range_nolock(fde, i * MDSL_STORAGE_RANGE_SLOTS,
+                                 (i + 1) * MDSL_STORAGE_RANGE_SLOTS - 1,
+                                 fde->mdisk.range_aid++);
+        __mdisk_range_sort(fde->mdisk.new_range, fde->mdisk.new_size);
+        xlock_unlock(&fde->lock);
+        goto relookup;
+    } else if (err) {
+        hvfs_err(mdsl, "mdisk_lookup_nolock failed w/ %d\n", err);
+        xlock_unlock(&fde->lock);
+        goto put_fde;
+    }
+    xlock_unlock(&fde->lock);
+
+    ma.foffset = 0;
+    ma.range_id = range->range_id;
+    ma.range_begin = range->begin;
+    ma.flag = MA_OFFICIAL;
+
+    err = __range_lookup(duuid, itb->h.itbid, &ma, old);
+    if (err) {
+        hvfs_err(mdsl, "range lookup failed w/ %d\n", err);
+        goto put_fde;
+    }
+    err = __range_write(duuid, itb->h.itbid, &ma, ii->location);
+    if (err) {
+        hvfs_err(mdsl, "range write failed w/ %d\n", err);
+        goto put_fde;
+    }
+    err = __mdisk_write(fde, NULL);
+    if (err) {
+        hvfs_err(mdsl, "sync md file failed w/ %d\n", err);
+    }
+put_fde:
+    mdsl_storage_fd_put(fde);
+
+    return err;
+}
+
 /* racer create a new thread and access the metadata/itb file randomizely
  */
 void *racer(void *arg)
 {
     struct itb *itb;
-    struct fdhash_entry *fde;
     struct itb_info ii;
-    u64 duuid = (u64)arg;
-    struct mmap_args ma = {0, };
-    range_t *range;
+    u64 duuid = (u64)arg, old;
     int len, range_begin, range_end, err, counter = 0;
 
     itb = xmalloc(sizeof(*itb) + ITB_SIZE * sizeof(struct ite));
@@ -120,6 +189,8 @@ void *racer(void *arg)
         itb->h.itbid = lib_random(0xfff);
         itb->h.puuid = duuid;
 
+        memset(&ii, 0, sizeof(ii));
+        ii.duuid = duuid;
         err = itb_append(itb, &ii, hmo.site_id, 0);
         if (err) {
             hvfs_err(mdsl, "Append itb <> to disk file failed w/ %d\n",
@@ -130,83 +201,237 @@ void *racer(void *arg)
                       (++counter), itb->h.itbid, atomic_read(&itb->h.len),
                       ii.master);
         }
-        /* open the md file and try to update the ranges */
-        fde = mdsl_storage_fd_lookup_create(duuid, MDSL_STORAGE_MD, 0);
-        if (IS_ERR(fde)) {
-            hvfs_err(mdsl, "lookup create MD file failed w/ %ld\n",
-                     PTR_ERR(fde));
+        racer_commit(duuid, itb, &ii, &old);
+        mdsl_gc_append_end(&ii);
+    }
+
+    pthread_exit(0);
+}
+
+/* Online GC vs. write-back
+ *
+ * The writers append ITBs and commit them to the range files after a random
+ * delay, as the TXG_END does, while the timer thread runs the online GC. At
+ * last, every ITB referenced by the range files must be intact.
+ */
+#define OGC_WRITERS             16
+#define OGC_ITBS                0x10  /* ITBs per writer */
+
+struct ogc_writer
+{
+    pthread_t thread;
+    u64 duuid;
+    int id;
+    u64 loc[OGC_ITBS];
+};
+
+void *ogc_writer(void *arg)
+{
+    struct ogc_writer *w = arg;
+    struct itb *itb;
+    struct itb_info ii;
+    u64 old;
+    int len, range_begin, range_end, idx, err;
+
+    itb = xzalloc(sizeof(*itb) + ITB_SIZE * sizeof(struct ite));
+    if (!itb) {
+        hvfs_err(mdsl, "xzalloc ITB failed\n");
+        pthread_exit(0);
+    }
+    /* small ITBs keep the GC rounds short */
+    range_begin = sizeof(itb->h);
+    range_end = sizeof(*itb) + 16 * sizeof(struct ite);
+
+    while (!racer_stop) {
+        len = lib_random(range_end - range_begin) + range_begin;
+        idx = lib_random(OGC_ITBS);
+        atomic_set(&itb->h.len, len);
+        itb->h.itbid = w->id * OGC_ITBS + idx;
+        itb->h.puuid = w->duuid;
+
+        memset(&ii, 0, sizeof(ii));
+        ii.duuid = w->duuid;
+        ii.itbid = itb->h.itbid;
+        err = itb_append(itb, &ii, hmo.site_id, 0);
+        if (err) {
+            hvfs_err(mdsl, "Append itb %ld failed w/ %d\n",
+                     itb->h.itbid, err);
             continue;
         }
-        if (ii.master < fde->mdisk.itb_master) {
-            hvfs_info(mdsl, "Drop obsolete itb %ld appending %ld\n",
-                      itb->h.itbid, ii.location);
-            goto put_fde;
-        }
-        ma.win = MDSL_STORAGE_DEFAULT_RANGE_SIZE;
-    relookup:
-        xlock_lock(&fde->lock);
-        err = __mdisk_lookup_nolock(fde, MDSL_MDISK_RANGE, itb->h.itbid,
-                                    &range);
-        if (err == -ENOENT) {
-            /* create a new range now */
-            u64 i;
-            
-            i = MDSL_STORAGE_idx2range(itb->h.itbid);
-            __mdisk_add_range_nolock(fde, i * MDSL_STORAGE_RANGE_SLOTS,
-                                     (i + 1) * MDSL_STORAGE_RANGE_SLOTS - 1,
-                                     fde->mdisk.range_aid++);
-            __mdisk_range_sort(fde->mdisk.new_range, fde->mdisk.new_size);
-            xlock_unlock(&fde->lock);
-            goto relookup;
-        } else if (err) {
-            hvfs_err(mdsl, "mdisk_lookup_nolock failed w/ %d\n", err);
-            xlock_unlock(&fde->lock);
-            goto put_fde;
+        /* the window between itb_append() and the TXG_END, it should
+         * cross the GC passes */
+        xsleep(lib_random(0x1fffff));
+        err = racer_commit(w->duuid, itb, &ii, &old);
+        if (!err) {
+            w->loc[idx] = ii.location;
+            if (old)
+                mdsl_gc_itb_dead(w->duuid);
         }
-        xlock_unlock(&fde->lock);
+        mdsl_gc_append_end(&ii);
+    }
+    xfree(itb);
 
-        ma.foffset = 0;
-        ma.range_id = range->range_id;
-        ma.range_begin = range->begin;
-        ma.flag = MA_OFFICIAL;
+    pthread_exit(0);
+}
 
-        err = __range_write(duuid, itb->h.itbid, &ma, ii.location);
-        if (err) {
-            hvfs_err(mdsl, "range write failed w/ %d\n", err);
-            goto put_fde;
+/* check that the ITBs referenced by the range files are not punched out
+ */
+int ogc_verify(struct ogc_writer *w)
+{
+    struct fdhash_entry *md, *itbf;
+    struct mmap_args ma = {0, };
+    struct itbh h;
+    struct iovec iov = {
+        .iov_base = &h,
+        .iov_len = sizeof(h),
+    };
+    struct mdsl_storage_access msa = {
+        .iov = &iov,
+        .iov_nr = 1,
+    };
+    range_t *range;
+    u64 itbid, location;
+    int i, j, err = 0, bad = 0, nr = 0;
+
+    md = mdsl_storage_fd_lookup_create(w->duuid, MDSL_STORAGE_MD, 0);
+    if (IS_ERR(md)) {
+        hvfs_err(mdsl, "lookup create MD file failed w/ %ld\n", PTR_ERR(md));
+        return PTR_ERR(md);
+    }
+    itbf = mdsl_storage_fd_lookup_create(w->duuid, MDSL_STORAGE_ITB,
+                                         md->mdisk.itb_master);
+    if (IS_ERR(itbf)) {
+        hvfs_err(mdsl, "lookup create ITB file failed w/ %ld\n",
+                 PTR_ERR(itbf));
+        err = PTR_ERR(itbf);
+        goto out_put;
+    }
+
+    for (i = 0; i < OGC_WRITERS; i++) {
+        for (j = 0; j < OGC_ITBS; j++) {
+            if (!w[i].loc[j])
+                continue;
+            itbid = i * OGC_ITBS + j;
+            err = __mdisk_lookup(md, MDSL_MDISK_RANGE, itbid, &range);
+            if (err) {
+                hvfs_err(mdsl, "ITB %ld has no range w/ %d\n", itbid, err);
+                bad++;
+                continue;
+            }
+            ma.win = MDSL_STORAGE_DEFAULT_RANGE_SIZE;
+            ma.foffset = 0;
+            ma.range_id = range->range_id;
+            ma.range_begin = range->begin;
+            ma.flag = MA_OFFICIAL;
+            err = __range_lookup(w->duuid, itbid, &ma, &location);
+            if (err || !location) {
+                hvfs_err(mdsl, "ITB %ld range lookup failed w/ %d\n",
+                         itbid, err);
+                bad++;
+                continue;
+            }
+            msa.offset = location;
+            err = mdsl_storage_fd_read(itbf, &msa);
+            if (err || h.itbid != itbid || h.puuid != w->duuid ||
+                atomic_read(&h.len) < sizeof(h)) {
+                hvfs_err(mdsl, "ITB %ld @ %ld is corrupted (%ld, len %d)\n",
+                         itbid, location, h.itbid, atomic_read(&h.len));
+                bad++;
+                continue;
+            }
+            nr++;
         }
-        err = __mdisk_write(fde, NULL);
+    }
+    hvfs_info(mdsl, "Verified %d ITBs, %d corrupted, GC moved %ld bytes\n",
+              nr, bad, atomic64_read(&hmo.prof.storage.gc_moved));
+    err = bad ? -EFAULT : 0;
+
+    mdsl_storage_fd_put(itbf);
+out_put:
+    mdsl_storage_fd_put(md);
+
+    return err;
+}
+
+int ogc_test(u64 duuid, int seconds)
+{
+    struct ogc_writer *w;
+    time_t end;
+    int i, err = 0;
+
+    w = xzalloc(OGC_WRITERS * sizeof(*w));
+    if (!w) {
+        hvfs_err(mdsl, "xzalloc() writers failed\n");
+        return -ENOMEM;
+    }
+
+    /* sweep in small slices to interleave the GC and the writers */
+    hmo.conf.option |= HVFS_MDSL_ONLINE_GC;
+    hmo.conf.gc_bytes = 4096 * 1024;
+    hmo.conf.gc_ratio = 10;
+
+    for (i = 0; i < OGC_WRITERS; i++) {
+        w[i].duuid = duuid;
+        w[i].id = i;
+        err = pthread_create(&w[i].thread, NULL, &ogc_writer, &w[i]);
         if (err) {
-            hvfs_err(mdsl, "sync md file failed w/ %d\n", err);
+            hvfs_err(mdsl, "create writer %d failed w/ %d\n", i, err);
+            racer_stop = 1;
+            break;
         }
-    put_fde:
-        mdsl_storage_fd_put(fde);
     }
+    /* the timer signals interrupt sleep() */
+    end = time(NULL) + seconds;
+    while (time(NULL) < end)
+        sleep(1);
+    racer_stop = 1;
+    while (--i >= 0)
+        pthread_join(w[i].thread, NULL);
 
-    pthread_exit(0);
+    if (!err)
+        err = ogc_verify(w);
+    xfree(w);
+
+    return err;
 }
 
 int main(int argc, char *argv[])
 {
     u64 duuid = 1;
     pthread_t racer_thread;
-    int err = 0;
+    int online = 0, err = 0;
     
     hvfs_info(mdsl, "MDSL GC Unit Test ...\n");
 
     /* got the uuid from user */
     if (argc < 2) {
-        hvfs_err(mdsl, "Usage: %s dir_uuid\n", argv[0]);
+        hvfs_err(mdsl, "Usage: %s dir_uuid [online]\n", argv[0]);
         return EINVAL;
     } else {
         duuid = atol(argv[1]);
     }
+    if (argc > 2 && !strcmp(argv[2], "online")) {
+        online = 1;
+        /* run the online GC on each timer tick, and roll the appending
+         * window frequently to expose the appended ITBs to the GC */
+        setenv("hvfs_mdsl_gc_interval", "1", 0);
+        setenv("hvfs_mdsl_itb_file_chunk", "262144", 0);
+    }
     
     mdsl_init();
     hmo.site_id = HVFS_MDSL(0);
     mdsl_verify();
 
     preload_dir(duuid);
+    if (online) {
+        err = ogc_test(duuid, 30);
+        if (err) {
+            hvfs_err(mdsl, "Online GC test on %lx failed w/ %d\n",
+                     duuid, err);
+        }
+        goto out_clean;
+    }
+
     /* start a racer */
     err = pthread_create(&racer_thread, NULL, &racer, (void *)duuid);
     if (err)
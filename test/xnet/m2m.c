@@ -616,10 +616,21 @@ int ring_add(struct chring **r, u64 site)
     return 0;
 }
 
+void *__m2m_buf_alloc(size_t size, int aflag)
+{
+    if (unlikely(aflag == HVFS_MDS2MDS_SPITB) ||
+        unlikely(aflag == XNET_RPY_DATA_ITB)) {
+        /* alloc the whole ITB */
+        return get_free_itb_fast();
+    } else {
+        return xzalloc(size);
+    }
+}
+
 int main(int argc, char *argv[])
 {
     struct xnet_type_ops ops = {
-        .buf_alloc = NULL,
+        .buf_alloc = __m2m_buf_alloc,
         .buf_free = NULL,
         .recv_handler = mds_fe_dispatch,
     };
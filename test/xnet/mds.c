@@ -1139,6 +1139,8 @@ int main(int argc, char *argv[])
     hmo.cb_branch_destroy = mds_cb_branch_destroy;
 
     mds_init(11);
+    if (hmo.conf.xnet_pollin_nr)
+        g_xnet_conf.pollin_nr = hmo.conf.xnet_pollin_nr;
 
     /* set the uuid base! */
     hmi.uuid_base = (u64)self << 45;
@@ -543,6 +543,8 @@ int main(int argc, char *argv[])
         hvfs_err(xnet, "mdsl_init() failed %d\n", err);
         goto out;
     }
+    if (hmo.conf.xnet_pollin_nr)
+        g_xnet_conf.pollin_nr = hmo.conf.xnet_pollin_nr;
 
     /* init misc configrations */
     hmo.prof.xnet = &g_xnet_prof;
@@ -67,6 +67,21 @@ int main(int argc, char *argv[])
         pfs_fuse_mgr.use_dstore = (dstore ? 1 : 0);
         pfs_fuse_mgr.ttl = ttl;
     }
+    /* buffer cache memory bound (MB) and max read-ahead window (KB), zero
+     * means default, negative means unlimited/disabled */
+    value = getenv("bcmax");
+    if (value) {
+        pfs_fuse_mgr.bc_max = atoi(value);
+    }
+    value = getenv("ramax");
+    if (value) {
+        pfs_fuse_mgr.ra_max = atoi(value);
+    }
+    /* write-behind dirty expire (seconds), negative to sync on close */
+    value = getenv("wbexpire");
+    if (value) {
+        pfs_fuse_mgr.wb_expire = atoi(value);
+    }
 
     /* init the dstore */
     if (dstore) {
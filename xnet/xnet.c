@@ -30,6 +30,196 @@ void xnet_reset_tracing_flags(u64 flag)
     hvfs_xnet_tracing_flags = flag;
 }
 
+#ifdef USE_XNET_SIMPLE
+/* The xnet_msg/buffer cache
+ *
+ * Each thread keeps one magazine of free objects for each cache slot, the
+ * full and empty magazines are exchanged with a global depot. Thus, the fast
+ * path never touches a shared lock. Slot 0 caches struct xnet_msg, slot i
+ * caches the payload buffers of (1 << (XNET_BUF_SHIFT_MIN + i - 1)) bytes.
+ *
+ * Note that the objects in a magazine of an exited thread are lost, while
+ * all the xnet threads live as long as the process.
+ */
+#define XNET_MAG_SIZE           (32)
+#define XNET_DEPOT_MAX          (64) /* max # of full magazines in depot */
+#define XNET_BUF_SHIFT_MIN      (6)  /* 64B */
+#define XNET_BUF_SHIFT_MAX      (16) /* 64KB */
+#define XNET_CACHE_NR           (XNET_BUF_SHIFT_MAX - XNET_BUF_SHIFT_MIN + 2)
+
+struct xnet_magazine
+{
+    struct xnet_magazine *next;
+    int nr;
+    void *obj[XNET_MAG_SIZE];
+};
+
+struct xnet_depot
+{
+    xlock_t lock;
+    struct xnet_magazine *full, *empty;
+    int nr_full;
+};
+
+static struct xnet_depot xnet_depot[XNET_CACHE_NR];
+static __thread struct xnet_magazine *xnet_mag[XNET_CACHE_NR];
+
+void xnet_cache_init(void)
+{
+    int i;
+
+    memset(xnet_depot, 0, sizeof(xnet_depot));
+    for (i = 0; i < XNET_CACHE_NR; i++) {
+        xlock_init(&xnet_depot[i].lock);
+    }
+    atomic64_set(&g_xnet_prof.msg_cache_hit, 0);
+    atomic64_set(&g_xnet_prof.msg_cache_miss, 0);
+    atomic64_set(&g_xnet_prof.buf_cache_hit, 0);
+    atomic64_set(&g_xnet_prof.buf_cache_miss, 0);
+}
+
+/* __xnet_cache_get() return one cached object or NULL
+ */
+static inline
+void *__xnet_cache_get(int slot)
+{
+    struct xnet_depot *d = &xnet_depot[slot];
+    struct xnet_magazine *m = xnet_mag[slot];
+
+    if (likely(m && m->nr))
+        return m->obj[--m->nr];
+
+    /* exchange the empty magazine w/ a full one */
+    xlock_lock(&d->lock);
+    if (d->full) {
+        if (m) {
+            m->next = d->empty;
+            d->empty = m;
+        }
+        m = d->full;
+        d->full = m->next;
+        d->nr_full--;
+    }
+    xlock_unlock(&d->lock);
+    xnet_mag[slot] = m;
+
+    if (m && m->nr)
+        return m->obj[--m->nr];
+    return NULL;
+}
+
+/* __xnet_cache_put() return 0 if the object is cached, otherwise the caller
+ * should free it
+ */
+static inline
+int __xnet_cache_put(int slot, void *obj)
+{
+    struct xnet_depot *d = &xnet_depot[slot];
+    struct xnet_magazine *m = xnet_mag[slot];
+
+    if (likely(m && m->nr < XNET_MAG_SIZE)) {
+        m->obj[m->nr++] = obj;
+        return 0;
+    }
+
+    /* push the full magazine to the depot, get an empty one back */
+    xlock_lock(&d->lock);
+    if (m) {
+        if (d->nr_full >= XNET_DEPOT_MAX) {
+            xlock_unlock(&d->lock);
+            return 1;
+        }
+        m->next = d->full;
+        d->full = m;
+        d->nr_full++;
+    }
+    m = d->empty;
+    if (m)
+        d->empty = m->next;
+    xlock_unlock(&d->lock);
+
+    if (!m) {
+        m = xmalloc(sizeof(*m));
+        if (unlikely(!m)) {
+            xnet_mag[slot] = NULL;
+            return 1;
+        }
+    }
+    m->nr = 0;
+    xnet_mag[slot] = m;
+    m->obj[m->nr++] = obj;
+
+    return 0;
+}
+
+static inline
+int __xnet_buf_slot(size_t len)
+{
+    int shift = XNET_BUF_SHIFT_MIN;
+
+    if (len > (1UL << XNET_BUF_SHIFT_MAX))
+        return -1;
+    while ((1UL << shift) < len)
+        shift++;
+
+    return shift - XNET_BUF_SHIFT_MIN + 1;
+}
+
+/* xnet_buf_alloc() alloc a payload buffer from the size-classed cache. The
+ * buffer is NOT zeroed, and it can be released by xfree() safely.
+ */
+void *xnet_buf_alloc(size_t len)
+{
+    void *buf;
+    int slot = __xnet_buf_slot(len);
+
+    if (slot < 0)
+        return xmalloc(len);
+
+    buf = __xnet_cache_get(slot);
+    if (buf) {
+        atomic64_inc(&g_xnet_prof.buf_cache_hit);
+        return buf;
+    }
+    atomic64_inc(&g_xnet_prof.buf_cache_miss);
+
+    return xmalloc(1UL << (slot + XNET_BUF_SHIFT_MIN - 1));
+}
+
+/* xnet_buf_free() recycle a buffer got from xnet_buf_alloc(len)
+ */
+void xnet_buf_free(void *buf, size_t len)
+{
+    int slot = __xnet_buf_slot(len);
+
+    if (slot < 0 || __xnet_cache_put(slot, buf))
+        xfree(buf);
+}
+
+static inline
+struct xnet_msg *__xnet_msg_get(void)
+{
+    struct xnet_msg *msg;
+
+    msg = __xnet_cache_get(0);
+    if (msg) {
+        atomic64_inc(&g_xnet_prof.msg_cache_hit);
+        memset(msg, 0, sizeof(*msg));
+        return msg;
+    }
+    atomic64_inc(&g_xnet_prof.msg_cache_miss);
+
+    return xzalloc(sizeof(struct xnet_msg));
+}
+
+static inline
+void __xnet_msg_put(struct xnet_msg *msg)
+{
+    if (!(msg->alloc_flag & XNET_MSG_CACHE) || __xnet_cache_put(0, msg))
+        xfree(msg);
+}
+#endif
+
 struct xnet_msg *xnet_alloc_msg(u8 alloc_flag)
 {
     struct xnet_msg *msg;
@@ -44,7 +234,12 @@ struct xnet_msg *xnet_alloc_msg(u8 alloc_flag)
         return NULL;
 #endif
 
-    msg = xzalloc(sizeof(struct xnet_msg));
+#ifdef USE_XNET_SIMPLE
+    if (alloc_flag == XNET_MSG_CACHE)
+        msg = __xnet_msg_get();
+    else
+#endif
+        msg = xzalloc(sizeof(struct xnet_msg));
     if (unlikely(!msg)) {
         hvfs_err(xnet, "xzalloc() struct xnet_msg failed\n");
         return NULL;
@@ -53,6 +248,7 @@ struct xnet_msg *xnet_alloc_msg(u8 alloc_flag)
     INIT_LIST_HEAD(&msg->list);
 
 #ifdef USE_XNET_SIMPLE
+    msg->alloc_flag = alloc_flag;
     sem_init(&msg->event, 0, 0);
     atomic64_inc(&g_xnet_prof.msg_alloc);
     atomic_set(&msg->ref, 1);
@@ -64,10 +260,11 @@ struct xnet_msg *xnet_alloc_msg(u8 alloc_flag)
 void xnet_raw_free_msg(struct xnet_msg *msg)
 {
     if (atomic_dec_return(&msg->ref) == 0) {
-        /* FIXME: check whether this msg is in the cache */
-        xfree(msg);
 #ifdef USE_XNET_SIMPLE
+        __xnet_msg_put(msg);
         atomic64_inc(&g_xnet_prof.msg_free);
+#else
+        xfree(msg);
 #endif
     }
 }
@@ -108,9 +305,13 @@ void xnet_free_msg(struct xnet_msg *msg)
         if (msg->riov)
             xfree(msg->riov);
     }
-    xfree(msg);
+    if (msg->sfr)
+        xfree(msg->sfr);
 #ifdef USE_XNET_SIMPLE
+    __xnet_msg_put(msg);
     atomic64_inc(&g_xnet_prof.msg_free);
+#else
+    xfree(msg);
 #endif
 }
 
@@ -125,6 +326,11 @@ int xnet_msg_add_rdata(struct xnet_msg *msg, void *addr, u32 len)
     return 0;
 }
 
+int xnet_msg_add_sfile(struct xnet_msg *msg, int fd, loff_t offset, size_t len)
+{
+    return -ENOSYS;
+}
+
 void xnet_msg_free_sdata(struct xnet_msg *msg)
 {
 }
@@ -138,19 +344,119 @@ int xnet_send(struct xnet_context *xc, struct xnet_msg *msg)
     return -ENOSYS;
 }
 
+/* xnet_isend() falls back to the synchronous xnet_send(), the msg is
+ * completed before return.
+ */
 int xnet_isend(struct xnet_context *xc, struct xnet_msg *msg)
 {
-    return -ENOSYS;
+    struct xnet_wait_group *wg = msg->wg;
+    xnet_msg_cb_t cb = msg->cb;
+    int err;
+
+    err = xnet_send(xc, msg);
+    if (err)
+        return err;
+
+    msg->wg = NULL;
+    msg->cb = NULL;
+    if (wg) {
+        xcond_lock(&wg->cond);
+        if (--wg->nr == 0)
+            xcond_broadcast(&wg->cond);
+        xcond_unlock(&wg->cond);
+    }
+    if (cb)
+        cb(msg, 0, msg->cb_arg);
+
+    return 0;
 }
 
 void *mds_gwg;
+struct xnet_wait_group *xnet_wait_group_create(void)
+{
+    struct xnet_wait_group *wg;
+
+    wg = xzalloc(sizeof(*wg));
+    if (!wg) {
+        hvfs_err(xnet, "xzalloc() xnet_wait_group failed\n");
+        return NULL;
+    }
+    xcond_init(&wg->cond);
+
+    return wg;
+}
+
+void xnet_wait_group_destroy(struct xnet_wait_group *wg)
+{
+    if (!wg)
+        return;
+    xcond_destroy(&wg->cond);
+    xfree(wg);
+}
+
 int xnet_wait_group_add(void *gwg, struct xnet_msg *msg)
 {
-    return -ENOSYS;
+    struct xnet_wait_group *wg = (struct xnet_wait_group *)gwg;
+
+    if (!wg)
+        return -EINVAL;
+    xcond_lock(&wg->cond);
+    wg->nr++;
+    xcond_unlock(&wg->cond);
+    msg->wg = wg;
+
+    return 0;
 }
 
 int xnet_wait_group_del(void *gwg, struct xnet_msg *msg)
 {
-    return -ENOSYS;
+    struct xnet_wait_group *wg = (struct xnet_wait_group *)gwg;
+
+    if (!wg || msg->wg != wg)
+        return -EINVAL;
+    msg->wg = NULL;
+    xcond_lock(&wg->cond);
+    if (--wg->nr == 0)
+        xcond_broadcast(&wg->cond);
+    xcond_unlock(&wg->cond);
+
+    return 0;
+}
+
+/* the msgs are completed synchronously, nothing can be in flight */
+int xnet_wait_group_abandon(void *gwg, struct xnet_msg *msg)
+{
+    return 1;
+}
+
+int xnet_wait_group_wait(void *gwg)
+{
+    struct xnet_wait_group *wg = (struct xnet_wait_group *)gwg;
+    int err;
+
+    if (!wg)
+        return -EINVAL;
+    xcond_lock(&wg->cond);
+    while (wg->nr > 0)
+        xcond_wait(&wg->cond);
+    err = wg->err;
+    wg->err = 0;
+    xcond_unlock(&wg->cond);
+
+    return err;
+}
+
+void *xnet_buf_alloc(size_t len)
+{
+    return xmalloc(len);
+}
+
+void xnet_buf_free(void *buf, size_t len)
+{
+    xfree(buf);
+}
+
+void xnet_cache_init(void)
+{
 }
 #endif
@@ -44,10 +44,14 @@ u64 __attribute__((unused)) g_sc = 0;
 #define RESEND_TIMEOUT          (0x10)
 #define SEND_TIMEOUT            (120)
 #define SIOV_NR                 (50)
+#define POLLIN_NR               (4)
+#define POLLIN_MAX              (32)
+#define POLLIN_BATCH            (64)
 struct xnet_conf g_xnet_conf = {
     .resend_timeout = RESEND_TIMEOUT,
     .send_timeout = SEND_TIMEOUT,
     .siov_nr = SIOV_NR,
+    .pollin_nr = POLLIN_NR,
     .magic = 0,
     .enable_resend = 0,
     .pause = 0,
@@ -108,13 +112,16 @@ struct active_conn
 };
 
 struct site_table gst;
-pthread_t pollin_thread;        /* poll-in any requests */
+pthread_t pollin_thread[POLLIN_MAX]; /* poll-in any requests */
 pthread_t resend_thread;        /* resend the pending requests */
 LIST_HEAD(accept_list);         /* recored the accepted sockets */
+xlock_t accept_list_lock;
 LIST_HEAD(active_list);         /* recored the actived sockets */
 xlock_t active_list_lock;
+xlock_t isend_lock;             /* async completion vs. abandonment */
 int lsock = 0;                  /* local listening socket */
-int epfd = 0;
+int epfd[POLLIN_MAX];           /* one epoll set for each poll-in thread */
+int pollin_nr = 0;              /* # of active poll-in threads */
 int pollin_thread_stop = 0;
 int resend_thread_stop = 0;
 atomic_t global_reqno;
@@ -126,6 +133,7 @@ int accept_lookup(int fd)
     struct accept_conn *pos, *n;
     int ret = 0;
 
+    xlock_lock(&accept_list_lock);
     list_for_each_entry_safe(pos, n, &accept_list, list) {
         if (pos->sockfd == fd) {
             ret = 1;
@@ -134,10 +142,22 @@ int accept_lookup(int fd)
             break;
         }
     }
+    xlock_unlock(&accept_list_lock);
 
     return ret;
 }
 
+/* get_epfd() returns the epoll set of the poll-in thread owning this
+ * socket. All the events of one connection are handled by the same thread,
+ * thus the stream is parsed in order while different peers are received in
+ * parallel.
+ */
+static inline
+int get_epfd(int fd)
+{
+    return epfd[fd % pollin_nr];
+}
+
 void setnodelay(int fd)
 {
     int err = 0, val = 1;
@@ -219,6 +239,7 @@ int st_clean_sockfd(struct site_table *st, int fd);
 int st_update_sockfd_lock(struct site_table *st, int fd, u64 dsid, 
                           struct xnet_addr **oxa);
 void st_update_sockfd_unlock(struct xnet_addr *xa);
+static void __xnet_isend_complete(struct xnet_msg *msg, int err);
 
 /*
  * Return value: 0 => 
@@ -255,7 +276,7 @@ int __xnet_handle_tx(int fd)
     struct xnet_msg *msg, *req;
     struct xnet_context *xc;
     u32 br;
-    int bt;
+    int bt, async;
     int next = 1;               /* this means we should retry the read */
     int flag = MSG_DONTWAIT;
 
@@ -264,7 +285,7 @@ int __xnet_handle_tx(int fd)
     lib_timer_B();
 #endif
     
-    msg = xnet_alloc_msg(XNET_MSG_NORMAL);
+    msg = xnet_alloc_msg(XNET_MSG_CACHE);
     if (unlikely(!msg)) {
         hvfs_err(xnet, "xnet_alloc_msg() failed\n");
         /* FIXME: we should put this fd in the retry queue, we can retry the
@@ -349,7 +370,7 @@ int __xnet_handle_tx(int fd)
                     /* shutdown the connection now */
                     struct epoll_event ev;
                     
-                    err = epoll_ctl(epfd, EPOLL_CTL_DEL, fd, &ev);
+                    err = epoll_ctl(get_epfd(fd), EPOLL_CTL_DEL, fd, &ev);
                     if (err) {
                         hvfs_err(xnet, "epoll_ctl del fd %d failed w/ %s\n",
                                  fd, strerror(errno));
@@ -397,7 +418,8 @@ int __xnet_handle_tx(int fd)
         if (xc->ops.buf_alloc)
             buf = xc->ops.buf_alloc(msg->tx.len, msg->tx.cmd);
         else {
-            buf = xzalloc(msg->tx.len);
+            buf = xnet_buf_alloc(msg->tx.len);
+            msg->alloc_flag |= XNET_MSG_RBUF_CACHE;
         }
         /* we should default to free all the resource from xnet. */
         xnet_set_auto_free(msg);
@@ -558,7 +580,13 @@ processing:
         } else {
             ASSERT(0, xnet);
         }
+        /* a sync waiter may free the req once we post the event, while an
+         * async req lives until it is completed, thus check it first */
+        async = ((req->cb || req->wg) && msg->tx.cmd != XNET_RPY_COMMIT);
         sem_post(&req->event);
+        /* complete the async request on the first reply */
+        if (async)
+            __xnet_isend_complete(req, 0);
     } else if (msg->tx.type == XNET_MSG_CMD) {
         /* just receive the data */
     } else if (msg->tx.type == XNET_MSG_NOP) {
@@ -630,15 +658,21 @@ out:
     pthread_exit(NULL);
 }
 
+/* pollin_thread_main() waits on its own epoll set. The listening socket is
+ * only polled by thread 0, the accepted sockets are hashed to the owner
+ * thread by get_epfd().
+ */
 void *pollin_thread_main(void *arg)
 {
-    struct epoll_event ev, events[10];
+    struct epoll_event ev, events[POLLIN_BATCH];
     struct sockaddr_in addr = {0,};
     socklen_t addrlen = sizeof(struct sockaddr_in);
     struct accept_conn *ac;
     sigset_t set;
+    int id = (int)(long)arg;
+    int efd = epfd[id];
     int asock, i;
-    int err, nfds;
+    int err = 0, nfds;
     
     /* first, let us block the SIGALRM */
     sigemptyset(&set);
@@ -647,18 +681,21 @@ void *pollin_thread_main(void *arg)
     pthread_sigmask(SIG_BLOCK, &set, NULL);
 
     memset(&ev, 0, sizeof(ev));
-    ev.events = EPOLLIN;
-    ev.data.fd = lsock;
-    err = epoll_ctl(epfd, EPOLL_CTL_ADD, lsock, &ev);
-    if (err < 0) {
-        hvfs_err(xnet, "epoll_ctl() add fd %d failed %d\n", lsock, errno);
-        err = -errno;
-        goto out;
+    if (!id) {
+        ev.events = EPOLLIN;
+        ev.data.fd = lsock;
+        err = epoll_ctl(efd, EPOLL_CTL_ADD, lsock, &ev);
+        if (err < 0) {
+            hvfs_err(xnet, "epoll_ctl() add fd %d failed %d\n", lsock, errno);
+            err = -errno;
+            goto out;
+        }
     }
     
-    hvfs_debug(xnet, "POLL-IN thread running, waiting for any request in...\n");
+    hvfs_debug(xnet, "POLL-IN thread %d running, waiting for any request "
+               "in...\n", id);
     for (; !pollin_thread_stop;) {
-        nfds = epoll_wait(epfd, events, 10, 50);
+        nfds = epoll_wait(efd, events, POLLIN_BATCH, 50);
         if (nfds == -1) {
             hvfs_debug(xnet, "epoll_wait() failed %d\n", errno);
             continue;
@@ -678,13 +715,15 @@ void *pollin_thread_main(void *arg)
                 }
                 INIT_LIST_HEAD(&ac->list);
                 ac->sockfd = asock;
+                xlock_lock(&accept_list_lock);
                 list_add_tail(&ac->list, &accept_list);
+                xlock_unlock(&accept_list_lock);
                 
                 setnonblocking(asock);
                 setnodelay(asock);
                 ev.events = EPOLLIN | EPOLLET;
                 ev.data.fd = asock;
-                err = epoll_ctl(epfd, EPOLL_CTL_ADD, asock, &ev);
+                err = epoll_ctl(get_epfd(asock), EPOLL_CTL_ADD, asock, &ev);
                 if (err < 0) {
                     hvfs_err(xnet, "epoll_ctl() add fd %d failed %d\n",
                              asock, errno);
@@ -704,7 +743,7 @@ void *pollin_thread_main(void *arg)
                 if (events[i].events & EPOLLERR) {
                     hvfs_err(xnet, "Hoo, the connection %d is broken.\n",
                              events[i].data.fd);
-                    epoll_ctl(epfd, EPOLL_CTL_DEL, events[i].data.fd, &ev);
+                    epoll_ctl(efd, EPOLL_CTL_DEL, events[i].data.fd, &ev);
                     st_clean_sockfd(&gst, events[i].data.fd);
                     continue;
                 }
@@ -714,7 +753,7 @@ void *pollin_thread_main(void *arg)
                         /* this means the connection is shutdown */
                         hvfs_err(xnet, "connection %d is shutdown.\n",
                                  events[i].data.fd);
-                        epoll_ctl(epfd, EPOLL_CTL_DEL, events[i].data.fd, &ev);
+                        epoll_ctl(efd, EPOLL_CTL_DEL, events[i].data.fd, &ev);
                         st_clean_sockfd(&gst, events[i].data.fd);
                         break;
                     }
@@ -736,6 +775,9 @@ int st_init(void)
     atomic64_set(&g_xnet_prof.inbytes, 0);
     atomic64_set(&g_xnet_prof.outbytes, 0);
     xlock_init(&active_list_lock);
+    xlock_init(&accept_list_lock);
+    xlock_init(&isend_lock);
+    xnet_cache_init();
 
     return 0;
 }
@@ -1111,11 +1153,11 @@ struct xnet_context *xnet_register_lw(u8 type, u16 port, u64 site_id,
                port);
 
     /* do not need to create epfd here */
-    ASSERT(epfd != 0, xnet);
+    ASSERT(pollin_nr != 0, xnet);
     memset(&ev, 0, sizeof(ev));
     ev.events = EPOLLIN;
     ev.data.fd = lsock;
-    err = epoll_ctl(epfd, EPOLL_CTL_ADD, lsock, &ev);
+    err = epoll_ctl(epfd[0], EPOLL_CTL_ADD, lsock, &ev);
     if (err < 0) {
         hvfs_err(xnet, "epoll_ctl() add fd %d failed %d\n",
                  lsock, errno);
@@ -1138,7 +1180,7 @@ struct xnet_context *xnet_register_type(u8 type, u16 port, u64 site_id,
     struct sockaddr addr;
     struct sockaddr_in *ia = (struct sockaddr_in *)&addr;
     int val = 1;
-    int err;
+    int err, nr, i;
 
     /* init the global_reqno */
     atomic_set(&global_reqno, -1);
@@ -1209,45 +1251,82 @@ struct xnet_context *xnet_register_type(u8 type, u16 port, u64 site_id,
     hvfs_debug(xnet, "Listener start @ %s %d\n", inet_ntoa(ia->sin_addr),
                port);
     
-    /* create the epfd */
-    err = epoll_create(100);
-    if (err < 0) {
-        hvfs_err(xnet, "epoll_create1() failed %d\n", errno);
-        err = -errno;
-        goto out_close;
-    }
-    epfd = err;
-
-    /* we should create one thread to accept connections */
-    err = pthread_create(&pollin_thread, NULL, pollin_thread_main, NULL);
-    if (err) {
-        hvfs_err(xnet, "pthread_create() failed %d\n", err);
-        goto out_close;
+    /* create the epfds, all the sets should exist before any poll-in thread
+     * starts hashing the accepted sockets */
+    nr = g_xnet_conf.pollin_nr;
+    if (nr <= 0)
+        nr = 1;
+    else if (nr > POLLIN_MAX)
+        nr = POLLIN_MAX;
+    for (i = 0; i < nr; i++) {
+        err = epoll_create(100);
+        if (err < 0) {
+            hvfs_err(xnet, "epoll_create1() failed %d\n", errno);
+            err = -errno;
+            goto out_close_ep;
+        }
+        epfd[i] = err;
+    }
+    pollin_nr = nr;
+
+    /* we should create the threads to accept connections and poll-in the
+     * requests */
+    for (i = 0; i < nr; i++) {
+        err = pthread_create(&pollin_thread[i], NULL, pollin_thread_main,
+                             (void *)(long)i);
+        if (err) {
+            hvfs_err(xnet, "pthread_create() failed %d\n", err);
+            err = -err;
+            goto out_join;
+        }
     }
 
     /* we should create one thread to resend the requests */
     err = pthread_create(&resend_thread, NULL, resend_thread_main, xc);
     if (err) {
         hvfs_err(xnet, "pthread_create() failed %d\n", err);
-        goto out_close;
+        err = -err;
+        goto out_join;
     }
     
-    hvfs_debug(xnet, "Poll-in thread created.\n");
+    hvfs_debug(xnet, "%d Poll-in thread(s) created.\n", nr);
 
     return xc;
+out_join:
+    /* stop the poll-in threads created so far, then close all the epfds */
+    pollin_thread_stop = 1;
+    while (--i >= 0) {
+        pthread_kill(pollin_thread[i], SIGUSR1);
+        pthread_join(pollin_thread[i], NULL);
+    }
+    pollin_thread_stop = 0;
+    i = nr;
+out_close_ep:
+    while (--i >= 0) {
+        close(epfd[i]);
+        epfd[i] = 0;
+    }
+    pollin_nr = 0;
 out_close:
     close(lsock);
+    lsock = 0;
 out_free:
+    list_del(&xc->list);
+    sem_destroy(&xc->wait);
     xfree(xc);
     return ERR_PTR(err);
 }
 
 int xnet_unregister_type(struct xnet_context *xc)
 {
+    int i;
+
     /* waiting for the disconnections */
     pollin_thread_stop = 1;
-    pthread_kill(pollin_thread, SIGUSR1);
-    pthread_join(pollin_thread, NULL);
+    for (i = 0; i < pollin_nr; i++) {
+        pthread_kill(pollin_thread[i], SIGUSR1);
+        pthread_join(pollin_thread[i], NULL);
+    }
     resend_thread_stop = 1;
     pthread_kill(resend_thread, SIGUSR1);
     /* FIXME: if we do join, there is glibc memory corruption */
@@ -1259,8 +1338,10 @@ int xnet_unregister_type(struct xnet_context *xc)
         xfree(xc);
     if (lsock)
         close(lsock);
-    if (epfd)
-        close(epfd);
+    for (i = 0; i < pollin_nr; i++) {
+        if (epfd[i])
+            close(epfd[i]);
+    }
     return 0;
 }
 
@@ -1377,6 +1458,65 @@ void __iov_cut(struct iovec *in, struct iovec **out, int inlen, size_t *outlen,
     *ooffset += slen;
 }
 
+/* __xnet_send_frange() send the file ranges of the msg w/o copying them to
+ * user space
+ *
+ * Note that, the header and the iovs have already been written to the
+ * socket, thus a failure in the middle leaves a truncated frame on the
+ * stream. We shut the socket down then, the receiving thread detects it and
+ * cleans the link up.
+ */
+static
+int __xnet_send_frange(int ssock, struct xnet_msg *msg)
+{
+    struct xnet_frange *fr;
+    struct pollfd pfd;
+    loff_t offset;
+    size_t left;
+    ssize_t bt;
+    int i, err = 0;
+
+    for (i = 0; i < msg->sfr_ulen; i++) {
+        fr = &msg->sfr[i];
+        offset = fr->offset;
+        left = fr->len;
+        while (left > 0) {
+            bt = sendfile(ssock, fr->fd, &offset, min(left, __MAX_MSG_SIZE));
+            if (bt < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN) {
+                    /* wait for the socket buffer to drain */
+                    pfd.fd = ssock;
+                    pfd.events = POLLOUT;
+                    if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+                        err = -errno;
+                        goto out_shutdown;
+                    }
+                    continue;
+                }
+                hvfs_err(xnet, "sendfile(%d[%lx], fd %d) @ %ld err %d\n",
+                         ssock, msg->tx.dsite_id, fr->fd, offset, errno);
+                err = -errno;
+                goto out_shutdown;
+            } else if (bt == 0) {
+                hvfs_err(xnet, "sendfile(%d[%lx], fd %d) reach EOF @ %ld\n",
+                         ssock, msg->tx.dsite_id, fr->fd, offset);
+                err = -EINVAL;
+                goto out_shutdown;
+            }
+            left -= bt;
+            atomic64_add(bt, &g_xnet_prof.outbytes);
+            atomic64_add(bt, &g_xnet_prof.sfbytes);
+        }
+    }
+
+    return 0;
+out_shutdown:
+    shutdown(ssock, SHUT_RDWR);
+    return err;
+}
+
 /* xnet_resend()
  *
  * This is a shadow function of xnet_send() which do not wait for any replies
@@ -1392,6 +1532,8 @@ int xnet_resend(struct xnet_context *xc, struct xnet_msg *msg)
     int nr_conn = 0;
     int lock_idx = 0;
     int __attribute__((unused))bw, bt, msg_found = 0;
+    u32 ilen;
+    int i;
 
     xlock_lock(&xc->resend_lock);
     list_for_each_entry_safe(pos, n, &xc->resend_q, list) {
@@ -1554,12 +1696,12 @@ retry:
                 setnodelay(csock);
                 ev.events = EPOLLIN | EPOLLET;
                 ev.data.fd = csock;
-                err = epoll_ctl(epfd, EPOLL_CTL_ADD, csock, &ev);
+                err = epoll_ctl(get_epfd(csock), EPOLL_CTL_ADD, csock, &ev);
                 if (err < 0) {
                     xlock_unlock(&xa->clock);
                     hvfs_err(xnet, "epoll_ctl() add fd %d to SET(%d) "
                              "failed %d\n", 
-                             csock, epfd, errno);
+                             csock, get_epfd(csock), errno);
                     close(csock);
                     csock = 0;
                     sleep(1);
@@ -1613,6 +1755,12 @@ retry:
     msg->tx.ssite_id = xc->site_id;
     if (msg->tx.type != XNET_MSG_RPY)
         msg->tx.handle = (u64)msg;
+
+    /* the file ranges are sent after all the siov data */
+    ilen = msg->tx.len;
+    for (i = 0; i < msg->sfr_ulen; i++)
+        ilen -= msg->sfr[i].len;
+
     ASSERT((u64)msg == msg->tx.handle, xnet);
 
 reselect_conn:
@@ -1658,7 +1806,7 @@ reselect_conn:
             bw = 0;
             do {
                 bt = sendmsg(ssock, &__msg, MSG_NOSIGNAL);
-                if (bt < 0 || msg->tx.len > bt) {
+                if (bt < 0 || ilen > bt) {
                     if (bt >= 0) {
                         /* ok, we should adjust the iov */
                         __iov_recal(msg->siov, &__msg.msg_iov, msg->siov_ulen,
@@ -1685,12 +1833,12 @@ reselect_conn:
                     goto out_unlock;
                 }
                 bw += bt;
-            } while (bw < msg->tx.len);
+            } while (bw < ilen);
             atomic64_add(bt, &g_xnet_prof.outbytes);
         }
 #elif 1
         bt = writev(ssock, msg->siov, msg->siov_ulen);
-        if (bt < 0 || msg->tx.len > bt) {
+        if (bt < 0 || ilen > bt) {
             hvfs_err(xnet, "writev(%d[%lx]) err %d, for now we do not "
                      "support redo:(\n", ssock, msg->tx.dsite_id,
                      errno);
@@ -1720,6 +1868,13 @@ reselect_conn:
 #endif
     }
 
+    /* finally, send the file ranges */
+    if (msg->sfr_ulen) {
+        err = __xnet_send_frange(ssock, msg);
+        if (err)
+            goto out_unlock;
+    }
+
     xlock_unlock(&xa->socklock[lock_idx]);
 
     hvfs_debug(xnet, "We have sent the msg %p throuth link %d\n", msg, ssock);
@@ -1731,9 +1886,13 @@ out_unlock:
     return err;
 }
 
-/* xnet_send()
+/* __xnet_send_msg()
+ *
+ * Write the whole msg to one of the connections of the target site. We do
+ * NOT wait for the reply here.
  */
-int xnet_send(struct xnet_context *xc, struct xnet_msg *msg)
+static
+int __xnet_send_msg(struct xnet_context *xc, struct xnet_msg *msg)
 {
     struct epoll_event ev;
     struct xnet_site *xs;
@@ -1742,8 +1901,8 @@ int xnet_send(struct xnet_context *xc, struct xnet_msg *msg)
     int ssock = 0;              /* selected socket */
     int nr_conn = 0;
     int lock_idx = 0;
-    u32 bw;
-    int bt;
+    u32 bw, ilen;
+    int bt, i;
 
     if (unlikely(msg->tx.ssite_id == msg->tx.dsite_id)) {
         hvfs_err(xnet, "Warning: target site is the original site, BYPASS?\n");
@@ -1876,12 +2035,12 @@ retry:
                 setnodelay(csock);
                 ev.events = EPOLLIN | EPOLLET;
                 ev.data.fd = csock;
-                err = epoll_ctl(epfd, EPOLL_CTL_ADD, csock, &ev);
+                err = epoll_ctl(get_epfd(csock), EPOLL_CTL_ADD, csock, &ev);
                 if (err < 0) {
                     xlock_unlock(&xa->clock);
                     hvfs_err(xnet, "epoll_ctl() add fd %d to SET(%d) "
                              "failed %d\n", 
-                             csock, epfd, errno);
+                             csock, get_epfd(csock), errno);
                     close(csock);
                     csock = 0;
                     sleep(1);
@@ -1939,6 +2098,11 @@ retry:
     if (msg->tx.type != XNET_MSG_RPY)
         msg->tx.handle = (u64)msg;
 
+    /* the file ranges are sent after all the siov data */
+    ilen = msg->tx.len;
+    for (i = 0; i < msg->sfr_ulen; i++)
+        ilen -= msg->sfr[i].len;
+
 reselect_conn:
     ssock = SELECT_CONNECTION(xa, &lock_idx);
     /* already connected, just send the message */
@@ -1979,7 +2143,7 @@ reselect_conn:
                 .msg_iovlen = msg->siov_ulen,
             };
 
-            if (msg->tx.len <= __MAX_MSG_SIZE) {
+            if (ilen <= __MAX_MSG_SIZE) {
                 bw = 0;
                 do {
                     bt = sendmsg(ssock, &__msg, MSG_NOSIGNAL);
@@ -2020,7 +2184,7 @@ reselect_conn:
                         goto out_unlock;
                     }
                     bw += bt;
-                } while (bw < msg->tx.len);
+                } while (bw < ilen);
                 atomic64_add(bw, &g_xnet_prof.outbytes);
                 if (msg->siov != __msg.msg_iov)
                     xfree(__msg.msg_iov);
@@ -2088,12 +2252,12 @@ reselect_conn:
                         atomic64_add(bw, &g_xnet_prof.outbytes);
                     }
                     xfree(__msg.msg_iov);
-                } while (send_offset < msg->tx.len);
+                } while (send_offset < ilen);
             }
         }
 #elif 1
         bt = writev(ssock, msg->siov, msg->siov_ulen);
-        if (bt < 0 || msg->tx.len > bt) {
+        if (bt < 0 || ilen > bt) {
             hvfs_err(xnet, "writev(%d[%lx]) err %d, for now we do not "
                      "support redo:(\n", ssock, msg->tx.dsite_id,
                      errno);
@@ -2123,10 +2287,34 @@ reselect_conn:
 #endif
     }
 
+    /* finally, send the file ranges */
+    if (msg->sfr_ulen) {
+        err = __xnet_send_frange(ssock, msg);
+        if (err)
+            goto out_unlock;
+    }
+
     xlock_unlock(&xa->socklock[lock_idx]);
 
     hvfs_debug(xnet, "We have sent the msg %p throuth link %d\n", msg, ssock);
 
+out:
+    return err;
+out_unlock:
+    xlock_unlock(&xa->socklock[lock_idx]);
+    return err;
+}
+
+/* xnet_send()
+ */
+int xnet_send(struct xnet_context *xc, struct xnet_msg *msg)
+{
+    int err;
+
+    err = __xnet_send_msg(xc, msg);
+    if (err)
+        goto out;
+
     /* finally, we wait for the reply msg */
     if (msg->tx.flag & XNET_NEED_REPLY) {
         struct timespec ts;
@@ -2153,9 +2341,6 @@ reselect_conn:
     
 out:
     return err;
-out_unlock:
-    xlock_unlock(&xa->socklock[lock_idx]);
-    return err;
 }
 
 void xnet_wait_any(struct xnet_context *xc)
@@ -2195,6 +2380,36 @@ out:
     return err;
 }
 
+/* xnet_msg_add_sfile() add a file range to the msg, the range is sent after
+ * all the siov data by sendfile()
+ */
+int xnet_msg_add_sfile(struct xnet_msg *msg, int fd, loff_t offset, size_t len)
+{
+    struct xnet_frange *sfr;
+    int err = 0;
+
+    if (msg->sfr_ulen >= msg->sfr_alen) {
+        sfr = xrealloc(msg->sfr, sizeof(struct xnet_frange) *
+                       (msg->sfr_alen + g_xnet_conf.siov_nr));
+        if (!sfr) {
+            hvfs_err(xnet, "xrealloc() xnet_frange failed\n");
+            err = -ENOMEM;
+            goto out;
+        }
+        msg->sfr = sfr;
+        msg->sfr_alen += g_xnet_conf.siov_nr;
+    }
+
+    msg->sfr[msg->sfr_ulen].fd = fd;
+    msg->sfr[msg->sfr_ulen].offset = offset;
+    msg->sfr[msg->sfr_ulen].len = len;
+    msg->sfr_ulen++;
+    msg->tx.len += len;
+
+out:
+    return err;
+}
+
 void xnet_msg_free_sdata(struct xnet_msg *msg)
 {
     int i;
@@ -2253,24 +2468,216 @@ void xnet_msg_free_rdata(struct xnet_msg *msg)
     }
     for (i = 0; i < msg->riov_ulen; i++) {
         ASSERT(msg->riov[i].iov_base, xnet);
-        xfree(msg->riov[i].iov_base);
+        if (!i && (msg->alloc_flag & XNET_MSG_RBUF_CACHE))
+            xnet_buf_free(msg->riov[i].iov_base, msg->riov[i].iov_len);
+        else
+            xfree(msg->riov[i].iov_base);
     }
     xfree(msg->riov);
 }
 
+/* __xnet_isend_complete()
+ *
+ * Finish an async msg: wake up the wait group and/or call the completion
+ * callback. Both of them are one-shot. The wait group is touched under
+ * isend_lock, thus it can not be destroyed by an abandoning owner meanwhile.
+ */
+static
+void __xnet_isend_complete(struct xnet_msg *msg, int err)
+{
+    struct xnet_wait_group *wg;
+    xnet_msg_cb_t cb;
+    void *cb_arg;
+
+    xlock_lock(&isend_lock);
+    wg = msg->wg;
+    cb = msg->cb;
+    cb_arg = msg->cb_arg;
+    msg->wg = NULL;
+    msg->cb = NULL;
+    if (wg) {
+        xcond_lock(&wg->cond);
+        if (err && !wg->err)
+            wg->err = err;
+        if (--wg->nr == 0)
+            xcond_broadcast(&wg->cond);
+        xcond_unlock(&wg->cond);
+    }
+    xlock_unlock(&isend_lock);
+
+    if (cb)
+        cb(msg, err, cb_arg);
+}
+
+static
+void __xnet_isend_orphan(struct xnet_msg *msg, int err, void *arg)
+{
+    /* drop the reference the abandoning owner left to us */
+    xnet_free_msg(msg);
+}
+
+/* xnet_isend()
+ *
+ * Send the msg w/o waiting for the reply. The data buffers of the msg can be
+ * reused after return, while the msg itself should be kept alive until it is
+ * completed. If XNET_NEED_REPLY is set, the msg is completed by the receiving
+ * thread on the reply (matched by tx.handle), otherwise it is completed just
+ * after sending. Note that the completion callback runs in the receiving
+ * thread, it should never block.
+ *
+ * On error, the msg is not completed and the caller should remove it from the
+ * wait group by itself.
+ */
 int xnet_isend(struct xnet_context *xc, struct xnet_msg *msg)
 {
-    return xnet_send(xc, msg);
+    int err;
+
+    /* the reply may be handled before we return, hold a reference */
+    atomic_inc(&msg->ref);
+    err = __xnet_send_msg(xc, msg);
+    if (!err) {
+        atomic64_inc(&g_xnet_prof.isend);
+        if (!(msg->tx.flag & XNET_NEED_REPLY))
+            __xnet_isend_complete(msg, 0);
+    }
+    xnet_free_msg(msg);
+
+    return err;
+}
+
+struct xnet_wait_group *xnet_wait_group_create(void)
+{
+    struct xnet_wait_group *wg;
+
+    wg = xzalloc(sizeof(*wg));
+    if (!wg) {
+        hvfs_err(xnet, "xzalloc() xnet_wait_group failed\n");
+        return NULL;
+    }
+    xcond_init(&wg->cond);
+
+    return wg;
+}
+
+void xnet_wait_group_destroy(struct xnet_wait_group *wg)
+{
+    if (!wg)
+        return;
+    xcond_destroy(&wg->cond);
+    xfree(wg);
 }
 
+/* xnet_wait_group_add()
+ *
+ * Add the msg to the wait group, you should call it BEFORE xnet_isend().
+ */
 int xnet_wait_group_add(void *gwg, struct xnet_msg *msg)
 {
-    return -ENOSYS;
+    struct xnet_wait_group *wg = (struct xnet_wait_group *)gwg;
+
+    if (!wg)
+        return -EINVAL;
+    xcond_lock(&wg->cond);
+    wg->nr++;
+    xcond_unlock(&wg->cond);
+    msg->wg = wg;
+
+    return 0;
 }
 
+/* xnet_wait_group_del()
+ *
+ * Remove a msg which is not sent (or canceled) from the wait group.
+ */
 int xnet_wait_group_del(void *gwg, struct xnet_msg *msg)
 {
-    return -ENOSYS;
+    struct xnet_wait_group *wg = (struct xnet_wait_group *)gwg;
+    int err = 0;
+
+    if (!wg)
+        return -EINVAL;
+    xlock_lock(&isend_lock);
+    if (msg->wg == wg) {
+        msg->wg = NULL;
+        xcond_lock(&wg->cond);
+        if (--wg->nr == 0)
+            xcond_broadcast(&wg->cond);
+        xcond_unlock(&wg->cond);
+    } else
+        err = -EINVAL;
+    xlock_unlock(&isend_lock);
+
+    return err;
+}
+
+/* xnet_wait_group_abandon()
+ *
+ * Detach a msg which is still in flight after a wait timeout from the wait
+ * group. The owner's reference is passed to the msg itself, it is freed on
+ * the late reply. Return 0 if the msg is abandoned, the caller should NOT
+ * touch it anymore; return 1 if it has been completed meanwhile, the caller
+ * still owns it.
+ */
+int xnet_wait_group_abandon(void *gwg, struct xnet_msg *msg)
+{
+    struct xnet_wait_group *wg = (struct xnet_wait_group *)gwg;
+    int err = 1;
+
+    if (!wg)
+        return -EINVAL;
+    xlock_lock(&isend_lock);
+    if (msg->wg == wg) {
+        msg->wg = NULL;
+        msg->cb = __xnet_isend_orphan;
+        msg->cb_arg = NULL;
+        xcond_lock(&wg->cond);
+        if (--wg->nr == 0)
+            xcond_broadcast(&wg->cond);
+        xcond_unlock(&wg->cond);
+        err = 0;
+    }
+    xlock_unlock(&isend_lock);
+
+    return err;
+}
+
+/* xnet_wait_group_wait()
+ *
+ * Wait for all the msgs in the wait group to complete. Return the first
+ * error reported by the msgs, or -ETIMEDOUT if some msgs are still in flight
+ * after g_xnet_conf.send_timeout seconds. On timeout, the in-flight msgs
+ * still refer to the wait group, do NOT free them or the wait group before
+ * xnet_wait_group_abandon() them.
+ */
+int xnet_wait_group_wait(void *gwg)
+{
+    struct xnet_wait_group *wg = (struct xnet_wait_group *)gwg;
+    struct timespec ts;
+    int err = 0;
+
+    if (!wg)
+        return -EINVAL;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += g_xnet_conf.send_timeout;
+
+    xcond_lock(&wg->cond);
+    while (wg->nr > 0) {
+        err = xcond_timedwait(&wg->cond, &ts);
+        if (err == ETIMEDOUT) {
+            hvfs_err(xnet, "Wait group %p time out for %d seconds, "
+                     "%d msgs in flight.\n", wg, 
+                     g_xnet_conf.send_timeout, wg->nr);
+            err = -ETIMEDOUT;
+            break;
+        }
+        err = 0;
+    }
+    if (!err)
+        err = wg->err;
+    wg->err = 0;
+    xcond_unlock(&wg->cond);
+
+    return err;
 }
 
 /* Note that the following region is used to convert the standard R2 site